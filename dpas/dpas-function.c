@@ -27,6 +27,31 @@ static jit_function_t *function_stack = 0;
 static int function_stack_size = 0;
 static jit_function_t *main_list = 0;
 static int main_list_size = 0;
+static int optimization_level = -1;
+static int unroll_factor = -1;
+
+/*
+ * Context options that can be set with the "{$option name value}"
+ * compiler directive.
+ */
+static struct
+{
+	const char *name;
+	int option;
+} const context_options[] = {
+	{"dont_fold",		JIT_OPTION_DONT_FOLD},
+	{"value_numbering",	JIT_OPTION_VALUE_NUMBERING},
+	{"inline_limit",	JIT_OPTION_INLINE_LIMIT},
+	{"code_alignment",	JIT_OPTION_CODE_ALIGNMENT},
+	{"block_profile",	JIT_OPTION_BLOCK_PROFILE},
+	{"schedule_pressure",	JIT_OPTION_SCHEDULE_PRESSURE},
+	{"reclaim_code",	JIT_OPTION_RECLAIM_CODE},
+	{"code_budget",		JIT_OPTION_CODE_BUDGET},
+	{"write_xor_execute",	JIT_OPTION_WRITE_XOR_EXECUTE},
+	{"cache_huge_pages",	JIT_OPTION_CACHE_HUGE_PAGES},
+};
+#define	num_context_options	\
+	(sizeof(context_options) / sizeof(context_options[0]))
 
 jit_context_t dpas_current_context(void)
 {
@@ -75,6 +100,14 @@ jit_function_t dpas_new_function(jit_type_t signature)
 		dpas_out_of_memory();
 	}
 	function_stack[function_stack_size++] = func;
+	if(optimization_level >= 0)
+	{
+		jit_function_set_optimization_level(func, optimization_level);
+	}
+	if(unroll_factor >= 0)
+	{
+		jit_function_set_unroll_factor(func, unroll_factor);
+	}
 	return func;
 }
 
@@ -86,6 +119,45 @@ void dpas_pop_function(void)
 	}
 }
 
+void dpas_directive(const char *text)
+{
+	char name[64];
+	char option[64];
+	long value;
+	unsigned int index;
+
+	if(sscanf(text, "%63s %ld", name, &value) == 2)
+	{
+		/* Settings for the functions that are declared after this */
+		if(!jit_stricmp(name, "optimize"))
+		{
+			optimization_level = (int)value;
+			return;
+		}
+		else if(!jit_stricmp(name, "unroll"))
+		{
+			unroll_factor = (int)value;
+			return;
+		}
+	}
+	else if(sscanf(text, "%63s %63s %ld", name, option, &value) == 3
+		&& !jit_stricmp(name, "option"))
+	{
+		/* Options for the whole context */
+		for(index = 0; index < num_context_options; ++index)
+		{
+			if(!jit_stricmp(option, context_options[index].name))
+			{
+				jit_context_set_meta_numeric
+					(dpas_current_context(),
+					 context_options[index].option, (jit_nuint)value);
+				return;
+			}
+		}
+	}
+	dpas_error("unknown compiler directive `{$%s}'", text);
+}
+
 int dpas_function_is_nested(void)
 {
 	return (function_stack_size > 1);
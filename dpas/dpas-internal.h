@@ -116,6 +116,11 @@ jit_function_t dpas_new_function(jit_type_t signature);
  */
 void dpas_pop_function(void);
 
+/*
+ * Process a compiler directive, which is a comment starting with "$".
+ */
+void dpas_directive(const char *text);
+
 /*
  * Determine if the current function is nested.
  */
@@ -34,6 +34,10 @@ void jit_context_destroy(jit_context_t context) JIT_NOTHROW;
 void jit_context_build_start(jit_context_t context) JIT_NOTHROW;
 void jit_context_build_end(jit_context_t context) JIT_NOTHROW;
 
+unsigned int jit_context_enter_code(jit_context_t context) JIT_NOTHROW;
+void jit_context_leave_code
+	(jit_context_t context, unsigned int epoch) JIT_NOTHROW;
+
 void jit_context_set_on_demand_driver(
 	jit_context_t context,
 	jit_on_demand_driver_func driver) JIT_NOTHROW;
@@ -41,6 +45,11 @@ void jit_context_set_on_demand_driver(
 void jit_context_set_memory_manager(
 	jit_context_t context,
 	jit_memory_manager_t manager) JIT_NOTHROW;
+int jit_context_get_memory_stats
+	(jit_context_t context, jit_memory_stats_t *stats) JIT_NOTHROW;
+void jit_code_iter_init
+	(jit_code_iter_t *iter, jit_context_t context) JIT_NOTHROW;
+jit_function_t jit_code_iter_next(jit_code_iter_t *iter) JIT_NOTHROW;
 
 int jit_context_set_meta
 	(jit_context_t context, int type, void *data,
@@ -61,6 +70,16 @@ void jit_context_free_meta(jit_context_t context, int type) JIT_NOTHROW;
 #define	JIT_OPTION_DONT_FOLD		10003
 #define JIT_OPTION_POSITION_INDEPENDENT	10004
 #define JIT_OPTION_CACHE_MAX_PAGE_FACTOR	10005
+#define JIT_OPTION_COMPILE_THREADS	10006
+#define JIT_OPTION_VALUE_NUMBERING	10007
+#define JIT_OPTION_INLINE_LIMIT		10008
+#define JIT_OPTION_CODE_ALIGNMENT	10009
+#define JIT_OPTION_BLOCK_PROFILE	10010
+#define JIT_OPTION_SCHEDULE_PRESSURE	10011
+#define JIT_OPTION_RECLAIM_CODE		10012
+#define JIT_OPTION_CODE_BUDGET		10013
+#define JIT_OPTION_WRITE_XOR_EXECUTE	10014
+#define JIT_OPTION_CACHE_HUGE_PAGES	10015
 
 #ifdef	__cplusplus
 };
@@ -30,6 +30,10 @@ extern	"C" {
 /* Optimization levels */
 #define JIT_OPTLEVEL_NONE	0
 #define JIT_OPTLEVEL_NORMAL	1
+#define JIT_OPTLEVEL_HIGH	2
+
+/* Largest loop unroll factor */
+#define JIT_MAX_UNROLL_FACTOR	8
 
 jit_function_t jit_function_create
 	(jit_context_t context, jit_type_t signature) JIT_NOTHROW;
@@ -52,12 +56,15 @@ jit_block_t jit_function_get_entry(jit_function_t func) JIT_NOTHROW;
 jit_block_t jit_function_get_current(jit_function_t func) JIT_NOTHROW;
 jit_function_t jit_function_get_nested_parent(jit_function_t func) JIT_NOTHROW;
 int jit_function_compile(jit_function_t func) JIT_NOTHROW;
+int jit_optimize(jit_function_t func) JIT_NOTHROW;
 int jit_function_is_compiled(jit_function_t func) JIT_NOTHROW;
+jit_nuint jit_function_get_code_size(jit_function_t func) JIT_NOTHROW;
 void jit_function_set_recompilable(jit_function_t func) JIT_NOTHROW;
 void jit_function_clear_recompilable(jit_function_t func) JIT_NOTHROW;
 int jit_function_is_recompilable(jit_function_t func) JIT_NOTHROW;
 int jit_function_compile_entry(jit_function_t func, void **entry_point) JIT_NOTHROW;
 void jit_function_setup_entry(jit_function_t func, void *entry_point) JIT_NOTHROW;
+int jit_function_queue_compile(jit_function_t func) JIT_NOTHROW;
 void *jit_function_to_closure(jit_function_t func) JIT_NOTHROW;
 jit_function_t jit_function_from_closure
 	(jit_context_t context, void *closure) JIT_NOTHROW;
@@ -78,6 +85,10 @@ void jit_function_set_optimization_level
 unsigned int jit_function_get_optimization_level
 	(jit_function_t func) JIT_NOTHROW;
 unsigned int jit_function_get_max_optimization_level(void) JIT_NOTHROW;
+void jit_function_set_unroll_factor
+	(jit_function_t func, unsigned int factor) JIT_NOTHROW;
+unsigned int jit_function_get_unroll_factor
+	(jit_function_t func) JIT_NOTHROW;
 jit_label_t jit_function_reserve_label(jit_function_t func) JIT_NOTHROW;
 int jit_function_labels_equal(jit_function_t func, jit_label_t label, jit_label_t label2);
 
@@ -44,6 +44,41 @@ typedef void *jit_function_info_t;
 
 typedef struct jit_memory_manager const* jit_memory_manager_t;
 
+/*
+ * Statistics of the memory that holds the compiled code.
+ */
+typedef struct jit_memory_stats
+{
+	jit_nuint	page_size;	/* Size of a page of factor 1 */
+	jit_nuint	num_pages;	/* Number of pages allocated */
+	jit_nuint	pages_used;	/* Sum of the page factors */
+	jit_nuint	region_pages;	/* Pages reserved in one region, or 0 */
+	int		huge_pages;	/* Non-zero if the region has huge pages */
+	jit_nuint	num_functions;	/* Number of function code blocks */
+	jit_nuint	code_bytes;	/* Bytes of function code */
+	jit_nuint	data_bytes;	/* Bytes of function data */
+	jit_nuint	trampoline_bytes; /* Bytes of trampolines */
+	jit_nuint	closure_bytes;	/* Bytes of closures */
+	jit_nuint	free_bytes;	/* Bytes free within the pages */
+	jit_nuint	num_free_blocks; /* Number of free blocks */
+	jit_nuint	largest_free;	/* Bytes of the largest free block */
+
+} jit_memory_stats_t;
+
+/*
+ * Structure for iterating over the compiled code of a context.
+ * The "start" and "end" fields hold the code of the function last
+ * returned by "jit_code_iter_next".  The other fields should be
+ * treated as opaque.
+ */
+typedef struct
+{
+	jit_context_t	context;
+	void		*start;
+	void		*end;
+
+} jit_code_iter_t;
+
 struct jit_memory_manager
 {
 	jit_memory_context_t (*create)(jit_context_t context);
@@ -72,6 +107,16 @@ struct jit_memory_manager
 	void (*free_closure)(jit_memory_context_t memctx, void *ptr);
 
 	void * (*alloc_data)(jit_memory_context_t memctx, jit_size_t size, jit_size_t align);
+
+	/* The members below may be NULL if not supported */
+	void (*free_code)(jit_memory_context_t memctx, jit_function_info_t info);
+
+	jit_nint (*get_exec_offset)(jit_memory_context_t memctx);
+
+	void (*get_stats)(jit_memory_context_t memctx, jit_memory_stats_t *stats);
+	jit_function_info_t (*find_next_function_info)(jit_memory_context_t memctx, void *pc);
+
+	void (*set_size_hint)(jit_memory_context_t memctx, jit_size_t size);
 };
 
 jit_memory_manager_t jit_default_memory_manager(void) JIT_NOTHROW;
@@ -0,0 +1,732 @@
+/*
+ * jit-alias.c - Alias analysis and redundant load elimination.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#include "jit-cfg.h"
+#ifdef _JIT_COMPILE_DEBUG
+#include <jit/jit-dump.h>
+#include <stdio.h>
+#endif
+
+/*
+ * The relative loads and stores are described by an address that is
+ * a root value plus a constant offset, found by following the chains
+ * of "add_relative" instructions.  The root is either a pointer value
+ * or, for the addresses of local variables, the variable itself.
+ *
+ * Two accesses do not alias if they have the same root and their
+ * bytes do not overlap, or if their roots are distinct local
+ * variables.  Nothing is assumed about the accesses through distinct
+ * pointers because the same memory may be accessed with any type.
+ *
+ * The function is walked along its dominator tree, keeping the memory
+ * contents that are known from the earlier loads and stores.  A load
+ * of a known location becomes a copy of the value that was loaded or
+ * stored there.  The stores kill the known contents that they may
+ * alias and the calls and other instructions with side effects kill
+ * all of them.  A node starts with what is known at the end of its
+ * immediate dominator, less what is killed on the paths that lead to
+ * the node from there.
+ */
+
+/*
+ * Special values for the defining node of a value.
+ */
+#define NO_DEF		-1
+#define MULTIPLE_DEFS	-2
+
+/*
+ * Limits on the number of known contents and on the paths that are
+ * scanned when entering a node.
+ */
+#define MAX_FACTS	256
+#define MAX_PATH_NODES	32
+
+/*
+ * The kinds of the memory accesses.
+ */
+#define ACCESS_BYTE	0
+#define ACCESS_SHORT	1
+#define ACCESS_INT	2
+#define ACCESS_LONG	3
+#define ACCESS_FLOAT32	4
+#define ACCESS_FLOAT64	5
+#define ACCESS_NFLOAT	6
+
+struct address
+{
+	jit_value_t		root;
+	int			is_local;
+	jit_nint		offset;
+};
+
+/*
+ * The known contents of a memory location.  The opcode is the load
+ * that the value came from, or zero for a stored value.
+ */
+struct fact
+{
+	struct address		addr;
+	int			kind;
+	int			opcode;
+	jit_value_t		value;
+	int			alive;
+};
+
+struct alias_state
+{
+	_jit_cfg_t		cfg;
+	int			*def_node;
+	jit_insn_t		*def_insn;
+	int			*visited;
+	int			visit_mark;
+	_jit_node_t		*worklist;
+	struct fact		facts[MAX_FACTS];
+	int			num_facts;
+	int			killed[MAX_FACTS];
+	int			num_killed;
+};
+
+static void
+set_def(struct alias_state *state, jit_value_t value, int node, jit_insn_t insn)
+{
+	if(state->def_node[value->index] == NO_DEF)
+	{
+		state->def_node[value->index] = node;
+		state->def_insn[value->index] = insn;
+	}
+	else
+	{
+		state->def_node[value->index] = MULTIPLE_DEFS;
+		state->def_insn[value->index] = 0;
+	}
+}
+
+/*
+ * Check if the instruction defines its first operand rather than the
+ * destination operand.
+ */
+static int
+defines_value1(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_INCOMING_REG:
+	case JIT_OP_INCOMING_FRAME_POSN:
+	case JIT_OP_RETURN_REG:
+	case JIT_OP_OUTGOING_FRAME_POSN:
+		return 1;
+	}
+	return 0;
+}
+
+static void
+find_defs(struct alias_state *state)
+{
+	_jit_cfg_t cfg;
+	_jit_phi_t phi;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+	int index;
+
+	cfg = state->cfg;
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		state->def_node[index] = NO_DEF;
+	}
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		for(phi = cfg->nodes[index].phis; phi; phi = phi->next)
+		{
+			set_def(state, phi->dest, index, 0);
+		}
+		jit_insn_iter_init(&iter, cfg->nodes[index].block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			value = _jit_cfg_get_dest(insn);
+			if(value && (insn->flags & JIT_INSN_DEST_IS_VALUE) == 0)
+			{
+				set_def(state, value, index, insn);
+			}
+			value = _jit_cfg_get_value1(insn);
+			if(value && defines_value1(insn))
+			{
+				set_def(state, value, index, 0);
+			}
+		}
+	}
+}
+
+/*
+ * Check if the value keeps the same contents wherever it is available.
+ * These are the constants, the variables in SSA form, the temporary
+ * values that are assigned only once, and the parameters that are
+ * never assigned.
+ */
+static int
+is_stable(struct alias_state *state, jit_value_t value)
+{
+	if(value->is_constant)
+	{
+		return 1;
+	}
+	if(value->index < 0 || value->is_addressable || value->is_volatile
+	   || state->def_node[value->index] == MULTIPLE_DEFS)
+	{
+		return 0;
+	}
+	return (value->is_temporary || value->is_parameter
+		|| state->cfg->values[value->index].var != 0);
+}
+
+/*
+ * Get the address that a pointer value refers to.  Returns zero if
+ * the pointer may change.
+ */
+static int
+get_address(struct alias_state *state, jit_value_t value, jit_nint offset,
+	    struct address *addr)
+{
+	jit_insn_t insn;
+
+	if(value->is_constant || !is_stable(state, value))
+	{
+		return 0;
+	}
+	for(;;)
+	{
+		insn = state->def_insn[value->index];
+		if(!insn)
+		{
+			break;
+		}
+		if(insn->opcode == JIT_OP_ADDRESS_OF)
+		{
+			addr->root = insn->value1;
+			addr->is_local = 1;
+			addr->offset = offset;
+			return 1;
+		}
+		if(insn->opcode != JIT_OP_ADD_RELATIVE
+		   || !insn->value2->is_constant
+		   || insn->value1->is_constant
+		   || !is_stable(state, insn->value1))
+		{
+			break;
+		}
+		offset += jit_value_get_nint_constant(insn->value2);
+		value = insn->value1;
+	}
+	addr->root = value;
+	addr->is_local = 0;
+	addr->offset = offset;
+	return 1;
+}
+
+/*
+ * Get the kind of a relative load or store.  Returns -1 if it is not
+ * one that is tracked.
+ */
+static int
+get_access_kind(int opcode)
+{
+	switch(opcode)
+	{
+	case JIT_OP_LOAD_RELATIVE_SBYTE:
+	case JIT_OP_LOAD_RELATIVE_UBYTE:
+	case JIT_OP_STORE_RELATIVE_BYTE:
+		return ACCESS_BYTE;
+	case JIT_OP_LOAD_RELATIVE_SHORT:
+	case JIT_OP_LOAD_RELATIVE_USHORT:
+	case JIT_OP_STORE_RELATIVE_SHORT:
+		return ACCESS_SHORT;
+	case JIT_OP_LOAD_RELATIVE_INT:
+	case JIT_OP_STORE_RELATIVE_INT:
+		return ACCESS_INT;
+	case JIT_OP_LOAD_RELATIVE_LONG:
+	case JIT_OP_STORE_RELATIVE_LONG:
+		return ACCESS_LONG;
+	case JIT_OP_LOAD_RELATIVE_FLOAT32:
+	case JIT_OP_STORE_RELATIVE_FLOAT32:
+		return ACCESS_FLOAT32;
+	case JIT_OP_LOAD_RELATIVE_FLOAT64:
+	case JIT_OP_STORE_RELATIVE_FLOAT64:
+		return ACCESS_FLOAT64;
+	case JIT_OP_LOAD_RELATIVE_NFLOAT:
+	case JIT_OP_STORE_RELATIVE_NFLOAT:
+		return ACCESS_NFLOAT;
+	}
+	return -1;
+}
+
+static jit_nint
+get_access_size(int kind)
+{
+	switch(kind)
+	{
+	case ACCESS_BYTE:	return 1;
+	case ACCESS_SHORT:	return 2;
+	case ACCESS_INT:	return 4;
+	case ACCESS_FLOAT32:	return 4;
+	case ACCESS_NFLOAT:	return sizeof(jit_nfloat);
+	}
+	return 8;
+}
+
+/*
+ * Get the instruction that takes the place of a load of a known value.
+ * The small integers that were stored are truncated as the load would
+ * have done.
+ */
+static int
+get_copy_opcode(int load_opcode, int kind, int from_load)
+{
+	if(!from_load)
+	{
+		switch(load_opcode)
+		{
+		case JIT_OP_LOAD_RELATIVE_SBYTE:	return JIT_OP_TRUNC_SBYTE;
+		case JIT_OP_LOAD_RELATIVE_UBYTE:	return JIT_OP_TRUNC_UBYTE;
+		case JIT_OP_LOAD_RELATIVE_SHORT:	return JIT_OP_TRUNC_SHORT;
+		case JIT_OP_LOAD_RELATIVE_USHORT:	return JIT_OP_TRUNC_USHORT;
+		}
+	}
+	switch(kind)
+	{
+	case ACCESS_LONG:	return JIT_OP_COPY_LONG;
+	case ACCESS_FLOAT32:	return JIT_OP_COPY_FLOAT32;
+	case ACCESS_FLOAT64:	return JIT_OP_COPY_FLOAT64;
+	case ACCESS_NFLOAT:	return JIT_OP_COPY_NFLOAT;
+	}
+	return JIT_OP_COPY_INT;
+}
+
+/*
+ * Check if the accesses may refer to overlapping memory.
+ */
+static int
+may_alias(struct address *addr1, int kind1, struct address *addr2, int kind2)
+{
+	if(addr1->root == addr2->root && addr1->is_local == addr2->is_local)
+	{
+		return (addr1->offset < addr2->offset + get_access_size(kind2)
+			&& addr2->offset < addr1->offset + get_access_size(kind1));
+	}
+	return !(addr1->is_local && addr2->is_local);
+}
+
+/*
+ * Forget a known content until the walk leaves the current node.  A
+ * fact is recorded at most once because it stays dead until then.
+ */
+static void
+kill_fact(struct alias_state *state, int index)
+{
+	state->killed[(state->num_killed)++] = index;
+	state->facts[index].alive = 0;
+}
+
+/*
+ * Forget the contents that a store to the address may change, or all
+ * of them if the address is NULL.
+ */
+static void
+kill_facts(struct alias_state *state, struct address *addr, int kind)
+{
+	int index;
+
+	for(index = 0; index < state->num_facts; index++)
+	{
+		if(state->facts[index].alive
+		   && (!addr || may_alias(addr, kind, &state->facts[index].addr,
+					  state->facts[index].kind)))
+		{
+			kill_fact(state, index);
+		}
+	}
+}
+
+static void
+add_fact(struct alias_state *state, struct address *addr, int kind,
+	 int opcode, jit_value_t value)
+{
+	struct fact *fact;
+
+	if(state->num_facts < MAX_FACTS)
+	{
+		fact = &state->facts[(state->num_facts)++];
+		fact->addr = *addr;
+		fact->kind = kind;
+		fact->opcode = opcode;
+		fact->value = value;
+		fact->alive = 1;
+	}
+}
+
+static struct fact *
+find_fact(struct alias_state *state, struct address *addr, int kind, int opcode)
+{
+	struct fact *fact;
+	int index;
+
+	for(index = state->num_facts - 1; index >= 0; index--)
+	{
+		fact = &state->facts[index];
+		if(fact->alive && fact->kind == kind
+		   && fact->addr.root == addr->root
+		   && fact->addr.is_local == addr->is_local
+		   && fact->addr.offset == addr->offset
+		   && (fact->opcode == 0 || fact->opcode == opcode))
+		{
+			return fact;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Check if the instruction assigns a value that lives in memory.
+ */
+static int
+writes_addressable(jit_insn_t insn)
+{
+	jit_value_t dest;
+
+	dest = _jit_cfg_get_dest(insn);
+	return (dest && dest->is_addressable
+		&& (insn->flags & JIT_INSN_DEST_IS_VALUE) == 0);
+}
+
+/*
+ * Forget the contents that the instruction may change.
+ */
+static void
+kill_by_insn(struct alias_state *state, jit_insn_t insn)
+{
+	struct address addr;
+	int opcode;
+	int kind;
+
+	opcode = insn->opcode;
+	if(opcode <= JIT_OP_CHECK_NULL
+	   || (opcode >= JIT_OP_COPY_LOAD_SBYTE && opcode <= JIT_OP_INCOMING_FRAME_POSN)
+	   || (opcode >= JIT_OP_LOAD_RELATIVE_SBYTE && opcode <= JIT_OP_LOAD_RELATIVE_STRUCT)
+	   || (opcode >= JIT_OP_LOAD_ELEMENT_SBYTE && opcode <= JIT_OP_LOAD_ELEMENT_NFLOAT)
+	   || opcode == JIT_OP_ADD_RELATIVE
+	   || opcode == JIT_OP_ADDRESS_OF_LABEL
+	   || opcode == JIT_OP_MARK_OFFSET
+	   || opcode == JIT_OP_JUMP_TABLE)
+	{
+		if(writes_addressable(insn))
+		{
+			kill_facts(state, 0, 0);
+		}
+		return;
+	}
+
+	kind = get_access_kind(opcode);
+	if(kind >= 0 && (insn->flags & JIT_INSN_DEST_IS_VALUE) != 0
+	   && insn->value2->is_constant
+	   && get_address(state, insn->dest,
+			  jit_value_get_nint_constant(insn->value2), &addr))
+	{
+		kill_facts(state, &addr, kind);
+		return;
+	}
+
+	/* The calls, the block copies and the other side effects */
+	kill_facts(state, 0, 0);
+}
+
+/*
+ * Forget the contents that are changed on the paths that lead from
+ * the node's immediate dominator to the node.  The nodes on the paths
+ * are found by walking the graph backwards from the node until the
+ * dominator is reached.
+ */
+static void
+kill_on_paths(struct alias_state *state, _jit_node_t node)
+{
+	_jit_cfg_t cfg;
+	_jit_node_t pred;
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int num_work, num_nodes;
+	int index;
+
+	cfg = state->cfg;
+	block = node->block;
+	if(!node->idom || state->num_facts == 0)
+	{
+		return;
+	}
+	if(block->num_preds == 1 && block->preds[0]->src == node->idom->block)
+	{
+		return;
+	}
+
+	++(state->visit_mark);
+	num_work = 0;
+	num_nodes = 0;
+	for(index = 0; index < block->num_preds; index++)
+	{
+		pred = _jit_cfg_get_node(cfg, block->preds[index]->src);
+		if(pred != node->idom && pred->dfn >= 0
+		   && state->visited[pred->block->index] != state->visit_mark)
+		{
+			state->visited[pred->block->index] = state->visit_mark;
+			state->worklist[num_work++] = pred;
+		}
+	}
+	while(num_work > 0)
+	{
+		pred = state->worklist[--num_work];
+		if(++num_nodes > MAX_PATH_NODES)
+		{
+			kill_facts(state, 0, 0);
+			return;
+		}
+		jit_insn_iter_init(&iter, pred->block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			kill_by_insn(state, insn);
+		}
+		block = pred->block;
+		for(index = 0; index < block->num_preds; index++)
+		{
+			pred = _jit_cfg_get_node(cfg, block->preds[index]->src);
+			if(pred != node->idom && pred->dfn >= 0
+			   && state->visited[pred->block->index] != state->visit_mark)
+			{
+				state->visited[pred->block->index] = state->visit_mark;
+				state->worklist[num_work++] = pred;
+			}
+		}
+	}
+}
+
+/*
+ * Replace the load with a copy of the known value.
+ */
+static void
+replace_load(struct alias_state *state, _jit_node_t node, jit_insn_t insn,
+	     int kind, struct fact *fact)
+{
+	jit_value_t value;
+
+#ifdef _JIT_COMPILE_DEBUG
+	printf("redundant load elimination: replace instruction '");
+	jit_dump_insn(stdout, state->cfg->func, insn);
+	printf("'\n");
+#endif
+
+	value = fact->value;
+	insn->opcode = (short) get_copy_opcode(insn->opcode, kind, fact->opcode != 0);
+	insn->flags = 0;
+	insn->value1 = value;
+	insn->value2 = 0;
+	++(value->usage_count);
+
+	/* The value is no longer local to the block that computes it */
+	if(value->is_temporary
+	   && state->def_node[value->index] != node->block->index)
+	{
+		_jit_value_make_local(state->cfg->func, value);
+	}
+}
+
+static void
+eliminate_in_node(struct alias_state *state, _jit_node_t node)
+{
+	struct address addr;
+	struct fact *fact;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int kind;
+
+	kill_on_paths(state, node);
+
+	jit_insn_iter_init(&iter, node->block);
+	while((insn = jit_insn_iter_next(&iter)) != 0)
+	{
+		kind = get_access_kind(insn->opcode);
+		if(kind < 0 || !insn->value2->is_constant)
+		{
+			kill_by_insn(state, insn);
+			continue;
+		}
+
+		if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+		{
+			/* The store makes the stored value known */
+			kill_by_insn(state, insn);
+			if(get_address(state, insn->dest,
+				       jit_value_get_nint_constant(insn->value2), &addr)
+			   && is_stable(state, insn->value1))
+			{
+				add_fact(state, &addr, kind, 0, insn->value1);
+			}
+			continue;
+		}
+
+		if(writes_addressable(insn))
+		{
+			kill_facts(state, 0, 0);
+			continue;
+		}
+		if(!get_address(state, insn->value1,
+				jit_value_get_nint_constant(insn->value2), &addr))
+		{
+			continue;
+		}
+		fact = find_fact(state, &addr, kind, insn->opcode);
+		if(fact)
+		{
+			replace_load(state, node, insn, kind, fact);
+		}
+		else if(is_stable(state, insn->dest))
+		{
+			add_fact(state, &addr, kind, insn->opcode, insn->dest);
+		}
+	}
+}
+
+/*
+ * Walk the dominator tree, keeping the known contents of memory for
+ * each node and restoring them when leaving it.
+ */
+static int
+eliminate_loads(struct alias_state *state)
+{
+	struct stack_entry
+	{
+		_jit_node_t node;
+		int num_facts;
+		int num_killed;
+	} *stack;
+	_jit_cfg_t cfg;
+	int *first_child;
+	int *next_sibling;
+	int sp, index, child;
+	_jit_node_t node;
+
+	cfg = state->cfg;
+	stack = jit_malloc(cfg->num_nodes * sizeof(struct stack_entry));
+	first_child = jit_malloc(cfg->num_nodes * sizeof(int));
+	next_sibling = jit_malloc(cfg->num_nodes * sizeof(int));
+	if(!stack || !first_child || !next_sibling)
+	{
+		jit_free(stack);
+		jit_free(first_child);
+		jit_free(next_sibling);
+		return 0;
+	}
+
+	/* Build the dominator tree */
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		first_child[index] = -1;
+	}
+	for(index = 0; index < cfg->num_post_order; index++)
+	{
+		node = cfg->post_order[index];
+		if(node->idom)
+		{
+			next_sibling[node->block->index] = first_child[node->idom->block->index];
+			first_child[node->idom->block->index] = node->block->index;
+		}
+	}
+
+	/* A node is on the stack with a negative fact count until it is
+	   processed.  Then it stays there until all its children are done */
+	stack[0].node = &cfg->nodes[0];
+	stack[0].num_facts = -1;
+	sp = 1;
+	while(sp > 0)
+	{
+		node = stack[sp - 1].node;
+		if(stack[sp - 1].num_facts >= 0)
+		{
+			while(state->num_killed > stack[sp - 1].num_killed)
+			{
+				--(state->num_killed);
+				state->facts[state->killed[state->num_killed]].alive = 1;
+			}
+			state->num_facts = stack[sp - 1].num_facts;
+			--sp;
+			continue;
+		}
+
+		stack[sp - 1].num_facts = state->num_facts;
+		stack[sp - 1].num_killed = state->num_killed;
+		eliminate_in_node(state, node);
+		for(child = first_child[node->block->index]; child >= 0; child = next_sibling[child])
+		{
+			stack[sp].node = &cfg->nodes[child];
+			stack[sp].num_facts = -1;
+			++sp;
+		}
+	}
+
+	jit_free(stack);
+	jit_free(first_child);
+	jit_free(next_sibling);
+	return 1;
+}
+
+int
+_jit_ssa_eliminate_loads(_jit_cfg_t cfg)
+{
+	struct alias_state *state;
+	int result;
+
+	if(!cfg->in_ssa || cfg->num_values == 0)
+	{
+		return 1;
+	}
+
+	state = jit_cnew(struct alias_state);
+	if(!state)
+	{
+		return 0;
+	}
+	state->cfg = cfg;
+	state->def_node = jit_malloc(cfg->num_values * sizeof(int));
+	state->def_insn = jit_calloc(cfg->num_values, sizeof(jit_insn_t));
+	state->visited = jit_calloc(cfg->num_nodes, sizeof(int));
+	state->worklist = jit_malloc(cfg->num_nodes * sizeof(_jit_node_t));
+	result = (state->def_node && state->def_insn && state->visited && state->worklist);
+	if(result)
+	{
+		find_defs(state);
+		result = eliminate_loads(state);
+	}
+
+	jit_free(state->def_node);
+	jit_free(state->def_insn);
+	jit_free(state->visited);
+	jit_free(state->worklist);
+	jit_free(state);
+	return result;
+}
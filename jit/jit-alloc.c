@@ -20,7 +20,13 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+/* memfd_create is a GNU extension */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "jit-config.h"
+#include <jit/jit-defs.h>
 
 #ifdef HAVE_STDLIB_H
 	#include <stdlib.h>
@@ -115,6 +121,231 @@ _jit_free_exec(void *ptr, unsigned int size)
 	}
 }
 
+/*@
+ * @deftypefun {void *} _jit_malloc_exec_view (jit_nuint @var{size}, void **@var{exec}, int *@var{fd})
+ * Reserve a block of address space that is mapped twice: once
+ * read/write, which is returned, and once read/executable, which is
+ * returned in @var{exec}.  Code written through the first mapping runs
+ * from the second one, so no page is ever writable and executable at
+ * the same time.  The size should be a multiple of
+ * @code{jit_vmem_page_size()}.  Both mappings are backed by the file
+ * returned in @var{fd}, which is empty at first and is grown with
+ * @code{_jit_grow_exec_view}.  Only the address space is reserved,
+ * so the block may be much larger than the code it will hold.
+ *
+ * Returns NULL if the system cannot map memory twice.
+ * @end deftypefun
+@*/
+void *
+_jit_malloc_exec_view(jit_nuint size, void **exec, int *fd)
+{
+#if defined(JIT_USE_MMAP) && defined(HAVE_MEMFD_CREATE)
+	void *ptr;
+
+	*fd = memfd_create("libjit", MFD_CLOEXEC);
+	if(*fd < 0)
+	{
+		return (void *)0;
+	}
+	ptr = mmap(0, size, PROT_NONE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(ptr == (void *)-1)
+	{
+		close(*fd);
+		return (void *)0;
+	}
+	*exec = mmap(0, size, PROT_NONE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(*exec == (void *)-1)
+	{
+		munmap(ptr, size);
+		close(*fd);
+		return (void *)0;
+	}
+	return ptr;
+#else
+	return (void *)0;
+#endif
+}
+
+/*@
+ * @deftypefun int _jit_grow_exec_view (void *@var{ptr}, void *@var{exec}, int @var{fd}, jit_nuint @var{from}, jit_nuint @var{to})
+ * Grow the part of a block allocated by @code{_jit_malloc_exec_view}
+ * that is backed by memory from @var{from} to @var{to} bytes.  The new
+ * pages are mapped at the same offset in both mappings, and are not
+ * backed by memory until they are written to.
+ *
+ * Returns zero if the system cannot grow the block.
+ * @end deftypefun
+@*/
+int
+_jit_grow_exec_view(void *ptr, void *exec, int fd, jit_nuint from, jit_nuint to)
+{
+#if defined(JIT_USE_MMAP) && defined(HAVE_MEMFD_CREATE)
+	if(ftruncate(fd, (off_t) to) != 0)
+	{
+		return 0;
+	}
+	if(mmap((unsigned char *) ptr + from, to - from, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, fd, (off_t) from) == (void *)-1)
+	{
+		return 0;
+	}
+	if(mmap((unsigned char *) exec + from, to - from, PROT_READ | PROT_EXEC,
+		MAP_SHARED | MAP_FIXED, fd, (off_t) from) == (void *)-1)
+	{
+		/* Put the reservation back, the file is truncated later */
+		mmap((unsigned char *) ptr + from, to - from, PROT_NONE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+		return 0;
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/*@
+ * @deftypefun void _jit_free_exec_view (void *@var{ptr}, void *@var{exec}, int @var{fd}, jit_nuint @var{size})
+ * Free a block of memory that was previously allocated by
+ * @code{_jit_malloc_exec_view}, together with its file.
+ * @end deftypefun
+@*/
+void
+_jit_free_exec_view(void *ptr, void *exec, int fd, jit_nuint size)
+{
+#if defined(JIT_USE_MMAP) && defined(HAVE_MEMFD_CREATE)
+	if(ptr)
+	{
+		munmap(exec, size);
+		munmap(ptr, size);
+		close(fd);
+	}
+#endif
+}
+
+/*@
+ * @deftypefun {void *} _jit_malloc_exec_huge (jit_nuint @var{size}, jit_nuint @var{align}, int @var{reserve})
+ * Reserve a block of address space to be backed by huge pages of
+ * @var{align} bytes, to reduce the number of instruction TLB misses.
+ * The block is aligned on @var{align} bytes, and the size should be a
+ * multiple of it.  No page of the block may be accessed until it is
+ * made read/write/executable with @code{_jit_commit_exec}.  If
+ * @var{reserve} is non-zero, the huge pages that are reserved by the
+ * system administrator are used if there are enough of them for the
+ * whole block, and they are taken right away.  Otherwise the system is
+ * asked to back the block with transparent huge pages, which are not
+ * taken until they are written to.
+ *
+ * Returns NULL if the system cannot allocate such a block.  The block
+ * is freed with @code{_jit_free_exec_huge}.
+ * @end deftypefun
+@*/
+void *
+_jit_malloc_exec_huge(jit_nuint size, jit_nuint align, int reserve)
+{
+#if defined(JIT_USE_MMAP) && defined(HAVE_MADVISE) && defined(HAVE_MPROTECT) \
+	&& defined(MADV_HUGEPAGE)
+	unsigned char *ptr;
+	unsigned char *start;
+
+#ifdef MAP_HUGETLB
+	if(reserve)
+	{
+		ptr = (unsigned char *) mmap(0, size, PROT_NONE,
+					     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+					     -1, 0);
+		if(ptr != (unsigned char *)-1)
+		{
+			return ptr;
+		}
+	}
+#endif
+
+	/* Map more than needed and trim the block to the alignment */
+	ptr = (unsigned char *) mmap(0, size + align, PROT_NONE,
+				     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(ptr == (unsigned char *)-1)
+	{
+		return (void *)0;
+	}
+	start = (unsigned char *) ((((jit_nuint) ptr) + align - 1) & ~(align - 1));
+	if(start > ptr)
+	{
+		munmap(ptr, start - ptr);
+	}
+	munmap(start + size, ptr + align - start);
+	if(madvise(start, size, MADV_HUGEPAGE) != 0)
+	{
+		munmap(start, size);
+		return (void *)0;
+	}
+	return start;
+#else
+	return (void *)0;
+#endif
+}
+
+/*@
+ * @deftypefun int _jit_commit_exec (void *@var{ptr}, jit_nuint @var{size})
+ * Make pages of a block allocated by @code{_jit_malloc_exec_huge}
+ * read/write/executable.  The range should be aligned on the huge
+ * page size, so that the huge pages are not split.
+ *
+ * Returns zero if the system cannot change the pages.
+ * @end deftypefun
+@*/
+int
+_jit_commit_exec(void *ptr, jit_nuint size)
+{
+#if defined(JIT_USE_MMAP) && defined(HAVE_MADVISE) && defined(HAVE_MPROTECT) \
+	&& defined(MADV_HUGEPAGE)
+	return mprotect(ptr, size, PROT_READ | PROT_WRITE | PROT_EXEC) == 0;
+#else
+	return 0;
+#endif
+}
+
+/*@
+ * @deftypefun void _jit_free_exec_huge (void *@var{ptr}, jit_nuint @var{size})
+ * Free a block of memory that was previously allocated by
+ * @code{_jit_malloc_exec_huge}.
+ * @end deftypefun
+@*/
+void
+_jit_free_exec_huge(void *ptr, jit_nuint size)
+{
+#if defined(JIT_USE_MMAP) && defined(HAVE_MADVISE) && defined(HAVE_MPROTECT) \
+	&& defined(MADV_HUGEPAGE)
+	if(ptr)
+	{
+		munmap(ptr, size);
+	}
+#endif
+}
+
+/*@
+ * @deftypefun void _jit_discard_exec (void *@var{ptr}, jit_nuint @var{size})
+ * Give the memory behind pages of a block allocated by
+ * @code{_jit_malloc_exec_view} or @code{_jit_malloc_exec_huge} back
+ * to the system, while keeping the pages mapped.  They read as zero
+ * until they are written to again.
+ * @end deftypefun
+@*/
+void
+_jit_discard_exec(void *ptr, jit_nuint size)
+{
+#if defined(JIT_USE_MMAP) && defined(HAVE_MADVISE)
+#ifdef MADV_REMOVE
+	if(madvise(ptr, size, MADV_REMOVE) == 0)
+	{
+		return;
+	}
+#endif
+	madvise(ptr, size, MADV_DONTNEED);
+#endif
+}
+
 /*@
  * @deftypefun void _jit_flush_exec (void *@var{ptr}, unsigned int @var{size})
  * Flush the contents of the block at @var{ptr} from the CPU's
@@ -46,7 +46,6 @@
 void _jit_create_closure(unsigned char *buf, void *func,
                          void *closure, void *_type)
 {
-	jit_nint offset;
 	jit_type_t signature = (jit_type_t)_type;
 
 	/* Set up the local stack frame */
@@ -80,20 +79,12 @@ void _jit_create_closure(unsigned char *buf, void *func,
 	x86_64_mov_reg_reg_size(buf, X86_64_RSI, X86_64_RSP, 8);
 
 	/* Call the closure handling function */
-	offset = (jit_nint)func - ((jit_nint)buf + 5);
-	if((offset < jit_min_int) || (offset > jit_max_int))
-	{
-		/* offset is outside the 32 bit offset range */
-		/* so we have to do an indirect call */
-		/* We use R11 here because it's the only temporary caller saved */
-		/* register not used for argument passing. */
-		x86_64_mov_reg_imm_size(buf, X86_64_R11, (jit_nint)func, 8);
-		x86_64_call_reg(buf, X86_64_R11);
-	}
-	else
-	{
-		x86_64_call_imm(buf, (jit_int)offset);
-	}
+	/* The call goes via R11, as the closure code does not depend on */
+	/* its own address.  It may be written at one address and run */
+	/* from another one.  R11 is the only temporary caller saved */
+	/* register not used for argument passing. */
+	x86_64_mov_reg_imm_size(buf, X86_64_R11, (jit_nint)func, 8);
+	x86_64_call_reg(buf, X86_64_R11);
 
 	/* Pop the current stack frame */
 	x86_64_mov_reg_reg_size(buf, X86_64_RSP, X86_64_RBP, 8);
@@ -106,7 +97,6 @@ void _jit_create_closure(unsigned char *buf, void *func,
 void *_jit_create_redirector(unsigned char *buf, void *func,
 							 void *user_data, int abi)
 {
-	jit_nint offset;
 	void *start = (void *)buf;
 
 	/* Save all registers used for argument passing */
@@ -139,20 +129,9 @@ void *_jit_create_redirector(unsigned char *buf, void *func,
 	x86_64_mov_reg_imm_size(buf, X86_64_RDI, (jit_nint)user_data, 8);
 
 	/* Call "func" (the pointer result will be in RAX) */
-	offset = (jit_nint)func - ((jit_nint)buf + 5);
-	if((offset < jit_min_int) || (offset > jit_max_int))
-	{
-		/* offset is outside the 32 bit offset range */
-		/* so we have to do an indirect call */
-		/* We use R11 here because it's the only temporary caller saved */
-		/* register not used for argument passing. */
-		x86_64_mov_reg_imm_size(buf, X86_64_R11, (jit_nint)func, 8);
-		x86_64_call_reg(buf, X86_64_R11);
-	}
-	else
-	{
-		x86_64_call_imm(buf, (jit_int)offset);
-	}
+	/* The call goes via R11 for the same reason as in the closure. */
+	x86_64_mov_reg_imm_size(buf, X86_64_R11, (jit_nint)func, 8);
+	x86_64_call_reg(buf, X86_64_R11);
 
 	/* store the returned address in R11 */
 	x86_64_mov_reg_reg_size(buf, X86_64_R11, X86_64_RAX, 8);
@@ -188,7 +167,9 @@ void *_jit_create_indirector(unsigned char *buf, void **entry)
 {
 	void *start = (void *)buf;
 
-	/* Jump to the entry point. */
+	/* Jump to the entry point.  RIP relative addressing is not used, */
+	/* as the indirector may run from another address than it is */
+	/* written at. */
 	if(((jit_nint)entry >= jit_min_int) && ((jit_nint)entry <= jit_max_int))
 	{
 		/* We are in the 32bit range so we can use the entry directly. */
@@ -196,20 +177,9 @@ void *_jit_create_indirector(unsigned char *buf, void **entry)
 	}
 	else
 	{
-		jit_nint offset = (jit_nint)entry - ((jit_nint)buf + 6);
-
-		if((offset >= jit_min_int) && (offset <= jit_max_int))
-		{
-			/* We are in the 32bit range so we can use RIP relative addressing. */
-			x86_64_jmp_membase(buf, X86_64_RIP, offset);
-		}
-		else
-		{
-			/* offset is outside the 32 bit offset range */
-			/* so we have to do an indirect jump via register. */
-			x86_64_mov_reg_imm_size(buf, X86_64_R11, (jit_nint)entry, 8);
-			x86_64_jmp_regp(buf, X86_64_R11);
-		}
+		/* We have to do an indirect jump via register. */
+		x86_64_mov_reg_imm_size(buf, X86_64_R11, (jit_nint)entry, 8);
+		x86_64_jmp_regp(buf, X86_64_R11);
 	}
 
 	return start;
@@ -217,31 +187,82 @@ void *_jit_create_indirector(unsigned char *buf, void **entry)
 
 void _jit_pad_buffer(unsigned char *buf, int len)
 {
-	while(len >= 6)
-	{
-		/* "leal 0(%esi), %esi" with 32-bit displacement */
-		*buf++ = (unsigned char)0x8D;
-		x86_address_byte(buf, 2, X86_ESI, X86_ESI);
-		x86_imm_emit32(buf, 0);
-		len -= 6;
-	}
-	if(len >= 3)
-	{
-		/* "leal 0(%esi), %esi" with 8-bit displacement */
-		*buf++ = (unsigned char)0x8D;
-		x86_address_byte(buf, 1, X86_ESI, X86_ESI);
-		x86_imm_emit8(buf, 0);
-		len -= 3;
-	}
-	if(len == 1)
-	{
-		/* Traditional x86 NOP */
-		x86_nop(buf);
-	}
-	else if(len == 2)
+	int size;
+
+	/* Use the multi-byte NOP forms recommended by the CPU vendors so
+	   that the padding that is executed decodes as few instructions */
+	while(len > 0)
 	{
-		/* movl %esi, %esi */
-		x86_mov_reg_reg(buf, X86_ESI, X86_ESI, 4);
+		size = (len > 11) ? 11 : len;
+		len -= size;
+		if(size >= 9)
+		{
+			/* Operand size prefixes on the 8-byte form */
+			while(size > 8)
+			{
+				*buf++ = (unsigned char)0x66;
+				--size;
+			}
+		}
+		switch(size)
+		{
+		case 1:
+			/* nop */
+			*buf++ = (unsigned char)0x90;
+			break;
+
+		case 2:
+			/* xchg %ax, %ax */
+			*buf++ = (unsigned char)0x66;
+			*buf++ = (unsigned char)0x90;
+			break;
+
+		case 3:
+			/* nopl (%rax) */
+			*buf++ = (unsigned char)0x0F;
+			*buf++ = (unsigned char)0x1F;
+			*buf++ = (unsigned char)0x00;
+			break;
+
+		case 4:
+			/* nopl 0(%rax) */
+			*buf++ = (unsigned char)0x0F;
+			*buf++ = (unsigned char)0x1F;
+			*buf++ = (unsigned char)0x40;
+			*buf++ = (unsigned char)0x00;
+			break;
+
+		case 6:
+			/* nopw 0(%rax, %rax, 1) */
+			*buf++ = (unsigned char)0x66;
+			/* Fall through */
+
+		case 5:
+			/* nopl 0(%rax, %rax, 1) */
+			*buf++ = (unsigned char)0x0F;
+			*buf++ = (unsigned char)0x1F;
+			*buf++ = (unsigned char)0x44;
+			*buf++ = (unsigned char)0x00;
+			*buf++ = (unsigned char)0x00;
+			break;
+
+		case 7:
+			/* nopl 0L(%rax) */
+			*buf++ = (unsigned char)0x0F;
+			*buf++ = (unsigned char)0x1F;
+			*buf++ = (unsigned char)0x80;
+			x86_imm_emit32(buf, 0);
+			break;
+
+		case 8:
+			/* nopl 0L(%rax, %rax, 1) */
+			*buf++ = (unsigned char)0x0F;
+			*buf++ = (unsigned char)0x1F;
+			*buf++ = (unsigned char)0x84;
+			*buf++ = (unsigned char)0x00;
+			x86_imm_emit32(buf, 0);
+			break;
+		}
 	}
 }
 
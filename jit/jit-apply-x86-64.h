@@ -307,5 +307,9 @@ _jit_classify_struct(jit_param_passing_t *passing,
  */
 #define	jit_indirector_size		0x10
 
+/*
+ * We should pad unused code space with NOP's.
+ */
+#define	jit_should_pad			1
 
 #endif	/* _JIT_APPLY_X86_64_H */
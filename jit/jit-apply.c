@@ -904,6 +904,9 @@ jit_closure_create(jit_context_t context, jit_type_t signature, jit_closure_func
 	/* Release the memory context, as we are finished with it */
 	_jit_memory_unlock(context);
 
+	/* The closure runs from the executable view of its memory */
+	closure = (jit_closure_t) _jit_memory_get_exec_address(context, closure);
+
 	/* Perform a cache flush on the closure's code */
 	_jit_flush_exec(closure->buf, sizeof(closure->buf));
 
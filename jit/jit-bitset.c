@@ -20,9 +20,18 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+
 #include "jit-internal.h"
 #include "jit-bitset.h"
 
+/* Number of words needed to hold the bits of the set */
+#define _JIT_BITSET_WORDS(bs)	\
+	(((bs)->size + _JIT_BITSET_WORD_BITS - 1) / _JIT_BITSET_WORD_BITS)
+
+/* Bit mask of a bit within its word */
+#define _JIT_BITSET_MASK(bit)	\
+	(((_jit_bitset_word_t) 1) << ((bit) % _JIT_BITSET_WORD_BITS))
+
 void
 _jit_bitset_init(_jit_bitset_t *bs)
 {
@@ -40,7 +49,7 @@ _jit_bitset_allocate(_jit_bitset_t *bs, int size)
 		bs->bits = jit_calloc(size, sizeof(_jit_bitset_word_t));
 		if(!bs->bits)
 		{
-			jit_free(bs);
+			bs->size = 0;
 			return 0;
 		}
 	}
@@ -71,35 +80,27 @@ _jit_bitset_free(_jit_bitset_t *bs)
 void
 _jit_bitset_set_bit(_jit_bitset_t *bs, int bit)
 {
-	int word;
-	word = bit / _JIT_BITSET_WORD_BITS;
-	bit = bit % _JIT_BITSET_WORD_BITS;
-	bs->bits[word] |= bit;
+	bs->bits[bit / _JIT_BITSET_WORD_BITS] |= _JIT_BITSET_MASK(bit);
 }
 
 void
 _jit_bitset_clear_bit(_jit_bitset_t *bs, int bit)
 {
-	int word;
-	word = bit / _JIT_BITSET_WORD_BITS;
-	bit = bit % _JIT_BITSET_WORD_BITS;
-	bs->bits[word] &= ~bit;
+	bs->bits[bit / _JIT_BITSET_WORD_BITS] &= ~_JIT_BITSET_MASK(bit);
 }
 
 int
 _jit_bitset_test_bit(_jit_bitset_t *bs, int bit)
 {
-	int word;
-	word = bit / _JIT_BITSET_WORD_BITS;
-	bit = bit % _JIT_BITSET_WORD_BITS;
-	return (bs->bits[word] & bit) != 0;
+	return (bs->bits[bit / _JIT_BITSET_WORD_BITS] & _JIT_BITSET_MASK(bit)) != 0;
 }
 
 void
 _jit_bitset_clear(_jit_bitset_t *bs)
 {
-	int i;
-	for(i = 0; i < bs->size; i++)
+	int i, words;
+	words = _JIT_BITSET_WORDS(bs);
+	for(i = 0; i < words; i++)
 	{
 		bs->bits[i] = 0;
 	}
@@ -108,8 +109,9 @@ _jit_bitset_clear(_jit_bitset_t *bs)
 int
 _jit_bitset_empty(_jit_bitset_t *bs)
 {
-	int i;
-	for(i = 0; i < bs->size; i++)
+	int i, words;
+	words = _JIT_BITSET_WORDS(bs);
+	for(i = 0; i < words; i++)
 	{
 		if(bs->bits[i])
 		{
@@ -122,8 +124,9 @@ _jit_bitset_empty(_jit_bitset_t *bs)
 void
 _jit_bitset_add(_jit_bitset_t *dest, _jit_bitset_t *src)
 {
-	int i;
-	for(i = 0; i < dest->size; i++)
+	int i, words;
+	words = _JIT_BITSET_WORDS(dest);
+	for(i = 0; i < words; i++)
 	{
 		dest->bits[i] |= src->bits[i];
 	}
@@ -132,8 +135,9 @@ _jit_bitset_add(_jit_bitset_t *dest, _jit_bitset_t *src)
 void
 _jit_bitset_sub(_jit_bitset_t *dest, _jit_bitset_t *src)
 {
-	int i;
-	for(i = 0; i < dest->size; i++)
+	int i, words;
+	words = _JIT_BITSET_WORDS(dest);
+	for(i = 0; i < words; i++)
 	{
 		dest->bits[i] &= ~src->bits[i];
 	}
@@ -142,11 +146,12 @@ _jit_bitset_sub(_jit_bitset_t *dest, _jit_bitset_t *src)
 int
 _jit_bitset_copy(_jit_bitset_t *dest, _jit_bitset_t *src)
 {
-	int i;
+	int i, words;
 	int changed;
 
 	changed = 0;
-	for(i = 0; i < dest->size; i++)
+	words = _JIT_BITSET_WORDS(dest);
+	for(i = 0; i < words; i++)
 	{
 		if(dest->bits[i] != src->bits[i])
 		{
@@ -160,8 +165,9 @@ _jit_bitset_copy(_jit_bitset_t *dest, _jit_bitset_t *src)
 int
 _jit_bitset_equal(_jit_bitset_t *bs1, _jit_bitset_t *bs2)
 {
-	int i;
-	for(i = 0; i < bs1->size; i++)
+	int i, words;
+	words = _JIT_BITSET_WORDS(bs1);
+	for(i = 0; i < words; i++)
 	{
 		if(bs1->bits[i] != bs2->bits[i])
 		{
@@ -269,6 +269,83 @@ attach_edge_dst(_jit_edge_t edge, jit_block_t block)
 	edge->dst = block;
 }
 
+/* Create a new edge appending it to the edges of both blocks */
+static void
+add_edge(jit_function_t func, jit_block_t src, jit_block_t dst, int flags)
+{
+	_jit_edge_t edge;
+	_jit_edge_t *succs;
+
+	edge = jit_memory_pool_alloc(&func->builder->edge_pool, struct _jit_edge);
+	if(!edge)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	edge->src = src;
+	edge->flags = flags;
+
+	succs = jit_realloc(src->succs, (src->num_succs + 1) * sizeof(_jit_edge_t));
+	if(!succs)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	succs[src->num_succs++] = edge;
+	src->succs = succs;
+
+	attach_edge_dst(edge, dst);
+}
+
+/* Get a label that branches may use to reach the block */
+static jit_label_t
+get_branch_label(jit_function_t func, jit_block_t block)
+{
+	jit_label_t label;
+
+	label = block->label;
+	while(label != jit_label_undefined)
+	{
+		if((func->builder->label_info[label].flags & JIT_LABEL_ADDRESS_OF) == 0)
+		{
+			return label;
+		}
+		label = func->builder->label_info[label].alias;
+	}
+
+	label = (func->builder->next_label)++;
+	if(!_jit_block_record_label(block, label))
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	return label;
+}
+
+/* Retarget the branch that ends the source block of the edge */
+static void
+retarget_branch(jit_function_t func, _jit_edge_t edge, jit_block_t block)
+{
+	jit_insn_t insn;
+	jit_label_t *labels;
+	int index, num_labels;
+
+	insn = _jit_block_get_last(edge->src);
+	if(insn->opcode != JIT_OP_JUMP_TABLE)
+	{
+		insn->dest = (jit_value_t) get_branch_label(func, block);
+	}
+	else
+	{
+		labels = (jit_label_t *) insn->value1->address;
+		num_labels = (int) insn->value2->address;
+		for(index = 0; index < num_labels; index++)
+		{
+			if(jit_block_from_label(func, labels[index]) == edge->dst)
+			{
+				labels[index] = get_branch_label(func, block);
+			}
+		}
+	}
+}
+
 /* Delete edge along with references to it */
 static void
 delete_edge(jit_function_t func, _jit_edge_t edge)
@@ -644,6 +721,50 @@ visit_reachable(jit_block_t block)
 
 #endif
 
+/* Reduce a conditional branch with constant operands either to an
+   unconditional branch or to a fallthrough */
+static int
+fold_branch(jit_function_t func, jit_block_t block, jit_insn_t insn)
+{
+	jit_value_t taken;
+
+	if(block->num_succs != 2
+	   || (insn->flags & JIT_INSN_VALUE1_OTHER_FLAGS) != 0
+	   || !insn->value1 || !insn->value1->is_constant
+	   || (insn->value2 && !insn->value2->is_constant))
+	{
+		return 0;
+	}
+	if(jit_context_get_meta_numeric(func->context, JIT_OPTION_DONT_FOLD))
+	{
+		return 0;
+	}
+
+	taken = _jit_opcode_apply(func, insn->opcode, jit_type_int,
+				  insn->value1, insn->value2);
+	if(!taken)
+	{
+		return 0;
+	}
+
+	if(taken->address)
+	{
+		/* Keep the branch edge and delete the fallthrough edge */
+		insn->opcode = JIT_OP_BR;
+		insn->value1 = 0;
+		insn->value2 = 0;
+		block->ends_in_dead = 1;
+		delete_edge(func, block->succs[1]);
+	}
+	else
+	{
+		/* Keep the fallthrough edge and delete the branch edge */
+		insn->opcode = JIT_OP_NOP;
+		delete_edge(func, block->succs[0]);
+	}
+	return 1;
+}
+
 /* Eliminate unreachable blocks */
 static void
 eliminate_unreachable(jit_function_t func)
@@ -811,6 +932,16 @@ _jit_block_clean_cfg(jit_function_t func)
 				/* skip jump tables, handle only branches */
 				continue;
 			}
+			if(fold_branch(func, block, insn))
+			{
+#ifdef _JIT_BLOCK_DEBUG
+				printf("%d fold cbranch %d\n", index, block->label);
+#endif
+				/* The edges are changed, revisit the block on
+				   the next pass */
+				changed = 1;
+				continue;
+			}
 			if(block->succs[0]->dst == block->next)
 			{
 				/* Replace useless branch with NOP */
@@ -895,11 +1026,323 @@ _jit_block_clean_cfg(jit_function_t func)
 		{
 			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
 		}
+		/* Folded branches may leave some blocks unreachable */
+		eliminate_unreachable(func);
 		clear_visited(func);
 		goto loop;
 	}
 }
 
+jit_block_t
+_jit_block_create_preheader(jit_function_t func, jit_block_t block,
+			    _jit_edge_t *edges, int num_edges)
+{
+	jit_block_t preheader, jump;
+	_jit_edge_t edge;
+	jit_insn_t insn;
+	int index, entry;
+
+	preheader = _jit_block_create(func);
+	if(!preheader)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+
+	/* The preheader goes just before the block.  If the previous block
+	   falls through into the block over an edge that is not moved to the
+	   preheader then it has to jump over the preheader */
+	for(index = 0; index < block->num_preds; index++)
+	{
+		edge = block->preds[index];
+		if(edge->flags != _JIT_EDGE_FALLTHRU)
+		{
+			continue;
+		}
+		for(entry = 0; entry < num_edges; entry++)
+		{
+			if(edges[entry] == edge)
+			{
+				break;
+			}
+		}
+		if(entry < num_edges)
+		{
+			break;
+		}
+
+		jump = _jit_block_create(func);
+		if(!jump)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+		_jit_block_attach_after(edge->src, jump, jump);
+
+		insn = _jit_block_add_insn(jump);
+		if(!insn)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+		insn->opcode = (short)JIT_OP_BR;
+		insn->flags = JIT_INSN_DEST_IS_LABEL;
+		insn->dest = (jit_value_t) get_branch_label(func, block);
+		jump->ends_in_dead = 1;
+
+		detach_edge_dst(edge);
+		attach_edge_dst(edge, jump);
+		add_edge(func, jump, block, _JIT_EDGE_BRANCH);
+		break;
+	}
+	_jit_block_attach_before(block, preheader, preheader);
+
+	/* Move the entering edges to the preheader */
+	for(index = 0; index < num_edges; index++)
+	{
+		edge = edges[index];
+		if(edge->flags == _JIT_EDGE_BRANCH)
+		{
+			retarget_branch(func, edge, preheader);
+		}
+		detach_edge_dst(edge);
+		attach_edge_dst(edge, preheader);
+	}
+	add_edge(func, preheader, block, _JIT_EDGE_FALLTHRU);
+
+	return preheader;
+}
+
+jit_block_t
+_jit_block_split_fallthru(jit_function_t func, jit_block_t block)
+{
+	jit_block_t new_block;
+	_jit_edge_t edge;
+	int index;
+
+	new_block = _jit_block_create(func);
+	if(!new_block)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	_jit_block_attach_after(block, new_block, new_block);
+
+	for(index = 0; index < block->num_succs; index++)
+	{
+		edge = block->succs[index];
+		if(edge->flags == _JIT_EDGE_FALLTHRU)
+		{
+			detach_edge_dst(edge);
+			attach_edge_dst(edge, new_block);
+			break;
+		}
+	}
+	add_edge(func, new_block, new_block->next, _JIT_EDGE_FALLTHRU);
+
+	return new_block;
+}
+
+/* Get the conditional branch that is taken when the given one is not,
+   or zero if there is none */
+static int
+invert_branch(int opcode)
+{
+	switch(opcode)
+	{
+	case JIT_OP_BR_IFALSE:		return JIT_OP_BR_ITRUE;
+	case JIT_OP_BR_ITRUE:		return JIT_OP_BR_IFALSE;
+	case JIT_OP_BR_IEQ:		return JIT_OP_BR_INE;
+	case JIT_OP_BR_INE:		return JIT_OP_BR_IEQ;
+	case JIT_OP_BR_ILT:		return JIT_OP_BR_IGE;
+	case JIT_OP_BR_ILT_UN:		return JIT_OP_BR_IGE_UN;
+	case JIT_OP_BR_ILE:		return JIT_OP_BR_IGT;
+	case JIT_OP_BR_ILE_UN:		return JIT_OP_BR_IGT_UN;
+	case JIT_OP_BR_IGT:		return JIT_OP_BR_ILE;
+	case JIT_OP_BR_IGT_UN:		return JIT_OP_BR_ILE_UN;
+	case JIT_OP_BR_IGE:		return JIT_OP_BR_ILT;
+	case JIT_OP_BR_IGE_UN:		return JIT_OP_BR_ILT_UN;
+	case JIT_OP_BR_LFALSE:		return JIT_OP_BR_LTRUE;
+	case JIT_OP_BR_LTRUE:		return JIT_OP_BR_LFALSE;
+	case JIT_OP_BR_LEQ:		return JIT_OP_BR_LNE;
+	case JIT_OP_BR_LNE:		return JIT_OP_BR_LEQ;
+	case JIT_OP_BR_LLT:		return JIT_OP_BR_LGE;
+	case JIT_OP_BR_LLT_UN:		return JIT_OP_BR_LGE_UN;
+	case JIT_OP_BR_LLE:		return JIT_OP_BR_LGT;
+	case JIT_OP_BR_LLE_UN:		return JIT_OP_BR_LGT_UN;
+	case JIT_OP_BR_LGT:		return JIT_OP_BR_LLE;
+	case JIT_OP_BR_LGT_UN:		return JIT_OP_BR_LLE_UN;
+	case JIT_OP_BR_LGE:		return JIT_OP_BR_LLT;
+	case JIT_OP_BR_LGE_UN:		return JIT_OP_BR_LLT_UN;
+	case JIT_OP_BR_FEQ:		return JIT_OP_BR_FNE;
+	case JIT_OP_BR_FNE:		return JIT_OP_BR_FEQ;
+	case JIT_OP_BR_FLT:		return JIT_OP_BR_FGE_INV;
+	case JIT_OP_BR_FLE:		return JIT_OP_BR_FGT_INV;
+	case JIT_OP_BR_FGT:		return JIT_OP_BR_FLE_INV;
+	case JIT_OP_BR_FGE:		return JIT_OP_BR_FLT_INV;
+	case JIT_OP_BR_FLT_INV:		return JIT_OP_BR_FGE;
+	case JIT_OP_BR_FLE_INV:		return JIT_OP_BR_FGT;
+	case JIT_OP_BR_FGT_INV:		return JIT_OP_BR_FLE;
+	case JIT_OP_BR_FGE_INV:		return JIT_OP_BR_FLT;
+	case JIT_OP_BR_DEQ:		return JIT_OP_BR_DNE;
+	case JIT_OP_BR_DNE:		return JIT_OP_BR_DEQ;
+	case JIT_OP_BR_DLT:		return JIT_OP_BR_DGE_INV;
+	case JIT_OP_BR_DLE:		return JIT_OP_BR_DGT_INV;
+	case JIT_OP_BR_DGT:		return JIT_OP_BR_DLE_INV;
+	case JIT_OP_BR_DGE:		return JIT_OP_BR_DLT_INV;
+	case JIT_OP_BR_DLT_INV:		return JIT_OP_BR_DGE;
+	case JIT_OP_BR_DLE_INV:		return JIT_OP_BR_DGT;
+	case JIT_OP_BR_DGT_INV:		return JIT_OP_BR_DLE;
+	case JIT_OP_BR_DGE_INV:		return JIT_OP_BR_DLT;
+	case JIT_OP_BR_NFEQ:		return JIT_OP_BR_NFNE;
+	case JIT_OP_BR_NFNE:		return JIT_OP_BR_NFEQ;
+	case JIT_OP_BR_NFLT:		return JIT_OP_BR_NFGE_INV;
+	case JIT_OP_BR_NFLE:		return JIT_OP_BR_NFGT_INV;
+	case JIT_OP_BR_NFGT:		return JIT_OP_BR_NFLE_INV;
+	case JIT_OP_BR_NFGE:		return JIT_OP_BR_NFLT_INV;
+	case JIT_OP_BR_NFLT_INV:	return JIT_OP_BR_NFGE;
+	case JIT_OP_BR_NFLE_INV:	return JIT_OP_BR_NFGT;
+	case JIT_OP_BR_NFGT_INV:	return JIT_OP_BR_NFLE;
+	case JIT_OP_BR_NFGE_INV:	return JIT_OP_BR_NFLT;
+	}
+	return 0;
+}
+
+int
+_jit_block_can_fall_into(jit_block_t block, _jit_edge_t edge)
+{
+	jit_insn_t insn;
+
+	if(edge->flags == _JIT_EDGE_FALLTHRU)
+	{
+		return 1;
+	}
+	if(edge->flags != _JIT_EDGE_BRANCH)
+	{
+		return 0;
+	}
+	insn = _jit_block_get_last(block);
+	if(insn->opcode == JIT_OP_BR)
+	{
+		return 1;
+	}
+	return (block->num_succs == 2 && invert_branch(insn->opcode) != 0);
+}
+
+void
+_jit_block_reorder(jit_function_t func, jit_block_t *blocks, int num_blocks)
+{
+	jit_block_t block, jump;
+	_jit_edge_t edge, fallthru, branch;
+	jit_insn_t insn;
+	int index, succ;
+
+	/* Link the blocks in the new order */
+	for(index = 0; index < num_blocks; index++)
+	{
+		block = blocks[index];
+		block->prev = (index > 0) ? blocks[index - 1] : 0;
+		block->next = (index + 1 < num_blocks) ? blocks[index + 1] : 0;
+	}
+
+	/* Repair the control flow that relied on the old order */
+	for(index = 0; index < num_blocks - 1; index++)
+	{
+		block = blocks[index];
+		fallthru = 0;
+		branch = 0;
+		for(succ = 0; succ < block->num_succs; succ++)
+		{
+			edge = block->succs[succ];
+			if(edge->flags == _JIT_EDGE_FALLTHRU)
+			{
+				fallthru = edge;
+			}
+			else if(edge->flags == _JIT_EDGE_BRANCH)
+			{
+				branch = edge;
+			}
+		}
+		insn = _jit_block_get_last(block);
+
+		/* The jump to the next block is not needed */
+		if(branch && insn->opcode == JIT_OP_BR && branch->dst == block->next)
+		{
+			insn->opcode = (short)JIT_OP_NOP;
+			insn->flags = 0;
+			insn->dest = 0;
+			branch->flags = _JIT_EDGE_FALLTHRU;
+			block->ends_in_dead = 0;
+			continue;
+		}
+		if(!fallthru || fallthru->dst == block->next)
+		{
+			continue;
+		}
+
+		/* Branch to the old fallthrough block if the condition is
+		   reversed so that the old branch target is next */
+		if(branch && branch->dst == block->next && block->num_succs == 2
+		   && invert_branch(insn->opcode) != 0)
+		{
+			insn->opcode = (short)invert_branch(insn->opcode);
+			insn->dest = (jit_value_t) get_branch_label(func, fallthru->dst);
+			fallthru->flags = _JIT_EDGE_BRANCH;
+			branch->flags = _JIT_EDGE_FALLTHRU;
+			block->succs[0] = fallthru;
+			block->succs[1] = branch;
+			continue;
+		}
+
+		/* Otherwise jump to it from a new block */
+		jump = _jit_block_create(func);
+		if(!jump)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+		_jit_block_attach_after(block, jump, jump);
+
+		insn = _jit_block_add_insn(jump);
+		if(!insn)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+		insn->opcode = (short)JIT_OP_BR;
+		insn->flags = JIT_INSN_DEST_IS_LABEL;
+		insn->dest = (jit_value_t) get_branch_label(func, fallthru->dst);
+		jump->ends_in_dead = 1;
+
+		add_edge(func, jump, fallthru->dst, _JIT_EDGE_BRANCH);
+		detach_edge_dst(fallthru);
+		attach_edge_dst(fallthru, jump);
+	}
+}
+
+jit_insn_t
+_jit_block_add_branch(jit_function_t func, jit_block_t block, int opcode,
+		      jit_block_t target)
+{
+	jit_insn_t insn;
+	_jit_edge_t edge;
+	int index;
+
+	insn = _jit_block_add_insn(block);
+	if(!insn)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	insn->opcode = (short)opcode;
+	insn->flags = JIT_INSN_DEST_IS_LABEL;
+	insn->dest = (jit_value_t) get_branch_label(func, target);
+
+	/* The branch edge goes before the fallthrough edge */
+	add_edge(func, block, target, _JIT_EDGE_BRANCH);
+	edge = block->succs[block->num_succs - 1];
+	for(index = block->num_succs - 1; index > 0; index--)
+	{
+		block->succs[index] = block->succs[index - 1];
+	}
+	block->succs[0] = edge;
+
+	return insn;
+}
+
 int
 _jit_block_compute_postorder(jit_function_t func)
 {
@@ -1132,6 +1575,22 @@ _jit_block_add_insn(jit_block_t block)
 	return &block->insns[block->num_insns++];
 }
 
+jit_insn_t
+_jit_block_insert_insn(jit_block_t block, int index)
+{
+	if(!_jit_block_add_insn(block))
+	{
+		return 0;
+	}
+
+	/* Move the following instructions up by one and reuse the slot */
+	jit_memmove(&block->insns[index + 1], &block->insns[index],
+		    (block->num_insns - 1 - index) * sizeof(struct _jit_insn));
+	jit_memzero(&block->insns[index], sizeof(struct _jit_insn));
+
+	return &block->insns[index];
+}
+
 jit_insn_t
 _jit_block_get_last(jit_block_t block)
 {
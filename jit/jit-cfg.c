@@ -20,6 +20,7 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+
 #include "jit-internal.h"
 #include "jit-cfg.h"
 
@@ -27,15 +28,7 @@ static void
 init_node(_jit_node_t node, jit_block_t block)
 {
 	node->block = block;
-	if(block)
-	{
-		jit_block_set_meta(block, _JIT_BLOCK_CFG_NODE, node, 0);
-	}
 	node->flags = 0;
-	node->succs = 0;
-	node->num_succs = 0;
-	node->preds = 0;
-	node->num_preds = 0;
 
 	_jit_bitset_init(&node->live_in);
 	_jit_bitset_init(&node->live_out);
@@ -43,35 +36,49 @@ init_node(_jit_node_t node, jit_block_t block)
 	_jit_bitset_init(&node->live_def);
 
 	node->dfn = -1;
+	node->start = 0;
+	node->end = 0;
+
+	node->idom = 0;
+	node->frontier = 0;
+	node->num_frontier = 0;
+	node->phis = 0;
+	node->loop = 0;
 }
 
 static void
-init_edge(_jit_edge_t edge)
+free_node(_jit_node_t node)
 {
-	edge->src = 0;
-	edge->dst = 0;
-	edge->flags = 0;
-}
+	_jit_phi_t phi;
 
-static void
-init_value_entry(_jit_value_entry_t value)
-{
-	value->value = 0;
-}
+	_jit_bitset_free(&node->live_in);
+	_jit_bitset_free(&node->live_out);
+	_jit_bitset_free(&node->live_use);
+	_jit_bitset_free(&node->live_def);
 
-static _jit_node_t
-create_node()
-{
-	_jit_node_t node;
-	node = jit_new(struct _jit_node);
-	if(node)
+	if(node->frontier)
 	{
-		init_node(node, 0);
+		jit_free(node->frontier);
+	}
+	while(node->phis)
+	{
+		phi = node->phis;
+		node->phis = phi->next;
+		jit_free(phi->args);
+		jit_free(phi);
 	}
-	return node;
 }
 
-_jit_cfg_t
+static void
+init_value_entry(_jit_value_entry_t entry, jit_value_t value)
+{
+	entry->value = value;
+	entry->start = -1;
+	entry->end = -1;
+	entry->var = 0;
+}
+
+static _jit_cfg_t
 create_cfg(jit_function_t func)
 {
 	_jit_cfg_t cfg;
@@ -82,30 +89,17 @@ create_cfg(jit_function_t func)
 		return 0;
 	}
 
-	cfg->entry = create_node();
-	if(!cfg->entry)
-	{
-		jit_free(cfg);
-		return 0;
-	}
-
-	cfg->exit = create_node();
-	if(!cfg->exit)
-	{
-		jit_free(cfg->entry);
-		jit_free(cfg);
-		return 0;
-	}
-
 	cfg->func = func;
 	cfg->nodes = 0;
 	cfg->num_nodes = 0;
-	cfg->edges = 0;
-	cfg->num_edges = 0;
 	cfg->post_order = 0;
+	cfg->num_post_order = 0;
 	cfg->values = 0;
 	cfg->num_values = 0;
 	cfg->max_values = 0;
+	cfg->in_ssa = 0;
+	cfg->loops = 0;
+	cfg->num_loops = 0;
 
 	return cfg;
 }
@@ -117,10 +111,9 @@ build_nodes(_jit_cfg_t cfg, jit_function_t func)
 	jit_block_t block;
 
 	count = 0;
-	block = 0;
-	while((block = jit_block_next(func, block)) != 0)
+	for(block = func->builder->entry_block; block; block = block->next)
 	{
-		++count;
+		block->index = count++;
 	}
 
 	cfg->num_nodes = count;
@@ -130,210 +123,14 @@ build_nodes(_jit_cfg_t cfg, jit_function_t func)
 		return 0;
 	}
 
-	count = 0;
-	block = 0;
-	while((block = jit_block_next(func, block)) != 0)
+	for(block = func->builder->entry_block; block; block = block->next)
 	{
-		init_node(&cfg->nodes[count++], block);
+		init_node(&cfg->nodes[block->index], block);
 	}
 
 	return 1;
 }
 
-static _jit_node_t
-get_next_node(_jit_cfg_t cfg, _jit_node_t node)
-{
-	int index = (node - cfg->nodes) + 1;
-	if(index < cfg->num_nodes)
-	{
-		return cfg->nodes + index;
-	}
-	else
-	{
-		return cfg->exit;
-	}
-}
-
-static _jit_node_t
-get_label_node(_jit_cfg_t cfg, jit_label_t label)
-{
-	jit_block_t block;
-	block = jit_block_from_label(cfg->func, label);
-	if(!block)
-	{
-		return 0;
-	}
-	return jit_block_get_meta(block, _JIT_BLOCK_CFG_NODE);
-}
-
-static _jit_node_t
-get_catcher_node(_jit_cfg_t cfg)
-{
-	jit_label_t label;
-	label = cfg->func->builder->catcher_label;
-	if(label == jit_label_undefined)
-	{
-		return cfg->exit;
-	}
-	return get_label_node(cfg, label);
-}
-
-static void
-enum_edge(_jit_cfg_t cfg, _jit_node_t src, _jit_node_t dst, int flags, int create)
-{
-	if(!cfg || !src || !dst)
-	{
-		return;
-	}
-
-	if(create)
-	{
-		cfg->edges[cfg->num_edges].src = src;
-		cfg->edges[cfg->num_edges].dst = dst;
-		cfg->edges[cfg->num_edges].flags = flags;
-		src->succs[src->num_succs] = &cfg->edges[cfg->num_edges];
-		dst->preds[dst->num_preds] = &cfg->edges[cfg->num_edges];
-	}
-
-	++(cfg->num_edges);
-	++(src->num_succs);
-	++(dst->num_preds);
-}
-
-static void
-enum_node_edges(_jit_cfg_t cfg, _jit_node_t node, int create)
-{
-	jit_insn_t insn;
-	jit_label_t label;
-	jit_label_t *labels;
-	int index, num_labels;
-
-	/* TODO: Handle catch, finally, filter blocks and calls. */
-
-	insn = _jit_block_get_last(node->block);
-	if(!insn)
-	{
-		/* empty block: create a fall-through edge */
-		enum_edge(cfg, node, get_next_node(cfg, node), 0, create);
-	}
-	else if(insn->opcode == JIT_OP_BR)
-	{
-		label = (jit_label_t) insn->dest;
-		enum_edge(cfg, node, get_label_node(cfg, label), 0, create);
-	}
-	else if(insn->opcode >= JIT_OP_BR_IFALSE && insn->opcode <= JIT_OP_BR_NFGE_INV)
-	{
-		label = (jit_label_t) insn->dest;
-		enum_edge(cfg, node, get_label_node(cfg, label), 0, create);
-		enum_edge(cfg, node, get_next_node(cfg, node), 0, create);
-	}
-	else if(insn->opcode >= JIT_OP_RETURN && insn->opcode <= JIT_OP_RETURN_SMALL_STRUCT)
-	{
-		enum_edge(cfg, node, cfg->exit, 0, create);
-	}
-	else if(insn->opcode == JIT_OP_THROW)
-	{
-		enum_edge(cfg, node, get_catcher_node(cfg), 0, create);
-	}
-	else if(insn->opcode == JIT_OP_RETHROW)
-	{
-		enum_edge(cfg, node, cfg->exit, 0, create);
-	}
-	else if(insn->opcode == JIT_OP_JUMP_TABLE)
-	{
-		labels = (jit_label_t *) insn->value1->address;
-		num_labels = (int) insn->value2->address;
-		for(index = 0; index < num_labels; index++)
-		{
-			enum_edge(cfg, node, get_label_node(cfg, labels[index]), 0, create);
-		}
-		enum_edge(cfg, node, get_next_node(cfg, node), 0, create);
-	}
-	else
-	{
-		/* otherwise create a fall-through edge */
-		enum_edge(cfg, node, get_next_node(cfg, node), 0, create);
-	}
-}
-
-static void
-enum_all_edges(_jit_cfg_t cfg, jit_function_t func, int create)
-{
-	int index;
-
-	if(cfg->num_nodes == 0)
-	{
-		enum_edge(cfg, cfg->entry, cfg->exit, 0, create);
-	}
-	else
-	{
-		enum_edge(cfg, cfg->entry, &cfg->nodes[0], 0, create);
-		for(index = 0; index < cfg->num_nodes; index++)
-		{
-			enum_node_edges(cfg, &cfg->nodes[index], create);
-		}
-	}
-}
-
-static int
-create_edges(_jit_cfg_t cfg, jit_function_t func)
-{
-	int index;
-
-	if(cfg->num_edges == 0)
-	{
-		return 1;
-	}
-
-	cfg->edges = jit_malloc(cfg->num_edges * sizeof(struct _jit_edge));
-	if(!cfg->edges)
-	{
-		return 0;
-	}
-	for(index = 0; index < cfg->num_edges; index++)
-	{
-		init_edge(&cfg->edges[index]);
-	}
-	for(index = 0; index < cfg->num_nodes; index++)
-	{
-		if(cfg->nodes[index].num_succs > 0)
-		{
-			cfg->nodes[index].succs = jit_calloc(cfg->nodes[index].num_succs,
-							     sizeof(_jit_edge_t));
-			if(!cfg->nodes[index].succs)
-			{
-				return 0;
-			}
-			cfg->nodes[index].num_succs = 0;
-		}
-		if(cfg->nodes[index].num_preds > 0)
-		{
-			cfg->nodes[index].preds = jit_calloc(cfg->nodes[index].num_preds,
-							     sizeof(_jit_edge_t));
-			if(!cfg->nodes[index].preds)
-			{
-				return 0;
-			}
-			cfg->nodes[index].num_preds = 0;
-		}
-	}
-
-	cfg->num_edges = 0;
-	return 1;
-}
-
-static int
-build_edges(_jit_cfg_t cfg, jit_function_t func)
-{
-	enum_all_edges(cfg, func, 0);
-	if(!create_edges(cfg, func))
-	{
-		return 0;
-	}
-	enum_all_edges(cfg, func, 1);
-	return 1;
-}
-
 static int
 compute_depth_first_order(_jit_cfg_t cfg)
 {
@@ -344,16 +141,10 @@ compute_depth_first_order(_jit_cfg_t cfg)
 	} *stack;
 	_jit_node_t node;
 	_jit_node_t succ;
-	int post_order_num;
 	int sp;
 	int index;
 
-	if(cfg->post_order)
-	{
-		return 1;
-	}
-
-	stack = jit_malloc((cfg->num_nodes + 1) * sizeof(struct stack_entry));
+	stack = jit_malloc(cfg->num_nodes * sizeof(struct stack_entry));
 	if(!stack)
 	{
 		return 0;
@@ -366,9 +157,9 @@ compute_depth_first_order(_jit_cfg_t cfg)
 		return 0;
 	}
 
-	post_order_num = 0;
-
-	stack[0].node = cfg->entry;
+	node = &cfg->nodes[0];
+	node->flags |= _JIT_NODE_VISITED;
+	stack[0].node = node;
 	stack[0].index = 0;
 	sp = 1;
 
@@ -377,35 +168,22 @@ compute_depth_first_order(_jit_cfg_t cfg)
 		node = stack[sp - 1].node;
 		index = stack[sp - 1].index;
 
-		succ = node->succs[index]->dst;
-		if(succ != cfg->exit && (succ->flags & _JIT_NODE_VISITED) == 0)
+		if(index == node->block->num_succs)
 		{
-			succ->flags |= _JIT_NODE_VISITED;
-			if(succ->num_succs > 0)
-			{
-				stack[sp].node = succ;
-				stack[sp].index = 0;
-				++sp;
-			}
-			else
-			{
-				cfg->post_order[post_order_num++] = succ;
-			}
+			node->dfn = cfg->num_post_order;
+			cfg->post_order[cfg->num_post_order++] = node;
+			--sp;
+			continue;
 		}
-		else
+
+		stack[sp - 1].index = index + 1;
+		succ = _jit_cfg_get_node(cfg, node->block->succs[index]->dst);
+		if((succ->flags & _JIT_NODE_VISITED) == 0)
 		{
-			if(index < node->num_succs)
-			{
-				stack[sp - 1].index = index + 1;
-			}
-			else
-			{
-				if(node != cfg->entry)
-				{
-					cfg->post_order[post_order_num++] = node;
-				}
-				--sp;
-			}
+			succ->flags |= _JIT_NODE_VISITED;
+			stack[sp].node = succ;
+			stack[sp].index = 0;
+			++sp;
 		}
 	}
 
@@ -413,8 +191,8 @@ compute_depth_first_order(_jit_cfg_t cfg)
 	return 1;
 }
 
-static jit_value_t
-get_dest(jit_insn_t insn)
+jit_value_t
+_jit_cfg_get_dest(jit_insn_t insn)
 {
 	if(insn->opcode == JIT_OP_NOP
 	   || (insn->flags & JIT_INSN_DEST_OTHER_FLAGS) != 0
@@ -425,8 +203,8 @@ get_dest(jit_insn_t insn)
 	return insn->dest;
 }
 
-static jit_value_t
-get_value1(jit_insn_t insn)
+jit_value_t
+_jit_cfg_get_value1(jit_insn_t insn)
 {
 	if(insn->opcode == JIT_OP_NOP
 	   || (insn->flags & JIT_INSN_VALUE1_OTHER_FLAGS) != 0
@@ -437,8 +215,8 @@ get_value1(jit_insn_t insn)
 	return insn->value1;
 }
 
-static jit_value_t
-get_value2(jit_insn_t insn)
+jit_value_t
+_jit_cfg_get_value2(jit_insn_t insn)
 {
 	if(insn->opcode == JIT_OP_NOP
 	   || (insn->flags & JIT_INSN_VALUE2_OTHER_FLAGS) != 0
@@ -481,42 +259,24 @@ create_value_entry(_jit_cfg_t cfg, jit_value_t value)
 	}
 
 	value->index = cfg->num_values++;
-	init_value_entry(&cfg->values[value->index]);
+	init_value_entry(&cfg->values[value->index], value);
 
 	return 1;
 }
 
-static int
-use_value(_jit_cfg_t cfg, _jit_node_t node, jit_value_t value)
+static void
+use_value(_jit_node_t node, jit_value_t value)
 {
-	if(value->index < 0)
+	if(!_jit_bitset_test_bit(&node->live_def, value->index))
 	{
-		return 1;
+		_jit_bitset_set_bit(&node->live_use, value->index);
 	}
-	if(_jit_bitset_is_allocated(&node->live_def)
-	   && _jit_bitset_test_bit(&node->live_def, value->index))
-	{
-		return 1;
-	}
-	if(!_jit_bitset_is_allocated(&node->live_use)
-	   && !_jit_bitset_allocate(&node->live_use, cfg->num_values))
-	{
-		return 0;
-	}
-	_jit_bitset_set_bit(&node->live_use, value->index);
-	return 1;
 }
 
-static int
-def_value(_jit_cfg_t cfg, _jit_node_t node, jit_value_t value)
+static void
+def_value(_jit_node_t node, jit_value_t value)
 {
-	if(!_jit_bitset_is_allocated(&node->live_def)
-	   && !_jit_bitset_allocate(&node->live_def, cfg->num_values))
-	{
-		return 0;
-	}
 	_jit_bitset_set_bit(&node->live_def, value->index);
-	return 1;
 }
 
 static int
@@ -536,9 +296,9 @@ create_value_entries(_jit_cfg_t cfg)
 		jit_insn_iter_init(&iter, node->block);
 		while((insn = jit_insn_iter_next(&iter)) != 0)
 		{
-			dest = get_dest(insn);
-			value1 = get_value1(insn);
-			value2 = get_value1(insn);
+			dest = _jit_cfg_get_dest(insn);
+			value1 = _jit_cfg_get_value1(insn);
+			value2 = _jit_cfg_get_value2(insn);
 
 			if(dest && !create_value_entry(cfg, dest))
 			{
@@ -572,36 +332,45 @@ compute_local_live_sets(_jit_cfg_t cfg)
 	for(index = 0; index < cfg->num_nodes; index++)
 	{
 		node = &cfg->nodes[index];
+
+		/* The sets are reallocated as the liveness may be recomputed
+		   after the values are changed */
+		_jit_bitset_free(&node->live_in);
+		_jit_bitset_free(&node->live_out);
+		_jit_bitset_free(&node->live_use);
+		_jit_bitset_free(&node->live_def);
+		if(!_jit_bitset_allocate(&node->live_in, cfg->num_values)
+		   || !_jit_bitset_allocate(&node->live_out, cfg->num_values)
+		   || !_jit_bitset_allocate(&node->live_use, cfg->num_values)
+		   || !_jit_bitset_allocate(&node->live_def, cfg->num_values))
+		{
+			return 0;
+		}
+
 		jit_insn_iter_init(&iter, node->block);
 		while((insn = jit_insn_iter_next(&iter)) != 0)
 		{
-			dest = get_dest(insn);
-			value1 = get_value1(insn);
-			value2 = get_value2(insn);
+			dest = _jit_cfg_get_dest(insn);
+			value1 = _jit_cfg_get_value1(insn);
+			value2 = _jit_cfg_get_value2(insn);
 
-			if(value1 && !use_value(cfg, node, value1))
+			if(value1)
 			{
-				return 0;
+				use_value(node, value1);
 			}
-			if(value2 && !use_value(cfg, node, value2))
+			if(value2)
 			{
-				return 0;
+				use_value(node, value2);
 			}
 			if(dest)
 			{
 				if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
 				{
-					if(!use_value(cfg, node, dest))
-					{
-						return 0;
-					}
+					use_value(node, dest);
 				}
 				else
 				{
-					if(!def_value(cfg, node, dest))
-					{
-						return 0;
-					}
+					def_value(node, dest);
 				}
 			}
 		}
@@ -619,36 +388,35 @@ compute_global_live_sets(_jit_cfg_t cfg)
 	_jit_node_t succ;
 	_jit_bitset_t bitset;
 
+	if(cfg->num_values == 0)
+	{
+		return 1;
+	}
 	if(!_jit_bitset_allocate(&bitset, cfg->num_values))
 	{
 		return 0;
 	}
 
+	/* Nodes that are not reachable keep only their local uses as their
+	   live-in set.  Iterating in post order the reachable nodes
+	   converge in a few passes */
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		_jit_bitset_copy(&cfg->nodes[index].live_in, &cfg->nodes[index].live_use);
+	}
+
 	do
 	{
 		change = 0;
-		for(index = 0; index < cfg->num_nodes; index++)
+		for(index = 0; index < cfg->num_post_order; index++)
 		{
 			node = cfg->post_order[index];
-			if(!node)
-			{
-				continue;
-			}
 
 			_jit_bitset_clear(&bitset);
-			for(succ_index = 0; succ_index < node->num_succs; succ_index++)
-			{
-				succ = node->succs[succ_index]->dst;
-				if(_jit_bitset_is_allocated(&succ->live_in))
-				{
-					_jit_bitset_add(&bitset, &succ->live_in);
-				}
-			}
-			if(!_jit_bitset_is_allocated(&node->live_out)
-			   && !_jit_bitset_allocate(&node->live_out, cfg->num_values))
+			for(succ_index = 0; succ_index < node->block->num_succs; succ_index++)
 			{
-				_jit_bitset_free(&bitset);
-				return 0;
+				succ = _jit_cfg_get_node(cfg, node->block->succs[succ_index]->dst);
+				_jit_bitset_add(&bitset, &succ->live_in);
 			}
 			if(_jit_bitset_copy(&node->live_out, &bitset))
 			{
@@ -657,12 +425,6 @@ compute_global_live_sets(_jit_cfg_t cfg)
 
 			_jit_bitset_sub(&bitset, &node->live_def);
 			_jit_bitset_add(&bitset, &node->live_use);
-			if(!_jit_bitset_is_allocated(&node->live_in)
-			   && !_jit_bitset_allocate(&node->live_in, cfg->num_values))
-			{
-				_jit_bitset_free(&bitset);
-				return 0;
-			}
 			if(_jit_bitset_copy(&node->live_in, &bitset))
 			{
 				change = 1;
@@ -675,8 +437,161 @@ compute_global_live_sets(_jit_cfg_t cfg)
 	return 1;
 }
 
-void
-_jit_cfg_free(_jit_cfg_t cfg)
+/*
+ * Find the common dominator of two nodes given by their post order
+ * numbers as described in "A Simple, Fast Dominance Algorithm" by
+ * Cooper, Harvey and Kennedy.
+ */
+static int
+intersect(int *doms, int finger1, int finger2)
+{
+	while(finger1 != finger2)
+	{
+		while(finger1 < finger2)
+		{
+			finger1 = doms[finger1];
+		}
+		while(finger2 < finger1)
+		{
+			finger2 = doms[finger2];
+		}
+	}
+	return finger1;
+}
+
+static void
+compute_idoms(_jit_cfg_t cfg, int *doms)
+{
+	int change;
+	int index, pred_index;
+	int idom;
+	_jit_node_t node;
+	_jit_node_t pred;
+
+	for(index = 0; index < cfg->num_post_order; index++)
+	{
+		doms[index] = -1;
+	}
+	doms[cfg->num_post_order - 1] = cfg->num_post_order - 1;
+
+	do
+	{
+		change = 0;
+		for(index = cfg->num_post_order - 2; index >= 0; index--)
+		{
+			node = cfg->post_order[index];
+			idom = -1;
+			for(pred_index = 0; pred_index < node->block->num_preds; pred_index++)
+			{
+				pred = _jit_cfg_get_node(cfg, node->block->preds[pred_index]->src);
+				if(pred->dfn < 0 || doms[pred->dfn] < 0)
+				{
+					continue;
+				}
+				if(idom < 0)
+				{
+					idom = pred->dfn;
+				}
+				else
+				{
+					idom = intersect(doms, pred->dfn, idom);
+				}
+			}
+			if(doms[index] != idom)
+			{
+				doms[index] = idom;
+				change = 1;
+			}
+		}
+	}
+	while(change);
+}
+
+static int
+compute_frontiers(_jit_cfg_t cfg, int *doms)
+{
+	int *count;
+	int pass;
+	int index, pred_index;
+	int runner;
+	_jit_node_t node;
+	_jit_node_t pred;
+	_jit_node_t frontier;
+
+	count = jit_calloc(cfg->num_post_order, sizeof(int));
+	if(!count)
+	{
+		return 0;
+	}
+
+	/* The first pass finds the upper bound of the frontier sizes and
+	   the second one fills the frontier arrays */
+	for(pass = 0; pass < 2; pass++)
+	{
+		for(index = 0; index < cfg->num_post_order; index++)
+		{
+			node = cfg->post_order[index];
+			for(pred_index = 0; pred_index < node->block->num_preds; pred_index++)
+			{
+				pred = _jit_cfg_get_node(cfg, node->block->preds[pred_index]->src);
+				if(pred->dfn < 0)
+				{
+					continue;
+				}
+				for(runner = pred->dfn; runner != doms[index]; runner = doms[runner])
+				{
+					frontier = cfg->post_order[runner];
+					if(pass == 0)
+					{
+						++count[runner];
+					}
+					else if(frontier->num_frontier == 0
+						|| frontier->frontier[frontier->num_frontier - 1] != node)
+					{
+						frontier->frontier[frontier->num_frontier++] = node;
+					}
+				}
+			}
+		}
+
+		if(pass == 0)
+		{
+			for(index = 0; index < cfg->num_post_order; index++)
+			{
+				if(count[index] == 0)
+				{
+					continue;
+				}
+				node = cfg->post_order[index];
+				node->frontier = jit_malloc(count[index] * sizeof(_jit_node_t));
+				if(!node->frontier)
+				{
+					jit_free(count);
+					return 0;
+				}
+			}
+		}
+	}
+
+	jit_free(count);
+	return 1;
+}
+
+static void
+extend_range(_jit_value_entry_t entry, int start, int end)
+{
+	if(entry->start < 0 || start < entry->start)
+	{
+		entry->start = start;
+	}
+	if(end > entry->end)
+	{
+		entry->end = end;
+	}
+}
+
+static void
+free_loops(_jit_cfg_t cfg)
 {
 	int index;
 
@@ -684,20 +599,125 @@ _jit_cfg_free(_jit_cfg_t cfg)
 	{
 		for(index = 0; index < cfg->num_nodes; index++)
 		{
-			if(cfg->nodes[index].succs)
+			cfg->nodes[index].loop = 0;
+		}
+	}
+	if(cfg->loops)
+	{
+		for(index = 0; index < cfg->num_loops; index++)
+		{
+			_jit_bitset_free(&cfg->loops[index].body);
+		}
+		jit_free(cfg->loops);
+		cfg->loops = 0;
+	}
+	cfg->num_loops = 0;
+}
+
+/*
+ * Count the back edges that enter the node.  These come from the
+ * nodes that the node dominates.
+ */
+static int
+count_back_edges(_jit_cfg_t cfg, _jit_node_t node)
+{
+	_jit_node_t pred;
+	int index, count;
+
+	count = 0;
+	for(index = 0; index < node->block->num_preds; index++)
+	{
+		pred = _jit_cfg_get_node(cfg, node->block->preds[index]->src);
+		if(pred->dfn >= 0 && _jit_cfg_dominates(node, pred))
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+/*
+ * Collect the body of the loop walking backwards from the sources of
+ * the back edges up to the header.
+ */
+static void
+build_loop_body(_jit_cfg_t cfg, _jit_loop_t loop, _jit_node_t *stack)
+{
+	_jit_node_t node, pred;
+	int index, top;
+
+	_jit_bitset_set_bit(&loop->body, loop->header->block->index);
+	loop->num_nodes = 1;
+
+	top = 0;
+	stack[top++] = loop->header;
+	while(top > 0)
+	{
+		node = stack[--top];
+		for(index = 0; index < node->block->num_preds; index++)
+		{
+			pred = _jit_cfg_get_node(cfg, node->block->preds[index]->src);
+			if(pred->dfn < 0
+			   || _jit_bitset_test_bit(&loop->body, pred->block->index))
 			{
-				jit_free(cfg->nodes[index].succs);
+				continue;
 			}
-			if(cfg->nodes[index].preds)
+			if(node == loop->header && !_jit_cfg_dominates(node, pred))
 			{
-				jit_free(cfg->nodes[index].preds);
+				/* Entering edge */
+				continue;
 			}
+			_jit_bitset_set_bit(&loop->body, pred->block->index);
+			++(loop->num_nodes);
+			stack[top++] = pred;
 		}
-		jit_free(cfg->nodes);
 	}
-	if(cfg->edges)
+}
+
+/*
+ * Find the only node outside of the loop that enters the loop.
+ */
+static _jit_node_t
+find_preheader(_jit_cfg_t cfg, _jit_loop_t loop)
+{
+	_jit_node_t node, pred;
+	int index;
+
+	node = 0;
+	for(index = 0; index < loop->header->block->num_preds; index++)
+	{
+		pred = _jit_cfg_get_node(cfg, loop->header->block->preds[index]->src);
+		if(_jit_bitset_test_bit(&loop->body, pred->block->index))
+		{
+			continue;
+		}
+		if(node)
+		{
+			return 0;
+		}
+		node = pred;
+	}
+	if(!node || node->dfn < 0 || node->block->num_succs != 1
+	   || node->block->succs[0]->flags == _JIT_EDGE_EXCEPT)
+	{
+		return 0;
+	}
+	return node;
+}
+
+void
+_jit_cfg_free(_jit_cfg_t cfg)
+{
+	int index;
+
+	free_loops(cfg);
+	if(cfg->nodes)
 	{
-		jit_free(cfg->edges);
+		for(index = 0; index < cfg->num_nodes; index++)
+		{
+			free_node(&cfg->nodes[index]);
+		}
+		jit_free(cfg->nodes);
 	}
 	if(cfg->post_order)
 	{
@@ -705,10 +725,13 @@ _jit_cfg_free(_jit_cfg_t cfg)
 	}
 	if(cfg->values)
 	{
+		/* Make the values available for the next analysis */
+		for(index = 0; index < cfg->num_values; index++)
+		{
+			cfg->values[index].value->index = -1;
+		}
 		jit_free(cfg->values);
 	}
-	jit_free(cfg->entry);
-	jit_free(cfg->exit);
 	jit_free(cfg);
 }
 
@@ -722,12 +745,7 @@ _jit_cfg_build(jit_function_t func)
 	{
 		return 0;
 	}
-	if(!build_nodes(cfg, func) || !build_edges(cfg, func))
-	{
-		_jit_cfg_free(cfg);
-		return 0;
-	}
-	if(!compute_depth_first_order(cfg))
+	if(!build_nodes(cfg, func) || !compute_depth_first_order(cfg))
 	{
 		_jit_cfg_free(cfg);
 		return 0;
@@ -743,3 +761,219 @@ _jit_cfg_compute_liveness(_jit_cfg_t cfg)
 		&& compute_local_live_sets(cfg)
 		&& compute_global_live_sets(cfg));
 }
+
+int
+_jit_cfg_add_value(_jit_cfg_t cfg, jit_value_t value)
+{
+	return create_value_entry(cfg, value);
+}
+
+int
+_jit_cfg_compute_dominators(_jit_cfg_t cfg)
+{
+	int *doms;
+	int index;
+	_jit_node_t node;
+
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		node = &cfg->nodes[index];
+		node->idom = 0;
+		if(node->frontier)
+		{
+			jit_free(node->frontier);
+			node->frontier = 0;
+		}
+		node->num_frontier = 0;
+	}
+	if(cfg->num_post_order == 0)
+	{
+		return 1;
+	}
+
+	doms = jit_malloc(cfg->num_post_order * sizeof(int));
+	if(!doms)
+	{
+		return 0;
+	}
+
+	compute_idoms(cfg, doms);
+	for(index = 0; index < cfg->num_post_order - 1; index++)
+	{
+		cfg->post_order[index]->idom = cfg->post_order[doms[index]];
+	}
+
+	if(!compute_frontiers(cfg, doms))
+	{
+		jit_free(doms);
+		return 0;
+	}
+
+	jit_free(doms);
+	return 1;
+}
+
+int
+_jit_cfg_dominates(_jit_node_t dom, _jit_node_t node)
+{
+	while(node)
+	{
+		if(node == dom)
+		{
+			return 1;
+		}
+		node = node->idom;
+	}
+	return 0;
+}
+
+int
+_jit_cfg_find_loops(_jit_cfg_t cfg)
+{
+	_jit_node_t *stack;
+	_jit_node_t node;
+	_jit_loop_t loop;
+	struct _jit_loop temp;
+	int index, loop_index, num_loops;
+
+	free_loops(cfg);
+
+	num_loops = 0;
+	for(index = 0; index < cfg->num_post_order; index++)
+	{
+		if(count_back_edges(cfg, cfg->post_order[index]) > 0)
+		{
+			++num_loops;
+		}
+	}
+	if(num_loops == 0)
+	{
+		return 1;
+	}
+
+	cfg->loops = jit_calloc(num_loops, sizeof(struct _jit_loop));
+	if(!cfg->loops)
+	{
+		return 0;
+	}
+	stack = jit_malloc(cfg->num_nodes * sizeof(_jit_node_t));
+	if(!stack)
+	{
+		return 0;
+	}
+
+	/* There is one loop for every header no matter how many back
+	   edges reach it */
+	for(index = 0; index < cfg->num_post_order; index++)
+	{
+		node = cfg->post_order[index];
+		if(count_back_edges(cfg, node) == 0)
+		{
+			continue;
+		}
+		loop = &cfg->loops[cfg->num_loops++];
+		loop->header = node;
+		if(!_jit_bitset_allocate(&loop->body, cfg->num_nodes))
+		{
+			jit_free(stack);
+			return 0;
+		}
+		build_loop_body(cfg, loop, stack);
+	}
+	jit_free(stack);
+
+	/* Put the inner loops first, a loop has more nodes than any of
+	   the loops nested in it */
+	for(index = 1; index < num_loops; index++)
+	{
+		temp = cfg->loops[index];
+		for(loop_index = index; loop_index > 0; loop_index--)
+		{
+			if(cfg->loops[loop_index - 1].num_nodes <= temp.num_nodes)
+			{
+				break;
+			}
+			cfg->loops[loop_index] = cfg->loops[loop_index - 1];
+		}
+		cfg->loops[loop_index] = temp;
+	}
+
+	for(index = 0; index < num_loops; index++)
+	{
+		loop = &cfg->loops[index];
+		for(loop_index = index + 1; loop_index < num_loops; loop_index++)
+		{
+			if(_jit_bitset_test_bit(&cfg->loops[loop_index].body,
+						loop->header->block->index))
+			{
+				loop->parent = &cfg->loops[loop_index];
+				break;
+			}
+		}
+		for(loop_index = 0; loop_index < cfg->num_nodes; loop_index++)
+		{
+			if(!cfg->nodes[loop_index].loop
+			   && _jit_bitset_test_bit(&loop->body, loop_index))
+			{
+				cfg->nodes[loop_index].loop = loop;
+			}
+		}
+		loop->preheader = find_preheader(cfg, loop);
+	}
+	for(index = num_loops - 1; index >= 0; index--)
+	{
+		loop = &cfg->loops[index];
+		loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+	}
+
+	return 1;
+}
+
+void
+_jit_cfg_compute_live_ranges(_jit_cfg_t cfg)
+{
+	int index, bit, pos;
+	_jit_node_t node;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+
+	pos = 0;
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		node = &cfg->nodes[index];
+		node->start = pos;
+		jit_insn_iter_init(&iter, node->block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if((value = _jit_cfg_get_dest(insn)) != 0)
+			{
+				extend_range(&cfg->values[value->index], pos, pos);
+			}
+			if((value = _jit_cfg_get_value1(insn)) != 0)
+			{
+				extend_range(&cfg->values[value->index], pos, pos);
+			}
+			if((value = _jit_cfg_get_value2(insn)) != 0)
+			{
+				extend_range(&cfg->values[value->index], pos, pos);
+			}
+			++pos;
+		}
+		node->end = pos;
+
+		/* Values that are live on entry or exit cover the whole
+		   beginning or end of the node */
+		for(bit = 0; bit < cfg->num_values; bit++)
+		{
+			if(_jit_bitset_test_bit(&node->live_in, bit))
+			{
+				extend_range(&cfg->values[bit], node->start, node->start);
+			}
+			if(_jit_bitset_test_bit(&node->live_out, bit))
+			{
+				extend_range(&cfg->values[bit], node->end, node->end);
+			}
+		}
+	}
+}
@@ -20,47 +20,52 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+
 #ifndef	_JIT_CFG_H
 #define	_JIT_CFG_H
 
-#include <config.h>
 #include "jit-bitset.h"
 
-#define _JIT_BLOCK_CFG_NODE 10010
-
 #define _JIT_NODE_VISITED 1
 
 typedef struct _jit_cfg *_jit_cfg_t;
 typedef struct _jit_node *_jit_node_t;
-typedef struct _jit_edge *_jit_edge_t;
 typedef struct _jit_value_entry *_jit_value_entry_t;
+typedef struct _jit_phi *_jit_phi_t;
+typedef struct _jit_loop *_jit_loop_t;
 
 /*
- * Control flow graph.
+ * Control flow graph.  This is a data flow analysis overlay on top of
+ * the function's blocks.  The edges are those built by the function
+ * _jit_block_build_cfg() and are reached through the node's block.
  */
 struct _jit_cfg
 {
 	jit_function_t		func;
 
-	/* Special nodes */
-	_jit_node_t		entry;
-	_jit_node_t		exit;
-
-	/* Array of nodes */
+	/* Array of nodes, one for each block in the function's linear block
+	   list.  The first node is for the entry block and the last one is
+	   for the exit block.  The index of a block's node is stored in the
+	   block's "index" field */
 	_jit_node_t		nodes;
 	int			num_nodes;
 
-	/* Array of edges */
-	_jit_edge_t		edges;
-	int			num_edges;
-
-	/* depth first search post order. */
+	/* depth first search post order of the reachable nodes. */
 	_jit_node_t		*post_order;
+	int			num_post_order;
 
 	/* values */
 	_jit_value_entry_t	values;
 	int			num_values;
 	int			max_values;
+
+	/* Set if the instructions are in SSA form */
+	int			in_ssa;
+
+	/* Natural loops ordered so that inner loops go before the loops
+	   that contain them */
+	_jit_loop_t		loops;
+	int			num_loops;
 };
 
 /*
@@ -71,32 +76,33 @@ struct _jit_node
 	jit_block_t		block;
 	int			flags;
 
-	/* edges to successor nodes */
-	_jit_edge_t		*succs;
-	int			num_succs;
-
-	/* edges to predecessor nodes */
-	_jit_edge_t		*preds;
-	int			num_preds;
-
 	/* liveness analysis data */
 	_jit_bitset_t		live_in;
 	_jit_bitset_t		live_out;
 	_jit_bitset_t		live_use;
 	_jit_bitset_t		live_def;
 
-	/* depth first search number */
+	/* depth first search number, -1 if the node is unreachable */
 	int			dfn;
-};
 
-/*
- * Control flow graph edge.
- */
-struct _jit_edge
-{
-	_jit_node_t		src;
-	_jit_node_t		dst;
-	int			flags;
+	/* Positions of the node's first instruction and one past its
+	   last instruction in the linear instruction order */
+	int			start;
+	int			end;
+
+	/* Immediate dominator, NULL for the entry node and for
+	   unreachable nodes */
+	_jit_node_t		idom;
+
+	/* Dominance frontier */
+	_jit_node_t		*frontier;
+	int			num_frontier;
+
+	/* Phi functions at the start of the node */
+	_jit_phi_t		phis;
+
+	/* Innermost loop that contains the node, NULL if none */
+	_jit_loop_t		loop;
 };
 
 /*
@@ -106,8 +112,174 @@ struct _jit_edge
 struct _jit_value_entry
 {
 	jit_value_t		value;
-	short			reg;
-	short			other_reg;
+
+	/* The live range of the value in the linear instruction order */
+	int			start;
+	int			end;
+
+	/* The variable that the value is an SSA version of.  This is the
+	   value itself for the original variable and NULL for the values
+	   that are not renamed into SSA form */
+	jit_value_t		var;
 };
 
+/*
+ * Phi function.  The arguments correspond to the predecessor edges
+ * of the node's block in order.
+ */
+struct _jit_phi
+{
+	jit_value_t		dest;
+	jit_value_t		var;
+	jit_value_t		*args;
+	_jit_phi_t		next;
+};
+
+/*
+ * Natural loop.  The body is the set of the indices of the nodes in
+ * the loop, the header included.  The preheader is the only node that
+ * enters the loop if it has no other successor.
+ */
+struct _jit_loop
+{
+	_jit_node_t		header;
+	_jit_node_t		preheader;
+	_jit_loop_t		parent;
+	_jit_bitset_t		body;
+	int			num_nodes;
+	int			depth;
+};
+
+/*
+ * Get the node for a block.
+ */
+#define _jit_cfg_get_node(cfg, block)	(&((cfg)->nodes[(block)->index]))
+
+/*
+ * Build the data flow graph for a function.  The function's blocks must
+ * already have their edges built.  Returns NULL if out of memory.
+ */
+_jit_cfg_t _jit_cfg_build(jit_function_t func);
+
+/*
+ * Free the data flow graph.
+ */
+void _jit_cfg_free(_jit_cfg_t cfg);
+
+/*
+ * Number the values used in the function and compute the live-in and
+ * live-out sets of every node.  Returns zero if out of memory.
+ */
+int _jit_cfg_compute_liveness(_jit_cfg_t cfg);
+
+/*
+ * Compute the live ranges of all values in the linear instruction
+ * order.  This must be called after _jit_cfg_compute_liveness().
+ */
+void _jit_cfg_compute_live_ranges(_jit_cfg_t cfg);
+
+/*
+ * Get the values that are defined or used by an instruction.  NULL is
+ * returned for constants and for operands that are not values.
+ */
+jit_value_t _jit_cfg_get_dest(jit_insn_t insn);
+jit_value_t _jit_cfg_get_value1(jit_insn_t insn);
+jit_value_t _jit_cfg_get_value2(jit_insn_t insn);
+
+/*
+ * Number a value that was created after the data flow graph was built.
+ * Returns zero if out of memory.
+ */
+int _jit_cfg_add_value(_jit_cfg_t cfg, jit_value_t value);
+
+/*
+ * Compute the immediate dominators and the dominance frontiers of
+ * the reachable nodes.  Returns zero if out of memory.
+ */
+int _jit_cfg_compute_dominators(_jit_cfg_t cfg);
+
+/*
+ * Check if the node "dom" dominates the node "node".  The dominators
+ * must have been computed.
+ */
+int _jit_cfg_dominates(_jit_node_t dom, _jit_node_t node);
+
+/*
+ * Find the natural loops and their nesting.  The dominators must have
+ * been computed.  Returns zero if out of memory.
+ */
+int _jit_cfg_find_loops(_jit_cfg_t cfg);
+
+/*
+ * Create a preheader block for every loop that has none.  The graph
+ * has to be built again for the new blocks.  Returns zero if out of
+ * memory.
+ */
+int _jit_cfg_create_preheaders(_jit_cfg_t cfg);
+
+/*
+ * Convert the function's local variables into SSA form.  Phi functions
+ * are kept in the nodes, they are not visible as instructions.  The
+ * function is left unchanged if it cannot be converted, in which case
+ * the in_ssa flag is not set.  Returns zero if out of memory.
+ */
+int _jit_ssa_construct(_jit_cfg_t cfg);
+
+/*
+ * Propagate constants and copies through the function in SSA form.
+ * The instructions whose operands become constant are folded.
+ * Returns zero if out of memory.
+ */
+int _jit_ssa_propagate(_jit_cfg_t cfg);
+
+/*
+ * Replace the relative loads of the memory locations whose contents
+ * are known from the dominating loads and stores with copies of those
+ * contents.  Returns zero if out of memory.
+ */
+int _jit_ssa_eliminate_loads(_jit_cfg_t cfg);
+
+/*
+ * Decide the conditional branches on integer comparisons whose outcome
+ * follows from the dominating branches and the loop bounds, such as the
+ * repeated array bounds checks.  The decided branches are left with a
+ * constant condition for the graph cleanup to fold.  Returns zero if
+ * out of memory.
+ */
+int _jit_ssa_eliminate_checks(_jit_cfg_t cfg);
+
+/*
+ * Check if the instruction is a plain computation without side effects
+ * that cannot throw exceptions.
+ */
+int _jit_insn_is_pure(jit_insn_t insn);
+
+/*
+ * Move the loop invariant computations that cannot throw exceptions
+ * to the loop preheaders.  Returns zero if out of memory.
+ */
+int _jit_ssa_hoist_invariants(_jit_cfg_t cfg);
+
+/*
+ * Replace the values that are derived from the induction variables of
+ * the loops by multiplication with new variables that are incremented
+ * on every iteration instead.  Returns zero if out of memory.
+ */
+int _jit_ssa_reduce_strength(_jit_cfg_t cfg);
+
+/*
+ * Convert the function back from SSA form.  The phi functions are
+ * replaced with copies and the copies are coalesced where the live
+ * ranges of the values do not interfere.  Returns zero if out of memory.
+ */
+int _jit_ssa_destruct(_jit_cfg_t cfg);
+
+/*
+ * Remove the instructions that compute values that are not used
+ * anywhere in the function, including the stores to local variables
+ * that are overwritten before they are read.  The function must not
+ * be in SSA form.  Returns zero if out of memory.
+ */
+int _jit_cfg_eliminate_dead_code(_jit_cfg_t cfg);
+
 #endif
@@ -24,7 +24,9 @@
 #include "jit-internal.h"
 #include "jit-rules.h"
 #include "jit-reg-alloc.h"
+#include "jit-cfg.h"
 #include "jit-setjmp.h"
+#include <stdlib.h>
 #ifdef _JIT_COMPILE_DEBUG
 # include <jit/jit-dump.h>
 # include <stdio.h>
@@ -36,17 +38,59 @@
 typedef struct
 {
 	jit_function_t		func;
+	jit_function_t		inline_body;
 
+	int			codegen_locked;
 	int			memory_locked;
 	int 			memory_started;
 
 	int			restart;
 	int			page_factor;
+	int			evicted;
+
+	jit_nuint		num_insns;
+	jit_nuint		insns_done;
+	jit_nuint		space;
 
 	struct jit_gencode	gen;
 
 } _jit_compile_t;
 
+/*
+ * Upper limit for the JIT_OPTION_COMPILE_THREADS option.
+ */
+#define JIT_MAX_COMPILE_THREADS		64
+
+/*
+ * Space per instruction expected for the first function of a context.
+ * The later ones go by the space that the earlier ones took.
+ */
+#define JIT_SPACE_PER_INSN		16
+
+/*
+ * Number of instructions after which the space taken by the earlier
+ * functions counts half as much.
+ */
+#define JIT_SPACE_HISTORY		65536
+
+/*
+ * Room that the back end checks for before it outputs an instruction,
+ * which the estimate of the space of a function must leave over.
+ */
+#define JIT_SPACE_RESERVE		128
+
+/*
+ * Upper limit for the JIT_OPTION_CODE_ALIGNMENT option.
+ */
+#define JIT_MAX_CODE_ALIGNMENT		4096
+
+/*
+ * How the start of a block is aligned.
+ */
+#define ALIGN_NONE			0
+#define ALIGN_LOOP			1
+#define ALIGN_TARGET			2
+
 #define _JIT_RESULT_TO_OBJECT(x)	((void *) ((jit_nint) (x) - JIT_RESULT_OK))
 #define _JIT_RESULT_FROM_OBJECT(x)	((jit_nint) ((void *) (x)) + JIT_RESULT_OK)
 
@@ -59,6 +103,55 @@ internal_exception_handler(int exception_type)
 	return _JIT_RESULT_TO_OBJECT(exception_type);
 }
 
+/*
+ * Perform the optimizations that work on the whole control flow graph
+ * of the function.
+ */
+static void
+optimize_global(jit_function_t func)
+{
+	_jit_cfg_t cfg;
+
+	cfg = _jit_cfg_build(func);
+	if(!cfg)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+
+	/* Give every loop a preheader for the hoisted code */
+	if(!_jit_cfg_compute_dominators(cfg)
+	   || !_jit_cfg_find_loops(cfg)
+	   || !_jit_cfg_create_preheaders(cfg))
+	{
+		_jit_cfg_free(cfg);
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	if(cfg->num_loops > 0)
+	{
+		_jit_cfg_free(cfg);
+		cfg = _jit_cfg_build(func);
+		if(!cfg)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+	}
+
+	if(!_jit_ssa_construct(cfg)
+	   || !_jit_ssa_propagate(cfg)
+	   || !_jit_ssa_eliminate_loads(cfg)
+	   || !_jit_ssa_eliminate_checks(cfg)
+	   || !_jit_ssa_hoist_invariants(cfg)
+	   || !_jit_ssa_reduce_strength(cfg)
+	   || !_jit_ssa_destruct(cfg)
+	   || !_jit_cfg_eliminate_dead_code(cfg))
+	{
+		_jit_cfg_free(cfg);
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+
+	_jit_cfg_free(cfg);
+}
+
 /*
  * Optimize a function.
  */
@@ -77,6 +170,24 @@ optimize(jit_function_t func)
 	/* Eliminate useless control flow */
 	_jit_block_clean_cfg(func);
 
+	/* Perform global optimizations */
+	if(func->optimization_level >= JIT_OPTLEVEL_HIGH)
+	{
+		/* Keep the locals whose address does not escape in registers */
+		_jit_block_replace_scalars(func);
+
+		optimize_global(func);
+
+		/* Eliminate the branches that became constant */
+		_jit_block_clean_cfg(func);
+
+		/* Unroll the small counted loops if requested */
+		_jit_block_unroll_loops(func, func->unroll_factor);
+
+		/* Hide the latencies of the loads and divisions */
+		_jit_block_schedule_insns(func);
+	}
+
 	/* Optimization is done */
 	func->is_optimized = 1;
 }
@@ -307,7 +418,7 @@ reset_value(jit_value_t value)
 {
 	value->reg = -1;
 	value->in_register = 0;
-	value->in_global_register = 0;
+	value->in_global_register = value->has_global_register;
 	value->in_frame = 0;
 }
 
@@ -378,11 +489,49 @@ cleanup_on_restart(jit_gencode_t gen, jit_function_t func)
 }
 
 /*
- * Acquire the memory context.
+ * Acquire the right to compile a function.  The functions compiled on
+ * demand are compiled without the builder lock, but the optimizer and
+ * the code generator share the context options, the inline bodies and
+ * the code space with the other functions, so only one function of a
+ * context at a time may be compiled.
+ */
+static void
+codegen_acquire(_jit_compile_t *state)
+{
+	if(!state->codegen_locked)
+	{
+		jit_mutex_lock(&state->func->context->codegen_lock);
+		state->codegen_locked = 1;
+	}
+}
+
+/*
+ * Release the right to generate code.
+ */
+static void
+codegen_release(_jit_compile_t *state)
+{
+	if(state->codegen_locked)
+	{
+		jit_mutex_unlock(&state->func->context->codegen_lock);
+		state->codegen_locked = 0;
+	}
+}
+
+/*
+ * Acquire the memory context.  The lock is only held while the code
+ * space is handed out and given back, the code generation itself runs
+ * without it.
  */
 static void
 memory_acquire(_jit_compile_t *state)
 {
+	/* Bail out if the lock is already acquired */
+	if(state->memory_locked)
+	{
+		return;
+	}
+
 	/* Store the function's context as codegen context */
 	state->gen.context = state->func->context;
 
@@ -432,7 +581,7 @@ memory_align(_jit_compile_t *state, int align, int diff, int nop)
 	/* Determine the location of the next alignment boundary */
 	p = (jit_nuint) state->gen.ptr;
 	n = (p + (jit_nuint) align - 1) & ~((jit_nuint) align - 1);
-	if(p == n || (p - n) >= (jit_nuint) diff)
+	if(p == n || (n - p) >= (jit_nuint) diff)
 	{
 		return;
 	}
@@ -448,8 +597,8 @@ memory_align(_jit_compile_t *state, int align, int diff, int nop)
 	_jit_pad_buffer(state->gen.ptr, align);
 #else
 	jit_memset(state->gen.ptr, nop, align);
-	state->gen.ptr += align;
 #endif
+	state->gen.ptr += align;
 }
 
 /*
@@ -464,6 +613,11 @@ memory_start(_jit_compile_t *state)
 	/* Store the bounds of the available space */
 	state->gen.mem_start = _jit_memory_get_break(state->gen.context);
 	state->gen.mem_limit = _jit_memory_get_limit(state->gen.context); 
+	state->space = state->gen.mem_limit - state->gen.mem_start;
+
+	/* The code is written here, but it runs from another address
+	   if the memory context maps it twice */
+	state->gen.exec_offset = state->gen.context->exec_offset;
 
 	/* Align the function code start as required */
 	state->gen.ptr = state->gen.mem_start;
@@ -473,6 +627,192 @@ memory_start(_jit_compile_t *state)
 	_jit_varint_init_encoder(&state->gen.offset_encoder);
 }
 
+/*
+ * Check if the code of a function may be thrown away and compiled
+ * again on demand.  It must be called through the indirector, and
+ * the redirector must still be there to compile it.
+ */
+static int
+can_evict(jit_function_t func)
+{
+#if !defined(JIT_BACKEND_INTERP) && defined(jit_redirector_size) && defined(jit_indirector_size)
+	return func->is_compiled && func->is_recompilable && func->on_demand
+		&& !func->builder && !func->is_queued && !func->is_compiling
+		&& !func->nested_parent
+		&& func->entry_point != func->redirector;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Order the functions from the least recently used one.
+ */
+static int
+compare_last_use(const void *f1, const void *f2)
+{
+	jit_function_t func1 = *((jit_function_t *) f1);
+	jit_function_t func2 = *((jit_function_t *) f2);
+
+	if(func1->last_use != func2->last_use)
+	{
+		return (func1->last_use < func2->last_use) ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Evict the least recently used functions other than "keep" until
+ * the size of the code of the context drops to "target".  The code
+ * is retired, and its memory is reclaimed once no thread can run it.
+ * The caller must hold both the builder and the memory lock.  Returns
+ * non-zero if any function was evicted.
+ */
+static int
+evict_code(jit_context_t context, jit_function_t keep, jit_nuint target)
+{
+#if !defined(JIT_BACKEND_INTERP) && defined(jit_redirector_size) && defined(jit_indirector_size)
+	jit_function_t *candidates;
+	jit_function_t func;
+	void *entry_point;
+	jit_nuint clock;
+	int num_candidates;
+	int index;
+
+	if(!jit_context_get_meta_numeric(context, JIT_OPTION_CODE_BUDGET)
+	   || !jit_context_get_meta_numeric(context, JIT_OPTION_RECLAIM_CODE))
+	{
+		return 0;
+	}
+
+	/* The functions that ran since the cold functions were last looked
+	   for are used more recently than any function compiled before */
+	clock = ++(context->code_clock);
+	for(func = context->functions; func; func = func->next)
+	{
+		if(func->use_mark)
+		{
+			func->use_mark = 0;
+			func->last_use = clock;
+		}
+	}
+
+	/* Collect the functions that may be evicted */
+	num_candidates = 0;
+	for(func = context->functions; func; func = func->next)
+	{
+		if(func != keep && can_evict(func))
+		{
+			++num_candidates;
+		}
+	}
+	if(num_candidates == 0)
+	{
+		return 0;
+	}
+	candidates = (jit_function_t *) jit_malloc(num_candidates * sizeof(jit_function_t));
+	if(!candidates)
+	{
+		return 0;
+	}
+	num_candidates = 0;
+	for(func = context->functions; func; func = func->next)
+	{
+		if(func != keep && can_evict(func))
+		{
+			candidates[num_candidates++] = func;
+		}
+	}
+	qsort(candidates, num_candidates, sizeof(jit_function_t), compare_last_use);
+
+	/* Point the functions back at their redirectors, so that the next
+	   call compiles them again, and retire their code */
+	for(index = 0; index < num_candidates && context->code_size > target; ++index)
+	{
+		func = candidates[index];
+		entry_point = func->entry_point;
+		func->entry_point = func->redirector;
+		func->is_compiled = 0;
+		context->code_size -= func->code_size;
+		func->code_size = 0;
+		_jit_memory_retire_code(context, entry_point);
+	}
+
+	jit_free(candidates);
+	return (index > 0);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Estimate the space that the code and data of the function take,
+ * from the space per instruction that the functions compiled before
+ * took.  After a restart, extrapolate from the blocks that were
+ * compiled before the space ran out instead.  A quarter is added to
+ * the estimate, so that a function rarely has to be generated twice.
+ */
+static jit_nuint
+memory_estimate(_jit_compile_t *state)
+{
+	jit_context_t context = state->gen.context;
+	jit_ulong size;
+
+	if(state->restart)
+	{
+		if(state->insns_done == 0)
+		{
+			size = (jit_ulong) state->space * 2;
+		}
+		else
+		{
+			size = (jit_ulong) state->space * state->num_insns / state->insns_done;
+		}
+	}
+	else if(context->gen_insns > 0)
+	{
+		size = (jit_ulong) state->num_insns * context->gen_space / context->gen_insns;
+	}
+	else
+	{
+		size = (jit_ulong) state->num_insns * JIT_SPACE_PER_INSN;
+	}
+	size += size / 4 + JIT_SPACE_RESERVE;
+	if(size > (jit_size_t) -1)
+	{
+		size = (jit_size_t) -1;
+	}
+	return (jit_nuint) size;
+}
+
+/*
+ * Extend the memory limit and start the function again.  If the
+ * cache is full then evict the cold functions once and retry.  The
+ * functions can only be evicted with the builder lock, which is not
+ * held while a function is compiled on demand.
+ */
+static int
+memory_extend(_jit_compile_t *state)
+{
+	jit_context_t context = state->gen.context;
+	int count = state->page_factor++;
+	int result;
+
+	_jit_memory_extend_limit(context, count);
+	result = _jit_memory_start_function(context, state->func);
+	if(result != JIT_MEMORY_OK && !state->evicted && !state->func->is_compiling)
+	{
+		state->evicted = 1;
+		if(evict_code(context, state->func,
+			      context->code_size - context->code_size / 4))
+		{
+			_jit_memory_extend_limit(context, count);
+			result = _jit_memory_start_function(context, state->func);
+		}
+	}
+	return result;
+}
+
 /*
  * Allocate some amount of code space.
  */
@@ -481,13 +821,14 @@ memory_alloc(_jit_compile_t *state)
 {
 	int result;
 
-	/* Try to allocate within the current memory limit */
+	/* Try to allocate within the current memory limit, or on a new
+	   page if the function is not expected to fit there */
+	_jit_memory_set_size_hint(state->gen.context, memory_estimate(state));
 	result = _jit_memory_start_function(state->gen.context, state->func);
 	if(result == JIT_MEMORY_RESTART)
 	{
 		/* Not enough space. Request to extend the limit and retry */
-		_jit_memory_extend_limit(state->gen.context, state->page_factor++);
-		result = _jit_memory_start_function(state->gen.context, state->func);
+		result = memory_extend(state);
 	}
 	if(result != JIT_MEMORY_OK)
 	{
@@ -505,6 +846,7 @@ memory_alloc(_jit_compile_t *state)
 static void
 memory_flush(_jit_compile_t *state)
 {
+	jit_context_t context;
 	int result;
 
 	if(state->memory_started)
@@ -534,9 +876,21 @@ memory_flush(_jit_compile_t *state)
 			}
 		}
 
+		/* Remember the space that the function took for the estimate
+		   of the next ones, weighing the recent functions more */
+		context = state->gen.context;
+		context->gen_space += state->space
+			- (state->gen.mem_limit - state->gen.code_end);
+		context->gen_insns += state->num_insns;
+		if(context->gen_insns > JIT_SPACE_HISTORY)
+		{
+			context->gen_space /= 2;
+			context->gen_insns /= 2;
+		}
+
 #ifndef JIT_BACKEND_INTERP
 		/* On success perform a CPU cache flush, to make the code executable */
-		_jit_flush_exec(state->gen.code_start,
+		_jit_flush_exec(state->gen.code_start + state->gen.exec_offset,
 			        state->gen.code_end - state->gen.code_start);
 #endif
 
@@ -549,6 +903,15 @@ memory_flush(_jit_compile_t *state)
 	}
 }
 
+/*
+ * Get the entry point of the generated code, as it is seen by callers.
+ */
+static void *
+memory_entry(_jit_compile_t *state)
+{
+	return state->gen.code_start + state->gen.exec_offset;
+}
+
 /*
  * Give back the allocated space in case of failure to generate the code.
  */
@@ -578,9 +941,10 @@ memory_realloc(_jit_compile_t *state)
 	/* Release the previously allocated code space */
 	memory_abort(state);
 
-	/* Request to extend memory limit and retry space allocation */
-	_jit_memory_extend_limit(state->gen.context, state->page_factor++);
-	result = _jit_memory_start_function(state->gen.context, state->func);
+	/* Request to extend memory limit and retry space allocation, with
+	   room enough for the rest of the function this time */
+	_jit_memory_set_size_hint(state->gen.context, memory_estimate(state));
+	result = memory_extend(state);
 	if(result != JIT_MEMORY_OK)
 	{
 		/* Failed to allocate enough space */
@@ -592,20 +956,57 @@ memory_realloc(_jit_compile_t *state)
 }
 
 /*
- * Prepare function info needed for code generation.
+ * Place the blocks by the counts collected by the previous compilation
+ * of the function.  If there are none and the function may be compiled
+ * again then count the blocks in this compilation.
  */
 static void
-codegen_prepare(_jit_compile_t *state)
+profile(jit_function_t func)
 {
-	/* Intuit "nothrow" and "noreturn" flags for this function */
-	if(!state->func->builder->may_throw)
+	if(func->optimization_level == JIT_OPTLEVEL_NONE || func->has_try)
 	{
-		state->func->no_throw = 1;
+		return;
+	}
+	if(func->block_counts)
+	{
+		_jit_block_layout_by_counts(func);
 	}
-	if(!state->func->builder->ordinary_return)
+	else if(func->is_recompilable
+		&& jit_context_get_meta_numeric(func->context, JIT_OPTION_BLOCK_PROFILE))
 	{
-		state->func->no_return = 1;
+		_jit_block_add_counters(func);
 	}
+}
+
+/*
+ * Make the code of a function that may be evicted mark every run of
+ * it, so that a function that is called often is not taken for a cold
+ * one because it was compiled long ago.
+ */
+static void
+track_use(jit_function_t func)
+{
+#if !defined(JIT_BACKEND_INTERP) && defined(jit_redirector_size) && defined(jit_indirector_size)
+	if(func->is_recompilable && func->on_demand && !func->nested_parent
+	   && jit_context_get_meta_numeric(func->context, JIT_OPTION_CODE_BUDGET)
+	   && jit_context_get_meta_numeric(func->context, JIT_OPTION_RECLAIM_CODE))
+	{
+		_jit_block_add_use_mark(func, (jit_int *) &(func->use_mark));
+	}
+#endif
+}
+
+/*
+ * Prepare function info needed for code generation.
+ */
+static void
+codegen_prepare(_jit_compile_t *state)
+{
+	jit_block_t block;
+
+	/* Intuit "nothrow" and "noreturn" flags for this function */
+	state->func->no_throw = !state->func->builder->may_throw;
+	state->func->no_return = !state->func->builder->ordinary_return;
 
 	/* Compute liveness and "next use" information for this function */
 	_jit_function_compute_liveness(state->func);
@@ -614,6 +1015,137 @@ codegen_prepare(_jit_compile_t *state)
 #ifndef JIT_BACKEND_INTERP
 	_jit_regs_alloc_global(&state->gen, state->func);
 #endif
+
+	/* Count the instructions to estimate the space the code takes */
+	state->num_insns = 0;
+	block = 0;
+	while((block = jit_block_next(state->func, block)) != 0)
+	{
+		state->num_insns += block->num_insns;
+	}
+}
+
+/*
+ * Get the alignment of the function entry and the branch targets.
+ */
+static int
+get_code_alignment(jit_function_t func)
+{
+#if defined(JIT_CODE_ALIGNMENT) && defined(jit_should_pad)
+	jit_nint align;
+
+	align = jit_context_get_meta_numeric(func->context, JIT_OPTION_CODE_ALIGNMENT);
+	if(align <= 0)
+	{
+		return JIT_CODE_ALIGNMENT;
+	}
+	if(align > JIT_MAX_CODE_ALIGNMENT)
+	{
+		return JIT_MAX_CODE_ALIGNMENT;
+	}
+
+	/* Round down to a power of two */
+	while((align & (align - 1)) != 0)
+	{
+		align &= align - 1;
+	}
+	return (int) align;
+#else
+	return 1;
+#endif
+}
+
+/*
+ * Mark the blocks whose start is worth aligning.  These are the loop
+ * headers, which are the targets of the branches from the same or a
+ * later block, and the branch targets that follow a block that does
+ * not fall through.  A loop header is left alone if the code that
+ * falls into it is reached from within the loop as the padding would
+ * then be executed on every iteration.  This happens when the block
+ * layout rotates a loop.
+ */
+static void
+mark_aligned_blocks(jit_function_t func)
+{
+	jit_block_t block;
+	jit_block_t target;
+	jit_insn_t insn;
+	int *last_source;
+	int num_blocks;
+
+	num_blocks = 0;
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		block->index = num_blocks++;
+		block->visited = 0;
+		if(block->prev && block->prev->ends_in_dead
+		   && block->label != jit_label_undefined)
+		{
+			block->align = ALIGN_TARGET;
+		}
+		else
+		{
+			block->align = ALIGN_NONE;
+		}
+	}
+
+	/* The index of the last block that branches to each block */
+	last_source = jit_malloc(num_blocks * sizeof(int));
+	if(last_source)
+	{
+		jit_memset(last_source, -1, num_blocks * sizeof(int));
+	}
+
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		block->visited = 1;
+		insn = _jit_block_get_last(block);
+		if(insn && (insn->flags & JIT_INSN_DEST_IS_LABEL) != 0)
+		{
+			target = jit_block_from_label(func, (jit_label_t) insn->dest);
+			if(target && target->visited)
+			{
+				target->align = ALIGN_LOOP;
+			}
+			if(target && last_source)
+			{
+				last_source[target->index] = block->index;
+			}
+		}
+	}
+	if(!last_source)
+	{
+		return;
+	}
+
+	/* Find the first branch target on the fall through path into each
+	   loop header and check if it is branched to from the loop */
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		if(block->align != ALIGN_LOOP)
+		{
+			continue;
+		}
+		target = block->prev;
+		while(target && !target->ends_in_dead)
+		{
+			if(last_source[target->index] >= block->index)
+			{
+				block->align = ALIGN_NONE;
+				break;
+			}
+			if(last_source[target->index] >= 0)
+			{
+				break;
+			}
+			target = target->prev;
+		}
+	}
+
+	jit_free(last_source);
 }
 
 /*
@@ -630,6 +1162,13 @@ codegen(_jit_compile_t *state)
 	   the available space start - gen->start) */
 	gen->code_start = gen->ptr;
 
+	/* Find the blocks that are padded to the code alignment */
+	gen->code_alignment = get_code_alignment(func);
+	if(gen->code_alignment > 1)
+	{
+		mark_aligned_blocks(func);
+	}
+
 #ifdef JIT_PROLOG_SIZE
 	/* Output space for the function prolog */
 	_jit_gen_check_space(gen, JIT_PROLOG_SIZE);
@@ -637,9 +1176,21 @@ codegen(_jit_compile_t *state)
 #endif
 
 	/* Generate code for the blocks in the function */
+	state->insns_done = 0;
 	block = 0;
 	while((block = jit_block_next(func, block)) != 0)
 	{
+		/* Align the loop headers always, and the other branch targets
+		   unless that wastes too much space */
+		if(gen->code_alignment > 1 && block->align == ALIGN_LOOP)
+		{
+			memory_align(state, gen->code_alignment, gen->code_alignment, 0);
+		}
+		else if(gen->code_alignment > 1 && block->align == ALIGN_TARGET)
+		{
+			memory_align(state, gen->code_alignment, gen->code_alignment / 2, 0);
+		}
+
 		/* Notify the back end that the block is starting */
 		_jit_gen_start_block(gen, block);
 
@@ -658,6 +1209,7 @@ codegen(_jit_compile_t *state)
 
 		/* Notify the back end that the block is finished */
 		_jit_gen_end_block(gen, block);
+		state->insns_done += block->num_insns;
 	}
 
 	/* Output the function epilog.  All return paths will jump to here */
@@ -697,6 +1249,9 @@ compile(_jit_compile_t *state, jit_function_t func)
 	jit_memzero(state, sizeof(_jit_compile_t));
 	state->func = func;
 
+	/* Compile one function of the context at a time */
+	codegen_acquire(state);
+
 	/* Replace user's exception handler with internal handler */
 	handler = jit_exception_set_handler(internal_exception_handler);
 
@@ -718,7 +1273,12 @@ compile(_jit_compile_t *state, jit_function_t func)
 		}
 
 		/* Release allocated code space and exit */
+		if(state->memory_started)
+		{
+			memory_acquire(state);
+		}
 		memory_abort(state);
+		_jit_function_free_inline_body(state->inline_body);
 		goto exit;
 	}
 
@@ -726,15 +1286,29 @@ compile(_jit_compile_t *state, jit_function_t func)
 	{
 		/* Start compilation */
 
+		/* Keep a copy of a small body to inline into the functions
+		   built later, now that the build of this one is finished */
+		if(!state->func->inline_body)
+		{
+			state->inline_body = _jit_function_copy_inline_body(state->func);
+		}
+
 		/* Perform machine-independent optimizations */
 		optimize(state->func);
 
+		/* Lay out the blocks by the profile, or collect one */
+		profile(state->func);
+
+		/* Mark the runs of a function that may be evicted */
+		track_use(state->func);
+
 		/* Prepare data needed for code generation */
 		codegen_prepare(state);
 
 		/* Allocate some space */
 		memory_acquire(state);
 		memory_alloc(state);
+		memory_release(state);
 	}
 	else
 	{
@@ -744,7 +1318,9 @@ compile(_jit_compile_t *state, jit_function_t func)
 		cleanup_on_restart(&state->gen, state->func);
 
 		/* Allocate more space */
+		memory_acquire(state);
 		memory_realloc(state);
+		memory_release(state);
 	}
 
 #ifdef _JIT_COMPILE_DEBUG
@@ -775,14 +1351,23 @@ compile(_jit_compile_t *state, jit_function_t func)
 #endif
 
 	/* End the function's output process */
+	memory_acquire(state);
 	memory_flush(state);
 
+	/* Publish the copy of the body only once it is complete */
+	if(state->inline_body)
+	{
+		jit_barrier_store();
+		state->func->inline_body = state->inline_body;
+	}
+
 	/* Compilation done, no exceptions occurred */
 	result = JIT_RESULT_OK;
 
  exit:
 	/* Release the memory context */
 	memory_release(state);
+	codegen_release(state);
 
 	/* Restore the "setjmp" context */
 	_jit_unwind_pop_setjmp();
@@ -793,6 +1378,68 @@ compile(_jit_compile_t *state, jit_function_t func)
 	return result;
 }
 
+/*
+ * Make the newly compiled code the entry point of the function.  The
+ * code that a recompiled function no longer uses is handed over to the
+ * memory manager, as the recompilable functions are always called
+ * through the indirector.
+ */
+static void
+install_code(jit_function_t func, void *entry_point)
+{
+	jit_context_t context = func->context;
+	jit_function_info_t info;
+	void *old_entry;
+
+	old_entry = func->is_compiled ? func->entry_point : 0;
+	func->entry_point = entry_point;
+	func->is_compiled = 1;
+
+	_jit_memory_lock(context);
+	context->code_size -= func->code_size;
+	if(old_entry && old_entry != entry_point && func->is_recompilable)
+	{
+		_jit_memory_retire_code(context, old_entry);
+	}
+	info = _jit_memory_find_function_info(context, entry_point);
+	if(info)
+	{
+		func->code_size = (unsigned char *) _jit_memory_get_function_end(context, info)
+			- (unsigned char *) _jit_memory_get_function_start(context, info);
+	}
+	else
+	{
+		func->code_size = 0;
+	}
+	context->code_size += func->code_size;
+	func->last_use = ++(context->code_clock);
+	_jit_memory_unlock(context);
+}
+
+/*
+ * Evict the cold functions other than "func" if the code of the context
+ * has grown past the budget.  The caller must hold the builder lock.
+ */
+static void
+evict_over_budget(jit_function_t func)
+{
+	jit_context_t context = func->context;
+	jit_nuint budget;
+
+	/* Evict down to three quarters of the budget, so that it does
+	   not have to be done again for every function compiled next */
+	budget = jit_context_get_meta_numeric(context, JIT_OPTION_CODE_BUDGET);
+	if(budget)
+	{
+		_jit_memory_lock(context);
+		if(context->code_size > budget)
+		{
+			evict_code(context, func, budget - budget / 4);
+		}
+		_jit_memory_unlock(context);
+	}
+}
+
 /*@
  * @deftypefun int jit_compile (jit_function_t @var{func})
  * Compile a function to its executable form.  If the function was
@@ -821,6 +1468,9 @@ jit_compile(jit_function_t func)
 		return JIT_RESULT_NULL_FUNCTION;
 	}
 
+	/* Let a compilation on another thread finish first */
+	_jit_function_wait_compile(func);
+
 	/* Bail out if there is nothing to do here */
 	if(!func->builder)
 	{
@@ -840,8 +1490,8 @@ jit_compile(jit_function_t func)
 	result = compile(&state, func);
 	if(result == JIT_RESULT_OK)
 	{
-		func->entry_point = state.gen.code_start;
-		func->is_compiled = 1;
+		install_code(func, memory_entry(&state));
+		evict_over_budget(func);
 
 		/* Free the builder structure, which we no longer require */
 		_jit_function_free_builder(func);
@@ -879,6 +1529,9 @@ jit_compile_entry(jit_function_t func, void **entry_point)
 		return JIT_RESULT_NULL_FUNCTION;
 	}
 
+	/* Let a compilation on another thread finish first */
+	_jit_function_wait_compile(func);
+
 	/* Bail out if there is nothing to do here */
 	if(!func->builder)
 	{
@@ -899,7 +1552,7 @@ jit_compile_entry(jit_function_t func, void **entry_point)
 	result = compile(&state, func);
 	if(result == JIT_RESULT_OK)
 	{
-		*entry_point = state.gen.code_start;
+		*entry_point = memory_entry(&state);
 	}
 
 	return result;
@@ -924,8 +1577,8 @@ jit_function_setup_entry(jit_function_t func, void *entry_point)
 	/* Record the entry point */
 	if(entry_point)
 	{
-		func->entry_point = entry_point;
-		func->is_compiled = 1;
+		install_code(func, entry_point);
+		evict_over_budget(func);
 	}
 	_jit_function_free_builder(func);
 }
@@ -966,45 +1619,108 @@ jit_function_compile_entry(jit_function_t func, void **entry_point)
 	return (JIT_RESULT_OK == jit_compile_entry(func, entry_point));
 }
 
-void *
-_jit_function_compile_on_demand(jit_function_t func)
+/*
+ * Run the on-demand compiler for a function.  The caller must hold
+ * the context's builder lock.  The user's on-demand compiler runs with
+ * the lock held, but it is released while the code is generated, so
+ * that the other threads may build and compile functions meanwhile.
+ */
+static int
+compile_on_demand(jit_function_t func)
 {
+	jit_context_t context = func->context;
+	jit_thread_control_t control;
 	_jit_compile_t state;
+	int evicted = 0;
 	int result;
 
-	/* Lock down the context */
-	jit_context_build_start(func->context);
+ retry:
+	/* Wait if another thread is compiling the function right now */
+	_jit_function_wait_compile(func);
 
 	/* Fast return if we are already compiled */
 	if(func->is_compiled)
 	{
-		jit_context_build_end(func->context);
-		return func->entry_point;
+		return JIT_RESULT_OK;
 	}
 
 	if(!func->on_demand)
 	{
 		/* Bail out with an error if the user didn't supply an
 		   on-demand compiler */
-		result = JIT_RESULT_COMPILE_ERROR;
+		return JIT_RESULT_COMPILE_ERROR;
 	}
-	else
+
+	/* Call the user's on-demand compiler. */
+	result = (func->on_demand)(func);
+	if(result != JIT_RESULT_OK || func->is_compiled)
 	{
-		/* Call the user's on-demand compiler. */
-		result = (func->on_demand)(func);
-		if(result == JIT_RESULT_OK && !func->is_compiled)
+		_jit_function_free_builder(func);
+		return result;
+	}
+
+	/* The passes and the code generator create values in the function
+	   while it is compiled, which must not wait for it to be done */
+	control = _jit_thread_get_control();
+	if(!control)
+	{
+		_jit_function_free_builder(func);
+		return JIT_RESULT_OUT_OF_MEMORY;
+	}
+
+	/* Compile the function if the user didn't do so.  The function
+	   cannot be built again or destroyed until it is done */
+	func->is_compiling = 1;
+	jit_context_build_end(context);
+
+	control->compiling = func;
+	result = compile(&state, func);
+	control->compiling = 0;
+	if(result == JIT_RESULT_OK)
+	{
+		install_code(func, memory_entry(&state));
+	}
+	_jit_function_free_builder(func);
+
+	jit_monitor_lock(&context->compile_queue_lock);
+	func->is_compiling = 0;
+	jit_monitor_signal_all(&context->compile_queue_lock);
+	jit_monitor_unlock(&context->compile_queue_lock);
+
+	jit_context_build_start(context);
+	if(result == JIT_RESULT_OK)
+	{
+		evict_over_budget(func);
+	}
+	else if(result == JIT_RESULT_OUT_OF_MEMORY && !evicted)
+	{
+		/* The code space is full, and the cold functions could not be
+		   evicted without the builder lock.  Evict them now and build
+		   the function again */
+		evicted = 1;
+		_jit_memory_lock(context);
+		if(evict_code(context, func, context->code_size - context->code_size / 4))
 		{
-			/* Compile the function if the user didn't do so */
-			result = compile(&state, func);
-			if(result == JIT_RESULT_OK)
-			{
-				func->entry_point = state.gen.code_start;
-				func->is_compiled = 1;
-			}
+			_jit_memory_unlock(context);
+			goto retry;
 		}
-		_jit_function_free_builder(func);
+		_jit_memory_unlock(context);
 	}
 
+	return result;
+}
+
+void *
+_jit_function_compile_on_demand(jit_function_t func)
+{
+	int result;
+
+	/* Lock down the context.  If another thread is compiling this
+	   function right now then this waits for it to finish */
+	jit_context_build_start(func->context);
+
+	result = compile_on_demand(func);
+
 	/* Unlock the context and report the result */
 	jit_context_build_end(func->context);
 	if(result != JIT_RESULT_OK)
@@ -1017,6 +1733,284 @@ _jit_function_compile_on_demand(jit_function_t func)
 	return func->entry_point;
 }
 
+/*
+ * Compile a function on a background thread.  Exceptions thrown by the
+ * user's on-demand compiler are caught here.  A failed function remains
+ * uncompiled, so the error is reported again to the first caller that
+ * goes through the redirector.
+ */
+static void
+compile_in_background(jit_function_t func)
+{
+	jit_jmp_buf jbuf;
+	jit_exception_func handler;
+
+	handler = jit_exception_set_handler(internal_exception_handler);
+	_jit_unwind_push_setjmp(&jbuf);
+	if(setjmp(jbuf.buf))
+	{
+		jit_exception_clear_last();
+		_jit_function_free_builder(func);
+	}
+	else
+	{
+		compile_on_demand(func);
+	}
+	_jit_unwind_pop_setjmp();
+	jit_exception_set_handler(handler);
+}
+
+/*
+ * Main loop for a background compilation thread.
+ */
+static void
+compile_thread_main(void *arg)
+{
+	jit_context_t context = (jit_context_t)arg;
+	jit_function_t func;
+
+	for(;;)
+	{
+		/* Wait for some work to arrive */
+		jit_monitor_lock(&context->compile_queue_lock);
+		while(!context->compile_queue_head && !context->compile_queue_shutdown)
+		{
+			jit_monitor_wait(&context->compile_queue_lock, -1);
+		}
+		if(context->compile_queue_shutdown)
+		{
+			jit_monitor_unlock(&context->compile_queue_lock);
+			break;
+		}
+		jit_monitor_unlock(&context->compile_queue_lock);
+
+		/* Acquire the builder lock before taking the function off
+		   the queue so that it cannot be destroyed in between.  The
+		   queue may have been drained by another worker meanwhile */
+		jit_context_build_start(context);
+		jit_monitor_lock(&context->compile_queue_lock);
+		func = context->compile_queue_head;
+		if(func)
+		{
+			context->compile_queue_head = func->compile_queue_next;
+			if(!context->compile_queue_head)
+			{
+				context->compile_queue_tail = 0;
+			}
+			func->compile_queue_next = 0;
+			func->is_queued = 0;
+		}
+		jit_monitor_unlock(&context->compile_queue_lock);
+		if(func)
+		{
+			compile_in_background(func);
+		}
+		jit_context_build_end(context);
+	}
+}
+
+/*
+ * Start the background compilation threads for a context.  The caller
+ * must hold the compile_queue_lock.  Returns zero if no threads could
+ * be started.
+ */
+static int
+start_compile_threads(jit_context_t context)
+{
+	jit_nuint count;
+	int index;
+
+	count = jit_context_get_meta_numeric(context, JIT_OPTION_COMPILE_THREADS);
+	if(count == 0)
+	{
+		return 0;
+	}
+	if(count > JIT_MAX_COMPILE_THREADS)
+	{
+		count = JIT_MAX_COMPILE_THREADS;
+	}
+
+	context->compile_threads = jit_calloc(count, sizeof(jit_thread_id_t));
+	if(!context->compile_threads)
+	{
+		return 0;
+	}
+	for(index = 0; index < (int)count; ++index)
+	{
+		if(!_jit_thread_create(&context->compile_threads[index],
+				       compile_thread_main, context))
+		{
+			break;
+		}
+	}
+	context->num_compile_threads = index;
+	if(index == 0)
+	{
+		jit_free(context->compile_threads);
+		context->compile_threads = 0;
+		return 0;
+	}
+	return 1;
+}
+
+void
+_jit_context_stop_compile_threads(jit_context_t context)
+{
+	jit_function_t func;
+	int index;
+
+	/* Tell the workers to exit and drop any functions still queued */
+	jit_monitor_lock(&context->compile_queue_lock);
+	context->compile_queue_shutdown = 1;
+	while((func = context->compile_queue_head) != 0)
+	{
+		context->compile_queue_head = func->compile_queue_next;
+		func->compile_queue_next = 0;
+		func->is_queued = 0;
+	}
+	context->compile_queue_tail = 0;
+	jit_monitor_signal_all(&context->compile_queue_lock);
+	jit_monitor_unlock(&context->compile_queue_lock);
+
+	for(index = 0; index < context->num_compile_threads; ++index)
+	{
+		_jit_thread_join(context->compile_threads[index]);
+	}
+	jit_free(context->compile_threads);
+	context->compile_threads = 0;
+	context->num_compile_threads = 0;
+}
+
+void
+_jit_function_wait_compile(jit_function_t func)
+{
+	jit_context_t context = func->context;
+	jit_thread_control_t control;
+
+	/* The flag is only set with the builder lock, which the caller
+	   holds, so it can only be cleared meanwhile */
+	if(!func->is_compiling)
+	{
+		return;
+	}
+
+	/* Unless the caller is the thread that compiles the function */
+	control = _jit_thread_get_control();
+	if(control && control->compiling == func)
+	{
+		return;
+	}
+
+	jit_monitor_lock(&context->compile_queue_lock);
+	while(func->is_compiling)
+	{
+		jit_monitor_wait(&context->compile_queue_lock, -1);
+	}
+	jit_monitor_unlock(&context->compile_queue_lock);
+}
+
+void
+_jit_function_dequeue_compile(jit_function_t func)
+{
+	jit_context_t context = func->context;
+	jit_function_t prev;
+	jit_function_t current;
+
+	jit_monitor_lock(&context->compile_queue_lock);
+	if(func->is_queued)
+	{
+		prev = 0;
+		current = context->compile_queue_head;
+		while(current != func)
+		{
+			prev = current;
+			current = current->compile_queue_next;
+		}
+		if(prev)
+		{
+			prev->compile_queue_next = func->compile_queue_next;
+		}
+		else
+		{
+			context->compile_queue_head = func->compile_queue_next;
+		}
+		if(context->compile_queue_tail == func)
+		{
+			context->compile_queue_tail = prev;
+		}
+		func->compile_queue_next = 0;
+		func->is_queued = 0;
+	}
+	jit_monitor_unlock(&context->compile_queue_lock);
+}
+
+/*@
+ * @deftypefun int jit_function_queue_compile (jit_function_t @var{func})
+ * Queue @var{func} for compilation on one of the context's background
+ * compilation threads.  The function must have an on-demand compiler,
+ * which will be called on the background thread with the context's
+ * build lock held, just as it would be for an ordinary on-demand
+ * compilation.  The function is then compiled without the build lock,
+ * so the other threads may build functions meanwhile.  The context
+ * compiles one function at a time, while the other background threads
+ * run their on-demand compilers.
+ *
+ * Until the background compilation finishes, calls to the function
+ * continue to go through its redirector.  A caller that reaches the
+ * redirector first either waits for the background thread to publish
+ * the entry point or compiles the function itself, whichever happens
+ * first.  If the background compilation fails, the error is reported
+ * to the first caller of the function as usual.
+ *
+ * Background compilation is disabled unless the
+ * @code{JIT_OPTION_COMPILE_THREADS} option is set on the context.
+ * The threads are started the first time a function is queued.
+ * Returns zero if the function could not be queued, in which case it
+ * is still compiled on-demand when it is first called.  Returns
+ * non-zero if the function was queued or is already compiled.
+ * @end deftypefun
+@*/
+int
+jit_function_queue_compile(jit_function_t func)
+{
+	jit_context_t context;
+
+	if(!func || !func->on_demand)
+	{
+		return 0;
+	}
+	if(func->is_compiled)
+	{
+		return 1;
+	}
+
+	context = func->context;
+	jit_monitor_lock(&context->compile_queue_lock);
+	if(context->compile_queue_shutdown
+	   || (!context->compile_threads && !start_compile_threads(context)))
+	{
+		jit_monitor_unlock(&context->compile_queue_lock);
+		return 0;
+	}
+	if(!func->is_queued)
+	{
+		func->compile_queue_next = 0;
+		if(context->compile_queue_tail)
+		{
+			context->compile_queue_tail->compile_queue_next = func;
+		}
+		else
+		{
+			context->compile_queue_head = func;
+		}
+		context->compile_queue_tail = func;
+		func->is_queued = 1;
+		jit_monitor_signal(&context->compile_queue_lock);
+	}
+	jit_monitor_unlock(&context->compile_queue_lock);
+	return 1;
+}
+
 #define	JIT_CACHE_NO_OFFSET		(~((unsigned long)0))
 
 unsigned long
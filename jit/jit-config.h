@@ -93,6 +93,16 @@
 # define JIT_BACKEND_INTERP	1
 #endif
 
+/*
+ * Determine if the back end can write code at one address and
+ * run it from another one.
+ */
+#if defined(JIT_BACKEND_X86_64)
+# define JIT_EXEC_VIEW_SUPPORTED	1
+#else
+# define JIT_EXEC_VIEW_SUPPORTED	0
+#endif
+
 /*
 #define _JIT_COMPILE_DEBUG	1
 #define _JIT_BLOCK_DEBUG	1
@@ -88,6 +88,8 @@ jit_context_create(void)
 	/* Initialize the context and return it */
 	jit_mutex_create(&context->memory_lock);
 	jit_mutex_create(&context->builder_lock);
+	jit_mutex_create(&context->codegen_lock);
+	jit_monitor_create(&context->compile_queue_lock);
 	context->functions = 0;
 	context->last_function = 0;
 	context->on_demand_driver = _jit_function_compile_on_demand;
@@ -118,6 +120,8 @@ jit_context_destroy(jit_context_t context)
 	}
 	jit_free(context->registered_symbols);
 
+	_jit_context_stop_compile_threads(context);
+
 	while(context->functions != 0)
 	{
 		_jit_function_destroy(context->functions);
@@ -127,6 +131,8 @@ jit_context_destroy(jit_context_t context)
 
 	jit_mutex_destroy(&context->memory_lock);
 	jit_mutex_destroy(&context->builder_lock);
+	jit_mutex_destroy(&context->codegen_lock);
+	jit_monitor_destroy(&context->compile_queue_lock);
 
 	jit_free(context);
 }
@@ -159,6 +165,56 @@ jit_context_build_end(jit_context_t context)
 	jit_mutex_unlock(&context->builder_lock);
 }
 
+/*@
+ * @deftypefun {unsigned int} jit_context_enter_code (jit_context_t @var{context})
+ * Announce that the current thread is about to run code compiled
+ * within @var{context}.  The code that is replaced by recompiling
+ * a function is not reclaimed while a thread that may have seen it
+ * is still running.  The returned value must be passed to
+ * @code{jit_context_leave_code} when the thread is done.  The calls
+ * may be nested, and they are only needed if the option
+ * @code{JIT_OPTION_RECLAIM_CODE} is set.
+ * @end deftypefun
+@*/
+unsigned int
+jit_context_enter_code(jit_context_t context)
+{
+	unsigned int epoch;
+
+	/* If the epoch moves on before the thread is counted, the thread
+	   holds back the next epoch instead, which is just as safe */
+	epoch = context->code_epoch & 1;
+	jit_atomic_inc(&(context->code_readers[epoch]));
+
+	/* Count the thread before it looks at the entry points */
+	jit_barrier_full();
+	return epoch;
+}
+
+/*@
+ * @deftypefun void jit_context_leave_code (jit_context_t @var{context}, unsigned int @var{epoch})
+ * Announce that the current thread no longer runs the code that it
+ * could reach after the matching call to @code{jit_context_enter_code},
+ * which returned @var{epoch}.  The code that is no longer used by
+ * any thread is reclaimed.
+ * @end deftypefun
+@*/
+void
+jit_context_leave_code(jit_context_t context, unsigned int epoch)
+{
+	/* Only the last thread to leave an epoch lets it move on */
+	if(jit_atomic_dec(&(context->code_readers[epoch & 1])) != 0)
+	{
+		return;
+	}
+	_jit_memory_lock(context);
+	if(context->retired_code)
+	{
+		_jit_memory_reclaim_code(context);
+	}
+	_jit_memory_unlock(context);
+}
+
 /*@
  * @deftypefun void jit_context_set_on_demand_driver (jit_context_t @var{context}, jit_on_demand_driver_func @var{driver})
  * Specify the C function to be called to drive on-demand compilation.
@@ -239,6 +295,78 @@ jit_context_set_memory_manager(jit_context_t context, jit_memory_manager_t manag
 	}
 }
 
+/*@
+ * @deftypefun int jit_context_get_memory_stats (jit_context_t @var{context}, jit_memory_stats_t *@var{stats})
+ * Fill @var{stats} with the statistics of the memory that holds the
+ * code compiled within @var{context}: the size of a cache page, the
+ * number of pages, the number of pages of the default size they add up
+ * to, and the number of pages in the region they are taken from, if
+ * the cache reserves one.  It also tells how many bytes of the pages
+ * hold function code, function data, trampolines and closures, and
+ * how many are free, in how many blocks, and in the largest one.  The
+ * free bytes that are not in the largest block tell how fragmented
+ * the cache is.  Returns zero and clears @var{stats} if no function
+ * has been created yet, or if the memory manager does not keep
+ * statistics.
+ * @end deftypefun
+@*/
+int
+jit_context_get_memory_stats(jit_context_t context, jit_memory_stats_t *stats)
+{
+	int result = 0;
+
+	jit_memzero(stats, sizeof(jit_memory_stats_t));
+	_jit_memory_lock(context);
+	if(context->memory_context && context->memory_manager->get_stats)
+	{
+		context->memory_manager->get_stats(context->memory_context, stats);
+		result = 1;
+	}
+	_jit_memory_unlock(context);
+	return result;
+}
+
+/*@
+ * @deftypefun void jit_code_iter_init (jit_code_iter_t *@var{iter}, jit_context_t @var{context})
+ * Initialize an iterator over the compiled code of @var{context}.
+ * @end deftypefun
+@*/
+void
+jit_code_iter_init(jit_code_iter_t *iter, jit_context_t context)
+{
+	iter->context = context;
+	iter->start = 0;
+	iter->end = 0;
+}
+
+/*@
+ * @deftypefun jit_function_t jit_code_iter_next (jit_code_iter_t *@var{iter})
+ * Get the function that owns the next block of compiled code, in the
+ * order of addresses, and set the @code{start} and @code{end} fields
+ * of @var{iter} to the bounds of the code.  Returns NULL once all the
+ * code has been visited.  A recompiled function may be visited more
+ * than once, if its old code has not been reclaimed yet.
+ * @end deftypefun
+@*/
+jit_function_t
+jit_code_iter_next(jit_code_iter_t *iter)
+{
+	jit_context_t context = iter->context;
+	jit_function_info_t info;
+	jit_function_t func = 0;
+
+	_jit_memory_lock(context);
+	info = _jit_memory_find_next_function_info(context, iter->start);
+	if(info)
+	{
+		func = _jit_memory_get_function(context, info);
+		iter->start = _jit_memory_get_function_start(context, info);
+		iter->end = _jit_memory_get_function_end(context, info);
+	}
+	_jit_memory_unlock(context);
+	return func;
+}
+
 /*@
  * @deftypefun int jit_context_set_meta (jit_context_t @var{context}, int @var{type}, void *@var{data}, jit_meta_free_func @var{free_data})
  * Tag a context with some metadata.  Returns zero if out of memory.
@@ -299,6 +427,126 @@ jit_context_set_meta(jit_context_t context, int type, void *data, jit_meta_free_
  * A numeric option that forces generation of position-independent code (PIC)
  * if it is set to a non-zero value. This may be mainly useful for pre-compiled
  * contexts.
+ *
+ * @vindex JIT_OPTION_COMPILE_THREADS
+ * @item JIT_OPTION_COMPILE_THREADS
+ * A numeric option that sets the number of background threads used
+ * to compile functions queued with @code{jit_function_queue_compile}.
+ * If set to zero (the default), background compilation is disabled.
+ * The option is read when the first function is queued.
+ *
+ * @vindex JIT_OPTION_VALUE_NUMBERING
+ * @item JIT_OPTION_VALUE_NUMBERING
+ * A numeric option that enables local value numbering when it is set to
+ * a non-zero value.  An arithmetic instruction, or a load from memory
+ * that has not been modified since, that repeats one already built in
+ * the current block returns the earlier result instead of computing it
+ * again.  The results may then be shared, so the front end must not
+ * store into the values returned by such instructions.  The option is
+ * read when the function starts being built.
+ *
+ * @vindex JIT_OPTION_INLINE_LIMIT
+ * @item JIT_OPTION_INLINE_LIMIT
+ * A numeric option that sets the largest number of instructions in a
+ * function that @code{jit_insn_call} may copy into the caller instead
+ * of calling it.  A copy of the body is kept when a small function is
+ * compiled, so only the calls to functions that have already been
+ * compiled are inlined.  Recompilable functions are never inlined.
+ * The option must be set when the called function is compiled and when
+ * the calling function is built.  If set to zero (the default), calls
+ * are never inlined.
+ *
+ * @vindex JIT_OPTION_CODE_ALIGNMENT
+ * @item JIT_OPTION_CODE_ALIGNMENT
+ * A numeric option that sets the boundary in bytes, a power of two,
+ * that the function entry points, the loop headers and the branch
+ * targets that cannot be reached by falling through are aligned on.
+ * The padding is made of no-op instructions.  If set to zero (the
+ * default), the boundary preferred by the back end is used.  Setting
+ * it to 1 turns the alignment off, which makes the code smaller.
+ *
+ * @vindex JIT_OPTION_BLOCK_PROFILE
+ * @item JIT_OPTION_BLOCK_PROFILE
+ * A numeric option that enables the profile guided block layout when
+ * it is set to a non-zero value.  The first compilation of a function
+ * that is marked with @code{jit_function_set_recompilable} then adds
+ * code that counts how many times each block runs.  When the function
+ * is built and compiled again, the blocks are placed so that the most
+ * frequent paths fall through, and the blocks that have never run are
+ * moved after all the others.  The front end must build the same
+ * instructions both times.  The functions that are not optimized or
+ * that have exception handlers are not profiled.
+ *
+ * @vindex JIT_OPTION_SCHEDULE_PRESSURE
+ * @item JIT_OPTION_SCHEDULE_PRESSURE
+ * A numeric option that limits how many results the instruction
+ * scheduler may compute ahead of their uses within a block.  A higher
+ * limit hides more latency but needs more registers.  The default of
+ * zero uses the limit of the back end, and a negative value turns the
+ * scheduling off.  The scheduler only runs for the functions optimized
+ * at @code{JIT_OPTLEVEL_HIGH} on the back ends that describe their
+ * instruction latencies.
+ *
+ * @vindex JIT_OPTION_RECLAIM_CODE
+ * @item JIT_OPTION_RECLAIM_CODE
+ * A numeric option that lets the function cache reuse the memory of
+ * the code replaced by recompiling a function that is marked with
+ * @code{jit_function_set_recompilable}, when it is set to a non-zero
+ * value.  The application must then run the compiled code only between
+ * @code{jit_context_enter_code} and @code{jit_context_leave_code},
+ * and call the functions through their closures or vtable pointers
+ * rather than through the old entry points.  The old code is reclaimed
+ * once every thread that entered before the recompilation has left.
+ * If set to zero (the default), the old code is kept for all time.
+ *
+ * @vindex JIT_OPTION_CODE_BUDGET
+ * @item JIT_OPTION_CODE_BUDGET
+ * A numeric option that sets the size in bytes that the code of the
+ * functions may take before the least recently used ones are evicted.
+ * Only the functions that are marked with @code{jit_function_set_recompilable}
+ * and have an on-demand compiler are evicted.  They are pointed back at
+ * the on-demand compiler, which builds and compiles them again the next
+ * time they are called.  A function counts as used when it is compiled,
+ * called with @code{jit_function_apply}, or run in any other way since
+ * the functions were last evicted: the code of the functions that may
+ * be evicted marks every run of them.  The functions are also
+ * evicted when the function cache reaches @code{JIT_OPTION_CACHE_LIMIT}.
+ * The memory is reclaimed as described for @code{JIT_OPTION_RECLAIM_CODE},
+ * which must be set too.  If set to zero (the default), no function is
+ * evicted.
+ *
+ * @vindex JIT_OPTION_WRITE_XOR_EXECUTE
+ * @item JIT_OPTION_WRITE_XOR_EXECUTE
+ * A numeric option that, if non-zero, keeps every page of the function
+ * cache either writable or executable, but never both.  The cache is
+ * mapped twice, and the code is written through the writable mapping
+ * and runs from the executable one.  The pages are taken from a region
+ * of @code{JIT_OPTION_CACHE_LIMIT} bytes, or 64 gigabytes on 64-bit
+ * systems and 256 megabytes on others if no limit is set.  Only the
+ * address space of the region is reserved, the memory behind it grows
+ * with the code.  If the system cannot map the memory twice, no
+ * function can be compiled.  The option must be set before the first
+ * function is created, and has no effect on the back ends that cannot
+ * run the code from another address than it is written at, which are
+ * all but x86-64.
+ *
+ * @vindex JIT_OPTION_CACHE_HUGE_PAGES
+ * @item JIT_OPTION_CACHE_HUGE_PAGES
+ * A numeric option that, if non-zero, takes the pages of the function
+ * cache from one region backed by huge pages, so that the code needs
+ * fewer instruction TLB entries.  The region has the size of
+ * @code{JIT_OPTION_CACHE_LIMIT}, rounded up to 2 megabytes, or the
+ * size described for @code{JIT_OPTION_WRITE_XOR_EXECUTE} if no limit
+ * is set.  Only the address space of the region is reserved, and its
+ * pages become executable 2 megabytes at a time as they are taken.  If
+ * a limit is set, the huge pages that the system administrator
+ * reserved are used if there are enough of them for the whole region.
+ * Otherwise the system is asked for transparent huge pages.  If
+ * neither is available, the pages are allocated one by one as usual.
+ * The @code{jit_context_get_memory_stats} function tells how much of
+ * the region is in use.  The option must be set before the first
+ * function is created, and has no effect together with
+ * @code{JIT_OPTION_WRITE_XOR_EXECUTE}.
  * @end table
  *
  * Metadata type values of 10000 or greater are reserved for internal use.
@@ -0,0 +1,171 @@
+/*
+ * jit-dce.c - Global dead code and dead store elimination.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#include "jit-cfg.h"
+#ifdef _JIT_COMPILE_DEBUG
+#include <jit/jit-dump.h>
+#include <stdio.h>
+#endif
+
+/*
+ * Check if the stores to the local variables may be removed.  The
+ * exception handlers and the computed jumps are entered over edges
+ * that are not in the graph, so the variables might be live there
+ * although the live sets do not show it.
+ */
+static int
+can_remove_stores(_jit_cfg_t cfg)
+{
+	jit_block_t block;
+
+	if(cfg->func->has_try)
+	{
+		return 0;
+	}
+	for(block = cfg->func->builder->entry_block; block; block = block->next)
+	{
+		if(block->address_of)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Check if the value may be dropped when it is not live.  The values
+ * that can be accessed through memory must be kept.
+ */
+static int
+is_removable(jit_value_t value, int remove_stores)
+{
+	if(value->is_addressable || value->is_volatile)
+	{
+		return 0;
+	}
+	return value->is_temporary || remove_stores;
+}
+
+/*
+ * Remove the dead instructions of a node scanning them backwards from
+ * the end of the node where the live values are known.
+ */
+static int
+eliminate_dead_code(_jit_cfg_t cfg, _jit_node_t node, _jit_bitset_t *live,
+		    int remove_stores)
+{
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t dest;
+	jit_value_t value1;
+	jit_value_t value2;
+	int changed;
+
+	changed = 0;
+	_jit_bitset_copy(live, &node->live_out);
+
+	jit_insn_iter_init_last(&iter, node->block);
+	while((insn = jit_insn_iter_previous(&iter)) != 0)
+	{
+		dest = _jit_cfg_get_dest(insn);
+		value1 = _jit_cfg_get_value1(insn);
+		value2 = _jit_cfg_get_value2(insn);
+
+		if(dest)
+		{
+			if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+			{
+				_jit_bitset_set_bit(live, dest->index);
+			}
+			else if(_jit_bitset_test_bit(live, dest->index))
+			{
+				_jit_bitset_clear_bit(live, dest->index);
+			}
+			else if(is_removable(dest, remove_stores))
+			{
+#ifdef _JIT_COMPILE_DEBUG
+				printf("dead code elimination: remove instruction '");
+				jit_dump_insn(stdout, cfg->func, insn);
+				printf("'\n");
+#endif
+				insn->opcode = (short)JIT_OP_NOP;
+				changed = 1;
+				continue;
+			}
+		}
+		if(value1)
+		{
+			_jit_bitset_set_bit(live, value1->index);
+		}
+		if(value2)
+		{
+			_jit_bitset_set_bit(live, value2->index);
+		}
+	}
+
+	return changed;
+}
+
+int
+_jit_cfg_eliminate_dead_code(_jit_cfg_t cfg)
+{
+	_jit_bitset_t live;
+	int remove_stores;
+	int changed;
+	int index;
+
+	remove_stores = can_remove_stores(cfg);
+
+	/* Removing an instruction may make its operands dead in turn,
+	   so repeat until the live sets settle */
+	do
+	{
+		if(!_jit_cfg_compute_liveness(cfg))
+		{
+			return 0;
+		}
+		if(cfg->num_values == 0)
+		{
+			break;
+		}
+		if(!_jit_bitset_allocate(&live, cfg->num_values))
+		{
+			return 0;
+		}
+
+		changed = 0;
+		for(index = 0; index < cfg->num_post_order; index++)
+		{
+			if(eliminate_dead_code(cfg, cfg->post_order[index], &live,
+					       remove_stores))
+			{
+				changed = 1;
+			}
+		}
+
+		_jit_bitset_free(&live);
+	}
+	while(changed);
+
+	return 1;
+}
@@ -95,14 +95,18 @@ jit_function_create(jit_context_t context, jit_type_t signature)
 #if !defined(JIT_BACKEND_INTERP) && defined(jit_redirector_size)
 	/* If we aren't using interpretation, then point the function's
 	   initial entry point at the redirector, which in turn will
-	   invoke the on-demand compiler */
+	   invoke the on-demand compiler.  The trampolines are written
+	   where they were allocated, but run from the executable view */
 	func->entry_point = _jit_create_redirector
 		(func->redirector, (void *) context->on_demand_driver,
 		 func, jit_type_get_abi(signature));
+	func->entry_point = _jit_memory_get_exec_address(context, func->entry_point);
+	func->redirector = _jit_memory_get_exec_address(context, func->redirector);
 	_jit_flush_exec(func->redirector, jit_redirector_size);
 #endif
 #if !defined(JIT_BACKEND_INTERP) && defined(jit_indirector_size)
 	_jit_create_indirector(func->indirector, (void**) &(func->entry_point));
+	func->indirector = _jit_memory_get_exec_address(context, func->indirector);
 	_jit_flush_exec(func->indirector, jit_indirector_size);
 #endif
 
@@ -156,6 +160,7 @@ int _jit_function_ensure_builder(jit_function_t func)
 	{
 		return 0;
 	}
+	_jit_function_wait_compile(func);
 	if(func->builder)
 	{
 		return 1;
@@ -168,11 +173,22 @@ int _jit_function_ensure_builder(jit_function_t func)
 		return 0;
 	}
 
+	/* There is no exception handler until one is set up */
+	func->builder->catcher_label = jit_label_undefined;
+
+	/* The loop header for the self tail calls is created on demand */
+	func->builder->tail_call_label = jit_label_undefined;
+
 	/* Cache the value of the JIT_OPTION_POSITION_INDEPENDENT option */
 	func->builder->position_independent
 		= jit_context_get_meta_numeric(
 			func->context, JIT_OPTION_POSITION_INDEPENDENT);
 
+	/* Cache the value of the JIT_OPTION_VALUE_NUMBERING option */
+	func->builder->value_numbering
+		= jit_context_get_meta_numeric(
+			func->context, JIT_OPTION_VALUE_NUMBERING) != 0;
+
 	/* Initialize the function builder */
 	jit_memory_pool_init(&(func->builder->value_pool), struct _jit_value);
 	jit_memory_pool_init(&(func->builder->edge_pool), struct _jit_edge);
@@ -218,6 +234,7 @@ void _jit_function_free_builder(jit_function_t func)
 		jit_memory_pool_free(&(func->builder->meta_pool), _jit_meta_free_one);
 		jit_free(func->builder->param_values);
 		jit_free(func->builder->label_info);
+		jit_free(func->builder->value_numbers);
 		jit_free(func->builder);
 		func->builder = 0;
 		func->is_optimized = 0;
@@ -235,6 +252,8 @@ _jit_function_destroy(jit_function_t func)
 	}
 
 	context = func->context;
+	_jit_function_wait_compile(func);
+	_jit_function_dequeue_compile(func);
 	if(func->next)
 	{
 		func->next->prev = func->prev;
@@ -253,12 +272,15 @@ _jit_function_destroy(jit_function_t func)
 	}
 
 	_jit_function_free_builder(func);
+	_jit_function_free_inline_body(func->inline_body);
 	_jit_varint_free_data(func->bytecode_offset);
+	jit_free(func->block_counts);
 	jit_meta_destroy(&func->meta);
 	jit_type_free(func->signature);
 
 	_jit_memory_lock(context);
 
+	context->code_size -= func->code_size;
 #if !defined(JIT_BACKEND_INTERP) && (defined(jit_redirector_size) || defined(jit_indirector_size))
 # if defined(jit_redirector_size)
 	_jit_memory_free_trampoline(context, func->redirector);
@@ -282,6 +304,10 @@ _jit_function_destroy(jit_function_t func)
 @*/
 void jit_function_abandon(jit_function_t func)
 {
+	if(func)
+	{
+		_jit_function_wait_compile(func);
+	}
 	if(func && func->builder)
 	{
 		if(func->is_compiled)
@@ -528,6 +554,26 @@ int jit_function_is_compiled(jit_function_t func)
 	}
 }
 
+/*@
+ * @deftypefun jit_nuint jit_function_get_code_size (jit_function_t @var{func})
+ * Get the size in bytes of the current compiled code of a function.
+ * Returns zero if the function is not compiled, or if its code was
+ * evicted from the cache.
+ * @end deftypefun
+@*/
+jit_nuint
+jit_function_get_code_size(jit_function_t func)
+{
+	if(func)
+	{
+		return func->code_size;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
 /*@
  * @deftypefun int jit_function_set_recompilable (jit_function_t @var{func})
  * Mark this function as a candidate for recompilation.  That is,
@@ -943,6 +989,9 @@ int jit_function_apply_vararg
 		signature = func->signature;
 	}
 
+	/* Mark the function as recently used, races are harmless here */
+	func->last_use = func->context->code_clock;
+
 	/* Clear the exception state */
 	jit_exception_clear_last();
 
@@ -1010,12 +1059,64 @@ jit_function_get_optimization_level(jit_function_t func)
 /*@
  * @deftypefun {unsigned int} jit_function_get_max_optimization_level (void)
  * Get the maximum optimization level that is supported by @code{libjit}.
+ *
+ * At @code{JIT_OPTLEVEL_NORMAL} the control flow is cleaned up.  At
+ * @code{JIT_OPTLEVEL_HIGH} the local variables are also converted to
+ * static single assignment form for the global optimizations and then
+ * converted back with the copies coalesced.  The loops get their
+ * invariant code hoisted and their induction variables strength
+ * reduced at this level, and the instructions within the blocks are
+ * scheduled.
  * @end deftypefun
 @*/
 unsigned int
 jit_function_get_max_optimization_level(void)
 {
-	return JIT_OPTLEVEL_NORMAL;
+	return JIT_OPTLEVEL_HIGH;
+}
+
+/*@
+ * @deftypefun void jit_function_set_unroll_factor (jit_function_t @var{func}, unsigned int @var{factor})
+ * Set the number of times that the small counted loops of @var{func}
+ * are unrolled when the function is compiled at @code{JIT_OPTLEVEL_HIGH}.
+ * A factor of 0 or 1 disables loop unrolling, which is the default.
+ * The factor is limited to 8.
+ *
+ * Only the loops that consist of a single block ending with a test of
+ * a local integer counter that is incremented by a constant in the loop
+ * are unrolled.  The unrolled body runs while at least @var{factor}
+ * iterations remain and the original loop runs the rest of them.
+ * @end deftypefun
+@*/
+void
+jit_function_set_unroll_factor(jit_function_t func, unsigned int factor)
+{
+	if(factor > JIT_MAX_UNROLL_FACTOR)
+	{
+		factor = JIT_MAX_UNROLL_FACTOR;
+	}
+	if(func)
+	{
+		func->unroll_factor = factor;
+	}
+}
+
+/*@
+ * @deftypefun {unsigned int} jit_function_get_unroll_factor (jit_function_t @var{func})
+ * Get the loop unroll factor for @var{func}.
+ * @end deftypefun
+@*/
+unsigned int
+jit_function_get_unroll_factor(jit_function_t func)
+{
+	if(func)
+	{
+		return func->unroll_factor;
+	}
+	else
+	{
+		return 0;
+	}
 }
 
 /*@
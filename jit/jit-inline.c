@@ -0,0 +1,621 @@
+/*
+ * jit-inline.c - Inlining of calls to small functions.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+
+/*
+ * Inlining state.  The callee values are mapped to the caller values
+ * through a hash table with open addressing, and the callee blocks are
+ * mapped to the caller labels through a plain array.
+ */
+struct inline_state
+{
+	jit_function_t		func;
+	jit_function_t		callee;
+	jit_value_t		*from;
+	jit_value_t		*to;
+	unsigned int		size;
+	jit_block_t		*blocks;
+	jit_label_t		*labels;
+	int			num_blocks;
+	jit_value_t		return_value;
+	jit_label_t		end_label;
+};
+
+/*
+ * Check if the instruction is one that only makes sense within the
+ * frame of the function that contains it.
+ */
+static int
+is_frame_specific(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_CALL_TAIL:
+	case JIT_OP_CALL_INDIRECT_TAIL:
+	case JIT_OP_CALL_VTABLE_PTR_TAIL:
+	case JIT_OP_CALL_EXTERNAL_TAIL:
+	case JIT_OP_RETURN_SMALL_STRUCT:
+	case JIT_OP_SETUP_FOR_NESTED:
+	case JIT_OP_SETUP_FOR_SIBLING:
+	case JIT_OP_IMPORT:
+	case JIT_OP_RETHROW:
+	case JIT_OP_LOAD_PC:
+	case JIT_OP_LOAD_EXCEPTION_PC:
+	case JIT_OP_ENTER_FINALLY:
+	case JIT_OP_LEAVE_FINALLY:
+	case JIT_OP_CALL_FINALLY:
+	case JIT_OP_ENTER_FILTER:
+	case JIT_OP_LEAVE_FILTER:
+	case JIT_OP_CALL_FILTER:
+	case JIT_OP_CALL_FILTER_RETURN:
+	case JIT_OP_ADDRESS_OF_LABEL:
+	case JIT_OP_ALLOCA:
+	case JIT_OP_JUMP_TABLE:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Check if the instruction is skipped when the callee is copied.
+ * The incoming parameters are assigned from the call arguments.
+ */
+static int
+is_skipped(jit_insn_t insn)
+{
+	return (insn->opcode == JIT_OP_NOP
+		|| insn->opcode == JIT_OP_INCOMING_REG
+		|| insn->opcode == JIT_OP_INCOMING_FRAME_POSN);
+}
+
+static int
+is_return(jit_insn_t insn)
+{
+	return insn->opcode >= JIT_OP_RETURN && insn->opcode <= JIT_OP_RETURN_NFLOAT;
+}
+
+static int
+is_struct_type(jit_type_t type)
+{
+	type = jit_type_normalize(type);
+	return type->kind == JIT_TYPE_STRUCT || type->kind == JIT_TYPE_UNION;
+}
+
+/*
+ * Check if the body of a function can be copied into other functions.
+ * The exception handling state and the nested frames belong to the
+ * frame of the function, and a recompilable function may be given a
+ * new body, so such functions are always called.
+ */
+static int
+can_copy_body(jit_function_t func, jit_nuint limit)
+{
+	jit_builder_t builder;
+	jit_nuint count;
+	unsigned int num_params;
+	unsigned int param;
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+
+	builder = func->builder;
+	if(!builder || func->is_optimized || func->is_recompilable || func->nested_parent)
+	{
+		return 0;
+	}
+	if(func->has_try || builder->has_tail_call || builder->setjmp_value
+	   || builder->eh_frame_info || builder->struct_return || builder->parent_frame)
+	{
+		return 0;
+	}
+
+	/* The parameters are copied as plain values */
+	if(jit_type_get_abi(func->signature) == jit_abi_vararg
+	   || is_struct_type(jit_type_get_return(func->signature)))
+	{
+		return 0;
+	}
+	num_params = jit_type_num_params(func->signature);
+	for(param = 0; param < num_params; param++)
+	{
+		if(is_struct_type(jit_type_get_param(func->signature, param)))
+		{
+			return 0;
+		}
+	}
+
+	count = 0;
+	for(block = builder->entry_block; block; block = block->next)
+	{
+		if(block->address_of)
+		{
+			return 0;
+		}
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(is_skipped(insn))
+			{
+				continue;
+			}
+			if(is_frame_specific(insn))
+			{
+				return 0;
+			}
+			if((insn->flags & JIT_INSN_DEST_IS_LABEL) != 0
+			   && !jit_block_from_label(func, (jit_label_t) insn->dest))
+			{
+				return 0;
+			}
+			if(++count > limit)
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+jit_function_t
+_jit_insn_inline_body(jit_function_t func, jit_function_t callee,
+		      unsigned int num_args, int flags)
+{
+	jit_function_t body;
+
+	if(!jit_context_get_meta_numeric(func->context, JIT_OPTION_INLINE_LIMIT))
+	{
+		return 0;
+	}
+
+	/* The body is only there once the callee is compiled, as its build
+	   may not be finished before.  It is published with a barrier */
+	body = callee->inline_body;
+	jit_barrier_load();
+	if(!body || callee->is_recompilable || callee->context != func->context
+	   || func->nested_parent)
+	{
+		return 0;
+	}
+	if((flags & JIT_CALL_NORETURN) != 0
+	   || jit_type_num_params(callee->signature) != num_args)
+	{
+		return 0;
+	}
+	if(func->has_try && (body->builder->may_throw || body->builder->non_leaf))
+	{
+		return 0;
+	}
+
+	return body;
+}
+
+static unsigned int
+hash_value(struct inline_state *state, jit_value_t value)
+{
+	return (unsigned int) (((jit_nuint) value) >> 4) & (state->size - 1);
+}
+
+static int
+add_value(struct inline_state *state, jit_value_t from, jit_value_t to)
+{
+	unsigned int index;
+
+	if(!to)
+	{
+		return 0;
+	}
+	index = hash_value(state, from);
+	while(state->from[index])
+	{
+		index = (index + 1) & (state->size - 1);
+	}
+	state->from[index] = from;
+	state->to[index] = to;
+	return 1;
+}
+
+/*
+ * Replace a callee operand with the corresponding caller value.
+ * The constants are recreated in the caller, and the other values
+ * get a new caller value the first time they are seen.
+ */
+static int
+map_value(struct inline_state *state, jit_value_t *value)
+{
+	jit_value_t from;
+	jit_value_t to;
+	jit_constant_t constant;
+	unsigned int index;
+
+	from = *value;
+	if(!from)
+	{
+		return 1;
+	}
+
+	if(from->is_constant)
+	{
+		constant = jit_value_get_constant(from);
+		to = jit_value_create_constant(state->func, &constant);
+	}
+	else
+	{
+		index = hash_value(state, from);
+		while(state->from[index] && state->from[index] != from)
+		{
+			index = (index + 1) & (state->size - 1);
+		}
+		to = state->to[index];
+		if(!to)
+		{
+			to = jit_value_create(state->func, from->type);
+			if(!to)
+			{
+				return 0;
+			}
+			if(!from->is_temporary)
+			{
+				_jit_value_make_local(state->func, to);
+			}
+			to->is_volatile = from->is_volatile;
+			to->is_addressable = from->is_addressable;
+			state->from[index] = from;
+			state->to[index] = to;
+		}
+	}
+	if(!to)
+	{
+		return 0;
+	}
+
+	jit_value_ref(state->func, to);
+	*value = to;
+	return 1;
+}
+
+static jit_label_t
+map_label(struct inline_state *state, jit_label_t label)
+{
+	jit_block_t block;
+	int index;
+
+	block = jit_block_from_label(state->callee, label);
+	for(index = 0; index < state->num_blocks; index++)
+	{
+		if(state->blocks[index] == block)
+		{
+			return state->labels[index];
+		}
+	}
+	return jit_label_undefined;
+}
+
+/*
+ * Turn a return from the callee into a branch to the end of the
+ * inlined body.
+ */
+static int
+copy_return(struct inline_state *state, jit_insn_t insn)
+{
+	jit_value_t value;
+
+	if(insn->opcode != JIT_OP_RETURN)
+	{
+		value = insn->value1;
+		if(!map_value(state, &value))
+		{
+			return 0;
+		}
+		if(!jit_insn_store(state->func, state->return_value, value))
+		{
+			return 0;
+		}
+	}
+	return jit_insn_branch(state->func, &state->end_label);
+}
+
+static int
+copy_insn(struct inline_state *state, jit_insn_t insn)
+{
+	jit_insn_t copy;
+	jit_value_t dest;
+	jit_value_t value1;
+	jit_value_t value2;
+
+	if(is_return(insn))
+	{
+		return copy_return(state, insn);
+	}
+
+	dest = insn->dest;
+	value1 = insn->value1;
+	value2 = insn->value2;
+	if((insn->flags & JIT_INSN_DEST_IS_LABEL) != 0)
+	{
+		dest = (jit_value_t) map_label(state, (jit_label_t) dest);
+	}
+	else if((insn->flags & JIT_INSN_DEST_OTHER_FLAGS) == 0)
+	{
+		if(!map_value(state, &dest))
+		{
+			return 0;
+		}
+	}
+	if((insn->flags & JIT_INSN_VALUE1_OTHER_FLAGS) == 0)
+	{
+		if(!map_value(state, &value1))
+		{
+			return 0;
+		}
+	}
+	if((insn->flags & JIT_INSN_VALUE2_IS_SIGNATURE) != 0)
+	{
+		value2 = (jit_value_t) jit_type_copy((jit_type_t) value2);
+	}
+	else if(!map_value(state, &value2))
+	{
+		return 0;
+	}
+
+	copy = _jit_block_add_insn(state->func->builder->current_block);
+	if(!copy)
+	{
+		return 0;
+	}
+	copy->opcode = insn->opcode;
+	copy->flags = insn->flags & ~JIT_INSN_LIVENESS_FLAGS;
+	copy->dest = dest;
+	copy->value1 = value1;
+	copy->value2 = value2;
+	return 1;
+}
+
+static int
+copy_body(struct inline_state *state, jit_value_t *args)
+{
+	jit_function_t func;
+	jit_builder_t builder;
+	jit_value_t param;
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	unsigned int num_params;
+	unsigned int index;
+
+	func = state->func;
+	builder = state->callee->builder;
+
+	/* The parameters may be changed by the callee so they are copied
+	   into new values rather than shared with the arguments */
+	num_params = jit_type_num_params(state->callee->signature);
+	for(index = 0; index < num_params; index++)
+	{
+		if(!builder->param_values || !builder->param_values[index])
+		{
+			continue;
+		}
+		param = jit_value_create(func, builder->param_values[index]->type);
+		if(!add_value(state, builder->param_values[index], param))
+		{
+			return 0;
+		}
+		param->is_addressable = builder->param_values[index]->is_addressable;
+		if(!jit_insn_store(func, param, args[index]))
+		{
+			return 0;
+		}
+	}
+
+	state->return_value = jit_value_create(func, jit_type_get_return(state->callee->signature));
+	if(!state->return_value)
+	{
+		return 0;
+	}
+	for(index = 0; index < state->num_blocks; index++)
+	{
+		state->labels[index] = jit_function_reserve_label(func);
+	}
+	state->end_label = jit_function_reserve_label(func);
+
+	/* Copy the blocks in their original order so that the fall through
+	   edges are kept.  Every block is started anew so that a branch to
+	   it finds a label at its first instruction */
+	for(index = 0; index < state->num_blocks; index++)
+	{
+		block = state->blocks[index];
+		if(!jit_insn_label(func, &state->labels[index]))
+		{
+			return 0;
+		}
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(!is_skipped(insn) && !copy_insn(state, insn))
+			{
+				return 0;
+			}
+		}
+		insn = _jit_block_get_last(func->builder->current_block);
+		if(block->ends_in_dead && insn)
+		{
+			func->builder->current_block->ends_in_dead = 1;
+			if(!jit_insn_new_block(func))
+			{
+				return 0;
+			}
+		}
+	}
+
+	return jit_insn_label(func, &state->end_label);
+}
+
+jit_value_t
+_jit_insn_inline_call(jit_function_t func, jit_function_t callee,
+		      jit_value_t *args, unsigned int num_args)
+{
+	struct inline_state state;
+	jit_builder_t builder;
+	jit_block_t block;
+	int num_values;
+	int result;
+
+	builder = callee->builder;
+	jit_memzero(&state, sizeof(state));
+	state.func = func;
+	state.callee = callee;
+
+	/* Every instruction has up to three operands, so the table can
+	   hold them all while at most half full */
+	num_values = num_args;
+	for(block = builder->entry_block; block; block = block->next)
+	{
+		num_values += 3 * block->num_insns;
+		++(state.num_blocks);
+	}
+	state.size = 16;
+	while(state.size < 2 * num_values)
+	{
+		state.size *= 2;
+	}
+	state.from = jit_calloc(state.size, sizeof(jit_value_t));
+	state.to = jit_calloc(state.size, sizeof(jit_value_t));
+	state.blocks = jit_calloc(state.num_blocks, sizeof(jit_block_t));
+	state.labels = jit_calloc(state.num_blocks, sizeof(jit_label_t));
+	if(!state.from || !state.to || !state.blocks || !state.labels)
+	{
+		jit_free(state.from);
+		jit_free(state.to);
+		jit_free(state.blocks);
+		jit_free(state.labels);
+		return 0;
+	}
+	state.num_blocks = 0;
+	for(block = builder->entry_block; block; block = block->next)
+	{
+		state.blocks[(state.num_blocks)++] = block;
+	}
+
+	result = copy_body(&state, args);
+
+	jit_free(state.from);
+	jit_free(state.to);
+	jit_free(state.blocks);
+	jit_free(state.labels);
+	if(!result)
+	{
+		return 0;
+	}
+
+	/* The caller takes over the properties of the inlined code */
+	if(builder->non_leaf)
+	{
+		func->builder->non_leaf = 1;
+	}
+	if(builder->may_throw)
+	{
+		func->builder->may_throw = 1;
+	}
+	if(func->builder->param_area_size < builder->param_area_size)
+	{
+		func->builder->param_area_size = builder->param_area_size;
+	}
+
+	return state.return_value;
+}
+
+jit_function_t
+_jit_function_copy_inline_body(jit_function_t func)
+{
+	jit_function_t body;
+	jit_value_t *params;
+	jit_value_t value;
+	unsigned int num_params;
+	unsigned int index;
+	jit_nuint limit;
+
+	limit = jit_context_get_meta_numeric(func->context, JIT_OPTION_INLINE_LIMIT);
+	if(limit == 0 || !can_copy_body(func, limit))
+	{
+		return 0;
+	}
+
+	/* The copy is a function of its own that is never compiled and is
+	   not on the context's list.  It calls the original body inline */
+	body = jit_cnew(struct _jit_function);
+	if(!body)
+	{
+		return 0;
+	}
+	body->context = func->context;
+	body->signature = jit_type_copy(func->signature);
+	num_params = jit_type_num_params(func->signature);
+	params = (jit_value_t *) jit_calloc(num_params + 1, sizeof(jit_value_t));
+	if(!params || !_jit_function_ensure_builder(body))
+	{
+		jit_free(params);
+		_jit_function_free_inline_body(body);
+		return 0;
+	}
+	for(index = 0; index < num_params; index++)
+	{
+		params[index] = jit_value_get_param(body, index);
+		if(!params[index])
+		{
+			break;
+		}
+	}
+	value = 0;
+	if(index == num_params)
+	{
+		value = _jit_insn_inline_call(body, func, params, num_params);
+	}
+	jit_free(params);
+	if(!value)
+	{
+		_jit_function_free_inline_body(body);
+		return 0;
+	}
+	if(jit_type_normalize(jit_type_get_return(func->signature))->kind == JIT_TYPE_VOID)
+	{
+		value = 0;
+	}
+	if(!jit_insn_return(body, value))
+	{
+		_jit_function_free_inline_body(body);
+		return 0;
+	}
+
+	return body;
+}
+
+void
+_jit_function_free_inline_body(jit_function_t body)
+{
+	if(body)
+	{
+		_jit_function_free_builder(body);
+		jit_type_free(body->signature);
+		jit_free(body);
+	}
+}
@@ -279,6 +279,263 @@ static jit_intrinsic_descr_t const descr_i_D = {
 	0
 };
 
+/*
+ * Size of the value numbering table.  It is a cache, so an expression
+ * that collides with a newer one is simply computed again.
+ */
+#define	JIT_VALUE_NUMBERS		256
+
+/*
+ * An expression computed in a block, identified by the position of
+ * the instruction that computes it.
+ */
+struct _jit_value_number
+{
+	jit_block_t		block;
+	int			posn;
+	int			opcode;
+	jit_value_t		value1;
+	jit_value_t		value2;
+	jit_value_t		dest;
+};
+
+/*
+ * Determine if an instruction may be replaced by an earlier instance.
+ */
+static int
+is_numbered_opcode(int opcode, jit_type_t type)
+{
+	if(opcode >= JIT_OP_COPY_LOAD_SBYTE && opcode <= JIT_OP_ADDRESS_OF_LABEL)
+	{
+		return 0;
+	}
+	if(opcode == JIT_OP_ALLOCA || opcode == JIT_OP_LOAD_RELATIVE_STRUCT)
+	{
+		return 0;
+	}
+	return !jit_type_is_struct(type) && !jit_type_is_union(type);
+}
+
+static int
+is_load_opcode(int opcode)
+{
+	return ((opcode >= JIT_OP_LOAD_RELATIVE_SBYTE
+		 && opcode <= JIT_OP_LOAD_RELATIVE_NFLOAT)
+		|| (opcode >= JIT_OP_LOAD_ELEMENT_SBYTE
+		    && opcode <= JIT_OP_LOAD_ELEMENT_NFLOAT));
+}
+
+static int
+is_commutative_opcode(int opcode)
+{
+	switch(opcode)
+	{
+	case JIT_OP_IADD:
+	case JIT_OP_LADD:
+	case JIT_OP_IMUL:
+	case JIT_OP_LMUL:
+	case JIT_OP_IAND:
+	case JIT_OP_LAND:
+	case JIT_OP_IOR:
+	case JIT_OP_LOR:
+	case JIT_OP_IXOR:
+	case JIT_OP_LXOR:
+	case JIT_OP_IEQ:
+	case JIT_OP_LEQ:
+	case JIT_OP_INE:
+	case JIT_OP_LNE:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Check if the value may change behind the back of the instructions
+ * that define it.
+ */
+static int
+is_aliased_value(jit_value_t value)
+{
+	return value && (value->is_addressable || value->is_volatile);
+}
+
+/*
+ * Each constant is a separate value, so the constants are compared by
+ * their contents.
+ */
+static int
+is_same_operand(jit_value_t value1, jit_value_t value2)
+{
+	if(value1 == value2)
+	{
+		return 1;
+	}
+	return (value1 && value2
+		&& value1->is_nint_constant && value2->is_nint_constant
+		&& value1->address == value2->address
+		&& jit_type_normalize(value1->type) == jit_type_normalize(value2->type));
+}
+
+static jit_nuint
+hash_operand(jit_value_t value)
+{
+	if(value && value->is_nint_constant)
+	{
+		return (jit_nuint)(value->address);
+	}
+	return ((jit_nuint)value) >> 4;
+}
+
+static unsigned int
+hash_value_number(int opcode, jit_value_t value1, jit_value_t value2)
+{
+	jit_nuint hash;
+
+	hash = (jit_nuint)opcode;
+	hash = hash * 31 + hash_operand(value1);
+	hash = hash * 31 + hash_operand(value2);
+	return (unsigned int)(hash % JIT_VALUE_NUMBERS);
+}
+
+/*
+ * Check that the expression still holds at the end of its block: none
+ * of its values is assigned to after it, and in case of a load nothing
+ * may have written to the memory.
+ */
+static int
+is_value_number_valid(struct _jit_value_number *number)
+{
+	jit_block_t block;
+	jit_insn_t insn;
+	int posn, is_load;
+
+	block = number->block;
+	if(number->posn >= block->num_insns)
+	{
+		return 0;
+	}
+	insn = &block->insns[number->posn];
+	if(insn->opcode != number->opcode || insn->dest != number->dest
+	   || insn->value1 != number->value1 || insn->value2 != number->value2)
+	{
+		return 0;
+	}
+	if(is_aliased_value(number->value1) || is_aliased_value(number->value2)
+	   || is_aliased_value(number->dest))
+	{
+		return 0;
+	}
+
+	is_load = is_load_opcode(number->opcode);
+	for(posn = number->posn + 1; posn < block->num_insns; posn++)
+	{
+		insn = &block->insns[posn];
+		if(insn->opcode == JIT_OP_NOP)
+		{
+			continue;
+		}
+		if((insn->flags & JIT_INSN_DEST_IS_VALUE) == 0 && insn->dest
+		   && (insn->dest == number->dest || insn->dest == number->value1
+		       || insn->dest == number->value2))
+		{
+			return 0;
+		}
+		if(is_load
+		   && ((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0
+		       || (insn->dest && insn->dest->is_addressable)
+		       || (jit_opcodes[insn->opcode].flags
+			   & (JIT_OPCODE_IS_CALL | JIT_OPCODE_IS_CALL_EXTERNAL)) != 0))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Find an earlier instance of the expression in the current block.
+ */
+static jit_value_t
+find_value_number(jit_function_t func, int opcode, jit_value_t value1,
+		  jit_value_t value2, jit_type_t type)
+{
+	struct _jit_value_number *number;
+	jit_value_t temp;
+	int swap;
+
+	if(!func->builder->value_numbering || !func->builder->value_numbers
+	   || !is_numbered_opcode(opcode, type))
+	{
+		return 0;
+	}
+
+	for(swap = 0; swap < 2; swap++)
+	{
+		number = &func->builder->value_numbers
+			[hash_value_number(opcode, value1, value2)];
+		if(number->block == func->builder->current_block
+		   && number->opcode == opcode
+		   && is_same_operand(number->value1, value1)
+		   && is_same_operand(number->value2, value2)
+		   && number->dest->type == type
+		   && is_value_number_valid(number))
+		{
+			return number->dest;
+		}
+		if(!value2 || !is_commutative_opcode(opcode))
+		{
+			break;
+		}
+		temp = value1;
+		value1 = value2;
+		value2 = temp;
+	}
+	return 0;
+}
+
+/*
+ * Remember the expression computed by the last instruction of the
+ * current block.
+ */
+static void
+add_value_number(jit_function_t func, jit_value_t dest)
+{
+	struct _jit_value_number *number;
+	jit_block_t block;
+	jit_insn_t insn;
+
+	if(!func->builder->value_numbering)
+	{
+		return;
+	}
+	block = func->builder->current_block;
+	insn = &block->insns[block->num_insns - 1];
+	if(!is_numbered_opcode(insn->opcode, dest->type))
+	{
+		return;
+	}
+	if(!func->builder->value_numbers)
+	{
+		func->builder->value_numbers = jit_calloc
+			(JIT_VALUE_NUMBERS, sizeof(struct _jit_value_number));
+		if(!func->builder->value_numbers)
+		{
+			/* The table is an optimization, so carry on without it */
+			func->builder->value_numbering = 0;
+			return;
+		}
+	}
+
+	number = &func->builder->value_numbers
+		[hash_value_number(insn->opcode, insn->value1, insn->value2)];
+	number->block = block;
+	number->posn = block->num_insns - 1;
+	number->opcode = insn->opcode;
+	number->value1 = insn->value1;
+	number->value2 = insn->value2;
+	number->dest = dest;
+}
+
 /*
  * Apply a unary operator.
  */
@@ -296,6 +553,11 @@ static jit_value_t apply_unary
 	{
 		return 0;
 	}
+	dest = find_value_number(func, oper, value1, 0, result_type);
+	if(dest)
+	{
+		return dest;
+	}
 	insn = _jit_block_add_insn(func->builder->current_block);
 	if(!insn)
 	{
@@ -310,6 +572,7 @@ static jit_value_t apply_unary
 	insn->opcode = (short)oper;
 	insn->dest = dest;
 	insn->value1 = value1;
+	add_value_number(func, dest);
 	return dest;
 }
 
@@ -330,6 +593,11 @@ static jit_value_t apply_binary
 	{
 		return 0;
 	}
+	dest = find_value_number(func, oper, value1, value2, result_type);
+	if(dest)
+	{
+		return dest;
+	}
 	insn = _jit_block_add_insn(func->builder->current_block);
 	if(!insn)
 	{
@@ -346,6 +614,7 @@ static jit_value_t apply_binary
 	insn->dest = dest;
 	insn->value1 = value1;
 	insn->value2 = value2;
+	add_value_number(func, dest);
 	return dest;
 }
 
@@ -4313,6 +4582,12 @@ static jit_value_t apply_unary_conversion
 		(jit_function_t func, int oper, jit_value_t value1,
 		 jit_type_t result_type)
 {
+	/* The copies that widen the small integers have no intrinsics */
+	if(oper > JIT_OP_FLOAT64_TO_NFLOAT)
+	{
+		return apply_unary(func, oper, value1, result_type);
+	}
+
 	/* Set the "may_throw" flag if the conversion may throw an exception */
 	if(convert_intrinsics[oper - 1].descr.ptr_result_type)
 	{
@@ -5461,6 +5736,36 @@ static int create_call_setup_insns
 		 is_nested, nesting_level, struct_return, flags);
 }
 
+/*
+ * Create the empty block that the self tail calls branch back to.  It
+ * is placed after the initialization code so that the parameters are
+ * not reloaded from their incoming locations on each iteration.
+ */
+static int
+create_tail_call_header(jit_function_t func)
+{
+	jit_block_t block;
+
+	if(func->builder->tail_call_label != jit_label_undefined)
+	{
+		return 1;
+	}
+	block = _jit_block_create(func);
+	if(!block)
+	{
+		return 0;
+	}
+	func->builder->tail_call_label = (func->builder->next_label)++;
+	if(!_jit_block_record_label(block, func->builder->tail_call_label))
+	{
+		func->builder->tail_call_label = jit_label_undefined;
+		_jit_block_destroy(block);
+		return 0;
+	}
+	_jit_block_attach_after(func->builder->init_block, block, block);
+	return 1;
+}
+
 static jit_value_t
 handle_return(jit_function_t func,
 	      jit_type_t signature,
@@ -5549,7 +5854,9 @@ handle_return(jit_function_t func,
  * call will be immediately returned from the containing function.
  * Tail calls are only appropriate when the signature of the called
  * function matches the callee, and none of the parameters point
- * to local variables.
+ * to local variables.  A tail call to @var{func} itself stores the
+ * arguments into the parameters and branches back to the start of
+ * the function body, so that the function becomes a loop.
  * @end table
  *
  * If @var{jit_func} has already been compiled, then @code{jit_insn_call}
@@ -5564,11 +5871,10 @@ jit_value_t jit_insn_call
 	int is_nested;
 	int nesting_level;
 	jit_function_t temp_func;
+	jit_function_t body;
 	jit_value_t *new_args;
 	jit_value_t return_value;
 	jit_insn_t insn;
-	jit_label_t entry_point;
-	jit_label_t label_end;
 
 	/* Bail out if there is something wrong with the parameters */
 	if(!_jit_function_ensure_builder(func) || !jit_func)
@@ -5643,14 +5949,29 @@ jit_value_t jit_insn_call
 		new_args = args;
 	}
 
-	/* Intuit additional flags from "jit_func" if it was already compiled */
-	if(func->no_throw)
+	/* Intuit additional flags from "jit_func" if it was already compiled.
+	   A recompilable function, which includes every function whose code
+	   may be evicted, may get another body that throws or returns */
+	if(jit_func->is_compiled && !jit_func->is_recompilable)
 	{
-		flags |= JIT_CALL_NOTHROW;
+		if(jit_func->no_throw)
+		{
+			flags |= JIT_CALL_NOTHROW;
+		}
+		if(jit_func->no_return)
+		{
+			flags |= JIT_CALL_NORETURN;
+		}
 	}
-	if(func->no_return)
+
+	/* Copy the body of a small function in place of the call */
+	if(signature_identical(signature, jit_func->signature))
 	{
-		flags |= JIT_CALL_NORETURN;
+		body = _jit_insn_inline_body(func, jit_func, num_args, flags);
+		if(body)
+		{
+			return _jit_insn_inline_call(func, body, new_args, num_args);
+		}
 	}
 
 	/* Set up exception frame information for the call */
@@ -5671,22 +5992,13 @@ jit_value_t jit_insn_call
 	if((flags & JIT_CALL_TAIL) != 0 && func == jit_func)
 	{
 		/* We are performing a tail call to ourselves, which we can
-		   turn into an unconditional branch back to our entry point */
-		entry_point = jit_label_undefined;
-		label_end = jit_label_undefined;
-		if(!jit_insn_branch(func, &entry_point))
-		{
-			return 0;
-		}
-		if(!jit_insn_label(func, &entry_point))
-		{
-			return 0;
-		}
-		if(!jit_insn_label(func, &label_end))
+		   turn into an unconditional branch back to the loop header
+		   that follows the initialization code */
+		if(!create_tail_call_header(func))
 		{
 			return 0;
 		}
-		if(!jit_insn_move_blocks_to_start(func, entry_point, label_end))
+		if(!jit_insn_branch(func, &(func->builder->tail_call_label)))
 		{
 			return 0;
 		}
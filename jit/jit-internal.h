@@ -253,6 +253,12 @@ struct _jit_block
 	unsigned		ends_in_dead : 1;
 	unsigned		address_of : 1;
 
+	/* Index of the block's node in the current data flow analysis */
+	int			index;
+
+	/* How the start of the block is aligned in the generated code */
+	int			align;
+
 	/* Metadata */
 	jit_meta_t		meta;
 
@@ -308,6 +314,18 @@ void _jit_value_free(void *value);
  */
 void _jit_value_ref_params(jit_function_t func);
 
+/*
+ * Create a function-wide local variable for use by the optimizer.
+ * Returns NULL if out of memory.
+ */
+jit_value_t _jit_value_create_local(jit_function_t func, jit_type_t type);
+
+/*
+ * Turn a temporary value into a function-wide local variable when the
+ * optimizer moves its definition to another block.
+ */
+void _jit_value_make_local(jit_function_t func, jit_value_t value);
+
 /*
  * Internal structure of an instruction.
  */
@@ -404,6 +422,9 @@ struct _jit_builder
 	jit_label_t		catcher_label;
 	jit_value_t		eh_frame_info;
 
+	/* The loop header that self tail calls branch back to */
+	jit_label_t		tail_call_label;
+
 	/* Flag that is set to indicate that this function is not a leaf */
 	unsigned		non_leaf : 1;
 
@@ -419,6 +440,9 @@ struct _jit_builder
 	/* Generate position-independent code */
 	unsigned		position_independent : 1;
 
+	/* Reuse the expressions already computed in the current block */
+	unsigned		value_numbering : 1;
+
 	/* Memory pools that contain values, instructions, and metadata blocks */
 	jit_memory_pool		value_pool;
 	jit_memory_pool		edge_pool;
@@ -436,6 +460,9 @@ struct _jit_builder
 	/* Metadata that is stored only while the function is being built */
 	jit_meta_t		meta;
 
+	/* Hash table of the expressions computed in the current block */
+	struct _jit_value_number *value_numbers;
+
 	/* Current size of the local variable frame (used by the back end) */
 	jit_nint		frame_size;
 
@@ -486,16 +513,44 @@ struct _jit_function
 	unsigned		no_return : 1;
 	unsigned		has_try : 1;
 	unsigned		optimization_level : 8;
+	unsigned		unroll_factor : 8;
 
 	/* Flag set once the function is compiled */
 	int volatile		is_compiled;
 
+	/* Copy of the body of a small function made when it was compiled,
+	   which the functions built later inline in place of calls */
+	jit_function_t		inline_body;
+
+	/* Counts of the block executions for the profile guided layout */
+	jit_ulong		*block_counts;
+	int			num_block_counts;
+
 	/* The entry point for the function's compiled code */
 	void * volatile		entry_point;
 
+	/* Size of the compiled code, and the value of the context's code
+	   clock when the function was last compiled or seen to be used */
+	jit_nuint		code_size;
+	jit_nuint		last_use;
+
+	/* Set by the code of a function that may be evicted every time
+	   it runs, and cleared when the cold functions are looked for */
+	jit_int volatile	use_mark;
+
 	/* The function to call to perform on-demand compilation */
 	jit_on_demand_func	on_demand;
 
+	/* Link in the context's background compilation queue.  The queue
+	   fields are protected by the context's compile_queue_lock */
+	jit_function_t		compile_queue_next;
+	int			is_queued;
+
+	/* Flag set while the function is compiled without the builder
+	   lock.  It is set under the builder lock and cleared under the
+	   compile_queue_lock, which is signalled when it is cleared */
+	int volatile		is_compiling;
+
 #ifndef JIT_BACKEND_INTERP
 # ifdef jit_redirector_size
 	/* Buffer that contains the redirector for this function.
@@ -536,6 +591,23 @@ void _jit_function_compute_liveness(jit_function_t func);
  */
 void *_jit_function_compile_on_demand(jit_function_t func);
 
+/*
+ * Remove a function from the background compilation queue.
+ */
+void _jit_function_dequeue_compile(jit_function_t func);
+
+/*
+ * Wait until a compilation of the function that runs without the
+ * builder lock is finished.  The caller must hold the builder lock,
+ * or be the thread that compiles the function, which does not wait.
+ */
+void _jit_function_wait_compile(jit_function_t func);
+
+/*
+ * Stop the background compilation threads for a context.
+ */
+void _jit_context_stop_compile_threads(jit_context_t context);
+
 /*
  * Get the bytecode offset that is associated with a native
  * offset within a method.  Returns JIT_CACHE_NO_OFFSET
@@ -564,9 +636,18 @@ struct _jit_context
 	jit_memory_context_t	memory_context;
 	jit_mutex_t		memory_lock;
 
+	/* Offset from the address the code is written at to the address
+	   it runs from, if the memory context maps the code twice */
+	jit_nint		exec_offset;
+
 	/* Lock that controls access to the building process */
 	jit_mutex_t		builder_lock;
 
+	/* Lock that lets only one function at a time be compiled, as the
+	   functions compiled on demand are compiled without the builder
+	   lock */
+	jit_mutex_t		codegen_lock;
+
 	/* List of functions that are currently registered with the context */
 	jit_function_t		functions;
 	jit_function_t		last_function;
@@ -587,10 +668,45 @@ struct _jit_context
 
 	/* On-demand compilation driver */
 	jit_on_demand_driver_func	on_demand_driver;
+
+	/* Queue of functions waiting for background compilation and
+	   the worker threads that service it */
+	jit_monitor_t		compile_queue_lock;
+	jit_function_t		compile_queue_head;
+	jit_function_t		compile_queue_tail;
+	jit_thread_id_t		*compile_threads;
+	int			num_compile_threads;
+	int			compile_queue_shutdown;
+
+	/* Code of recompiled functions that waits until no thread may
+	   still run it, and the epoch counters that tell when that is.
+	   The epoch only moves on with the memory lock held, the readers
+	   are counted without it */
+	struct _jit_retired_code *retired_code;
+	volatile unsigned int	code_epoch;
+	volatile unsigned int	code_readers[2];
+
+	/* Size of the current code of all functions, and the clock that
+	   ticks for every compiled function to tell which are cold */
+	jit_nuint		code_size;
+	jit_nuint		code_clock;
+
+	/* Space taken by the code and data of the functions compiled so
+	   far, and their number of instructions, to tell how much space
+	   the next function needs */
+	jit_nuint		gen_space;
+	jit_nuint		gen_insns;
 };
 
 void *_jit_malloc_exec(unsigned int size);
 void _jit_free_exec(void *ptr, unsigned int size);
+void *_jit_malloc_exec_view(jit_nuint size, void **exec, int *fd);
+int _jit_grow_exec_view(void *ptr, void *exec, int fd, jit_nuint from, jit_nuint to);
+void _jit_free_exec_view(void *ptr, void *exec, int fd, jit_nuint size);
+void *_jit_malloc_exec_huge(jit_nuint size, jit_nuint align, int reserve);
+int _jit_commit_exec(void *ptr, jit_nuint size);
+void _jit_free_exec_huge(void *ptr, jit_nuint size);
+void _jit_discard_exec(void *ptr, jit_nuint size);
 void _jit_flush_exec(void *ptr, unsigned int size);
 
 void _jit_memory_lock(jit_context_t context);
@@ -600,12 +716,14 @@ int _jit_memory_ensure(jit_context_t context);
 void _jit_memory_destroy(jit_context_t context);
 
 jit_function_info_t _jit_memory_find_function_info(jit_context_t context, void *pc);
+jit_function_info_t _jit_memory_find_next_function_info(jit_context_t context, void *pc);
 jit_function_t _jit_memory_get_function(jit_context_t context, jit_function_info_t info);
 void *_jit_memory_get_function_start(jit_context_t context, jit_function_info_t info);
 void *_jit_memory_get_function_end(jit_context_t context, jit_function_info_t info);
 
 jit_function_t _jit_memory_alloc_function(jit_context_t context);
 void _jit_memory_free_function(jit_context_t context, jit_function_t func);
+void _jit_memory_set_size_hint(jit_context_t context, jit_size_t size);
 int _jit_memory_start_function(jit_context_t context, jit_function_t func);
 int _jit_memory_end_function(jit_context_t context, int result);
 int _jit_memory_extend_limit(jit_context_t context, int count);
@@ -617,6 +735,9 @@ void _jit_memory_free_trampoline(jit_context_t context, void *ptr);
 void *_jit_memory_alloc_closure(jit_context_t context);
 void _jit_memory_free_closure(jit_context_t context, void *ptr);
 void *_jit_memory_alloc_data(jit_context_t context, jit_size_t size, jit_size_t align);
+void *_jit_memory_get_exec_address(jit_context_t context, void *ptr);
+void _jit_memory_retire_code(jit_context_t context, void *code);
+void _jit_memory_reclaim_code(jit_context_t context);
 
 /*
  * Backtrace control structure, for managing stack traces.
@@ -656,6 +777,9 @@ struct jit_thread_control
 	jit_exception_func	exception_handler;
 	jit_backtrace_t		backtrace_head;
 	struct jit_jmp_buf	*setjmp_head;
+
+	/* The function that the thread compiles without the builder lock */
+	jit_function_t		compiling;
 };
 
 /*
@@ -679,6 +803,82 @@ void _jit_block_build_cfg(jit_function_t func);
  */
 void _jit_block_clean_cfg(jit_function_t func);
 
+/*
+ * Create a block that is placed just before the given block and falls
+ * through into it.  The listed incoming edges of the block are moved
+ * over to the new block and the branches along them are retargeted.
+ * The control flow graph edges must have been built.
+ */
+jit_block_t _jit_block_create_preheader(jit_function_t func, jit_block_t block,
+					_jit_edge_t *edges, int num_edges);
+
+/*
+ * Unroll the counted loops that consist of a single small block by
+ * the given factor.  The control flow graph edges must have been built.
+ */
+void _jit_block_unroll_loops(jit_function_t func, int factor);
+
+/*
+ * Split the locals whose address is only used to load and store at
+ * constant offsets into separate values for the fields they hold.
+ */
+void _jit_block_replace_scalars(jit_function_t func);
+
+/*
+ * Create an empty block that is placed just after the given block and
+ * takes over its fallthrough edge.
+ */
+jit_block_t _jit_block_split_fallthru(jit_function_t func, jit_block_t block);
+
+/*
+ * Add a branch to the given target at the end of the block and add the
+ * matching edge as the first successor of the block.  The operands of
+ * the returned instruction are filled in by the caller.
+ */
+jit_insn_t _jit_block_add_branch(jit_function_t func, jit_block_t block,
+				 int opcode, jit_block_t target);
+
+/*
+ * Add the instructions that count the executions of every block and
+ * allocate the counts.  This is done after the machine-independent
+ * optimizations, just before the code generation.
+ */
+void _jit_block_add_counters(jit_function_t func);
+
+/*
+ * Add the instruction that sets the mark at the address every time the
+ * function runs.
+ */
+void _jit_block_add_use_mark(jit_function_t func, jit_int *mark);
+
+/*
+ * Reorder the blocks by the counts collected by the code of an earlier
+ * compilation of the same function.  The frequent paths fall through
+ * and the blocks that have never run go to the end.
+ */
+void _jit_block_layout_by_counts(jit_function_t func);
+
+/*
+ * Determine if the edge can be made to fall through by placing its
+ * destination just after the block.
+ */
+int _jit_block_can_fall_into(jit_block_t block, _jit_edge_t edge);
+
+/*
+ * Place the blocks in the given order, which starts with the entry
+ * block and ends with the exit block.  The branches are reversed or
+ * added where a block does not fall through into the same block as
+ * before.  The control flow graph edges must have been built.
+ */
+void _jit_block_reorder(jit_function_t func, jit_block_t *blocks, int num_blocks);
+
+/*
+ * Reorder the instructions within each block so that the results of
+ * the long latency instructions are not used right away.  Does nothing
+ * if the back end does not describe the instruction latencies.
+ */
+void _jit_block_schedule_insns(jit_function_t func);
+
 /*
  * Compute block postorder for control flow graph depth first traversal.
  */
@@ -724,6 +924,13 @@ int _jit_block_record_label_flags(jit_function_t func, jit_label_t label, int fl
  */
 jit_insn_t _jit_block_add_insn(jit_block_t block);
 
+/*
+ * Insert an instruction into a block before the instruction at
+ * the given index.  Pointers to the block's instructions are not
+ * valid after this call.
+ */
+jit_insn_t _jit_block_insert_insn(jit_block_t block, int index);
+
 /*
  * Get the last instruction in a block.  NULL if the block is empty.
  */
@@ -747,6 +954,34 @@ void _jit_meta_free_one(void *meta);
  */
 int _jit_insn_check_is_redundant(const jit_insn_iter_t *iter);
 
+/*
+ * Get the body to copy in place of a call to "callee", or NULL if the
+ * call may not be inlined.  Only the compiled functions that were small
+ * enough for the JIT_OPTION_INLINE_LIMIT option have one.
+ */
+jit_function_t _jit_insn_inline_body(jit_function_t func, jit_function_t callee,
+				     unsigned int num_args, int flags);
+
+/*
+ * Copy the body of "callee" into the current block of "func" with the
+ * parameters set to "args".  Returns the value that holds the result
+ * of the call, or NULL if out of memory.
+ */
+jit_value_t _jit_insn_inline_call(jit_function_t func, jit_function_t callee,
+				  jit_value_t *args, unsigned int num_args);
+
+/*
+ * Make a copy of the body of a function that is about to be compiled,
+ * for the functions built later to inline.  Returns NULL if the function
+ * is not small enough or cannot be inlined.
+ */
+jit_function_t _jit_function_copy_inline_body(jit_function_t func);
+
+/*
+ * Free a copy of a body made by "_jit_function_copy_inline_body".
+ */
+void _jit_function_free_inline_body(jit_function_t body);
+
 /*
  * Get the correct opcode to use for a "load" instruction,
  * starting at a particular opcode base.  We assume that the
@@ -909,6 +1144,8 @@ extern _jit_intrinsic_info_t const _jit_intrinsics[JIT_OP_NUM_OPCODES];
 /*
  * Apply an opcode to one or two constant values.
  * Returns the constant result value on success and NULL otherwise.
+ * For a conditional branch the result is a non-zero integer constant
+ * if the branch is taken.
  * NOTE: dest_type MUST be either the correct destination type for the
  * opcode or a tagged type of the correct destination type.
  */
@@ -307,7 +307,7 @@ forward_propagation(jit_block_t block)
 			/* Skip NOP instructions, which may have arguments left
 			   over from when the instruction was replaced, but which
 			   are not relevant to our analysis */
-			if(insn->opcode == JIT_OP_NOP)
+			if(insn2->opcode == JIT_OP_NOP)
 			{
 				continue;
 			}
@@ -453,7 +453,7 @@ backward_propagation(jit_block_t block)
 			/* Skip NOP instructions, which may have arguments left
 			   over from when the instruction was replaced, but which
 			   are not relevant to our analysis */
-			if(insn->opcode == JIT_OP_NOP)
+			if(insn2->opcode == JIT_OP_NOP)
 			{
 				continue;
 			}
@@ -496,7 +496,7 @@ backward_propagation(jit_block_t block)
 			}
 			if((flags2 & JIT_INSN_VALUE2_OTHER_FLAGS) == 0)
 			{
-				if(insn2->value2 == dest || insn2->value1 == value)
+				if(insn2->value2 == dest || insn2->value2 == value)
 				{
 					break;
 				}
@@ -0,0 +1,1455 @@
+/*
+ * jit-loop.c - Loop invariant code motion and induction variables.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#include "jit-cfg.h"
+#ifdef _JIT_COMPILE_DEBUG
+#include <jit/jit-dump.h>
+#include <stdio.h>
+#endif
+
+/*
+ * Special values for the defining node of a value.
+ */
+#define NO_DEF		-1
+#define MULTIPLE_DEFS	-2
+
+/*
+ * Check if the block ends with a call.  The block that follows it picks
+ * up the return value so nothing may be placed between the two.
+ */
+static int
+ends_in_call(jit_block_t block)
+{
+	jit_insn_t insn;
+
+	insn = _jit_block_get_last(block);
+	return (insn && insn->opcode >= JIT_OP_CALL
+		&& insn->opcode <= JIT_OP_CALL_EXTERNAL_TAIL);
+}
+
+/*
+ * Insert a new instruction at the end of the block but before the
+ * branch that ends it if any.
+ */
+static jit_insn_t
+insert_before_branch(jit_block_t block)
+{
+	jit_insn_t last;
+	jit_insn_t insn;
+	int index;
+
+	index = block->num_insns;
+	last = _jit_block_get_last(block);
+	if(last && ((last->opcode >= JIT_OP_BR && last->opcode <= JIT_OP_BR_NFGE_INV)
+		    || last->opcode == JIT_OP_JUMP_TABLE))
+	{
+		--index;
+	}
+
+	insn = _jit_block_insert_insn(block, index);
+	if(!insn)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	return insn;
+}
+
+static int
+create_preheader(_jit_cfg_t cfg, _jit_loop_t loop)
+{
+	jit_block_t header;
+	_jit_edge_t edge;
+	_jit_edge_t *edges;
+	int index, num_edges;
+
+	header = loop->header->block;
+	if(header == cfg->func->builder->entry_block || header->address_of)
+	{
+		return 1;
+	}
+
+	edges = jit_malloc(header->num_preds * sizeof(_jit_edge_t));
+	if(!edges)
+	{
+		return 0;
+	}
+
+	num_edges = 0;
+	for(index = 0; index < header->num_preds; index++)
+	{
+		edge = header->preds[index];
+		if(edge->flags == _JIT_EDGE_FALLTHRU && ends_in_call(edge->src))
+		{
+			num_edges = 0;
+			break;
+		}
+		if(_jit_bitset_test_bit(&loop->body, edge->src->index))
+		{
+			continue;
+		}
+		if(edge->flags != _JIT_EDGE_FALLTHRU && edge->flags != _JIT_EDGE_BRANCH)
+		{
+			num_edges = 0;
+			break;
+		}
+		edges[num_edges++] = edge;
+	}
+
+	if(num_edges > 0)
+	{
+		_jit_block_create_preheader(cfg->func, header, edges, num_edges);
+	}
+
+	jit_free(edges);
+	return 1;
+}
+
+int
+_jit_cfg_create_preheaders(_jit_cfg_t cfg)
+{
+	int index;
+
+	if(cfg->func->has_try)
+	{
+		return 1;
+	}
+	for(index = 0; index < cfg->num_loops; index++)
+	{
+		if(!cfg->loops[index].preheader
+		   && !create_preheader(cfg, &cfg->loops[index]))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Check if the instruction is a plain computation without side effects
+ * that cannot throw exceptions.  The opcodes that are implemented by
+ * intrinsics tell this by their signatures.
+ */
+int
+_jit_insn_is_pure(jit_insn_t insn)
+{
+	const _jit_intrinsic_info_t *info;
+	int opcode;
+
+	if((insn->flags & (JIT_INSN_DEST_OTHER_FLAGS | JIT_INSN_DEST_IS_VALUE
+			   | JIT_INSN_VALUE1_OTHER_FLAGS
+			   | JIT_INSN_VALUE2_OTHER_FLAGS)) != 0)
+	{
+		return 0;
+	}
+
+	opcode = insn->opcode;
+	if((opcode >= JIT_OP_COPY_LOAD_SBYTE && opcode <= JIT_OP_COPY_NFLOAT)
+	   || opcode == JIT_OP_ADD_RELATIVE)
+	{
+		return 1;
+	}
+
+	info = &_jit_intrinsics[opcode];
+	if((info->flags & _JIT_INTRINSIC_FLAG_MASK) == _JIT_INTRINSIC_FLAG_NOT)
+	{
+		opcode = info->flags & ~_JIT_INTRINSIC_FLAG_MASK;
+		if(opcode >= JIT_OP_NUM_OPCODES)
+		{
+			return 0;
+		}
+		info = &_jit_intrinsics[opcode];
+	}
+	if((info->flags & _JIT_INTRINSIC_FLAG_MASK) != _JIT_INTRINSIC_FLAG_NONE)
+	{
+		return 0;
+	}
+	if(info->signature == JIT_SIG_conv)
+	{
+		/* The conversions without overflow checks */
+		return 1;
+	}
+	if(!info->intrinsic)
+	{
+		return 0;
+	}
+
+	switch(info->signature)
+	{
+	case JIT_SIG_NONE:
+	case JIT_SIG_i_piii:
+	case JIT_SIG_i_pIII:
+	case JIT_SIG_i_plll:
+	case JIT_SIG_i_pLLL:
+	case JIT_SIG_conv_ovf:
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Check if the instruction defines its first operand rather than the
+ * destination operand.
+ */
+static int
+defines_value1(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_INCOMING_REG:
+	case JIT_OP_INCOMING_FRAME_POSN:
+	case JIT_OP_RETURN_REG:
+	case JIT_OP_OUTGOING_FRAME_POSN:
+		return 1;
+	}
+	return 0;
+}
+
+static void
+set_def(int *def_node, jit_value_t value, int node)
+{
+	if(def_node[value->index] == NO_DEF)
+	{
+		def_node[value->index] = node;
+	}
+	else
+	{
+		def_node[value->index] = MULTIPLE_DEFS;
+	}
+}
+
+/*
+ * Find the node that defines each value.
+ */
+static void
+find_defs(_jit_cfg_t cfg, int *def_node)
+{
+	_jit_node_t node;
+	_jit_phi_t phi;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+	int index;
+
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		def_node[index] = NO_DEF;
+	}
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		node = &cfg->nodes[index];
+		for(phi = node->phis; phi; phi = phi->next)
+		{
+			set_def(def_node, phi->dest, index);
+		}
+		jit_insn_iter_init(&iter, node->block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			value = _jit_cfg_get_dest(insn);
+			if(value && (insn->flags & JIT_INSN_DEST_IS_VALUE) == 0)
+			{
+				set_def(def_node, value, index);
+			}
+			value = _jit_cfg_get_value1(insn);
+			if(value && defines_value1(insn))
+			{
+				set_def(def_node, value, index);
+			}
+		}
+	}
+}
+
+/*
+ * Check if the value stays the same throughout the loop.
+ */
+static int
+is_invariant(_jit_loop_t loop, int *def_node, jit_value_t value)
+{
+	int node;
+
+	if(!value)
+	{
+		return 1;
+	}
+	if(value->is_addressable || value->is_volatile)
+	{
+		return 0;
+	}
+	node = def_node[value->index];
+	if(node == NO_DEF)
+	{
+		return 1;
+	}
+	return node >= 0 && !_jit_bitset_test_bit(&loop->body, node);
+}
+
+/*
+ * Check if the instruction may be moved out of the loop.  Its result
+ * must be assigned only here so that moving it does not change what
+ * the other instructions see.
+ */
+static int
+is_hoistable(_jit_cfg_t cfg, _jit_loop_t loop, int *def_node, jit_insn_t insn)
+{
+	jit_value_t dest;
+
+	if(insn->opcode == JIT_OP_NOP || !_jit_insn_is_pure(insn))
+	{
+		return 0;
+	}
+	dest = _jit_cfg_get_dest(insn);
+	if(!dest || dest->is_addressable || dest->is_volatile
+	   || def_node[dest->index] < 0)
+	{
+		return 0;
+	}
+	if(!dest->is_temporary && !cfg->values[dest->index].var)
+	{
+		return 0;
+	}
+	return (is_invariant(loop, def_node, _jit_cfg_get_value1(insn))
+		&& is_invariant(loop, def_node, _jit_cfg_get_value2(insn)));
+}
+
+/*
+ * Move the instruction to the end of the preheader.
+ */
+static void
+hoist_insn(_jit_cfg_t cfg, _jit_loop_t loop, int *def_node, jit_insn_t insn)
+{
+	jit_insn_t new_insn;
+	struct _jit_insn saved;
+
+#ifdef _JIT_COMPILE_DEBUG
+	printf("loop invariant code motion: hoist instruction '");
+	jit_dump_insn(stdout, cfg->func, insn);
+	printf("'\n");
+#endif
+
+	saved = *insn;
+	insn->opcode = (short)JIT_OP_NOP;
+	new_insn = insert_before_branch(loop->preheader->block);
+	*new_insn = saved;
+
+	/* The value is no longer local to the block that computes it */
+	if(saved.dest->is_temporary)
+	{
+		_jit_value_make_local(cfg->func, saved.dest);
+	}
+	def_node[saved.dest->index] = loop->preheader->block->index;
+}
+
+static void
+hoist_loop_invariants(_jit_cfg_t cfg, _jit_loop_t loop, int *def_node)
+{
+	_jit_node_t node;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int index, changed;
+
+	/* Visit the nodes in reverse post order so that the invariant
+	   operands are mostly hoisted before the instructions that
+	   use them */
+	do
+	{
+		changed = 0;
+		for(index = cfg->num_post_order - 1; index >= 0; index--)
+		{
+			node = cfg->post_order[index];
+			if(!_jit_bitset_test_bit(&loop->body, node->block->index))
+			{
+				continue;
+			}
+			jit_insn_iter_init(&iter, node->block);
+			while((insn = jit_insn_iter_next(&iter)) != 0)
+			{
+				if(is_hoistable(cfg, loop, def_node, insn))
+				{
+					hoist_insn(cfg, loop, def_node, insn);
+					changed = 1;
+				}
+			}
+		}
+	}
+	while(changed);
+}
+
+int
+_jit_ssa_hoist_invariants(_jit_cfg_t cfg)
+{
+	int *def_node;
+	int index;
+
+	if(!cfg->in_ssa)
+	{
+		return 1;
+	}
+	if(!_jit_cfg_find_loops(cfg))
+	{
+		return 0;
+	}
+	if(cfg->num_loops == 0)
+	{
+		return 1;
+	}
+
+	def_node = jit_malloc(cfg->num_values * sizeof(int));
+	if(!def_node)
+	{
+		return 0;
+	}
+	find_defs(cfg, def_node);
+
+	/* The code hoisted out of an inner loop may be hoisted further out
+	   of the loops that contain it */
+	for(index = 0; index < cfg->num_loops; index++)
+	{
+		if(cfg->loops[index].preheader)
+		{
+			hoist_loop_invariants(cfg, &cfg->loops[index], def_node);
+		}
+	}
+
+	jit_free(def_node);
+	return 1;
+}
+
+/*
+ * Induction value.  The value is equal to "expand(iv) * scale + offset"
+ * where "iv" is a basic induction variable that starts with "init" and
+ * changes by "step" on every iteration of the loop.  The expansion is
+ * applied only if "expand" is set.
+ */
+struct induction
+{
+	jit_value_t		iv;
+	jit_value_t		init;
+	jit_long		step;
+	int			expand;
+	jit_long		scale;
+	jit_value_t		offset;
+
+	/* Set if the arithmetic is done on long values */
+	int			is_long;
+
+	/* The instruction that derives the value from another one and
+	   the variable that replaces it */
+	jit_insn_t		insn;
+	jit_value_t		var;
+	int			needed;
+};
+
+/*
+ * Get the value of an integer constant.
+ */
+static int
+get_constant(jit_value_t value, jit_long *result)
+{
+	if(!value || !value->is_constant)
+	{
+		return 0;
+	}
+	switch(jit_type_normalize(value->type)->kind)
+	{
+	case JIT_TYPE_INT:
+		*result = (jit_int) jit_value_get_nint_constant(value);
+		return 1;
+	case JIT_TYPE_UINT:
+		*result = (jit_uint) jit_value_get_nint_constant(value);
+		return 1;
+	case JIT_TYPE_LONG:
+	case JIT_TYPE_ULONG:
+		*result = jit_value_get_long_constant(value);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Check if the value holds an integer of the given width.  Returns zero
+ * for other types.
+ */
+static int
+is_integer(jit_value_t value, int is_long)
+{
+	switch(jit_type_normalize(value->type)->kind)
+	{
+	case JIT_TYPE_INT:
+	case JIT_TYPE_UINT:
+		return !is_long;
+	case JIT_TYPE_LONG:
+	case JIT_TYPE_ULONG:
+		return is_long;
+	}
+	return 0;
+}
+
+static struct induction *
+get_induction(_jit_cfg_t cfg, struct induction *ivs, jit_value_t value)
+{
+	if(!value || value->is_constant || value->index < 0
+	   || value->index >= cfg->num_values || !ivs[value->index].iv)
+	{
+		return 0;
+	}
+	return &ivs[value->index];
+}
+
+/*
+ * Find the instruction in the node that defines the value.
+ */
+static jit_insn_t
+find_def_insn(_jit_node_t node, jit_value_t value)
+{
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+
+	jit_insn_iter_init(&iter, node->block);
+	while((insn = jit_insn_iter_next(&iter)) != 0)
+	{
+		if(insn->opcode != JIT_OP_NOP && _jit_cfg_get_dest(insn) == value
+		   && (insn->flags & JIT_INSN_DEST_IS_VALUE) == 0)
+		{
+			return insn;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Find out how much the basic induction variable changes on one
+ * iteration following the copies of the value that is passed back
+ * to the header.
+ */
+static int
+find_step(_jit_cfg_t cfg, _jit_loop_t loop, int *def_node, jit_value_t iv,
+	  jit_value_t value, int is_long, jit_long *step)
+{
+	jit_insn_t insn;
+	jit_long constant;
+	int node;
+
+	for(;;)
+	{
+		if(value->is_constant || value->index < 0)
+		{
+			return 0;
+		}
+		node = def_node[value->index];
+		if(node < 0 || !_jit_bitset_test_bit(&loop->body, node))
+		{
+			return 0;
+		}
+		insn = find_def_insn(&cfg->nodes[node], value);
+		if(!insn || !_jit_insn_is_pure(insn))
+		{
+			return 0;
+		}
+		if(insn->opcode == (is_long ? JIT_OP_COPY_LONG : JIT_OP_COPY_INT))
+		{
+			value = insn->value1;
+			continue;
+		}
+		break;
+	}
+
+	if(insn->opcode == (is_long ? JIT_OP_LADD : JIT_OP_IADD))
+	{
+		if(insn->value1 == iv && get_constant(insn->value2, &constant))
+		{
+			*step = constant;
+		}
+		else if(insn->value2 == iv && get_constant(insn->value1, &constant))
+		{
+			*step = constant;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	else if(insn->opcode == (is_long ? JIT_OP_LSUB : JIT_OP_ISUB))
+	{
+		if(insn->value1 == iv && get_constant(insn->value2, &constant))
+		{
+			*step = -constant;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		return 0;
+	}
+
+	if(!is_long)
+	{
+		*step = (jit_int) *step;
+	}
+	return *step != 0;
+}
+
+/*
+ * Find the basic induction variables of the loop.  These are the phi
+ * functions of the header that add a constant to their value on every
+ * iteration.
+ */
+static void
+find_basic_ivs(_jit_cfg_t cfg, _jit_loop_t loop, int *def_node,
+	       struct induction *ivs, int entry)
+{
+	_jit_phi_t phi;
+	struct induction *iv;
+	jit_long step;
+	int is_long;
+
+	for(phi = loop->header->phis; phi; phi = phi->next)
+	{
+		if(is_integer(phi->dest, 0))
+		{
+			is_long = 0;
+		}
+		else if(is_integer(phi->dest, 1))
+		{
+			is_long = 1;
+		}
+		else
+		{
+			continue;
+		}
+		if(!find_step(cfg, loop, def_node, phi->dest, phi->args[1 - entry],
+			      is_long, &step))
+		{
+			continue;
+		}
+
+		iv = &ivs[phi->dest->index];
+		iv->iv = phi->dest;
+		iv->init = phi->args[entry];
+		iv->step = step;
+		iv->scale = 1;
+		iv->is_long = is_long;
+	}
+}
+
+/*
+ * Check if the instruction derives an induction value from another one
+ * and record it.
+ */
+static void
+derive_induction(_jit_cfg_t cfg, _jit_loop_t loop, int *def_node,
+		 struct induction *ivs, jit_insn_t insn)
+{
+	struct induction *base;
+	struct induction result;
+	jit_value_t dest;
+	jit_value_t other;
+	jit_long constant;
+	int is_long;
+
+	if(!_jit_insn_is_pure(insn))
+	{
+		return;
+	}
+	dest = _jit_cfg_get_dest(insn);
+	if(!dest || dest->index < 0 || dest->index >= cfg->num_values
+	   || dest->is_addressable || dest->is_volatile
+	   || def_node[dest->index] < 0 || ivs[dest->index].iv)
+	{
+		return;
+	}
+	if(!dest->is_temporary && !cfg->values[dest->index].var)
+	{
+		return;
+	}
+
+	base = get_induction(cfg, ivs, insn->value1);
+	other = insn->value2;
+	if(!base)
+	{
+		base = get_induction(cfg, ivs, insn->value2);
+		other = insn->value1;
+		if(!base)
+		{
+			return;
+		}
+	}
+	result = *base;
+	is_long = base->is_long;
+
+	switch(insn->opcode)
+	{
+	case JIT_OP_EXPAND_INT:
+	case JIT_OP_EXPAND_UINT:
+		/* The variable is assumed not to wrap around, it would be
+		   undefined to use such a value as an index anyway */
+		if(is_long || result.scale != 1 || result.offset)
+		{
+			return;
+		}
+		result.expand = insn->opcode;
+		is_long = 1;
+		break;
+
+	case JIT_OP_IMUL:
+	case JIT_OP_LMUL:
+		if(is_long != (insn->opcode == JIT_OP_LMUL) || result.offset
+		   || !get_constant(other, &constant) || constant == 0)
+		{
+			return;
+		}
+		result.scale = (jit_long) ((jit_ulong) result.scale * (jit_ulong) constant);
+		break;
+
+	case JIT_OP_ISHL:
+	case JIT_OP_LSHL:
+		if(is_long != (insn->opcode == JIT_OP_LSHL) || result.offset
+		   || base != get_induction(cfg, ivs, insn->value1)
+		   || !get_constant(other, &constant)
+		   || constant < 0 || constant >= (is_long ? 64 : 32))
+		{
+			return;
+		}
+		result.scale = (jit_long) ((jit_ulong) result.scale << constant);
+		break;
+
+	case JIT_OP_IADD:
+	case JIT_OP_LADD:
+		if(is_long != (insn->opcode == JIT_OP_LADD) || result.offset
+		   || (!other->is_constant && !is_invariant(loop, def_node, other)))
+		{
+			return;
+		}
+		result.offset = other;
+		break;
+
+	default:
+		return;
+	}
+
+	if(!is_long)
+	{
+		result.scale = (jit_int) result.scale;
+	}
+	if(result.scale == 0 || !is_integer(dest, is_long))
+	{
+		return;
+	}
+	result.is_long = is_long;
+	result.insn = insn;
+	ivs[dest->index] = result;
+}
+
+/*
+ * Mark the derived induction values that are used by anything other
+ * than the instructions that derive the values that are replaced in
+ * turn.  Only these need to be computed incrementally.
+ */
+static void
+mark_use(_jit_cfg_t cfg, struct induction *ivs, jit_insn_t insn,
+	 jit_value_t value)
+{
+	struct induction *iv;
+	struct induction *user;
+
+	iv = get_induction(cfg, ivs, value);
+	if(!iv || !iv->insn || iv->scale == 1)
+	{
+		return;
+	}
+	if(insn)
+	{
+		user = get_induction(cfg, ivs, _jit_cfg_get_dest(insn));
+		if(user && user->insn == insn && user->scale != 1)
+		{
+			return;
+		}
+	}
+	iv->needed = 1;
+}
+
+static void
+mark_needed(_jit_cfg_t cfg, struct induction *ivs)
+{
+	_jit_node_t node;
+	_jit_phi_t phi;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int index, arg;
+
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		node = &cfg->nodes[index];
+		for(phi = node->phis; phi; phi = phi->next)
+		{
+			for(arg = 0; arg < node->block->num_preds; arg++)
+			{
+				mark_use(cfg, ivs, 0, phi->args[arg]);
+			}
+		}
+		jit_insn_iter_init(&iter, node->block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+			{
+				mark_use(cfg, ivs, insn, _jit_cfg_get_dest(insn));
+			}
+			mark_use(cfg, ivs, insn, _jit_cfg_get_value1(insn));
+			mark_use(cfg, ivs, insn, _jit_cfg_get_value2(insn));
+		}
+	}
+}
+
+static jit_value_t
+create_integer(jit_function_t func, int is_long, jit_long value)
+{
+	jit_value_t result;
+
+	if(is_long)
+	{
+		result = jit_value_create_long_constant(func, jit_type_long, value);
+	}
+	else
+	{
+		result = jit_value_create_nint_constant(func, jit_type_int, (jit_int) value);
+	}
+	if(!result)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	return result;
+}
+
+/*
+ * Add an instruction before the branch at the end of the block or
+ * fold it if its operands are constant.
+ */
+static jit_value_t
+emit_insn(jit_function_t func, jit_block_t block, int fold, int opcode,
+	  jit_value_t dest, jit_value_t value1, jit_value_t value2)
+{
+	jit_value_t result;
+	jit_insn_t insn;
+
+	if(fold && value1->is_constant && (!value2 || value2->is_constant))
+	{
+		result = _jit_opcode_apply(func, opcode, dest->type, value1, value2);
+		if(result)
+		{
+			return result;
+		}
+	}
+
+	insn = insert_before_branch(block);
+	insn->opcode = (short)opcode;
+	insn->dest = dest;
+	insn->value1 = value1;
+	insn->value2 = value2;
+	if(!value1->is_constant)
+	{
+		++(value1->usage_count);
+	}
+	if(value2 && !value2->is_constant)
+	{
+		++(value2->usage_count);
+	}
+	return dest;
+}
+
+/*
+ * Compute the initial value of the induction variable in the preheader
+ * and increment it at the end of the latch.
+ */
+static void
+update_induction(_jit_cfg_t cfg, _jit_loop_t loop, jit_block_t latch,
+		 int fold, struct induction *iv)
+{
+	jit_function_t func;
+	jit_value_t value;
+	jit_block_t block;
+	jit_long constant;
+	int is_long;
+
+	func = cfg->func;
+	block = loop->preheader->block;
+	is_long = iv->is_long;
+
+	value = iv->init;
+	if(iv->expand)
+	{
+		value = emit_insn(func, block, fold, iv->expand, iv->var, value, 0);
+	}
+	value = emit_insn(func, block, fold, is_long ? JIT_OP_LMUL : JIT_OP_IMUL,
+			  iv->var, value, create_integer(func, is_long, iv->scale));
+	if(iv->offset && get_constant(value, &constant) && constant == 0)
+	{
+		value = iv->offset;
+	}
+	else if(iv->offset)
+	{
+		value = emit_insn(func, block, fold, is_long ? JIT_OP_LADD : JIT_OP_IADD,
+				  iv->var, value, iv->offset);
+	}
+	if(value != iv->var)
+	{
+		emit_insn(func, block, 0, is_long ? JIT_OP_COPY_LONG : JIT_OP_COPY_INT,
+			  iv->var, value, 0);
+	}
+
+	emit_insn(func, latch, 0, is_long ? JIT_OP_LADD : JIT_OP_IADD,
+		  iv->var, iv->var,
+		  create_integer(func, is_long, (jit_long) ((jit_ulong) iv->scale
+							    * (jit_ulong) iv->step)));
+}
+
+static int
+reduce_loop(_jit_cfg_t cfg, _jit_loop_t loop, int *def_node,
+	    struct induction *ivs, int fold)
+{
+	_jit_node_t node;
+	jit_block_t header, latch;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	struct induction *iv;
+	int index, entry, num_values;
+
+	/* Look for the loops with a single latch that may be updated */
+	header = loop->header->block;
+	if(!loop->preheader || header->num_preds != 2)
+	{
+		return 1;
+	}
+	entry = (header->preds[0]->src == loop->preheader->block) ? 0 : 1;
+	latch = header->preds[1 - entry]->src;
+	if(header->preds[entry]->src != loop->preheader->block
+	   || !_jit_bitset_test_bit(&loop->body, latch->index)
+	   || ends_in_call(latch))
+	{
+		return 1;
+	}
+
+	num_values = cfg->num_values;
+	jit_memzero(ivs, num_values * sizeof(struct induction));
+	find_basic_ivs(cfg, loop, def_node, ivs, entry);
+
+	for(index = cfg->num_post_order - 1; index >= 0; index--)
+	{
+		node = cfg->post_order[index];
+		if(!_jit_bitset_test_bit(&loop->body, node->block->index))
+		{
+			continue;
+		}
+		jit_insn_iter_init(&iter, node->block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			derive_induction(cfg, loop, def_node, ivs, insn);
+		}
+	}
+	mark_needed(cfg, ivs);
+
+	/* Replace the derived values with copies of the new variables.
+	   The instructions are added to the blocks only after that as
+	   the recorded instructions might move */
+	for(index = 0; index < num_values; index++)
+	{
+		iv = &ivs[index];
+		if(!iv->needed)
+		{
+			continue;
+		}
+
+#ifdef _JIT_COMPILE_DEBUG
+		printf("strength reduction: replace instruction '");
+		jit_dump_insn(stdout, cfg->func, iv->insn);
+		printf("'\n");
+#endif
+
+		iv->var = _jit_value_create_local(cfg->func, iv->insn->dest->type);
+		if(!iv->var || !_jit_cfg_add_value(cfg, iv->var))
+		{
+			return 0;
+		}
+		iv->insn->opcode = (short)(iv->is_long ? JIT_OP_COPY_LONG : JIT_OP_COPY_INT);
+		iv->insn->value1 = iv->var;
+		iv->insn->value2 = 0;
+		++(iv->var->usage_count);
+	}
+	for(index = 0; index < num_values; index++)
+	{
+		if(ivs[index].needed)
+		{
+			update_induction(cfg, loop, latch, fold, &ivs[index]);
+		}
+	}
+
+	return 1;
+}
+
+int
+_jit_ssa_reduce_strength(_jit_cfg_t cfg)
+{
+	struct induction *ivs;
+	int *def_node;
+	int index, fold;
+
+	if(!cfg->in_ssa)
+	{
+		return 1;
+	}
+	if(!_jit_cfg_find_loops(cfg))
+	{
+		return 0;
+	}
+	fold = !jit_context_get_meta_numeric(cfg->func->context, JIT_OPTION_DONT_FOLD);
+
+	for(index = 0; index < cfg->num_loops; index++)
+	{
+		/* The variables that replace the induction values of a loop
+		   are added to the value table so the tables are built anew
+		   for every loop */
+		def_node = jit_malloc(cfg->num_values * sizeof(int));
+		ivs = jit_malloc(cfg->num_values * sizeof(struct induction));
+		if(!def_node || !ivs)
+		{
+			jit_free(def_node);
+			jit_free(ivs);
+			return 0;
+		}
+		find_defs(cfg, def_node);
+		if(!reduce_loop(cfg, &cfg->loops[index], def_node, ivs, fold))
+		{
+			jit_free(def_node);
+			jit_free(ivs);
+			return 0;
+		}
+		jit_free(def_node);
+		jit_free(ivs);
+	}
+
+	return 1;
+}
+
+/*
+ * Largest number of instructions in the body of an unrolled loop.
+ */
+#define UNROLL_MAX_INSNS	128
+
+/*
+ * Counted loop that consists of a single block.  The loop ends with
+ * a test of the counter against the limit that branches back to the
+ * start of the block.  The counter is incremented by a constant once
+ * in the block.
+ */
+struct counted_loop
+{
+	jit_block_t		block;
+	jit_block_t		exit;
+	int			opcode;
+	jit_value_t		counter;
+	jit_value_t		limit;
+	jit_long		step;
+	int			num_insns;
+};
+
+static int
+defines_value(jit_insn_t insn, jit_value_t value)
+{
+	if(insn->opcode == JIT_OP_NOP)
+	{
+		return 0;
+	}
+	if(insn->dest == value
+	   && (insn->flags & (JIT_INSN_DEST_OTHER_FLAGS | JIT_INSN_DEST_IS_VALUE)) == 0)
+	{
+		return 1;
+	}
+	return (insn->value1 == value && defines_value1(insn));
+}
+
+/*
+ * Find the instruction that is the only one to define the value in
+ * the block.  Returns NULL if there are none or more than one.
+ */
+static jit_insn_t
+find_single_def(jit_block_t block, jit_value_t value)
+{
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_insn_t def;
+
+	def = 0;
+	jit_insn_iter_init(&iter, block);
+	while((insn = jit_insn_iter_next(&iter)) != 0)
+	{
+		if(defines_value(insn, value))
+		{
+			if(def)
+			{
+				return 0;
+			}
+			def = insn;
+		}
+	}
+	return def;
+}
+
+/*
+ * Check if the instruction adds a positive constant to the counter.
+ */
+static int
+is_increment(jit_insn_t insn, jit_value_t counter, jit_long *step)
+{
+	if(insn->opcode != JIT_OP_IADD || insn->value1 != counter
+	   || !get_constant(insn->value2, step))
+	{
+		return 0;
+	}
+	*step = (jit_int) *step;
+	return *step > 0;
+}
+
+static int
+find_counted_loop(jit_function_t func, jit_block_t block,
+		  struct counted_loop *loop)
+{
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_insn_t last;
+	jit_value_t counter;
+	jit_value_t limit;
+	_jit_edge_t edge;
+	int index, num_entries;
+
+	if(block == func->builder->entry_block || block->address_of
+	   || block->num_succs != 2
+	   || block->succs[0]->dst != block
+	   || block->succs[0]->flags != _JIT_EDGE_BRANCH
+	   || block->succs[1]->flags != _JIT_EDGE_FALLTHRU
+	   || block->succs[1]->dst == func->builder->exit_block)
+	{
+		return 0;
+	}
+	num_entries = 0;
+	for(index = 0; index < block->num_preds; index++)
+	{
+		edge = block->preds[index];
+		if(edge->src == block)
+		{
+			continue;
+		}
+		if((edge->flags != _JIT_EDGE_FALLTHRU && edge->flags != _JIT_EDGE_BRANCH)
+		   || (edge->flags == _JIT_EDGE_FALLTHRU && ends_in_call(edge->src)))
+		{
+			return 0;
+		}
+		++num_entries;
+	}
+	if(num_entries == 0)
+	{
+		return 0;
+	}
+
+	last = _jit_block_get_last(block);
+	switch(last->opcode)
+	{
+	case JIT_OP_BR_ILT:
+	case JIT_OP_BR_ILE:
+	case JIT_OP_BR_ILT_UN:
+	case JIT_OP_BR_ILE_UN:
+		break;
+	default:
+		return 0;
+	}
+
+	/* The counter is a local variable compared against a constant
+	   or a variable that does not change in the loop */
+	counter = last->value1;
+	limit = last->value2;
+	if(counter->is_constant || counter->is_temporary
+	   || counter->is_addressable || counter->is_volatile
+	   || !is_integer(counter, 0) || !is_integer(limit, 0))
+	{
+		return 0;
+	}
+	if(!limit->is_constant
+	   && (limit == counter || limit->is_temporary
+	       || limit->is_addressable || limit->is_volatile
+	       || find_single_def(block, limit) != 0))
+	{
+		return 0;
+	}
+
+	/* The counter is incremented either directly or through a copy */
+	insn = find_single_def(block, counter);
+	if(!insn)
+	{
+		return 0;
+	}
+	if(insn->opcode == JIT_OP_COPY_INT && !insn->value1->is_constant
+	   && (insn->flags & JIT_INSN_VALUE1_OTHER_FLAGS) == 0)
+	{
+		last = insn;
+		insn = find_single_def(block, insn->value1);
+		if(!insn || insn > last)
+		{
+			return 0;
+		}
+		last = _jit_block_get_last(block);
+	}
+	if(!is_increment(insn, counter, &loop->step))
+	{
+		return 0;
+	}
+
+	loop->num_insns = 0;
+	jit_insn_iter_init(&iter, block);
+	while((insn = jit_insn_iter_next(&iter)) != 0 && insn != last)
+	{
+		if(insn->opcode == JIT_OP_NOP)
+		{
+			continue;
+		}
+		if((insn->flags & JIT_INSN_DEST_IS_LABEL) != 0)
+		{
+			return 0;
+		}
+		++(loop->num_insns);
+	}
+
+	loop->block = block;
+	loop->exit = block->succs[1]->dst;
+	loop->opcode = last->opcode;
+	loop->counter = counter;
+	loop->limit = limit;
+	return 1;
+}
+
+/*
+ * Compute the value of the counter after the given number of further
+ * iterations widened to a long so that the result does not overflow.
+ */
+static jit_value_t
+emit_guard_value(jit_function_t func, jit_block_t block, int expand,
+		 jit_value_t dest, jit_value_t value, jit_long offset)
+{
+	jit_long constant;
+
+	if(value->is_constant)
+	{
+		get_constant(value, &constant);
+		if(expand == JIT_OP_EXPAND_INT)
+		{
+			constant = (jit_int) constant;
+		}
+		else
+		{
+			constant = (jit_uint) constant;
+		}
+		return create_integer(func, 1, constant + offset);
+	}
+
+	emit_insn(func, block, 0, expand, dest, value, 0);
+	if(offset != 0)
+	{
+		emit_insn(func, block, 0, JIT_OP_LADD, dest, dest,
+			  create_integer(func, 1, offset));
+	}
+	return dest;
+}
+
+static void
+count_uses(jit_insn_t insn)
+{
+	jit_value_t value;
+
+	if((value = _jit_cfg_get_dest(insn)) != 0)
+	{
+		++(value->usage_count);
+	}
+	if((value = _jit_cfg_get_value1(insn)) != 0)
+	{
+		++(value->usage_count);
+	}
+	if((value = _jit_cfg_get_value2(insn)) != 0)
+	{
+		++(value->usage_count);
+	}
+}
+
+/*
+ * Unroll the loop.  The blocks are laid out as follows:
+ *
+ *	guard:	if(!(counter + (factor - 1) * step < limit)) goto loop;
+ *	body:	factor copies of the loop body
+ *		if(counter + (factor - 1) * step < limit) goto body;
+ *	test:	if(!(counter < limit)) goto exit;
+ *	loop:	the original loop
+ *	exit:
+ *
+ * The comparisons in the guard and at the end of the unrolled body
+ * are done on long values.
+ */
+static void
+unroll_loop(jit_function_t func, struct counted_loop *loop, int factor)
+{
+	jit_block_t guard, body, test;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_insn_t branch;
+	jit_insn_t new_insn;
+	_jit_edge_t *edges;
+	jit_value_t last;
+	jit_value_t limit;
+	jit_value_t value;
+	int index, num_edges, copy;
+	int expand, exit_opcode, body_opcode, guard_opcode;
+
+#ifdef _JIT_COMPILE_DEBUG
+	printf("loop unrolling: unroll block %d %d times\n",
+	       loop->block->index, factor);
+#endif
+
+	switch(loop->opcode)
+	{
+	case JIT_OP_BR_ILT:
+		expand = JIT_OP_EXPAND_INT;
+		exit_opcode = JIT_OP_BR_IGE;
+		body_opcode = JIT_OP_BR_LLT;
+		guard_opcode = JIT_OP_BR_LGE;
+		break;
+	case JIT_OP_BR_ILE:
+		expand = JIT_OP_EXPAND_INT;
+		exit_opcode = JIT_OP_BR_IGT;
+		body_opcode = JIT_OP_BR_LLE;
+		guard_opcode = JIT_OP_BR_LGT;
+		break;
+	case JIT_OP_BR_ILT_UN:
+		expand = JIT_OP_EXPAND_UINT;
+		exit_opcode = JIT_OP_BR_IGE_UN;
+		body_opcode = JIT_OP_BR_LLT;
+		guard_opcode = JIT_OP_BR_LGE;
+		break;
+	default:
+		expand = JIT_OP_EXPAND_UINT;
+		exit_opcode = JIT_OP_BR_IGT_UN;
+		body_opcode = JIT_OP_BR_LLE;
+		guard_opcode = JIT_OP_BR_LGT;
+		break;
+	}
+
+	/* Create the guard in place of the loop's entry */
+	edges = jit_malloc(loop->block->num_preds * sizeof(_jit_edge_t));
+	if(!edges)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	num_edges = 0;
+	for(index = 0; index < loop->block->num_preds; index++)
+	{
+		if(loop->block->preds[index]->src != loop->block)
+		{
+			edges[num_edges++] = loop->block->preds[index];
+		}
+	}
+	guard = _jit_block_create_preheader(func, loop->block, edges, num_edges);
+	jit_free(edges);
+	body = _jit_block_split_fallthru(func, guard);
+	test = _jit_block_split_fallthru(func, body);
+
+	last = _jit_value_create_local(func, jit_type_long);
+	if(!last)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	limit = loop->limit;
+	if(!limit->is_constant)
+	{
+		limit = _jit_value_create_local(func, jit_type_long);
+		if(!limit)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+	}
+
+	value = emit_guard_value(func, guard, expand, last, loop->counter,
+				 (factor - 1) * loop->step);
+	limit = emit_guard_value(func, guard, expand, limit, loop->limit, 0);
+	insn = _jit_block_add_branch(func, guard, guard_opcode, loop->block);
+	insn->value1 = value;
+	insn->value2 = limit;
+	count_uses(insn);
+
+	/* Copy the loop body */
+	branch = _jit_block_get_last(loop->block);
+	for(copy = 0; copy < factor; copy++)
+	{
+		jit_insn_iter_init(&iter, loop->block);
+		while((insn = jit_insn_iter_next(&iter)) != 0 && insn != branch)
+		{
+			if(insn->opcode == JIT_OP_NOP)
+			{
+				continue;
+			}
+			new_insn = _jit_block_add_insn(body);
+			if(!new_insn)
+			{
+				jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+			}
+			*new_insn = *insn;
+			count_uses(new_insn);
+		}
+	}
+	value = emit_guard_value(func, body, expand, last, loop->counter,
+				 (factor - 1) * loop->step);
+	insn = _jit_block_add_branch(func, body, body_opcode, body);
+	insn->value1 = value;
+	insn->value2 = limit;
+	count_uses(insn);
+
+	insn = _jit_block_add_branch(func, test, exit_opcode, loop->exit);
+	insn->value1 = loop->counter;
+	insn->value2 = loop->limit;
+	count_uses(insn);
+}
+
+void
+_jit_block_unroll_loops(jit_function_t func, int factor)
+{
+	struct counted_loop loop;
+	jit_block_t block;
+
+	if(factor < 2 || func->has_try)
+	{
+		return;
+	}
+
+	for(block = func->builder->entry_block; block; block = block->next)
+	{
+		if(find_counted_loop(func, block, &loop)
+		   && loop.num_insns * factor <= UNROLL_MAX_INSNS)
+		{
+			unroll_loop(func, &loop, factor);
+		}
+	}
+}
@@ -52,17 +52,58 @@ extern	"C" {
 #endif
 
 /*
- * Method information block, organised as a red-black tree node.
- * There may be more than one such block associated with a method
- * if the method contains exception regions.
+ * Tune the size of the region that the pages are taken from when the
+ * code is mapped twice or backed by huge pages and no cache limit is
+ * set.  Only the address space is reserved, the memory behind it grows
+ * with the pages in use.  It is the largest size of the function cache
+ * in that case.
+ */
+#ifndef JIT_CACHE_REGION_SIZE
+#define JIT_CACHE_REGION_SIZE		\
+	(sizeof(void *) > 4 ? ((jit_nuint) 64 << 30) : ((jit_nuint) 256 << 20))
+#endif
+
+/*
+ * Tune the size of a huge page.  The region that the pages are taken
+ * from is aligned on it when the option JIT_OPTION_CACHE_HUGE_PAGES
+ * is set.
+ */
+#ifndef JIT_CACHE_HUGE_PAGE_SIZE
+#define JIT_CACHE_HUGE_PAGE_SIZE	(2 * 1024 * 1024)
+#endif
+
+/*
+ * Tune the lookup map.  The address space is split into granules of
+ * (1 << JIT_CACHE_MAP_SHIFT) bytes, and each level of the map indexes
+ * JIT_CACHE_MAP_BITS bits of the granule number.
+ */
+#ifndef JIT_CACHE_MAP_SHIFT
+#define JIT_CACHE_MAP_SHIFT		12
+#endif
+#ifndef JIT_CACHE_MAP_BITS
+#define JIT_CACHE_MAP_BITS		8
+#endif
+#define	JIT_CACHE_MAP_SIZE		(1 << JIT_CACHE_MAP_BITS)
+#define	JIT_CACHE_MAP_LEVELS		\
+	((sizeof(void *) * 8 - JIT_CACHE_MAP_SHIFT + JIT_CACHE_MAP_BITS - 1) \
+	 / JIT_CACHE_MAP_BITS)
+
+/*
+ * Initial number of entries of a bucket of the lookup map.
+ */
+#ifndef JIT_CACHE_BUCKET_SIZE
+#define JIT_CACHE_BUCKET_SIZE		8
+#endif
+
+/*
+ * Method information block.
  */
 typedef struct jit_cache_node *jit_cache_node_t;
 struct jit_cache_node
 {
-	jit_cache_node_t	left;		/* Left sub-tree and red/black bit */
-	jit_cache_node_t	right;		/* Right sub-tree */
 	unsigned char		*start;		/* Start of the cache region */
 	unsigned char		*end;		/* End of the cache region */
+	unsigned char		*data;		/* Start of the function data */
 	jit_function_t		func;		/* Function info block slot */
 };
 
@@ -75,6 +116,67 @@ struct jit_cache_page
 	long			factor;		/* Page size factor */
 };
 
+/*
+ * Structure of the free block list entry.
+ */
+struct jit_cache_block
+{
+	unsigned char		*start;		/* Start of the free block */
+	unsigned char		*end;		/* End of the free block */
+};
+
+/*
+ * Structure of the entry of a bucket of the lookup map.
+ */
+struct jit_cache_entry
+{
+	unsigned char		*start;		/* Start of the method code */
+	unsigned char		*end;		/* End of the method code */
+	jit_cache_node_t	node;		/* Method information block */
+};
+
+/*
+ * Structure of a level of the lookup map.  The slots of the last level
+ * point to buckets, and the slots of the others to the next level.
+ */
+struct jit_cache_map
+{
+	void			*slots[JIT_CACHE_MAP_SIZE];
+};
+
+/*
+ * Structure of a bucket of the lookup map, which holds the methods
+ * that overlap a granule.  A bucket that is outgrown is kept until
+ * the cache is destroyed, as a thread may still be searching it.
+ */
+struct jit_cache_bucket
+{
+	struct jit_cache_bucket	*next;		/* Next outgrown bucket */
+	unsigned long		size;		/* Number of entries that fit */
+	unsigned long		num;		/* Number of entries in use */
+	struct jit_cache_entry	entries[1];	/* Entries sorted by address */
+};
+
+/*
+ * Structure of the code region of a compiling thread.  Each thread
+ * writes its methods to a free region of its own, so that several
+ * methods can be written at once.  An arena without a started method
+ * may be taken over by another thread.
+ */
+typedef struct jit_cache_arena *jit_cache_arena_t;
+struct jit_cache_arena
+{
+	jit_cache_arena_t	next;		/* Next arena of the cache */
+	jit_thread_id_t		owner;		/* Thread that uses the arena */
+	unsigned long		restartSize;	/* Free region size needed to restart */
+	unsigned long		sizeHint;	/* Expected size of the next function */
+	unsigned char		*free_start;	/* Current start of the free region */
+	unsigned char		*free_end;	/* Current end of the free region */
+	unsigned char		*prev_start;	/* Previous start of the free region */
+	unsigned char		*prev_end;	/* Previous end of the free region */
+	jit_cache_node_t	node;		/* Information for the current function */
+};
+
 /*
  * Structure of the method cache.
  */
@@ -87,46 +189,415 @@ struct jit_cache
 	unsigned long		pageSize;	/* Default size of a page for allocation */
 	unsigned int		maxPageFactor;	/* Maximum page size factor */
 	long			pagesLeft;	/* Number of pages left to allocate */
-	unsigned char		*free_start;	/* Current start of the free region */
-	unsigned char		*free_end;	/* Current end of the free region */
-	unsigned char		*prev_start;	/* Previous start of the free region */
-	unsigned char		*prev_end;	/* Previous end of the free region */
-	jit_cache_node_t	node;		/* Information for the current function */
-	struct jit_cache_node	head;		/* Head of the lookup tree */
-	struct jit_cache_node	nil;		/* Nil pointer for the lookup tree */
+	unsigned char		*region;	/* Region the pages are taken from */
+	unsigned char		*regionTop;	/* Start of the unused region part */
+	unsigned char		*regionEnd;	/* End of the region */
+	unsigned char		*regionMapped;	/* End of the region part that may be used */
+	int			viewFd;		/* File behind the two region mappings */
+	jit_nint		execOffset;	/* Offset of the executable view */
+	unsigned long		discardSize;	/* Unit of memory given back in the region */
+	int			hugePages;	/* Non-zero if the region has huge pages */
+	struct jit_cache_block	*blocks;	/* Free blocks sorted by address */
+	unsigned long		numBlocks;	/* Number of free blocks */
+	unsigned long		maxNumBlocks;	/* Maximum number of blocks in the list */
+	jit_cache_arena_t	arenas;		/* Code regions of the compiling threads */
+	void			*map;		/* Lookup map of the methods */
+	struct jit_cache_bucket	*oldBuckets;	/* Outgrown buckets of the map */
+	unsigned long		numEntries;	/* Number of methods in the map */
+	volatile unsigned int	tableSeq;	/* Odd while the map is changed */
+	unsigned long		numTrampolines;	/* Number of trampolines allocated */
+	unsigned long		numClosures;	/* Number of closures allocated */
 };
 
+void _jit_cache_destroy(jit_cache_t cache);
+void * _jit_cache_alloc_data(jit_cache_t cache, unsigned long size, unsigned long align);
+
 /*
- * Get or set the sub-trees of a node.
+ * Align a pointer up or down to a power of two boundary.
  */
-#define	GetLeft(node)	\
-	((jit_cache_node_t)(((jit_nuint)(node)->left) & ~((jit_nuint)1)))
-#define	GetRight(node)	\
-	((node)->right)
-#define	SetLeft(node,value)	\
-	((node)->left = (jit_cache_node_t)(((jit_nuint)value) | \
-						(((jit_nuint)(node)->left) & ((jit_nuint)1))))
-#define	SetRight(node,value)	\
-	((node)->right = (value))
+#define	AlignUp(ptr,align)	\
+	((unsigned char *) ((((jit_nuint) (ptr)) + (align) - 1) & ~((jit_nuint) (align) - 1)))
+#define	AlignDown(ptr,align)	\
+	((unsigned char *) (((jit_nuint) (ptr)) & ~((jit_nuint) (align) - 1)))
 
 /*
- * Get or set the red/black state of a node.
+ * Give a cache page back to the system.
  */
-#define	GetRed(node)	\
-	((((jit_nuint)((node)->left)) & ((jit_nuint)1)) != 0)
-#define	SetRed(node)	\
-	((node)->left = (jit_cache_node_t)(((jit_nuint)(node)->left) | ((jit_nuint)1)))
-#define	SetBlack(node)	\
-	((node)->left = (jit_cache_node_t)(((jit_nuint)(node)->left) & ~((jit_nuint)1)))
+static void
+FreeCachePage(jit_cache_t cache, unsigned long page)
+{
+	_jit_free_exec(cache->pages[page].page,
+		       cache->pageSize * cache->pages[page].factor);
+	if(cache->pagesLeft >= 0)
+	{
+		cache->pagesLeft += cache->pages[page].factor;
+	}
 
-void _jit_cache_destroy(jit_cache_t cache);
-void * _jit_cache_alloc_data(jit_cache_t cache, unsigned long size, unsigned long align);
+	/* Keep the order of the pages, the last one is the newest */
+	--(cache->numPages);
+	jit_memmove(&cache->pages[page], &cache->pages[page + 1],
+		    sizeof(struct jit_cache_page) * (cache->numPages - page));
+}
 
 /*
- * Allocate a cache page and add it to the cache.
+ * Remove a block from the free list.
  */
 static void
-AllocCachePage(jit_cache_t cache, int factor)
+RemoveFreeBlock(jit_cache_t cache, unsigned long index)
+{
+	--(cache->numBlocks);
+	jit_memmove(&cache->blocks[index], &cache->blocks[index + 1],
+		    sizeof(struct jit_cache_block) * (cache->numBlocks - index));
+}
+
+/*
+ * Add a block to the free list, merging it with the adjacent blocks.
+ * A block that covers a whole page gives the page back to the system.
+ */
+static void
+AddFreeBlock(jit_cache_t cache, unsigned char *start, unsigned char *end)
+{
+	struct jit_cache_block *list;
+	unsigned long low, high, middle, page, num;
+
+	if(start >= end)
+	{
+		return;
+	}
+
+	/* Find the first block that lies above the new one */
+	low = 0;
+	high = cache->numBlocks;
+	while(low < high)
+	{
+		middle = (low + high) / 2;
+		if(cache->blocks[middle].start < start)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	if(low > 0 && cache->blocks[low - 1].end == start)
+	{
+		/* Merge with the block below, and maybe the one above too */
+		--low;
+		cache->blocks[low].end = end;
+		if((low + 1) < cache->numBlocks && cache->blocks[low + 1].start == end)
+		{
+			cache->blocks[low].end = cache->blocks[low + 1].end;
+			RemoveFreeBlock(cache, low + 1);
+		}
+	}
+	else if(low < cache->numBlocks && cache->blocks[low].start == end)
+	{
+		/* Merge with the block above */
+		cache->blocks[low].start = start;
+	}
+	else
+	{
+		/* Insert a new block */
+		if(cache->numBlocks == cache->maxNumBlocks)
+		{
+			num = cache->maxNumBlocks ? cache->maxNumBlocks * 2 : 16;
+			list = (struct jit_cache_block *) jit_realloc(cache->blocks,
+								      sizeof(struct jit_cache_block) * num);
+			if(!list)
+			{
+				/* The block is lost, but this is not fatal */
+				return;
+			}
+			cache->blocks = list;
+			cache->maxNumBlocks = num;
+		}
+		jit_memmove(&cache->blocks[low + 1], &cache->blocks[low],
+			    sizeof(struct jit_cache_block) * (cache->numBlocks - low));
+		cache->blocks[low].start = start;
+		cache->blocks[low].end = end;
+		++(cache->numBlocks);
+	}
+
+	/* The pages of the region stay in place, only the memory behind
+	   the system pages that became entirely free is given back */
+	if(cache->region)
+	{
+		page = cache->discardSize;
+		start = AlignDown(start, page);
+		if(start < cache->blocks[low].start)
+		{
+			start = AlignUp(cache->blocks[low].start, page);
+		}
+		end = AlignUp(end, page);
+		if(end > cache->blocks[low].end)
+		{
+			end = AlignDown(cache->blocks[low].end, page);
+		}
+		if(start < end)
+		{
+			_jit_discard_exec(start, end - start);
+		}
+		return;
+	}
+
+	/* Is there a page that became entirely free? */
+	start = cache->blocks[low].start;
+	end = cache->blocks[low].end;
+	if(((unsigned long) (end - start)) < cache->pageSize)
+	{
+		return;
+	}
+	for(page = 0; page < cache->numPages; ++page)
+	{
+		if(cache->pages[page].page == start
+		   && (start + cache->pageSize * cache->pages[page].factor) == end)
+		{
+			FreeCachePage(cache, page);
+			RemoveFreeBlock(cache, low);
+			return;
+		}
+	}
+}
+
+/*
+ * Find the smallest free block that fits the size at the alignment.
+ * Returns the number of blocks if none of them fits.
+ */
+static unsigned long
+FindFreeBlock(jit_cache_t cache, unsigned long size, unsigned long align)
+{
+	unsigned long index, best, best_size, block_size;
+	unsigned char *ptr;
+
+	best = cache->numBlocks;
+	best_size = 0;
+	for(index = 0; index < cache->numBlocks; ++index)
+	{
+		ptr = AlignUp(cache->blocks[index].start, align);
+		if(ptr >= cache->blocks[index].end)
+		{
+			continue;
+		}
+		block_size = cache->blocks[index].end - ptr;
+		if(block_size >= size && (best == cache->numBlocks || block_size < best_size))
+		{
+			best = index;
+			best_size = block_size;
+		}
+	}
+	return best;
+}
+
+/*
+ * Allocate memory from the start of a free block.
+ */
+static unsigned char *
+TakeFreeBlock(jit_cache_t cache, unsigned long index, unsigned long size, unsigned long align)
+{
+	unsigned char *start, *ptr;
+
+	start = cache->blocks[index].start;
+	ptr = AlignUp(start, align);
+	if((ptr + size) == cache->blocks[index].end)
+	{
+		RemoveFreeBlock(cache, index);
+	}
+	else
+	{
+		cache->blocks[index].start = ptr + size;
+	}
+
+	/* Keep the bytes skipped by the alignment */
+	AddFreeBlock(cache, start, ptr);
+	return ptr;
+}
+
+/*
+ * Get the arena of the current thread.  If it has none, then it takes
+ * over one that has no started function, or a new one.  Returns NULL
+ * if out of memory.
+ */
+static jit_cache_arena_t
+GetArena(jit_cache_t cache)
+{
+	jit_thread_id_t self = jit_thread_self();
+	jit_cache_arena_t arena, idle;
+
+	idle = 0;
+	for(arena = cache->arenas; arena; arena = arena->next)
+	{
+		if(jit_thread_id_equal(arena->owner, self))
+		{
+			return arena;
+		}
+		if(!idle && !arena->node)
+		{
+			idle = arena;
+		}
+	}
+	if(!idle)
+	{
+		idle = jit_cnew(struct jit_cache_arena);
+		if(!idle)
+		{
+			return 0;
+		}
+		idle->next = cache->arenas;
+		cache->arenas = idle;
+	}
+	idle->owner = self;
+	return idle;
+}
+
+/*
+ * Put what is left of the free region of an arena on the free list.
+ */
+static void
+ReleaseFreeRegion(jit_cache_t cache, jit_cache_arena_t arena)
+{
+	unsigned char *start = arena->free_start;
+	unsigned char *end = arena->free_end;
+
+	arena->free_start = 0;
+	arena->free_end = 0;
+	if(start)
+	{
+		AddFreeBlock(cache, start, end);
+	}
+}
+
+/*
+ * Make the largest free block the free region of an arena if it has
+ * at least "size" bytes and more room than the current free region.
+ * Returns non-zero if the free region was replaced.
+ */
+static int
+UseLargestFreeBlock(jit_cache_t cache, jit_cache_arena_t arena, unsigned long size)
+{
+	unsigned long index, best;
+	unsigned char *start, *end;
+
+	best = cache->numBlocks;
+	for(index = 0; index < cache->numBlocks; ++index)
+	{
+		if(best == cache->numBlocks
+		   || (cache->blocks[index].end - cache->blocks[index].start)
+		      > (cache->blocks[best].end - cache->blocks[best].start))
+		{
+			best = index;
+		}
+	}
+	if(best == cache->numBlocks)
+	{
+		return 0;
+	}
+
+	start = cache->blocks[best].start;
+	end = cache->blocks[best].end;
+	if(((unsigned long) (end - start)) < size
+	   || (end - start) <= (arena->free_end - arena->free_start))
+	{
+		return 0;
+	}
+
+	RemoveFreeBlock(cache, best);
+	ReleaseFreeRegion(cache, arena);
+	arena->free_start = start;
+	arena->free_end = end;
+	return 1;
+}
+
+/*
+ * Give back a region of memory that is no longer used.  It joins the
+ * free region of an arena if the two are adjacent, unless a function
+ * is being written to that region.
+ */
+static void
+FreeRegion(jit_cache_t cache, unsigned char *start, unsigned char *end)
+{
+	jit_cache_arena_t arena;
+
+	if(start >= end)
+	{
+		return;
+	}
+	for(arena = cache->arenas; arena; arena = arena->next)
+	{
+		if(arena->node || !arena->free_start)
+		{
+			continue;
+		}
+		if(end == arena->free_start)
+		{
+			arena->free_start = start;
+			return;
+		}
+		if(start == arena->free_end)
+		{
+			arena->free_end = end;
+			return;
+		}
+	}
+	AddFreeBlock(cache, start, end);
+}
+
+/*
+ * Make the region usable up to "end" at least.  The region that is
+ * mapped twice is backed by a file that is grown, and the pages of the
+ * region backed by huge pages are made executable a huge page at a
+ * time.  The usable part doubles each time it grows, so that this is
+ * seldom done.  Returns zero if the region cannot grow.
+ */
+static int
+GrowRegion(jit_cache_t cache, unsigned char *end)
+{
+	unsigned char *mapped;
+
+	if(end <= cache->regionMapped)
+	{
+		return 1;
+	}
+	mapped = cache->region + 2 * (cache->regionMapped - cache->region);
+	if(mapped < end)
+	{
+		mapped = end;
+	}
+	if(cache->hugePages)
+	{
+		mapped = AlignUp(mapped, JIT_CACHE_HUGE_PAGE_SIZE);
+	}
+	if(mapped > cache->regionEnd)
+	{
+		mapped = cache->regionEnd;
+	}
+	if(cache->hugePages)
+	{
+		if(!_jit_commit_exec(cache->regionMapped, mapped - cache->regionMapped))
+		{
+			return 0;
+		}
+	}
+#if JIT_EXEC_VIEW_SUPPORTED
+	else if(!_jit_grow_exec_view(cache->region, cache->region + cache->execOffset,
+				     cache->viewFd,
+				     cache->regionMapped - cache->region,
+				     mapped - cache->region))
+	{
+		return 0;
+	}
+#endif
+	cache->regionMapped = mapped;
+	return 1;
+}
+
+/*
+ * Allocate a cache page and add it to the cache.  Returns NULL if
+ * the page cannot be allocated.
+ */
+static unsigned char *
+NewCachePage(jit_cache_t cache, int factor)
 {
 	long num;
 	unsigned char *ptr;
@@ -141,20 +612,32 @@ AllocCachePage(jit_cache_t cache, int factor)
 	/* If too big a page is requested, then bail out */
 	if(((unsigned int) factor) > cache->maxPageFactor)
 	{
-		goto failAlloc;
+		return 0;
 	}
 
 	/* If the page limit is hit, then bail out */
 	if(cache->pagesLeft >= 0 && cache->pagesLeft < factor)
 	{
-		goto failAlloc;
+		return 0;
 	}
 
-	/* Try to allocate a physical page */
-	ptr = (unsigned char *) _jit_malloc_exec((unsigned int) cache->pageSize * factor);
-	if(!ptr)
+	/* Try to allocate a physical page, or take the next one from the
+	   region.  The page limit keeps the pages within the region */
+	if(cache->region)
 	{
-		goto failAlloc;
+		ptr = cache->regionTop;
+		if(!GrowRegion(cache, ptr + cache->pageSize * factor))
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		ptr = (unsigned char *) _jit_malloc_exec((unsigned int) cache->pageSize * factor);
+		if(!ptr)
+		{
+			return 0;
+		}
 	}
 
 	/* Add the page to the page list.  We keep this in an array
@@ -181,11 +664,11 @@ AllocCachePage(jit_cache_t cache, int factor)
 							     sizeof(struct jit_cache_page) * num);
 		if(!list)
 		{
-			_jit_free_exec(ptr, cache->pageSize * factor);
-		failAlloc:
-			cache->free_start = 0;
-			cache->free_end = 0;
-			return;
+			if(!cache->region)
+			{
+				_jit_free_exec(ptr, cache->pageSize * factor);
+			}
+			return 0;
 		}
 
 		cache->maxNumPages = num;
@@ -194,182 +677,366 @@ AllocCachePage(jit_cache_t cache, int factor)
 	cache->pages[cache->numPages].page = ptr;
 	cache->pages[cache->numPages].factor = factor;
 	++(cache->numPages);
+	if(cache->region)
+	{
+		cache->regionTop += cache->pageSize * factor;
+	}
 
 	/* Adjust te number of pages left before we hit the limit */
 	if(cache->pagesLeft > 0)
 	{
-		cache->pagesLeft -= factor;
+		cache->pagesLeft -= factor;
+	}
+
+	return ptr;
+}
+
+/*
+ * Allocate a cache page and make it the free region of an arena.
+ */
+static void
+AllocCachePage(jit_cache_t cache, jit_cache_arena_t arena, int factor)
+{
+	unsigned char *ptr;
+
+	/* The rest of the current free region may still be used later */
+	ReleaseFreeRegion(cache, arena);
+
+	if(factor <= 0)
+	{
+		factor = 1;
+	}
+	ptr = NewCachePage(cache, factor);
+	if(!ptr)
+	{
+		arena->free_start = 0;
+		arena->free_end = 0;
+		return;
 	}
 
 	/* Set up the working region within the new page */
-	cache->free_start = ptr;
-	cache->free_end = ptr + (int) cache->pageSize * factor;
+	arena->free_start = ptr;
+	arena->free_end = ptr + (int) cache->pageSize * factor;
 }
 
 /*
- * Compare a key against a node, being careful of sentinel nodes.
+ * Find the first entry of a bucket that starts above "pc".
  */
-static int
-CacheCompare(jit_cache_t cache, unsigned char *key, jit_cache_node_t node)
+static unsigned long
+FindTableEntry(struct jit_cache_entry *entries, unsigned long num, unsigned char *pc)
 {
-	if(node == &cache->nil || node == &cache->head)
-	{
-		/* Every key is greater than the sentinel nodes */
-		return 1;
-	}
-	else
+	unsigned long low, high, middle;
+
+	low = 0;
+	high = num;
+	while(low < high)
 	{
-		/* Compare a regular node */
-		if(key < node->start)
-		{
-			return -1;
-		}
-		else if(key > node->start)
+		middle = (low + high) / 2;
+		if(entries[middle].start <= pc)
 		{
-			return 1;
+			low = middle + 1;
 		}
 		else
 		{
-			return 0;
+			high = middle;
 		}
 	}
+	return low;
 }
 
 /*
- * Rotate a sub-tree around a specific node.
+ * Get the number of the granule that holds an address.
+ */
+#define	MapGranule(ptr)	(((jit_nuint) (ptr)) >> JIT_CACHE_MAP_SHIFT)
+
+/*
+ * Get the index of the slot of a granule in a level of the map.
+ */
+#define	MapIndex(granule,level)	\
+	((unsigned long) ((granule) >> ((level) * JIT_CACHE_MAP_BITS)) \
+	 & (JIT_CACHE_MAP_SIZE - 1))
+
+/*
+ * Get the bucket of a granule without a lock.  Returns NULL if there
+ * is none.
  */
-static jit_cache_node_t
-CacheRotate(jit_cache_t cache, unsigned char *key, jit_cache_node_t around)
+static struct jit_cache_bucket *
+FindBucket(jit_cache_t cache, jit_nuint granule)
 {
-	jit_cache_node_t child, grandChild;
-	int setOnLeft;
-	if(CacheCompare(cache, key, around) < 0)
+	void *next = cache->map;
+	int level;
+
+	for(level = JIT_CACHE_MAP_LEVELS - 1; level >= 0 && next; --level)
 	{
-		child = GetLeft(around);
-		setOnLeft = 1;
+		next = ((struct jit_cache_map *) next)->slots[MapIndex(granule, level)];
 	}
-	else
+	return (struct jit_cache_bucket *) next;
+}
+
+/*
+ * Get the slot of the bucket of a granule.  If "create" is non-zero,
+ * then the missing levels of the map are added.  Returns NULL if there
+ * is no such slot, or if out of memory.
+ */
+static void **
+GetBucketSlot(jit_cache_t cache, jit_nuint granule, int create)
+{
+	struct jit_cache_map *map;
+	void **slot;
+	int level;
+
+	slot = &cache->map;
+	for(level = JIT_CACHE_MAP_LEVELS - 1; level >= 0; --level)
 	{
-		child = GetRight(around);
-		setOnLeft = 0;
+		map = (struct jit_cache_map *) *slot;
+		if(!map)
+		{
+			if(!create)
+			{
+				return 0;
+			}
+			map = jit_cnew(struct jit_cache_map);
+			if(!map)
+			{
+				return 0;
+			}
+
+			/* The level must be clear before it can be searched */
+			jit_barrier_store();
+			*slot = map;
+		}
+		slot = &map->slots[MapIndex(granule, level)];
 	}
-	if(CacheCompare(cache, key, child) < 0)
+	return slot;
+}
+
+/*
+ * Replace a full bucket, or no bucket, with a bigger one that has the
+ * same entries.  Returns NULL if out of memory.
+ */
+static struct jit_cache_bucket *
+GrowBucket(jit_cache_t cache, struct jit_cache_bucket *old)
+{
+	struct jit_cache_bucket *bucket;
+	unsigned long size;
+
+	size = old ? old->size * 2 : JIT_CACHE_BUCKET_SIZE;
+	bucket = (struct jit_cache_bucket *) jit_malloc
+		(sizeof(struct jit_cache_bucket)
+		 + sizeof(struct jit_cache_entry) * (size - 1));
+	if(!bucket)
 	{
-		grandChild = GetLeft(child);
-		SetLeft(child, GetRight(grandChild));
-		SetRight(grandChild, child);
+		return 0;
 	}
-	else
+	bucket->next = 0;
+	bucket->size = size;
+	bucket->num = 0;
+	if(old)
 	{
-		grandChild = GetRight(child);
-		SetRight(child, GetLeft(grandChild));
-		SetLeft(grandChild, child);
+		jit_memcpy(bucket->entries, old->entries,
+			   sizeof(struct jit_cache_entry) * old->num);
+		bucket->num = old->num;
+		old->next = cache->oldBuckets;
+		cache->oldBuckets = old;
 	}
-	if(setOnLeft)
+	return bucket;
+}
+
+/*
+ * Find the first entry of the map that starts above "pc", from the
+ * level of the map that covers the granules from "base" on.
+ */
+static struct jit_cache_entry *
+FindNextEntry(struct jit_cache_map *map, int level, jit_nuint base, unsigned char *pc)
+{
+	jit_nuint granule = MapGranule(pc);
+	int shift = level * JIT_CACHE_MAP_BITS;
+	struct jit_cache_bucket *bucket;
+	struct jit_cache_entry *entry;
+	unsigned long index, posn;
+
+	index = (granule > base) ? (unsigned long) ((granule - base) >> shift) : 0;
+	for(; index < JIT_CACHE_MAP_SIZE; ++index)
 	{
-		SetLeft(around, grandChild);
+		if(!map->slots[index])
+		{
+			continue;
+		}
+		if(level > 0)
+		{
+			entry = FindNextEntry((struct jit_cache_map *) map->slots[index],
+					      level - 1, base + ((jit_nuint) index << shift), pc);
+			if(entry)
+			{
+				return entry;
+			}
+		}
+		else
+		{
+			bucket = (struct jit_cache_bucket *) map->slots[index];
+			posn = FindTableEntry(bucket->entries, bucket->num, pc);
+			if(posn < bucket->num)
+			{
+				return &bucket->entries[posn];
+			}
+		}
 	}
-	else
+	return 0;
+}
+
+/*
+ * Free a level of the map and everything below it.
+ */
+static void
+FreeMap(struct jit_cache_map *map, int level)
+{
+	unsigned long index;
+
+	for(index = 0; index < JIT_CACHE_MAP_SIZE; ++index)
 	{
-		SetRight(around, grandChild);
+		if(map->slots[index])
+		{
+			if(level > 0)
+			{
+				FreeMap((struct jit_cache_map *) map->slots[index], level - 1);
+			}
+			else
+			{
+				jit_free(map->slots[index]);
+			}
+		}
 	}
-	return grandChild;
+	jit_free(map);
 }
 
 /*
- * Split a red-black tree at the current position.
+ * Start and finish a change of the lookup map.  The threads that
+ * search the map without a lock try again if they see the sequence
+ * number odd, or changed over the search.
  */
-#define	Split()		\
-			do { \
-				SetRed(temp); \
-				SetBlack(GetLeft(temp)); \
-				SetBlack(GetRight(temp)); \
-				if(GetRed(parent)) \
-				{ \
-					SetRed(grandParent); \
-					if((CacheCompare(cache, key, grandParent) < 0) != \
-							(CacheCompare(cache, key, parent) < 0)) \
-					{ \
-						parent = CacheRotate(cache, key, grandParent); \
-					} \
-					temp = CacheRotate(cache, key, greatGrandParent); \
-					SetBlack(temp); \
-				} \
-			} while (0)
+static void
+BeginTableChange(jit_cache_t cache)
+{
+	cache->tableSeq = cache->tableSeq + 1;
+	jit_barrier_store();
+}
+
+static void
+EndTableChange(jit_cache_t cache)
+{
+	jit_barrier_store();
+	cache->tableSeq = cache->tableSeq + 1;
+}
 
 /*
- * Add a method region block to the red-black lookup tree
- * that is associated with a method cache.
+ * Add a method region block to the bucket of every granule that it
+ * overlaps.  Returns zero if out of memory.
  */
-static void
-AddToLookupTree(jit_cache_t cache, jit_cache_node_t method)
+static int
+AddToLookupTable(jit_cache_t cache, jit_cache_node_t method)
 {
-	unsigned char *key = method->start;
-	jit_cache_node_t temp;
-	jit_cache_node_t greatGrandParent;
-	jit_cache_node_t grandParent;
-	jit_cache_node_t parent;
-	jit_cache_node_t nil = &(cache->nil);
-	int cmp;
-
-	/* Search for the insert position */
-	temp = &(cache->head);
-	greatGrandParent = temp;
-	grandParent = temp;
-	parent = temp;
-	while(temp != nil)
-	{
-		/* Adjust our ancestor pointers */
-		greatGrandParent = grandParent;
-		grandParent = parent;
-		parent = temp;
-
-		/* Compare the key against the current node */
-		cmp = CacheCompare(cache, key, temp);
-		if(cmp == 0)
-		{
-			/* This is a duplicate, which normally shouldn't happen.
-			   If it does happen, then ignore the node and bail out */
-			return;
-		}
-		else if(cmp < 0)
+	struct jit_cache_bucket *bucket;
+	jit_nuint granule, first, last;
+	unsigned long index;
+	void **slot;
+
+	first = MapGranule(method->start);
+	last = MapGranule(method->end > method->start ? method->end - 1 : method->start);
+
+	/* Make room in the buckets first, so that running out of memory
+	   leaves the map as it was.  A full bucket is replaced with a
+	   bigger copy, so that the old one can still be searched */
+	for(granule = first; granule <= last; ++granule)
+	{
+		slot = GetBucketSlot(cache, granule, 1);
+		if(!slot)
 		{
-			temp = GetLeft(temp);
+			return 0;
 		}
-		else
+		bucket = (struct jit_cache_bucket *) *slot;
+		if(!bucket || bucket->num == bucket->size)
 		{
-			temp = GetRight(temp);
+			bucket = GrowBucket(cache, bucket);
+			if(!bucket)
+			{
+				return 0;
+			}
+			jit_barrier_store();
+			*slot = bucket;
 		}
+	}
 
-		/* Do we need to split this node? */
-		if(GetRed(GetLeft(temp)) && GetRed(GetRight(temp)))
-		{
-			Split();
-		}
+	/* Only the methods that overlap the same granules are moved */
+	BeginTableChange(cache);
+	for(granule = first; granule <= last; ++granule)
+	{
+		bucket = (struct jit_cache_bucket *) *GetBucketSlot(cache, granule, 0);
+		index = FindTableEntry(bucket->entries, bucket->num, method->start);
+		jit_memmove(&bucket->entries[index + 1], &bucket->entries[index],
+			    sizeof(struct jit_cache_entry) * (bucket->num - index));
+		bucket->entries[index].start = method->start;
+		bucket->entries[index].end = method->end;
+		bucket->entries[index].node = method;
+		++(bucket->num);
 	}
+	++(cache->numEntries);
+	EndTableChange(cache);
+	return 1;
+}
 
-	/* Insert the new node into the current position */
-	method->left = (jit_cache_node_t)(((jit_nuint)nil) | ((jit_nuint)1));
-	method->right = nil;
-	if(CacheCompare(cache, key, parent) < 0)
+/*
+ * Remove a method region block from the lookup map.  The buckets that
+ * become empty are kept for the methods written there later.
+ */
+static void
+RemoveFromLookupTable(jit_cache_t cache, jit_cache_node_t method)
+{
+	struct jit_cache_bucket *bucket;
+	jit_nuint granule, first, last;
+	unsigned long index;
+	int found = 0;
+
+	first = MapGranule(method->start);
+	last = MapGranule(method->end > method->start ? method->end - 1 : method->start);
+
+	BeginTableChange(cache);
+	for(granule = first; granule <= last; ++granule)
 	{
-		SetLeft(parent, method);
+		bucket = FindBucket(cache, granule);
+		if(!bucket)
+		{
+			continue;
+		}
+		index = FindTableEntry(bucket->entries, bucket->num, method->start);
+		if(index == 0 || bucket->entries[index - 1].node != method)
+		{
+			continue;
+		}
+		--index;
+		--(bucket->num);
+		jit_memmove(&bucket->entries[index], &bucket->entries[index + 1],
+			    sizeof(struct jit_cache_entry) * (bucket->num - index));
+		found = 1;
 	}
-	else
+	if(found)
 	{
-		SetRight(parent, method);
+		--(cache->numEntries);
 	}
-	Split();
-	SetBlack(cache->head.right);
+	EndTableChange(cache);
 }
 
 jit_cache_t
 _jit_cache_create(jit_context_t context)
 {
 	jit_cache_t cache;
+	jit_cache_arena_t arena;
 	long limit, cache_page_size;
 	int max_page_factor;
 	unsigned long exec_page_size;
+#if JIT_EXEC_VIEW_SUPPORTED
+	void *exec;
+#endif
+	jit_nuint region_size;
 
 	limit = (long)
 		jit_context_get_meta_numeric(context, JIT_OPTION_CACHE_LIMIT);
@@ -411,8 +1078,9 @@ _jit_cache_create(jit_context_t context)
 	cache->maxNumPages = 0;
 	cache->pageSize = cache_page_size;
 	cache->maxPageFactor = max_page_factor;
-	cache->free_start = 0;
-	cache->free_end = 0;
+	cache->blocks = 0;
+	cache->numBlocks = 0;
+	cache->maxNumBlocks = 0;
 	if(limit > 0)
 	{
 		cache->pagesLeft = limit / cache_page_size;
@@ -425,17 +1093,85 @@ _jit_cache_create(jit_context_t context)
 	{
 		cache->pagesLeft = -1;
 	}
-	cache->node = 0;
-	cache->nil.left = &(cache->nil);
-	cache->nil.right = &(cache->nil);
-	cache->nil.func = 0;
-	cache->head.left = 0;
-	cache->head.right = &(cache->nil);
-	cache->head.func = 0;
+	cache->arenas = 0;
+	cache->map = 0;
+	cache->oldBuckets = 0;
+	cache->numEntries = 0;
+	cache->tableSeq = 0;
+	cache->numTrampolines = 0;
+	cache->numClosures = 0;
+	cache->region = 0;
+	cache->regionTop = 0;
+	cache->regionEnd = 0;
+	cache->regionMapped = 0;
+	cache->viewFd = -1;
+	cache->execOffset = 0;
+	cache->discardSize = exec_page_size;
+	cache->hugePages = 0;
+
+#if JIT_EXEC_VIEW_SUPPORTED
+	/* Take the pages from a region that is mapped twice, if no page
+	   may be writable and executable at once */
+	if(jit_context_get_meta_numeric(context, JIT_OPTION_WRITE_XOR_EXECUTE))
+	{
+		if(cache->pagesLeft < 0)
+		{
+			cache->pagesLeft = (long) (JIT_CACHE_REGION_SIZE / cache_page_size);
+		}
+		region_size = (jit_nuint) cache->pagesLeft * cache_page_size;
+		cache->region = (unsigned char *)
+			_jit_malloc_exec_view(region_size, &exec, &(cache->viewFd));
+		if(!cache->region)
+		{
+			_jit_cache_destroy(cache);
+			return 0;
+		}
+		cache->regionTop = cache->region;
+		cache->regionEnd = cache->region + region_size;
+		cache->regionMapped = cache->region;
+		cache->execOffset = (unsigned char *) exec - cache->region;
+	}
+#endif
 
-	/* Allocate the initial cache page */
-	AllocCachePage(cache, 0);
-	if(!cache->free_start)
+	/* Take the pages from a region backed by huge pages, so that the
+	   code needs fewer TLB entries.  This is only a hint, the pages
+	   are allocated one by one if there is no such region.  The huge
+	   pages that the system reserved are only taken for a region that
+	   the cache limit sizes, as they are all taken up front */
+	if(!cache->region
+	   && jit_context_get_meta_numeric(context, JIT_OPTION_CACHE_HUGE_PAGES))
+	{
+		if(cache->pagesLeft < 0)
+		{
+			cache->pagesLeft = (long) (JIT_CACHE_REGION_SIZE / cache_page_size);
+		}
+		region_size = (jit_nuint) cache->pagesLeft * cache_page_size;
+		region_size = (region_size + JIT_CACHE_HUGE_PAGE_SIZE - 1)
+			& ~((jit_nuint) JIT_CACHE_HUGE_PAGE_SIZE - 1);
+		cache->region = (unsigned char *)
+			_jit_malloc_exec_huge(region_size, JIT_CACHE_HUGE_PAGE_SIZE,
+					      limit > 0);
+		if(cache->region)
+		{
+			cache->regionTop = cache->region;
+			cache->regionEnd = cache->region + region_size;
+			cache->regionMapped = cache->region;
+			cache->discardSize = JIT_CACHE_HUGE_PAGE_SIZE;
+			cache->hugePages = 1;
+		}
+		else if(limit <= 0)
+		{
+			cache->pagesLeft = -1;
+		}
+	}
+
+	/* Allocate the initial cache page for the creating thread */
+	arena = GetArena(cache);
+	if(arena)
+	{
+		AllocCachePage(cache, arena, 0);
+	}
+	if(!arena || !arena->free_start)
 	{
 		_jit_cache_destroy(cache);
 		return 0;
@@ -448,18 +1184,52 @@ _jit_cache_create(jit_context_t context)
 void
 _jit_cache_destroy(jit_cache_t cache)
 {
+	struct jit_cache_bucket *bucket;
+	jit_cache_arena_t arena;
 	unsigned long page;
 
 	/* Free all of the cache pages */
-	for(page = 0; page < cache->numPages; ++page)
+	if(cache->hugePages)
+	{
+		_jit_free_exec_huge(cache->region, cache->regionEnd - cache->region);
+	}
+	else if(cache->region)
+	{
+		_jit_free_exec_view(cache->region, cache->region + cache->execOffset,
+				    cache->viewFd, cache->regionEnd - cache->region);
+	}
+	else
 	{
-		_jit_free_exec(cache->pages[page].page,
-			       cache->pageSize * cache->pages[page].factor);
+		for(page = 0; page < cache->numPages; ++page)
+		{
+			_jit_free_exec(cache->pages[page].page,
+				       cache->pageSize * cache->pages[page].factor);
+		}
 	}
 	if(cache->pages)
 	{
 		jit_free(cache->pages);
 	}
+	if(cache->blocks)
+	{
+		jit_free(cache->blocks);
+	}
+	if(cache->map)
+	{
+		FreeMap((struct jit_cache_map *) cache->map, JIT_CACHE_MAP_LEVELS - 1);
+	}
+	while(cache->oldBuckets)
+	{
+		bucket = cache->oldBuckets;
+		cache->oldBuckets = bucket->next;
+		jit_free(bucket);
+	}
+	while(cache->arenas)
+	{
+		arena = cache->arenas;
+		cache->arenas = arena->next;
+		jit_free(arena);
+	}
 
 	/* Free the cache object itself */
 	jit_free(cache);
@@ -468,11 +1238,14 @@ _jit_cache_destroy(jit_cache_t cache)
 int
 _jit_cache_extend(jit_cache_t cache, int count)
 {
+	jit_cache_arena_t arena;
+
 	/* Compute the page size factor */
 	int factor = 1 << count;
 
-	/* Bail out if there is a started function */
-	if(cache->node)
+	/* Bail out if the thread has a started function */
+	arena = GetArena(cache);
+	if(!arena || arena->node)
 	{
 		return JIT_MEMORY_ERROR;
 	}
@@ -480,18 +1253,27 @@ _jit_cache_extend(jit_cache_t cache, int count)
 	/* If we had a newly allocated page then it has to be freed
 	   to let allocate another new page of appropriate size. */
 	struct jit_cache_page *p = &cache->pages[cache->numPages - 1];
-	if((cache->free_start == ((unsigned char *)p->page))
-	   && (cache->free_end == (cache->free_start + cache->pageSize * p->factor)))
+	if(cache->numPages > 0
+	   && (arena->free_start == ((unsigned char *)p->page))
+	   && (arena->free_end == (arena->free_start + cache->pageSize * p->factor)))
 	{
-		_jit_free_exec(p->page, cache->pageSize * p->factor);
+		if(cache->region)
+		{
+			/* The newest page is at the top of the region */
+			cache->regionTop = p->page;
+		}
+		else
+		{
+			_jit_free_exec(p->page, cache->pageSize * p->factor);
+		}
 
 		--(cache->numPages);
 		if(cache->pagesLeft >= 0)
 		{
 			cache->pagesLeft += p->factor;
 		}
-		cache->free_start = 0;
-		cache->free_end = 0;
+		arena->free_start = 0;
+		arena->free_end = 0;
 
 		if(factor <= p->factor)
 		{
@@ -499,13 +1281,35 @@ _jit_cache_extend(jit_cache_t cache, int count)
 		}
 	}
 
+	/* Make the page big enough for the expected size of the function */
+	while(((unsigned long) factor) < cache->maxPageFactor
+	      && cache->pageSize * factor < arena->sizeHint)
+	{
+		factor <<= 1;
+	}
+
+	/* Reuse a free block if there is one as big as the new page */
+	if(UseLargestFreeBlock(cache, arena, cache->pageSize * factor))
+	{
+		return JIT_MEMORY_OK;
+	}
+
 	/* Allocate a new page now */
-	AllocCachePage(cache, factor);
-	if(!cache->free_start)
+	AllocCachePage(cache, arena, factor);
+	if(arena->free_start)
 	{
-		return JIT_MEMORY_TOO_BIG;
+		return JIT_MEMORY_OK;
 	}
-	return JIT_MEMORY_OK;
+
+	/* The cache is full, so settle for a free block that is at least
+	   bigger than the region the function did not fit into.  Make sure
+	   that the restarted function is not given a smaller one */
+	arena->restartSize = (arena->prev_end - arena->prev_start) + 1;
+	if(UseLargestFreeBlock(cache, arena, arena->restartSize))
+	{
+		return JIT_MEMORY_OK;
+	}
+	return JIT_MEMORY_TOO_BIG;
 }
 
 jit_function_t
@@ -520,39 +1324,83 @@ _jit_cache_free_function(jit_cache_t cache, jit_function_t func)
 	jit_free(func);
 }
 
+void
+_jit_cache_set_size_hint(jit_cache_t cache, jit_size_t size)
+{
+	jit_cache_arena_t arena = GetArena(cache);
+
+	if(arena)
+	{
+		arena->sizeHint = size;
+	}
+}
+
 int
 _jit_cache_start_function(jit_cache_t cache, jit_function_t func)
 {
-	/* Bail out if there is a started function already */
-	if(cache->node)
+	jit_cache_arena_t arena;
+	unsigned char *ptr;
+	unsigned long factor;
+
+	/* Bail out if the thread has a started function already */
+	arena = GetArena(cache);
+	if(!arena || arena->node)
 	{
 		return JIT_MEMORY_ERROR;
 	}
 
+	/* Move to a free block if it has more room than the free region */
+	UseLargestFreeBlock(cache, arena, arena->restartSize);
+	arena->restartSize = 0;
+
+	/* Move to a new page if the function is not expected to fit into
+	   the free region, so that it need not be generated twice, or if
+	   the arena has no free region yet.  Keep the free region if there
+	   is no page left */
+	if(!arena->free_start
+	   || arena->sizeHint > (unsigned long) (arena->free_end - arena->free_start))
+	{
+		factor = (arena->sizeHint + cache->pageSize - 1) / cache->pageSize;
+		if(factor == 0)
+		{
+			factor = 1;
+		}
+		ptr = 0;
+		if(factor <= cache->maxPageFactor)
+		{
+			ptr = NewCachePage(cache, (int) factor);
+		}
+		if(ptr)
+		{
+			ReleaseFreeRegion(cache, arena);
+			arena->free_start = ptr;
+			arena->free_end = ptr + cache->pageSize * factor;
+		}
+	}
+
 	/* Bail out if the cache is already full */
-	if(!cache->free_start)
+	if(!arena->free_start)
 	{
 		return JIT_MEMORY_TOO_BIG;
 	}
+	arena->sizeHint = 0;
 
 	/* Save the cache position */
-	cache->prev_start = cache->free_start;
-	cache->prev_end = cache->free_end;
+	arena->prev_start = arena->free_start;
+	arena->prev_end = arena->free_end;
 
 	/* Allocate a new cache node */
-	cache->node = _jit_cache_alloc_data(
+	arena->node = _jit_cache_alloc_data(
 		cache, sizeof(struct jit_cache_node), sizeof(void *));
-	if(!cache->node)
+	if(!arena->node)
 	{
 		return JIT_MEMORY_RESTART;
 	}
-	cache->node->func = func;
+	arena->node->func = func;
 
 	/* Initialize the function information */
-	cache->node->start = cache->free_start;
-	cache->node->end = 0;
-	cache->node->left = 0;
-	cache->node->right = 0;
+	arena->node->start = arena->free_start;
+	arena->node->end = 0;
 
 	return JIT_MEMORY_OK;
 }
@@ -560,8 +1408,11 @@ _jit_cache_start_function(jit_cache_t cache, jit_function_t func)
 int
 _jit_cache_end_function(jit_cache_t cache, int result)
 {
+	jit_cache_arena_t arena;
+
 	/* Bail out if there is no started function */
-	if(!cache->node)
+	arena = GetArena(cache);
+	if(!arena || !arena->node)
 	{
 		return JIT_MEMORY_ERROR;
 	}
@@ -570,17 +1421,25 @@ _jit_cache_end_function(jit_cache_t cache, int result)
 	if(result != JIT_MEMORY_OK)
 	{
 		/* Restore the saved cache position */
-		cache->free_start = cache->prev_start;
-		cache->free_end = cache->prev_end;
-		cache->node = 0;
+		arena->free_start = arena->prev_start;
+		arena->free_end = arena->prev_end;
+		arena->node = 0;
 
 		return JIT_MEMORY_RESTART;
 	}
 
-	/* Update the method region block and then add it to the lookup tree */
-	cache->node->end = cache->free_start;
-	AddToLookupTree(cache, cache->node);
-	cache->node = 0;
+	/* Update the method region block and then add it to the lookup map */
+	arena->node->end = arena->free_start;
+	arena->node->data = arena->free_end;
+	if(!AddToLookupTable(cache, arena->node))
+	{
+		arena->free_start = arena->prev_start;
+		arena->free_end = arena->prev_end;
+		arena->node = 0;
+
+		return JIT_MEMORY_ERROR;
+	}
+	arena->node = 0;
 
 	/* The method is ready to go */
 	return JIT_MEMORY_OK;
@@ -589,90 +1448,122 @@ _jit_cache_end_function(jit_cache_t cache, int result)
 void *
 _jit_cache_get_code_break(jit_cache_t cache)
 {
+	jit_cache_arena_t arena;
+
 	/* Bail out if there is no started function */
-	if(!cache->node)
+	arena = GetArena(cache);
+	if(!arena || !arena->node)
 	{
 		return 0;
 	}
 
 	/* Return the address of the available code area */
-	return cache->free_start;
+	return arena->free_start;
 }
 
 void
 _jit_cache_set_code_break(jit_cache_t cache, void *ptr)
 {
+	jit_cache_arena_t arena;
+
 	/* Bail out if there is no started function */
-	if(!cache->node)
+	arena = GetArena(cache);
+	if(!arena || !arena->node)
 	{
 		return;
 	}
 	/* Sanity checks */
-	if((unsigned char *) ptr < cache->free_start)
+	if((unsigned char *) ptr < arena->free_start)
 	{
 		return;
 	}
-	if((unsigned char *) ptr > cache->free_end)
+	if((unsigned char *) ptr > arena->free_end)
 	{
 		return;
 	}
 
 	/* Update the address of the available code area */
-	cache->free_start = ptr;
+	arena->free_start = ptr;
 }
 
 void *
 _jit_cache_get_code_limit(jit_cache_t cache)
 {
+	jit_cache_arena_t arena;
+
 	/* Bail out if there is no started function */
-	if(!cache->node)
+	arena = GetArena(cache);
+	if(!arena || !arena->node)
 	{
 		return 0;
 	}
 
 	/* Return the end address of the available code area */
-	return cache->free_end;
+	return arena->free_end;
 }
 
 void *
 _jit_cache_alloc_data(jit_cache_t cache, unsigned long size, unsigned long align)
 {
+	jit_cache_arena_t arena;
 	unsigned char *ptr;
 
+	arena = GetArena(cache);
+	if(!arena || !arena->free_start)
+	{
+		return 0;
+	}
+
 	/* Get memory from the top of the free region, so that it does not
 	   overlap with the function code possibly being written at the bottom
 	   of the free region */
-	ptr = cache->free_end - size;
+	ptr = arena->free_end - size;
 	ptr = (unsigned char *) (((jit_nuint) ptr) & ~((jit_nuint) align - 1));
-	if(ptr < cache->free_start)
+	if(ptr < arena->free_start)
 	{
 		/* When we aligned the block, it caused an overflow */
 		return 0;
 	}
 
 	/* Allocate the block and return it */
-	cache->free_end = ptr;
+	arena->free_end = ptr;
 	return ptr;
 }
 
 static void *
 alloc_code(jit_cache_t cache, unsigned int size, unsigned int align)
 {
+	jit_cache_arena_t arena;
 	unsigned char *ptr;
+	unsigned long index;
 
-	/* Bail out if there is a started function */
-	if(cache->node)
+	/* Prefer the best fitting free block */
+	index = FindFreeBlock(cache, size, align);
+	if(index < cache->numBlocks)
 	{
-		return 0;
+		return TakeFreeBlock(cache, index, size, align);
 	}
-	/* Bail out if there is no cache available */
-	if(!cache->free_start)
+
+	/* The free region belongs to a started function.  Carve the memory
+	   from the start of a new page and keep the rest as a free block */
+	arena = GetArena(cache);
+	if(!arena || arena->node)
 	{
-		return 0;
+		if(size > cache->pageSize)
+		{
+			return 0;
+		}
+		ptr = NewCachePage(cache, 1);
+		if(!ptr)
+		{
+			return 0;
+		}
+		AddFreeBlock(cache, ptr + size, ptr + cache->pageSize);
+		return (void *) ptr;
 	}
 
 	/* Allocate aligned memory. */
-	ptr = cache->free_start;
+	ptr = arena->free_start;
 	if(align > 1)
 	{
 		jit_nuint p = ((jit_nuint) ptr + align - 1) & ~((jit_nuint) align - 1);
@@ -680,19 +1571,19 @@ alloc_code(jit_cache_t cache, unsigned int size, unsigned int align)
 	}
 
 	/* Do we need to allocate a new cache page? */
-	if((ptr + size) > cache->free_end)
+	if(!arena->free_start || (ptr + size) > arena->free_end)
 	{
 		/* Allocate a new page */
-		AllocCachePage(cache, 0);
+		AllocCachePage(cache, arena, 0);
 
 		/* Bail out if the cache is full */
-		if(!cache->free_start)
+		if(!arena->free_start)
 		{
 			return 0;
 		}
 
 		/* Allocate memory from the new page */
-		ptr = cache->free_start;
+		ptr = arena->free_start;
 		if(align > 1)
 		{
 			jit_nuint p = ((jit_nuint) ptr + align - 1) & ~((jit_nuint) align - 1);
@@ -701,36 +1592,54 @@ alloc_code(jit_cache_t cache, unsigned int size, unsigned int align)
 	}
 
 	/* Allocate the block and return it */
-	cache->free_start = ptr + size;
+	arena->free_start = ptr + size;
 	return (void *) ptr;
 }
 
 void *
 _jit_cache_alloc_trampoline(jit_cache_t cache)
 {
-	return alloc_code(cache,
-			  jit_get_trampoline_size(),
-			  jit_get_trampoline_alignment());
+	void *ptr;
+
+	ptr = alloc_code(cache,
+			 jit_get_trampoline_size(),
+			 jit_get_trampoline_alignment());
+	if(ptr)
+	{
+		++(cache->numTrampolines);
+	}
+	return ptr;
 }
 
 void
 _jit_cache_free_trampoline(jit_cache_t cache, void *trampoline)
 {
-	/* not supported yet */
+	--(cache->numTrampolines);
+	FreeRegion(cache, (unsigned char *) trampoline,
+		   ((unsigned char *) trampoline) + jit_get_trampoline_size());
 }
 
 void *
 _jit_cache_alloc_closure(jit_cache_t cache)
 {
-	return alloc_code(cache,
-			  jit_get_closure_size(),
-			  jit_get_closure_alignment());
+	void *ptr;
+
+	ptr = alloc_code(cache,
+			 jit_get_closure_size(),
+			 jit_get_closure_alignment());
+	if(ptr)
+	{
+		++(cache->numClosures);
+	}
+	return ptr;
 }
 
 void
 _jit_cache_free_closure(jit_cache_t cache, void *closure)
 {
-	/* not supported yet */
+	--(cache->numClosures);
+	FreeRegion(cache, (unsigned char *) closure,
+		   ((unsigned char *) closure) + jit_get_closure_size());
 }
 
 #if 0
@@ -793,23 +1702,41 @@ _jit_cache_alloc_no_method(jit_cache_t cache, unsigned long size, unsigned long
 void *
 _jit_cache_find_function_info(jit_cache_t cache, void *pc)
 {
-	jit_cache_node_t node = cache->head.right;
-	while(node != &(cache->nil))
+	struct jit_cache_bucket *bucket;
+	struct jit_cache_entry *entry;
+	unsigned long index, num;
+	unsigned int seq;
+	jit_cache_node_t node;
+
+	/* The map is searched without a lock.  Start over if it was
+	   changed in the meantime */
+	do
 	{
-		if(((unsigned char *)pc) < node->start)
-		{
-			node = GetLeft(node);
-		}
-		else if(((unsigned char *)pc) >= node->end)
-		{
-			node = GetRight(node);
-		}
-		else
+		seq = cache->tableSeq;
+		jit_barrier_load();
+		node = 0;
+		bucket = (seq & 1) ? 0 : FindBucket(cache, MapGranule(pc));
+		if(bucket)
 		{
-			return node;
+			num = bucket->num;
+			if(num > bucket->size)
+			{
+				num = bucket->size;
+			}
+			index = FindTableEntry(bucket->entries, num, (unsigned char *) pc);
+			if(index > 0)
+			{
+				entry = &bucket->entries[index - 1];
+				if(((unsigned char *) pc) < entry->end)
+				{
+					node = entry->node;
+				}
+			}
 		}
+		jit_barrier_load();
 	}
-	return 0;
+	while((seq & 1) || cache->tableSeq != seq);
+	return node;
 }
 
 jit_function_t
@@ -845,6 +1772,111 @@ _jit_cache_get_function_end(jit_memory_context_t memctx, void *func_info)
 	return 0;
 }
 
+void
+_jit_cache_free_code(jit_cache_t cache, void *func_info)
+{
+	jit_cache_node_t node = (jit_cache_node_t) func_info;
+	unsigned char *start, *end, *data;
+
+	if(!node)
+	{
+		return;
+	}
+
+	/* The block itself is the last item of the function data,
+	   which is about to be freed */
+	start = node->start;
+	end = node->end;
+	data = node->data;
+	RemoveFromLookupTable(cache, node);
+
+	FreeRegion(cache, start, end);
+	FreeRegion(cache, data, (unsigned char *) (node + 1));
+}
+
+jit_nint
+_jit_cache_get_exec_offset(jit_cache_t cache)
+{
+	return cache->execOffset;
+}
+
+void
+_jit_cache_get_stats(jit_cache_t cache, jit_memory_stats_t *stats)
+{
+	struct jit_cache_entry *entry;
+	jit_cache_arena_t arena;
+	unsigned long page, index;
+	jit_nuint size;
+
+	stats->page_size = cache->pageSize;
+	stats->num_pages = cache->numPages;
+	stats->pages_used = 0;
+	for(page = 0; page < cache->numPages; ++page)
+	{
+		stats->pages_used += cache->pages[page].factor;
+	}
+	stats->region_pages = (cache->regionEnd - cache->region) / cache->pageSize;
+	stats->huge_pages = cache->hugePages;
+
+	/* The method information block is the last item of the data */
+	stats->num_functions = cache->numEntries;
+	stats->code_bytes = 0;
+	stats->data_bytes = 0;
+	entry = 0;
+	while(cache->map
+	      && (entry = FindNextEntry((struct jit_cache_map *) cache->map,
+					JIT_CACHE_MAP_LEVELS - 1, 0,
+					entry ? entry->start : 0)) != 0)
+	{
+		stats->code_bytes += entry->end - entry->start;
+		stats->data_bytes += (unsigned char *) (entry->node + 1) - entry->node->data;
+	}
+	stats->trampoline_bytes = cache->numTrampolines * jit_get_trampoline_size();
+	stats->closure_bytes = cache->numClosures * jit_get_closure_size();
+
+	/* The free regions of the arenas count as free blocks */
+	stats->free_bytes = 0;
+	stats->num_free_blocks = 0;
+	stats->largest_free = 0;
+	for(arena = cache->arenas; arena; arena = arena->next)
+	{
+		size = arena->free_end - arena->free_start;
+		if(size != 0)
+		{
+			stats->free_bytes += size;
+			++(stats->num_free_blocks);
+			if(size > stats->largest_free)
+			{
+				stats->largest_free = size;
+			}
+		}
+	}
+	for(index = 0; index < cache->numBlocks; ++index)
+	{
+		size = cache->blocks[index].end - cache->blocks[index].start;
+		stats->free_bytes += size;
+		++(stats->num_free_blocks);
+		if(size > stats->largest_free)
+		{
+			stats->largest_free = size;
+		}
+	}
+}
+
+void *
+_jit_cache_find_next_function_info(jit_cache_t cache, void *pc)
+{
+	struct jit_cache_entry *entry;
+
+	if(!cache->map)
+	{
+		return 0;
+	}
+	entry = FindNextEntry((struct jit_cache_map *) cache->map,
+			      JIT_CACHE_MAP_LEVELS - 1, 0, (unsigned char *) pc);
+	return entry ? entry->node : 0;
+}
+
 jit_memory_manager_t
 jit_default_memory_manager(void)
 {
@@ -905,7 +1937,22 @@ jit_default_memory_manager(void)
 		&_jit_cache_free_closure,
 
 		(void * (*)(jit_memory_context_t, jit_size_t, jit_size_t))
-		&_jit_cache_alloc_data
+		&_jit_cache_alloc_data,
+
+		(void (*)(jit_memory_context_t, jit_function_info_t))
+		&_jit_cache_free_code,
+
+		(jit_nint (*)(jit_memory_context_t))
+		&_jit_cache_get_exec_offset,
+
+		(void (*)(jit_memory_context_t, jit_memory_stats_t *))
+		&_jit_cache_get_stats,
+
+		(jit_function_info_t (*)(jit_memory_context_t, void *))
+		&_jit_cache_find_next_function_info,
+
+		(void (*)(jit_memory_context_t, jit_size_t))
+		&_jit_cache_set_size_hint
 	};
 	return &mm;
 }
@@ -995,10 +2042,17 @@ with it.  These blocks indicate the start and end of regions within the
 method.  Normally these regions correspond to exception "try" blocks, or
 regular code between "try" blocks.
 
-The jit_cache_method blocks are organised into a red-black tree, which
-is used to perform fast lookups by address (_jit_cache_get_method).  These
-lookups are used when walking the stack during exceptions or security
-processing.
+The jit_cache_method blocks are listed in a map by address, which is
+used to perform fast lookups by address (_jit_cache_get_method).
+These lookups are used when walking the stack during exceptions or
+security processing.  The map splits the address space into granules
+of 4k (JIT_CACHE_MAP_SHIFT), and is a radix tree over the granule
+numbers with 256 slots per level (JIT_CACHE_MAP_BITS).  The last level
+points to a bucket per granule, which lists the methods that overlap
+the granule sorted by address.  A lookup takes a fixed number of steps
+and a search of one small bucket, and adding or removing a method only
+moves the entries of the methods in the same granules, instead of a
+part of a table of all the methods.
 
 Each method can also have offset information associated with it, to map
 between native code addresses and offsets within the original bytecode.
@@ -1008,10 +2062,35 @@ as auxiliary data, attached to the jit_cache_method block.
 Threading issues
 ----------------
 
-Writing a method to the cache, querying a method by address, or querying
-offset information for a method, are not thread-safe.  The caller should
-arrange for a cache lock to be acquired prior to performing these
-operations.
+Writing a method to the cache, or querying offset information for a
+method, are not thread-safe.  The caller should arrange for a cache lock
+to be acquired prior to performing these operations.
+
+Querying a method by address is thread-safe, and takes no lock, so that
+threads that throw exceptions or walk their stacks do not contend with
+each other or with the compiler.  The lookup map is only changed with
+the cache lock held.  Each change makes a sequence number odd before it
+starts and even again once it is done, and a search that sees the
+number odd, or changed over the search, starts over.  The levels of
+the map are never freed before the cache is.  A bucket that is too
+small is replaced with a bigger copy, and the old one is kept until
+the cache is destroyed, so a search never reads freed memory.  The
+buckets of a granule add up to less than twice the size of the
+current one.
+
+The lock does not have to be held while the method code is generated.
+Each thread that writes methods has an arena with a free region of its
+own.  Between _jit_cache_start_method and _jit_cache_end_method the free
+region belongs to the method being written, and only the thread writing
+it may touch the region, or allocate auxiliary data from it.  So several
+threads can write methods at once, and the lock is only held to hand
+out a region, and to add the finished method to the lookup map.  Other
+threads may still allocate trampolines and closures, and give back code,
+in the meantime.  These take memory from the free block list, from the
+free region of their own arena or from fresh pages, and put freed memory
+on the list or in a region that no method is written to.  The arena of
+a thread that has no started method may be taken over by another thread,
+so there are never more arenas than threads writing methods at once.
 
 Executing methods from the cache is thread-safe, as the method code is
 fixed in place once it has been written.
@@ -1066,6 +2145,62 @@ To prevent the cache from chewing up all of system memory, it is possible
 to set a limit on how far it will grow.  Once the limit is reached, out
 of memory will be reported and there is no way to recover.
 
+Reclaiming code
+---------------
+
+The one exception is the code replaced by recompiling a function, if
+the context has the JIT_OPTION_RECLAIM_CODE option set.  Instead of a
+lock per method, the application brackets the execution of the compiled
+code with jit_context_enter_code and jit_context_leave_code, which count
+the threads in two alternating epochs.  The replaced code is retired
+in the current epoch and handed to _jit_cache_free_code two epochs
+later, when every thread that could have seen it has left.
+
+_jit_cache_free_code removes the method region block from the lookup
+map, and gives back the code and the auxiliary data of the method.
+Freed memory goes to a list of free blocks sorted by address, where
+the adjacent blocks are merged, or joins the free region of an arena
+directly if it is adjacent to it.  Trampolines and closures are
+allocated from the best fitting free block.  A method is written to
+the largest free block if it is bigger than the free region of its
+arena, and that free region is put on the list.  The leftover of a page that is given
+up for a new page goes on the list as well.  A block that covers a
+whole page gives the page back to the system.
+
+Writable and executable views
+-----------------------------
+
+If the context has the JIT_OPTION_WRITE_XOR_EXECUTE option set, the
+cache reserves a single region of memory that is mapped twice, once
+read/write and once read/execute.  The pages are taken from the region
+in order and are never unmapped.  Instead, the memory behind the system
+pages that become entirely free is given back, and the free blocks stay
+on the list.  All addresses inside the cache belong to the writable
+view.  The offset of the executable view is reported by
+_jit_cache_get_exec_offset, and the code outside the cache converts
+the addresses of code, trampolines and closures as they cross the
+memory manager interface.
+
+Huge pages
+----------
+
+If the JIT_OPTION_CACHE_HUGE_PAGES option is set instead, the region
+is a single mapping aligned on JIT_CACHE_HUGE_PAGE_SIZE and backed by
+huge pages.  It is managed in the same way, except that memory is only
+given back in whole huge pages, so that a freed function does not
+split a huge page.  _jit_cache_get_stats reports how many pages have
+been taken from the region.
+
+Size hints
+----------
+
+Before a method is started or extended, the compiler estimates how
+much space its code will need and passes it to _jit_cache_set_size_hint.
+If the hint does not fit in the free region of the thread's arena, a
+page big enough for it is allocated up front, so the method is not
+restarted on a series of ever larger pages.  The hint is only used by
+the next call of the same thread.
+
 */
 
 #ifdef	__cplusplus
@@ -20,6 +20,16 @@
 
 #include "jit-internal.h"
 
+/*
+ * Code of a recompiled function that waits to be reclaimed.
+ */
+struct _jit_retired_code
+{
+	jit_function_info_t	info;
+	unsigned int		epoch;
+	struct _jit_retired_code *next;
+};
+
 void
 _jit_memory_lock(jit_context_t context)
 {
@@ -38,6 +48,11 @@ _jit_memory_ensure(jit_context_t context)
 	if(!context->memory_context)
 	{
  		context->memory_context = context->memory_manager->create(context);
+		if(context->memory_context && context->memory_manager->get_exec_offset)
+		{
+			context->exec_offset =
+				context->memory_manager->get_exec_offset(context->memory_context);
+		}
 	}
 	return (context->memory_context != 0);
 }
@@ -45,6 +60,13 @@ _jit_memory_ensure(jit_context_t context)
 void 
 _jit_memory_destroy(jit_context_t context)
 {
+	struct _jit_retired_code *retired;
+
+	while((retired = context->retired_code) != 0)
+	{
+		context->retired_code = retired->next;
+		jit_free(retired);
+	}
 	if(!context->memory_context)
 	{
 		return;
@@ -59,29 +81,49 @@ _jit_memory_find_function_info(jit_context_t context, void *pc)
 	{
 		return 0;
 	}
-	/* TODO: read lock? */
-	return context->memory_manager->find_function_info(context->memory_context, pc);
+	/* The memory manager must allow the lookup without the lock */
+	return context->memory_manager->find_function_info(context->memory_context,
+							   (unsigned char *) pc - context->exec_offset);
+}
+
+jit_function_info_t
+_jit_memory_find_next_function_info(jit_context_t context, void *pc)
+{
+	if(!context->memory_context || !context->memory_manager->find_next_function_info)
+	{
+		return 0;
+	}
+	if(pc)
+	{
+		pc = (unsigned char *) pc - context->exec_offset;
+	}
+	return context->memory_manager->find_next_function_info(context->memory_context, pc);
 }
 
+/*
+ * The function info is only read, so these need no lock either.  The
+ * info stays valid while its code may run: the code that is retired
+ * is only freed by _jit_memory_reclaim_code once the threads that
+ * entered the code before it was retired have all left.
+ */
 jit_function_t
 _jit_memory_get_function(jit_context_t context, jit_function_info_t info)
 {
-	/* TODO: read lock? */
 	return context->memory_manager->get_function(context->memory_context, info);
 }
 
 void *
 _jit_memory_get_function_start(jit_context_t context, jit_function_info_t info)
 {
-	/* TODO: read lock? */
-	return context->memory_manager->get_function_start(context->memory_context, info);
+	return (unsigned char *) context->memory_manager->get_function_start(context->memory_context, info)
+		+ context->exec_offset;
 }
 
 void *
 _jit_memory_get_function_end(jit_context_t context, jit_function_info_t info)
 {
-	/* TODO: read lock? */
-	return context->memory_manager->get_function_end(context->memory_context, info);
+	return (unsigned char *) context->memory_manager->get_function_end(context->memory_context, info)
+		+ context->exec_offset;
 }
 
 jit_function_t
@@ -96,6 +138,15 @@ _jit_memory_free_function(jit_context_t context, jit_function_t func)
 	context->memory_manager->free_function(context->memory_context, func);
 }
 
+void
+_jit_memory_set_size_hint(jit_context_t context, jit_size_t size)
+{
+	if(context->memory_manager->set_size_hint)
+	{
+		context->memory_manager->set_size_hint(context->memory_context, size);
+	}
+}
+
 int
 _jit_memory_start_function(jit_context_t context, jit_function_t func)
 {
@@ -141,7 +192,8 @@ _jit_memory_alloc_trampoline(jit_context_t context)
 void
 _jit_memory_free_trampoline(jit_context_t context, void *ptr)
 {
-	context->memory_manager->free_trampoline(context->memory_context, ptr);
+	context->memory_manager->free_trampoline(context->memory_context,
+						 (unsigned char *) ptr - context->exec_offset);
 }
 
 void *
@@ -153,7 +205,8 @@ _jit_memory_alloc_closure(jit_context_t context)
 void
 _jit_memory_free_closure(jit_context_t context, void *ptr)
 {
-	context->memory_manager->free_closure(context->memory_context, ptr);
+	context->memory_manager->free_closure(context->memory_context,
+					      (unsigned char *) ptr - context->exec_offset);
 }
 
 void *
@@ -161,3 +214,88 @@ _jit_memory_alloc_data(jit_context_t context, jit_size_t size, jit_size_t align)
 {
 	return context->memory_manager->alloc_data(context->memory_context, size, align);
 }
+
+/*
+ * Get the address that the code written at "ptr" runs from.  The code
+ * and the trampolines are written at the addresses handed out by the
+ * memory context, all the other code addresses are the executable ones.
+ */
+void *
+_jit_memory_get_exec_address(jit_context_t context, void *ptr)
+{
+	return (unsigned char *) ptr + context->exec_offset;
+}
+
+void
+_jit_memory_retire_code(jit_context_t context, void *code)
+{
+	struct _jit_retired_code *retired;
+	jit_function_info_t info;
+
+	if(!context->memory_context || !context->memory_manager->free_code)
+	{
+		return;
+	}
+	if(!jit_context_get_meta_numeric(context, JIT_OPTION_RECLAIM_CODE))
+	{
+		return;
+	}
+
+	info = _jit_memory_find_function_info(context, code);
+	if(!info)
+	{
+		return;
+	}
+	retired = jit_new(struct _jit_retired_code);
+	if(!retired)
+	{
+		/* The code is never reclaimed, but this is not fatal */
+		return;
+	}
+	retired->info = info;
+	retired->epoch = context->code_epoch;
+	retired->next = context->retired_code;
+	context->retired_code = retired;
+
+	_jit_memory_reclaim_code(context);
+}
+
+void
+_jit_memory_reclaim_code(jit_context_t context)
+{
+	struct _jit_retired_code **prev;
+	struct _jit_retired_code *retired;
+	int count;
+
+	/* The epoch moves on once the threads that entered in the
+	   epoch before the current one have all left.  The code retired
+	   in an epoch may be freed two epochs later, as by then every
+	   thread that could have seen it is gone.  The readers are
+	   counted without the lock, so the entry points that were just
+	   replaced must be seen by them before the counts are read */
+	jit_barrier_full();
+	for(count = 0; count < 2; ++count)
+	{
+		if(context->code_readers[(context->code_epoch + 1) & 1] != 0)
+		{
+			break;
+		}
+		++(context->code_epoch);
+	}
+
+	prev = &(context->retired_code);
+	while((retired = *prev) != 0)
+	{
+		if((context->code_epoch - retired->epoch) >= 2)
+		{
+			*prev = retired->next;
+			context->memory_manager->free_code(context->memory_context,
+							   retired->info);
+			jit_free(retired);
+		}
+		else
+		{
+			prev = &(retired->next);
+		}
+	}
+}
@@ -724,7 +724,8 @@ apply_opcode(jit_function_t func, const _jit_intrinsic_info_t *opcode_info,
 		break;
 	}
 
-	if(result)
+	/* The intrinsics that may fail return a result code */
+	if(result > 0)
 	{
 		return jit_value_create_constant(func, &const_result);
 	}
@@ -754,6 +755,36 @@ _jit_opcode_apply(jit_function_t func, jit_uint opcode, jit_type_t dest_type,
 		return apply_opcode(func, opcode_info, dest_type, value1, value2);
 	}
 
+	if((opcode_info->flags & _JIT_INTRINSIC_FLAG_MASK) == _JIT_INTRINSIC_FLAG_BRANCH)
+	{
+		/*
+		 * Evaluate the comparison of the conditional branch.
+		 * The result is non-zero if the branch is taken.
+		 */
+		opcode = opcode_info->flags & ~_JIT_INTRINSIC_FLAG_MASK;
+		if(opcode >= JIT_OP_NUM_OPCODES)
+		{
+			return 0;
+		}
+		return _jit_opcode_apply(func, opcode, jit_type_int, value1, value2);
+	}
+
+	if((opcode_info->flags & _JIT_INTRINSIC_FLAG_MASK) == _JIT_INTRINSIC_FLAG_BRANCH_UNARY)
+	{
+		if(!value1->is_nint_constant)
+		{
+			return 0;
+		}
+		/* The low bit tells the "true" branches from the "false" ones */
+		if((opcode_info->flags & _JIT_INTRINSIC_FLAG_ITRUE) != 0)
+		{
+			return jit_value_create_nint_constant(func, jit_type_int,
+							      value1->address != 0);
+		}
+		return jit_value_create_nint_constant(func, jit_type_int,
+						      value1->address == 0);
+	}
+
 	if((opcode_info->flags & _JIT_INTRINSIC_FLAG_MASK) == _JIT_INTRINSIC_FLAG_NOT)
 	{
 		jit_value_t value;
@@ -0,0 +1,584 @@
+/*
+ * jit-profile.c - Block execution counts and the block layout by them.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef _JIT_COMPILE_DEBUG
+#include <stdio.h>
+#endif
+
+/*
+ * The first compilation of a profiled function counts how many times
+ * each block starts.  The blocks are numbered in their order after the
+ * machine-independent optimizations, which is the same every time the
+ * function is built with the same instructions.  The next compilation
+ * recovers the edge counts from the block counts and chains the blocks
+ * along the most frequent edges in the manner of Pettis and Hansen.
+ * The chains of blocks that rarely ran are moved to the end of the
+ * function, out of the way of the hot code.
+ */
+
+/*
+ * Edge count that is not yet known.
+ */
+#define UNKNOWN_COUNT	((jit_ulong) -1)
+
+/*
+ * A chain is cold if its blocks run less often than this many times
+ * less than the most frequent block of the function.
+ */
+#define COLD_RATIO	100
+
+/*
+ * Candidate for an edge that falls through in the new layout.
+ */
+typedef struct
+{
+	_jit_edge_t		edge;
+	jit_ulong		count;
+	int			order;
+
+} _jit_layout_edge_t;
+
+/*
+ * Check if the block ends with a call.  The block that follows it picks
+ * up the return value so nothing may be placed between the two.
+ */
+static int
+ends_in_call(jit_block_t block)
+{
+	jit_insn_t insn;
+
+	insn = _jit_block_get_last(block);
+	return (insn && insn->opcode >= JIT_OP_CALL
+		&& insn->opcode <= JIT_OP_CALL_EXTERNAL_TAIL);
+}
+
+/*
+ * Get the position after the instructions that must start the block,
+ * those that pick up the incoming parameters and the return value.
+ */
+static int
+get_counter_position(jit_block_t block)
+{
+	int index;
+
+	for(index = 0; index < block->num_insns; index++)
+	{
+		switch(block->insns[index].opcode)
+		{
+		case JIT_OP_NOP:
+		case JIT_OP_INCOMING_REG:
+		case JIT_OP_INCOMING_FRAME_POSN:
+		case JIT_OP_RETURN_REG:
+		case JIT_OP_FLUSH_SMALL_STRUCT:
+		case JIT_OP_POP_STACK:
+			break;
+
+		default:
+			return index;
+		}
+	}
+	return index;
+}
+
+/*
+ * Add the instructions that increment the counter at the address.
+ */
+static void
+add_counter(jit_function_t func, jit_block_t block, jit_ulong *counter)
+{
+	jit_value_t address, offset, one, count, sum;
+	jit_insn_t insn;
+	int index;
+
+	address = jit_value_create_nint_constant(func, jit_type_void_ptr,
+						 (jit_nint) counter);
+	offset = jit_value_create_nint_constant(func, jit_type_nint, 0);
+	one = jit_value_create_long_constant(func, jit_type_ulong, 1);
+	count = jit_value_create(func, jit_type_ulong);
+	sum = jit_value_create(func, jit_type_ulong);
+	if(!address || !offset || !one || !count || !sum)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	count->block = block;
+	sum->block = block;
+
+	index = get_counter_position(block);
+	insn = _jit_block_insert_insn(block, index);
+	if(!insn)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	insn->opcode = (short)JIT_OP_LOAD_RELATIVE_LONG;
+	insn->dest = count;
+	insn->value1 = address;
+	insn->value2 = offset;
+
+	insn = _jit_block_insert_insn(block, index + 1);
+	if(!insn)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	insn->opcode = (short)JIT_OP_LADD;
+	insn->dest = sum;
+	insn->value1 = count;
+	insn->value2 = one;
+
+	insn = _jit_block_insert_insn(block, index + 2);
+	if(!insn)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	insn->opcode = (short)JIT_OP_STORE_RELATIVE_LONG;
+	insn->flags = JIT_INSN_DEST_IS_VALUE;
+	insn->dest = address;
+	insn->value1 = sum;
+	insn->value2 = offset;
+}
+
+void
+_jit_block_add_counters(jit_function_t func)
+{
+	jit_block_t block;
+	jit_ulong *counts;
+	int num_blocks;
+	int index;
+
+	num_blocks = 0;
+	for(block = func->builder->entry_block; block; block = block->next)
+	{
+		++num_blocks;
+	}
+
+	counts = jit_calloc(num_blocks, sizeof(jit_ulong));
+	if(!counts)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	func->block_counts = counts;
+	func->num_block_counts = num_blocks;
+
+	/* The exit block stays empty, nothing runs there */
+	index = 0;
+	for(block = func->builder->entry_block; block; block = block->next)
+	{
+		if(block != func->builder->exit_block)
+		{
+			add_counter(func, block, &counts[index]);
+		}
+		++index;
+	}
+}
+
+void
+_jit_block_add_use_mark(jit_function_t func, jit_int *mark)
+{
+	jit_block_t block;
+	jit_value_t address, offset, one;
+	jit_insn_t insn;
+
+	address = jit_value_create_nint_constant(func, jit_type_void_ptr,
+						 (jit_nint) mark);
+	offset = jit_value_create_nint_constant(func, jit_type_nint, 0);
+	one = jit_value_create_nint_constant(func, jit_type_int, 1);
+	if(!address || !offset || !one)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+
+	/* A constant is stored, so that a call costs no load */
+	block = func->builder->entry_block;
+	insn = _jit_block_insert_insn(block, get_counter_position(block));
+	if(!insn)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	insn->opcode = (short)JIT_OP_STORE_RELATIVE_INT;
+	insn->flags = JIT_INSN_DEST_IS_VALUE;
+	insn->dest = address;
+	insn->value1 = one;
+	insn->value2 = offset;
+}
+
+/*
+ * Get the index of the edge in the list of all edges, which holds the
+ * successors of the blocks one after another.
+ */
+static int
+get_edge_index(int *first_edge, _jit_edge_t edge)
+{
+	int index;
+
+	for(index = 0; edge->src->succs[index] != edge; index++)
+	{
+		/* Find the edge among the successors of its source */
+	}
+	return first_edge[edge->src->index] + index;
+}
+
+/*
+ * Count the edges from the counts of the blocks.  If all the counts of
+ * the edges leaving or entering a block but one are known then the last
+ * one is the rest of the block count.
+ */
+static void
+count_edges(jit_function_t func, jit_block_t *blocks, int num_blocks,
+	    int *first_edge, jit_ulong *edge_counts, int num_edges)
+{
+	jit_block_t block;
+	_jit_edge_t edge, unknown;
+	jit_ulong count, known;
+	int index, succ, changed;
+
+	for(index = 0; index < num_edges; index++)
+	{
+		edge_counts[index] = UNKNOWN_COUNT;
+	}
+	for(index = 0; index < num_blocks; index++)
+	{
+		block = blocks[index];
+		for(succ = 0; succ < block->num_succs; succ++)
+		{
+			/* The exceptions are assumed to be rare */
+			edge = block->succs[succ];
+			if(edge->flags == _JIT_EDGE_EXCEPT)
+			{
+				edge_counts[first_edge[index] + succ] = 0;
+			}
+		}
+	}
+
+	do
+	{
+		changed = 0;
+		for(index = 0; index < num_blocks; index++)
+		{
+			block = blocks[index];
+			count = func->block_counts[index];
+			if(block == func->builder->exit_block)
+			{
+				continue;
+			}
+
+			known = 0;
+			unknown = 0;
+			for(succ = 0; succ < block->num_succs; succ++)
+			{
+				edge = block->succs[succ];
+				if(edge_counts[first_edge[index] + succ] == UNKNOWN_COUNT)
+				{
+					if(unknown)
+					{
+						break;
+					}
+					unknown = edge;
+				}
+				else
+				{
+					known += edge_counts[first_edge[index] + succ];
+				}
+			}
+			if(unknown && succ == block->num_succs)
+			{
+				edge_counts[get_edge_index(first_edge, unknown)]
+					= (count > known) ? count - known : 0;
+				changed = 1;
+			}
+
+			if(block == func->builder->entry_block)
+			{
+				continue;
+			}
+			known = 0;
+			unknown = 0;
+			for(succ = 0; succ < block->num_preds; succ++)
+			{
+				edge = block->preds[succ];
+				if(edge_counts[get_edge_index(first_edge, edge)] == UNKNOWN_COUNT)
+				{
+					if(unknown)
+					{
+						break;
+					}
+					unknown = edge;
+				}
+				else
+				{
+					known += edge_counts[get_edge_index(first_edge, edge)];
+				}
+			}
+			if(unknown && succ == block->num_preds)
+			{
+				edge_counts[get_edge_index(first_edge, unknown)]
+					= (count > known) ? count - known : 0;
+				changed = 1;
+			}
+		}
+	}
+	while(changed);
+
+	for(index = 0; index < num_edges; index++)
+	{
+		if(edge_counts[index] == UNKNOWN_COUNT)
+		{
+			edge_counts[index] = 0;
+		}
+	}
+}
+
+/*
+ * Order the candidate edges by decreasing count and then by their
+ * position in the function.
+ */
+static int
+compare_edges(const void *e1, const void *e2)
+{
+	const _jit_layout_edge_t *edge1 = (const _jit_layout_edge_t *) e1;
+	const _jit_layout_edge_t *edge2 = (const _jit_layout_edge_t *) e2;
+
+	if(edge1->count != edge2->count)
+	{
+		return (edge1->count > edge2->count) ? -1 : 1;
+	}
+	return edge1->order - edge2->order;
+}
+
+/*
+ * Get the first block of the chain that contains the block.
+ */
+static int
+find_chain(int *chain, int index)
+{
+	while(chain[index] != index)
+	{
+		chain[index] = chain[chain[index]];
+		index = chain[index];
+	}
+	return index;
+}
+
+/*
+ * Append the chain that starts with the destination of the edge to the
+ * chain that ends with its source.  Returns zero if that is not possible.
+ */
+static int
+join_chains(jit_function_t func, _jit_edge_t edge,
+	    int *chain, int *next, int *last)
+{
+	int src, dst;
+
+	src = edge->src->index;
+	dst = edge->dst->index;
+	if(edge->dst == func->builder->entry_block
+	   || edge->dst == func->builder->exit_block
+	   || chain[dst] != dst || next[src] >= 0
+	   || find_chain(chain, src) == dst)
+	{
+		return 0;
+	}
+	next[src] = dst;
+	last[find_chain(chain, src)] = last[dst];
+	chain[dst] = find_chain(chain, src);
+	return 1;
+}
+
+void
+_jit_block_layout_by_counts(jit_function_t func)
+{
+	jit_block_t block;
+	jit_block_t *blocks;
+	jit_block_t *order;
+	jit_ulong *edge_counts;
+	jit_ulong max_count;
+	_jit_layout_edge_t *candidates;
+	_jit_edge_t edge;
+	int *first_edge, *chain, *next, *last;
+	int num_blocks, num_edges, num_candidates, num_order;
+	int index, succ, pass, hot, start;
+
+	num_blocks = 0;
+	for(block = func->builder->entry_block; block; block = block->next)
+	{
+		++num_blocks;
+	}
+	if(num_blocks != func->num_block_counts || func->block_counts[0] == 0)
+	{
+		/* The function was built differently or has never run */
+		return;
+	}
+
+	blocks = jit_malloc(num_blocks * sizeof(jit_block_t));
+	order = jit_malloc(num_blocks * sizeof(jit_block_t));
+	first_edge = jit_malloc(num_blocks * sizeof(int));
+	chain = jit_malloc(num_blocks * sizeof(int));
+	next = jit_malloc(num_blocks * sizeof(int));
+	last = jit_malloc(num_blocks * sizeof(int));
+	num_edges = 0;
+	index = 0;
+	for(block = func->builder->entry_block; block; block = block->next)
+	{
+		if(blocks)
+		{
+			blocks[index] = block;
+		}
+		if(first_edge)
+		{
+			first_edge[index] = num_edges;
+		}
+		block->index = index++;
+		num_edges += block->num_succs;
+	}
+	edge_counts = jit_malloc((num_edges + 1) * sizeof(jit_ulong));
+	candidates = jit_malloc((num_edges + 1) * sizeof(_jit_layout_edge_t));
+	if(!blocks || !order || !first_edge || !chain || !next || !last
+	   || !edge_counts || !candidates)
+	{
+		jit_free(blocks);
+		jit_free(order);
+		jit_free(first_edge);
+		jit_free(chain);
+		jit_free(next);
+		jit_free(last);
+		jit_free(edge_counts);
+		jit_free(candidates);
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+
+	count_edges(func, blocks, num_blocks, first_edge, edge_counts, num_edges);
+	max_count = 0;
+	for(index = 0; index < num_blocks; index++)
+	{
+		if(func->block_counts[index] > max_count)
+		{
+			max_count = func->block_counts[index];
+		}
+	}
+
+	/* Every block starts as a chain of its own */
+	for(index = 0; index < num_blocks; index++)
+	{
+		chain[index] = index;
+		next[index] = -1;
+		last[index] = index;
+	}
+
+	/* The block that follows a call stays where it is and the other
+	   frequent edges fall through if possible, the most frequent first */
+	num_candidates = 0;
+	for(index = 0; index < num_blocks; index++)
+	{
+		block = blocks[index];
+		for(succ = 0; succ < block->num_succs; succ++)
+		{
+			edge = block->succs[succ];
+			if(edge->flags == _JIT_EDGE_FALLTHRU && ends_in_call(block))
+			{
+				join_chains(func, edge, chain, next, last);
+			}
+			else if(edge_counts[first_edge[index] + succ] > 0
+				&& edge->dst != block
+				&& _jit_block_can_fall_into(block, edge))
+			{
+				candidates[num_candidates].edge = edge;
+				candidates[num_candidates].count
+					= edge_counts[first_edge[index] + succ];
+				candidates[num_candidates].order
+					= first_edge[index] + succ;
+				++num_candidates;
+			}
+		}
+	}
+	qsort(candidates, num_candidates, sizeof(_jit_layout_edge_t), compare_edges);
+	for(index = 0; index < num_candidates; index++)
+	{
+		join_chains(func, candidates[index].edge, chain, next, last);
+	}
+
+	/* The chain of the entry block goes first, then the hot chains in
+	   their original order, then the cold ones, then the exit block */
+	num_order = 0;
+	for(pass = 0; pass < 3; pass++)
+	{
+		for(start = 0; start < num_blocks; start++)
+		{
+			if(chain[start] != start
+			   || blocks[start] == func->builder->exit_block)
+			{
+				continue;
+			}
+			if(pass == 0 && start != 0)
+			{
+				continue;
+			}
+			if(pass > 0 && start == 0)
+			{
+				continue;
+			}
+			hot = 0;
+			for(index = start; index >= 0; index = next[index])
+			{
+				if(func->block_counts[index] > max_count / COLD_RATIO)
+				{
+					hot = 1;
+				}
+			}
+			if(pass == 1 && !hot)
+			{
+				continue;
+			}
+			if(pass == 2 && hot)
+			{
+				continue;
+			}
+			for(index = start; index >= 0; index = next[index])
+			{
+				order[num_order++] = blocks[index];
+			}
+		}
+	}
+	order[num_order++] = func->builder->exit_block;
+
+#ifdef _JIT_COMPILE_DEBUG
+	printf("Block layout by counts:");
+	for(index = 0; index < num_order; index++)
+	{
+		printf(" %d(%lu)", order[index]->index,
+		       (unsigned long) func->block_counts[order[index]->index]);
+	}
+	printf("\n");
+#endif
+
+	_jit_block_reorder(func, order, num_order);
+
+	jit_free(blocks);
+	jit_free(order);
+	jit_free(first_edge);
+	jit_free(chain);
+	jit_free(next);
+	jit_free(last);
+	jit_free(edge_counts);
+	jit_free(candidates);
+}
@@ -0,0 +1,337 @@
+/*
+ * jit-propagate.c - Global constant and copy propagation.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#include "jit-cfg.h"
+
+/*
+ * Propagation state.  The values that are found to be equal to a
+ * constant or to another value are recorded in the "replace" array
+ * indexed by the value number.
+ */
+struct propagate_state
+{
+	_jit_cfg_t		cfg;
+	jit_value_t		*replace;
+	int			*num_defs;
+	int			fold;
+	int			changed;
+};
+
+static int
+is_copy_insn(jit_insn_t insn)
+{
+	return insn->opcode >= JIT_OP_COPY_INT && insn->opcode <= JIT_OP_COPY_NFLOAT;
+}
+
+/*
+ * Check if the instruction defines its first operand rather than the
+ * destination operand.
+ */
+static int
+defines_value1(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_INCOMING_REG:
+	case JIT_OP_INCOMING_FRAME_POSN:
+	case JIT_OP_RETURN_REG:
+	case JIT_OP_OUTGOING_FRAME_POSN:
+		return 1;
+	}
+	return 0;
+}
+
+static void
+count_defs(struct propagate_state *state)
+{
+	_jit_cfg_t cfg;
+	int index;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+
+	cfg = state->cfg;
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		jit_insn_iter_init(&iter, cfg->nodes[index].block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			value = _jit_cfg_get_dest(insn);
+			if(value && (insn->flags & JIT_INSN_DEST_IS_VALUE) == 0)
+			{
+				++(state->num_defs[value->index]);
+			}
+			value = _jit_cfg_get_value1(insn);
+			if(value && defines_value1(insn))
+			{
+				++(state->num_defs[value->index]);
+			}
+		}
+	}
+}
+
+/*
+ * Check if the value keeps the same contents wherever it is available.
+ * These are the constants, the variables in SSA form, and the temporary
+ * values that are assigned only once.
+ */
+static int
+is_single_assignment(struct propagate_state *state, jit_value_t value)
+{
+	if(value->is_constant)
+	{
+		return 1;
+	}
+	if(value->index < 0 || value->is_addressable || value->is_volatile)
+	{
+		return 0;
+	}
+	if(state->cfg->values[value->index].var)
+	{
+		return 1;
+	}
+	return value->is_temporary && state->num_defs[value->index] == 1;
+}
+
+/*
+ * Check if the copy does not change the representation of the value.
+ */
+static int
+is_same_type(jit_value_t dest, jit_value_t value)
+{
+	jit_type_t dtype;
+	jit_type_t vtype;
+
+	dtype = jit_type_normalize(dest->type);
+	vtype = jit_type_normalize(value->type);
+	if(dtype == vtype)
+	{
+		return 1;
+	}
+	return ((dtype->kind == JIT_TYPE_INT || dtype->kind == JIT_TYPE_UINT)
+		&& (vtype->kind == JIT_TYPE_INT || vtype->kind == JIT_TYPE_UINT));
+}
+
+static int
+is_same_value(jit_value_t value1, jit_value_t value2)
+{
+	if(value1 == value2)
+	{
+		return 1;
+	}
+	return (value1->is_nint_constant && value2->is_nint_constant
+		&& value1->address == value2->address
+		&& jit_type_normalize(value1->type) == jit_type_normalize(value2->type));
+}
+
+static jit_value_t
+resolve(struct propagate_state *state, jit_value_t value)
+{
+	while(!value->is_constant && value->index >= 0 && state->replace[value->index])
+	{
+		value = state->replace[value->index];
+	}
+	return value;
+}
+
+static jit_value_t
+substitute(struct propagate_state *state, jit_value_t value)
+{
+	jit_value_t result;
+
+	result = resolve(state, value);
+	if(result != value)
+	{
+		if(!result->is_constant)
+		{
+			++(result->usage_count);
+		}
+		state->changed = 1;
+	}
+	return result;
+}
+
+static void
+replace_dest(struct propagate_state *state, jit_insn_t insn, jit_value_t value)
+{
+	state->replace[insn->dest->index] = value;
+	insn->opcode = (short)JIT_OP_NOP;
+	state->changed = 1;
+}
+
+/*
+ * Replace phi functions whose arguments are all the same value.
+ */
+static void
+propagate_phis(struct propagate_state *state, _jit_node_t node)
+{
+	_jit_phi_t phi, *link;
+	jit_value_t same;
+	int index;
+
+	link = &node->phis;
+	while((phi = *link) != 0)
+	{
+		same = 0;
+		for(index = 0; index < node->block->num_preds; index++)
+		{
+			phi->args[index] = substitute(state, phi->args[index]);
+			if(phi->args[index] == phi->dest)
+			{
+				continue;
+			}
+			if(!same)
+			{
+				same = phi->args[index];
+			}
+			else if(!is_same_value(same, phi->args[index]))
+			{
+				same = phi->dest;
+			}
+		}
+
+		if(same && same != phi->dest)
+		{
+			state->replace[phi->dest->index] = same;
+			state->changed = 1;
+			*link = phi->next;
+			jit_free(phi->args);
+			jit_free(phi);
+		}
+		else
+		{
+			link = &phi->next;
+		}
+	}
+}
+
+static void
+propagate_insn(struct propagate_state *state, jit_insn_t insn)
+{
+	jit_value_t dest;
+	jit_value_t value;
+
+	if((value = _jit_cfg_get_value1(insn)) != 0 && !defines_value1(insn))
+	{
+		insn->value1 = substitute(state, value);
+	}
+	if((value = _jit_cfg_get_value2(insn)) != 0)
+	{
+		insn->value2 = substitute(state, value);
+	}
+
+	dest = _jit_cfg_get_dest(insn);
+	if(!dest)
+	{
+		return;
+	}
+	if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+	{
+		/* Only copies are propagated to the values that are used
+		   as addresses */
+		value = resolve(state, dest);
+		if(!value->is_constant && value != dest)
+		{
+			insn->dest = substitute(state, dest);
+		}
+		return;
+	}
+	if(!is_single_assignment(state, dest) || insn->value1 == 0
+	   || (insn->flags & JIT_INSN_VALUE1_OTHER_FLAGS) != 0)
+	{
+		return;
+	}
+
+	value = insn->value1;
+	if(is_copy_insn(insn))
+	{
+		/* A temporary value may only be propagated within its block */
+		if(is_same_type(dest, value) && is_single_assignment(state, value)
+		   && (value->is_constant || dest->is_temporary || !value->is_temporary))
+		{
+			replace_dest(state, insn, value);
+		}
+	}
+	else if(state->fold && value->is_constant
+		&& (insn->value2 == 0 || insn->value2->is_constant)
+		&& (insn->flags & JIT_INSN_VALUE2_OTHER_FLAGS) == 0)
+	{
+		value = _jit_opcode_apply(state->cfg->func, insn->opcode, dest->type,
+					  insn->value1, insn->value2);
+		if(value)
+		{
+			replace_dest(state, insn, value);
+		}
+	}
+}
+
+int
+_jit_ssa_propagate(_jit_cfg_t cfg)
+{
+	struct propagate_state state;
+	_jit_node_t node;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int index;
+
+	if(!cfg->in_ssa)
+	{
+		return 1;
+	}
+
+	state.cfg = cfg;
+	state.replace = jit_calloc(cfg->num_values, sizeof(jit_value_t));
+	state.num_defs = jit_calloc(cfg->num_values, sizeof(int));
+	if(!state.replace || !state.num_defs)
+	{
+		jit_free(state.replace);
+		jit_free(state.num_defs);
+		return 0;
+	}
+	state.fold = !jit_context_get_meta_numeric(cfg->func->context,
+						   JIT_OPTION_DONT_FOLD);
+	count_defs(&state);
+
+	/* Visit the nodes in reverse post order so that most definitions
+	   are seen before their uses.  The uses reached over back edges
+	   are taken care of on the next pass */
+	do
+	{
+		state.changed = 0;
+		for(index = cfg->num_post_order - 1; index >= 0; index--)
+		{
+			node = cfg->post_order[index];
+			propagate_phis(&state, node);
+			jit_insn_iter_init(&iter, node->block);
+			while((insn = jit_insn_iter_next(&iter)) != 0)
+			{
+				propagate_insn(&state, insn);
+			}
+		}
+	}
+	while(state.changed);
+
+	jit_free(state.replace);
+	jit_free(state.num_defs);
+	return 1;
+}
@@ -0,0 +1,1029 @@
+/*
+ * jit-range.c - Range analysis and redundant check elimination.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#include "jit-cfg.h"
+#ifdef _JIT_COMPILE_DEBUG
+#include <jit/jit-dump.h>
+#include <stdio.h>
+#endif
+
+/*
+ * The conditional branches on integer comparisons are decided by
+ * proving inequalities of the form "x <= y + c" between the values.
+ * This follows the demand driven approach of "ABCD: Eliminating Array
+ * Bounds Checks on Demand" by Bodik, Gupta and Sarkar.  The facts are
+ * the outcomes of the dominating branches, the additions of constants,
+ * and the phi functions that merge them, including the ones of the
+ * loop headers.  A null term in an inequality stands for zero.
+ */
+
+/*
+ * Special values for the defining node of a value.
+ */
+#define NO_DEF		-1
+#define MULTIPLE_DEFS	-2
+
+/*
+ * Limits on the search for a proof.
+ */
+#define MAX_DEPTH	8
+#define MAX_STEPS	1000
+
+/*
+ * Comparisons that every integer comparison is reduced to.
+ */
+#define COND_EQ		0
+#define COND_LT		1
+#define COND_LT_UN	2
+
+/*
+ * The minimum and maximum integer values.
+ */
+#define INT_MIN_VALUE	((jit_long) jit_min_int)
+#define INT_MAX_VALUE	((jit_long) jit_max_int)
+
+struct condition
+{
+	int			op;
+	jit_value_t		value1;
+	jit_value_t		value2;
+};
+
+/*
+ * The inequality "x <= y + c" that is assumed while the phi function
+ * that defines one of its terms is being proved.
+ */
+struct assumption
+{
+	jit_value_t		x;
+	jit_value_t		y;
+	jit_long		c;
+};
+
+struct range_state
+{
+	_jit_cfg_t		cfg;
+	int			*def_node;
+	jit_insn_t		*def_insn;
+	_jit_phi_t		*def_phi;
+	struct assumption	assumptions[MAX_DEPTH];
+	int			num_assumptions;
+	int			steps;
+};
+
+static int prove(struct range_state *state, _jit_node_t node,
+		 jit_value_t x, jit_value_t y, jit_long c, int depth);
+
+static void
+set_def(struct range_state *state, jit_value_t value, int node,
+	jit_insn_t insn, _jit_phi_t phi)
+{
+	if(state->def_node[value->index] == NO_DEF)
+	{
+		state->def_node[value->index] = node;
+		state->def_insn[value->index] = insn;
+		state->def_phi[value->index] = phi;
+	}
+	else
+	{
+		state->def_node[value->index] = MULTIPLE_DEFS;
+		state->def_insn[value->index] = 0;
+		state->def_phi[value->index] = 0;
+	}
+}
+
+/*
+ * Check if the instruction defines its first operand rather than the
+ * destination operand.
+ */
+static int
+defines_value1(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_INCOMING_REG:
+	case JIT_OP_INCOMING_FRAME_POSN:
+	case JIT_OP_RETURN_REG:
+	case JIT_OP_OUTGOING_FRAME_POSN:
+		return 1;
+	}
+	return 0;
+}
+
+static void
+find_defs(struct range_state *state)
+{
+	_jit_cfg_t cfg;
+	_jit_node_t node;
+	_jit_phi_t phi;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+	int index;
+
+	cfg = state->cfg;
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		state->def_node[index] = NO_DEF;
+	}
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		node = &cfg->nodes[index];
+		for(phi = node->phis; phi; phi = phi->next)
+		{
+			set_def(state, phi->dest, index, 0, phi);
+		}
+		jit_insn_iter_init(&iter, node->block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			value = _jit_cfg_get_dest(insn);
+			if(value && (insn->flags & JIT_INSN_DEST_IS_VALUE) == 0)
+			{
+				set_def(state, value, index, insn, 0);
+			}
+			value = _jit_cfg_get_value1(insn);
+			if(value && defines_value1(insn))
+			{
+				set_def(state, value, index, 0, 0);
+			}
+		}
+	}
+}
+
+static int
+is_int_type(jit_type_t type)
+{
+	type = jit_type_normalize(type);
+	return type->kind == JIT_TYPE_INT || type->kind == JIT_TYPE_UINT;
+}
+
+/*
+ * Check if the value is an integer that keeps the same contents
+ * wherever it is available.
+ */
+static int
+is_tracked(struct range_state *state, jit_value_t value)
+{
+	if(!is_int_type(value->type))
+	{
+		return 0;
+	}
+	if(value->is_constant)
+	{
+		return value->is_nint_constant;
+	}
+	if(value->index < 0 || value->is_addressable || value->is_volatile
+	   || state->def_node[value->index] == MULTIPLE_DEFS)
+	{
+		return 0;
+	}
+	/* The parameters that are never assigned keep their incoming value */
+	return (value->is_temporary || value->is_parameter
+		|| state->cfg->values[value->index].var != 0);
+}
+
+/*
+ * Split the value into a term and a constant offset.  The integer
+ * constants become the null term.
+ */
+static int
+get_term(struct range_state *state, jit_value_t value,
+	 jit_value_t *term, jit_long *offset)
+{
+	if(!value)
+	{
+		*term = 0;
+		*offset = 0;
+		return 1;
+	}
+	if(!is_tracked(state, value))
+	{
+		return 0;
+	}
+	if(value->is_constant)
+	{
+		*term = 0;
+		*offset = (jit_int) value->address;
+	}
+	else
+	{
+		*term = value;
+		*offset = 0;
+	}
+	return 1;
+}
+
+/*
+ * Get the value that is an integer constant, or NULL.
+ */
+static jit_value_t
+get_int_constant(jit_value_t value)
+{
+	if(value && value->is_nint_constant && is_int_type(value->type))
+	{
+		return value;
+	}
+	return 0;
+}
+
+/*
+ * Reduce the comparison to one of the basic ones.  Returns zero if the
+ * comparison is not on integers that are tracked, -1 if the result is
+ * the negation of the basic comparison, and 1 otherwise.
+ */
+static int
+get_condition(struct range_state *state, int opcode,
+	      jit_value_t value1, jit_value_t value2, struct condition *cond)
+{
+	int sense;
+
+	if(!value1 || !value2
+	   || !is_tracked(state, value1) || !is_tracked(state, value2))
+	{
+		return 0;
+	}
+
+	sense = 1;
+	switch(opcode)
+	{
+	case JIT_OP_IEQ:
+		cond->op = COND_EQ;
+		break;
+
+	case JIT_OP_INE:
+		cond->op = COND_EQ;
+		sense = -1;
+		break;
+
+	case JIT_OP_ILT:
+	case JIT_OP_IGT:
+	case JIT_OP_IGE:
+	case JIT_OP_ILE:
+		cond->op = COND_LT;
+		break;
+
+	case JIT_OP_ILT_UN:
+	case JIT_OP_IGT_UN:
+	case JIT_OP_IGE_UN:
+	case JIT_OP_ILE_UN:
+		cond->op = COND_LT_UN;
+		break;
+
+	default:
+		return 0;
+	}
+
+	/* "a > b" is "b < a", "a >= b" is "!(a < b)" and "a <= b" is
+	   "!(b < a)" */
+	switch(opcode)
+	{
+	case JIT_OP_IGT:
+	case JIT_OP_IGT_UN:
+	case JIT_OP_ILE:
+	case JIT_OP_ILE_UN:
+		cond->value1 = value2;
+		cond->value2 = value1;
+		break;
+
+	default:
+		cond->value1 = value1;
+		cond->value2 = value2;
+		break;
+	}
+	switch(opcode)
+	{
+	case JIT_OP_IGE:
+	case JIT_OP_IGE_UN:
+	case JIT_OP_ILE:
+	case JIT_OP_ILE_UN:
+		sense = -sense;
+		break;
+	}
+	return sense;
+}
+
+/*
+ * Get the comparison that decides the conditional branch.
+ */
+static int
+get_branch_condition(struct range_state *state, jit_insn_t insn,
+		     struct condition *cond)
+{
+	jit_insn_t def;
+	int sense;
+
+	if(insn->opcode >= JIT_OP_BR_IEQ && insn->opcode <= JIT_OP_BR_IGE_UN)
+	{
+		return get_condition(state, insn->opcode - JIT_OP_BR_IEQ + JIT_OP_IEQ,
+				     insn->value1, insn->value2, cond);
+	}
+	if(insn->opcode != JIT_OP_BR_ITRUE && insn->opcode != JIT_OP_BR_IFALSE)
+	{
+		return 0;
+	}
+
+	/* The comparison was computed into a value before the branch */
+	if(!insn->value1 || insn->value1->is_constant
+	   || !is_tracked(state, insn->value1))
+	{
+		return 0;
+	}
+	def = state->def_insn[insn->value1->index];
+	if(!def || (def->flags & (JIT_INSN_VALUE1_OTHER_FLAGS
+				  | JIT_INSN_VALUE2_OTHER_FLAGS)) != 0)
+	{
+		return 0;
+	}
+	sense = get_condition(state, def->opcode, def->value1, def->value2, cond);
+	if(insn->opcode == JIT_OP_BR_IFALSE)
+	{
+		sense = -sense;
+	}
+	return sense;
+}
+
+/*
+ * Get the comparison that is known to hold on entry to the node because
+ * the node is reached only over one edge of a conditional branch.
+ */
+static int
+get_edge_condition(struct range_state *state, _jit_node_t node,
+		   struct condition *cond)
+{
+	jit_block_t block;
+	_jit_edge_t edge;
+	jit_insn_t insn;
+	int sense;
+
+	block = node->block;
+	if(block->num_preds != 1)
+	{
+		return 0;
+	}
+	edge = block->preds[0];
+	if(edge->src->num_succs != 2
+	   || (edge->flags != _JIT_EDGE_BRANCH && edge->flags != _JIT_EDGE_FALLTHRU))
+	{
+		return 0;
+	}
+	insn = _jit_block_get_last(edge->src);
+	if(!insn)
+	{
+		return 0;
+	}
+
+	sense = get_branch_condition(state, insn, cond);
+	if(edge->flags == _JIT_EDGE_FALLTHRU)
+	{
+		sense = -sense;
+	}
+	return sense;
+}
+
+/*
+ * Check if the sum of the value and the constant does not overflow
+ * at the node.  This is known from the bounds of the dominating
+ * branches.
+ */
+static int
+is_no_overflow(struct range_state *state, _jit_node_t node,
+	       jit_value_t value, jit_long k)
+{
+	struct condition cond;
+	jit_value_t x, y;
+	jit_long kx, ky, c;
+	int sense;
+
+	if(k == 0)
+	{
+		return 1;
+	}
+	for(; node; node = node->idom)
+	{
+		sense = get_edge_condition(state, node, &cond);
+		if(!sense || cond.op == COND_LT_UN)
+		{
+			continue;
+		}
+		if(cond.op == COND_EQ)
+		{
+			if(sense < 0)
+			{
+				continue;
+			}
+			if(cond.value1->is_constant && cond.value2 == value)
+			{
+				c = (jit_int) cond.value1->address;
+			}
+			else if(cond.value2->is_constant && cond.value1 == value)
+			{
+				c = (jit_int) cond.value2->address;
+			}
+			else
+			{
+				continue;
+			}
+			if(c + k >= INT_MIN_VALUE && c + k <= INT_MAX_VALUE)
+			{
+				return 1;
+			}
+			continue;
+		}
+
+		/* "a < b" gives "a <= b - 1", "!(a < b)" gives "b <= a" */
+		if(sense > 0)
+		{
+			if(!get_term(state, cond.value1, &x, &kx)
+			   || !get_term(state, cond.value2, &y, &ky))
+			{
+				continue;
+			}
+			c = -1;
+		}
+		else
+		{
+			if(!get_term(state, cond.value2, &x, &kx)
+			   || !get_term(state, cond.value1, &y, &ky))
+			{
+				continue;
+			}
+			c = 0;
+		}
+		c += ky - kx;
+
+		if(k > 0 && x == value)
+		{
+			/* "value <= y + c" where y is at most INT_MAX */
+			if(y ? (c <= -k) : (c <= INT_MAX_VALUE - k))
+			{
+				return 1;
+			}
+		}
+		if(k < 0 && y == value)
+		{
+			/* "value >= x - c" where x is at least INT_MIN */
+			if(x ? (c <= k) : (c <= k - INT_MIN_VALUE))
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Check if the value is the sum of another value and a constant.
+ */
+static int
+get_sum(struct range_state *state, jit_value_t value,
+	jit_value_t *base, jit_long *k)
+{
+	jit_insn_t insn;
+	jit_value_t constant;
+
+	insn = state->def_insn[value->index];
+	if(!insn || (insn->flags & (JIT_INSN_VALUE1_OTHER_FLAGS
+				    | JIT_INSN_VALUE2_OTHER_FLAGS)) != 0)
+	{
+		return 0;
+	}
+	switch(insn->opcode)
+	{
+	case JIT_OP_COPY_INT:
+	case JIT_OP_TRUNC_INT:
+	case JIT_OP_TRUNC_UINT:
+		/* The conversions between "int" and "uint" keep the bits */
+		if(!is_int_type(insn->value1->type))
+		{
+			return 0;
+		}
+		*base = insn->value1;
+		*k = 0;
+		return 1;
+
+	case JIT_OP_IADD:
+		if((constant = get_int_constant(insn->value2)) != 0)
+		{
+			*base = insn->value1;
+		}
+		else if((constant = get_int_constant(insn->value1)) != 0)
+		{
+			*base = insn->value2;
+		}
+		else
+		{
+			return 0;
+		}
+		*k = (jit_int) constant->address;
+		return 1;
+
+	case JIT_OP_ISUB:
+		if((constant = get_int_constant(insn->value2)) == 0)
+		{
+			return 0;
+		}
+		*base = insn->value1;
+		*k = -(jit_long) (jit_int) constant->address;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Check if two values are computed the same way from the same value.
+ * The sums wrap identically so no overflow check is needed here.
+ */
+static int
+is_same_term(struct range_state *state, jit_value_t a, jit_value_t b,
+	     int depth)
+{
+	jit_value_t base_a, base_b;
+	jit_long k_a, k_b;
+
+	if(a == b)
+	{
+		return 1;
+	}
+	if(a->is_nint_constant || b->is_nint_constant)
+	{
+		return (a->is_nint_constant && b->is_nint_constant
+			&& a->address == b->address);
+	}
+	if(depth >= MAX_DEPTH || !is_tracked(state, a) || !is_tracked(state, b))
+	{
+		return 0;
+	}
+	if(!get_sum(state, a, &base_a, &k_a))
+	{
+		base_a = a;
+		k_a = 0;
+	}
+	if(!get_sum(state, b, &base_b, &k_b))
+	{
+		base_b = b;
+		k_b = 0;
+	}
+	if((jit_int) k_a != (jit_int) k_b || (base_a == a && base_b == b))
+	{
+		return 0;
+	}
+	return is_same_term(state, base_a, base_b, depth + 1);
+}
+
+/*
+ * Check if the value is a mask with a non-negative constant.
+ */
+static int
+get_mask(struct range_state *state, jit_value_t value, jit_long *mask)
+{
+	jit_insn_t insn;
+	jit_value_t constant;
+
+	insn = state->def_insn[value->index];
+	if(!insn || insn->opcode != JIT_OP_IAND
+	   || (insn->flags & (JIT_INSN_VALUE1_OTHER_FLAGS
+			      | JIT_INSN_VALUE2_OTHER_FLAGS)) != 0)
+	{
+		return 0;
+	}
+	constant = get_int_constant(insn->value2);
+	if(!constant)
+	{
+		constant = get_int_constant(insn->value1);
+	}
+	if(!constant || (jit_int) constant->address < 0)
+	{
+		return 0;
+	}
+	*mask = (jit_int) constant->address;
+	return 1;
+}
+
+/*
+ * Check if the value does not change while the phi function is executed
+ * again, so that it may appear in an inequality assumed for the phi.
+ */
+static int
+is_invariant(struct range_state *state, _jit_node_t phi_node, jit_value_t value)
+{
+	int def;
+
+	if(!value)
+	{
+		return 1;
+	}
+	def = state->def_node[value->index];
+	if(def == NO_DEF)
+	{
+		return 1;
+	}
+	return (def >= 0 && &state->cfg->nodes[def] != phi_node
+		&& _jit_cfg_dominates(&state->cfg->nodes[def], phi_node));
+}
+
+/*
+ * Prove "x <= y + c" where one of the terms is defined by the phi
+ * function.  Each argument must satisfy the inequality at the end of
+ * its predecessor.  If the same inequality is reached again through
+ * a loop then it holds by induction unless it has become stronger.
+ * The other term must be defined before the phi node, otherwise its
+ * value at the end of a back edge is from the previous iteration.
+ */
+static int
+prove_phi(struct range_state *state, _jit_phi_t phi, int phi_is_x,
+	  jit_value_t x, jit_value_t y, jit_long c, int depth)
+{
+	_jit_node_t phi_node;
+	_jit_node_t pred;
+	jit_block_t block;
+	int index;
+	int result;
+
+	phi_node = &state->cfg->nodes[state->def_node[phi->dest->index]];
+	if(!is_invariant(state, phi_node, phi_is_x ? y : x))
+	{
+		return 0;
+	}
+	for(index = 0; index < state->num_assumptions; index++)
+	{
+		if(state->assumptions[index].x == x && state->assumptions[index].y == y)
+		{
+			return c >= state->assumptions[index].c;
+		}
+	}
+	if(state->num_assumptions >= MAX_DEPTH)
+	{
+		return 0;
+	}
+
+	state->assumptions[state->num_assumptions].x = x;
+	state->assumptions[state->num_assumptions].y = y;
+	state->assumptions[state->num_assumptions].c = c;
+	++(state->num_assumptions);
+
+	result = 1;
+	block = phi_node->block;
+	for(index = 0; index < block->num_preds && result; index++)
+	{
+		pred = _jit_cfg_get_node(state->cfg, block->preds[index]->src);
+		if(phi_is_x)
+		{
+			result = prove(state, pred, phi->args[index], y, c, depth + 1);
+		}
+		else
+		{
+			result = prove(state, pred, x, phi->args[index], c, depth + 1);
+		}
+	}
+
+	--(state->num_assumptions);
+	return result;
+}
+
+/*
+ * Prove "x <= y + c" from the upper bounds of x.
+ */
+static int
+prove_upper(struct range_state *state, _jit_node_t node,
+	    jit_value_t x, jit_value_t y, jit_long c, int depth)
+{
+	jit_value_t base;
+	jit_long k;
+	int def;
+
+	if(state->def_phi[x->index])
+	{
+		return prove_phi(state, state->def_phi[x->index], 1, x, y, c, depth);
+	}
+	if(get_sum(state, x, &base, &k))
+	{
+		/* "x = base + k" is at most "base + k" unless it goes below
+		   the minimum */
+		def = state->def_node[x->index];
+		if(k < 0 && !is_no_overflow(state, &state->cfg->nodes[def], base, k))
+		{
+			return 0;
+		}
+		return prove(state, node, base, y, c - k, depth + 1);
+	}
+	if(get_mask(state, x, &k))
+	{
+		return prove(state, node, 0, y, c - k, depth + 1);
+	}
+	return 0;
+}
+
+/*
+ * Prove "x <= y + c" from the lower bounds of y.
+ */
+static int
+prove_lower(struct range_state *state, _jit_node_t node,
+	    jit_value_t x, jit_value_t y, jit_long c, int depth)
+{
+	jit_value_t base;
+	jit_long k;
+	int def;
+
+	if(state->def_phi[y->index])
+	{
+		return prove_phi(state, state->def_phi[y->index], 0, x, y, c, depth);
+	}
+	if(get_sum(state, y, &base, &k))
+	{
+		/* "y = base + k" is at least "base + k" unless it goes over
+		   the maximum */
+		def = state->def_node[y->index];
+		if(k > 0 && !is_no_overflow(state, &state->cfg->nodes[def], base, k))
+		{
+			return 0;
+		}
+		return prove(state, node, x, base, c + k, depth + 1);
+	}
+	if(get_mask(state, y, &k))
+	{
+		return prove(state, node, x, 0, c, depth + 1);
+	}
+	return 0;
+}
+
+/*
+ * Prove "x <= y + c" at the node using the outcomes of the dominating
+ * branches and the definitions of the terms.
+ */
+static int
+prove(struct range_state *state, _jit_node_t node,
+      jit_value_t x, jit_value_t y, jit_long c, int depth)
+{
+	struct condition cond;
+	jit_value_t p, q;
+	jit_long kx, ky, kp, kq, d;
+	_jit_node_t dom;
+	int sense;
+
+	if(!get_term(state, x, &x, &kx) || !get_term(state, y, &y, &ky))
+	{
+		return 0;
+	}
+	c += ky - kx;
+	if(x == y)
+	{
+		return c >= 0;
+	}
+	if(depth >= MAX_DEPTH || ++(state->steps) > MAX_STEPS)
+	{
+		return 0;
+	}
+
+	for(dom = node; dom; dom = dom->idom)
+	{
+		sense = get_edge_condition(state, dom, &cond);
+		if(!sense || cond.op == COND_LT_UN || (cond.op == COND_EQ && sense < 0))
+		{
+			continue;
+		}
+
+		/* "a < b" gives "a <= b - 1", "!(a < b)" gives "b <= a",
+		   and "a == b" gives both "a <= b" and "b <= a" */
+		if(cond.op == COND_LT && sense < 0)
+		{
+			if(!get_term(state, cond.value2, &p, &kp)
+			   || !get_term(state, cond.value1, &q, &kq))
+			{
+				continue;
+			}
+			d = 0;
+		}
+		else
+		{
+			if(!get_term(state, cond.value1, &p, &kp)
+			   || !get_term(state, cond.value2, &q, &kq))
+			{
+				continue;
+			}
+			d = (cond.op == COND_LT) ? -1 : 0;
+		}
+		d += kq - kp;
+		if(p == x && (q == y ? d <= c : prove(state, node, q, y, c - d, depth + 1)))
+		{
+			return 1;
+		}
+		if(q == y && p != x && prove(state, node, x, p, c - d, depth + 1))
+		{
+			return 1;
+		}
+		if(cond.op == COND_EQ)
+		{
+			/* The reverse inequality "b <= a" */
+			if(q == x && (p == y ? -d <= c : prove(state, node, p, y, c + d, depth + 1)))
+			{
+				return 1;
+			}
+			if(p == y && q != x && prove(state, node, x, q, c + d, depth + 1))
+			{
+				return 1;
+			}
+		}
+	}
+
+	if(x && prove_upper(state, node, x, y, c, depth))
+	{
+		return 1;
+	}
+	if(y && prove_lower(state, node, x, y, c, depth))
+	{
+		return 1;
+	}
+	return 0;
+}
+
+static int
+prove_start(struct range_state *state, _jit_node_t node,
+	    jit_value_t x, jit_value_t y, jit_long c)
+{
+	state->num_assumptions = 0;
+	state->steps = 0;
+	return prove(state, node, x, y, c, 0);
+}
+
+/*
+ * Decide the comparison at the end of the node.  Returns 1 if it is
+ * known to be true, -1 if it is known to be false, and 0 otherwise.
+ */
+static int
+decide_condition(struct range_state *state, _jit_node_t node,
+		 struct condition *cond)
+{
+	struct condition known;
+	jit_value_t a, b;
+	_jit_node_t dom;
+	int sense;
+
+	/* The same comparison was made by a dominating branch */
+	for(dom = node; dom; dom = dom->idom)
+	{
+		sense = get_edge_condition(state, dom, &known);
+		if(sense && known.op == cond->op
+		   && ((is_same_term(state, known.value1, cond->value1, 0)
+			&& is_same_term(state, known.value2, cond->value2, 0))
+		       || (cond->op == COND_EQ
+			   && is_same_term(state, known.value1, cond->value2, 0)
+			   && is_same_term(state, known.value2, cond->value1, 0))))
+		{
+			return sense;
+		}
+	}
+
+	a = cond->value1;
+	b = cond->value2;
+	switch(cond->op)
+	{
+	case COND_EQ:
+		if(prove_start(state, node, a, b, 0) && prove_start(state, node, b, a, 0))
+		{
+			return 1;
+		}
+		if(prove_start(state, node, a, b, -1) || prove_start(state, node, b, a, -1))
+		{
+			return -1;
+		}
+		break;
+
+	case COND_LT:
+		if(prove_start(state, node, a, b, -1))
+		{
+			return 1;
+		}
+		if(prove_start(state, node, b, a, 0))
+		{
+			return -1;
+		}
+		break;
+
+	case COND_LT_UN:
+		/* The unsigned comparison agrees with the signed one when
+		   both operands are not negative */
+		if(prove_start(state, node, 0, a, 0) && prove_start(state, node, a, b, -1))
+		{
+			return 1;
+		}
+		if(prove_start(state, node, 0, b, 0) && prove_start(state, node, b, a, 0))
+		{
+			return -1;
+		}
+		break;
+	}
+	return 0;
+}
+
+int
+_jit_ssa_eliminate_checks(_jit_cfg_t cfg)
+{
+	struct range_state state;
+	struct condition cond;
+	_jit_node_t node;
+	jit_insn_t insn;
+	jit_insn_t *decided;
+	int *taken;
+	int num_decided;
+	int index;
+	int sense;
+	int result;
+
+	if(!cfg->in_ssa || cfg->num_values == 0)
+	{
+		return 1;
+	}
+	if(jit_context_get_meta_numeric(cfg->func->context, JIT_OPTION_DONT_FOLD))
+	{
+		return 1;
+	}
+
+	state.cfg = cfg;
+	state.def_node = jit_malloc(cfg->num_values * sizeof(int));
+	state.def_insn = jit_calloc(cfg->num_values, sizeof(jit_insn_t));
+	state.def_phi = jit_calloc(cfg->num_values, sizeof(_jit_phi_t));
+	decided = jit_malloc(cfg->num_nodes * sizeof(jit_insn_t));
+	taken = jit_malloc(cfg->num_nodes * sizeof(int));
+	result = (state.def_node && state.def_insn && state.def_phi && decided && taken);
+	if(result)
+	{
+		find_defs(&state);
+
+		/* Decide all the branches before changing any of them because
+		   the facts come from the original comparisons */
+		num_decided = 0;
+		for(index = 0; index < cfg->num_post_order; index++)
+		{
+			node = cfg->post_order[index];
+			if(node->block->num_succs != 2)
+			{
+				continue;
+			}
+			insn = _jit_block_get_last(node->block);
+			if(!insn)
+			{
+				continue;
+			}
+			sense = get_branch_condition(&state, insn, &cond);
+			if(!sense)
+			{
+				continue;
+			}
+			sense *= decide_condition(&state, node, &cond);
+			if(sense)
+			{
+				decided[num_decided] = insn;
+				taken[num_decided] = (sense > 0);
+				++num_decided;
+			}
+		}
+
+		/* Make the branches constant so that the graph cleanup folds
+		   them and removes the checks that became unreachable */
+		for(index = 0; index < num_decided; index++)
+		{
+			insn = decided[index];
+#ifdef _JIT_COMPILE_DEBUG
+			printf("range analysis: branch '");
+			jit_dump_insn(stdout, cfg->func, insn);
+			printf("' is %s\n", taken[index] ? "taken" : "not taken");
+#endif
+			insn->opcode = JIT_OP_BR_ITRUE;
+			insn->value1 = jit_value_create_nint_constant(cfg->func, jit_type_int,
+								      taken[index]);
+			insn->value2 = 0;
+			if(!insn->value1)
+			{
+				result = 0;
+				break;
+			}
+		}
+	}
+
+	jit_free(state.def_node);
+	jit_free(state.def_insn);
+	jit_free(state.def_phi);
+	jit_free(decided);
+	jit_free(taken);
+	return result;
+}
@@ -22,9 +22,13 @@
 
 #include "jit-internal.h"
 #include "jit-reg-alloc.h"
+#include "jit-cfg.h"
 #include <jit/jit-dump.h>
 #include <stdio.h>
 #include <string.h>
+#if HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
 
 /*@
 
@@ -2535,6 +2539,40 @@ pop_input_value(jit_gencode_t gen, _jit_regs_t *regs, int index)
 }
 #endif
 
+/*
+ * A duplicate input may be a distinct value that only happens to share
+ * the register with another input. If that register is killed by the
+ * instruction then the duplicate value has to leave it as well.
+ */
+static void
+commit_duplicate_value(jit_gencode_t gen, _jit_regs_t *regs, int index)
+{
+	_jit_regdesc_t *desc;
+	int other;
+
+	desc = &regs->descs[index];
+	if(IS_STACK_REG(desc->reg)
+	   || !desc->value->in_register
+	   || desc->value->reg != desc->reg)
+	{
+		return;
+	}
+
+	for(other = regs->ternary ? 0 : 1; other < 3; other++)
+	{
+		if(other != index
+		   && regs->descs[other].value
+		   && !regs->descs[other].duplicate
+		   && regs->descs[other].reg == desc->reg
+		   && regs->descs[other].value != desc->value
+		   && regs->descs[other].kill)
+		{
+			free_value(gen, desc->value, desc->reg, desc->other_reg, 0);
+			return;
+		}
+	}
+}
+
 static void
 commit_input_value(jit_gencode_t gen, _jit_regs_t *regs, int index, int killed)
 {
@@ -2546,8 +2584,13 @@ commit_input_value(jit_gencode_t gen, _jit_regs_t *regs, int index, int killed)
 #endif
 
 	desc = &regs->descs[index];
-	if(!desc->value || desc->duplicate)
+	if(!desc->value)
+	{
+		return;
+	}
+	if(desc->duplicate)
 	{
+		commit_duplicate_value(gen, regs, index);
 		return;
 	}
 
@@ -2679,47 +2722,46 @@ _jit_regs_lookup(char *name)
 	return -1;
 }
 
-/*@
- * @deftypefun void _jit_regs_alloc_global (jit_gencode_t gen, jit_function_t func)
- * Perform global register allocation on the values in @code{func}.
- * This is called during function compilation just after variable
- * liveness has been computed.
- * @end deftypefun
-@*/
-void _jit_regs_alloc_global(jit_gencode_t gen, jit_function_t func)
-{
 #if JIT_NUM_GLOBAL_REGS != 0
+
+/*
+ * Check if the value is worth putting in a global register.
+ */
+static int
+is_global_candidate(jit_value_t value)
+{
+	return (value->global_candidate && value->usage_count >= JIT_MIN_USED
+		&& !(value->is_addressable) && !(value->is_volatile));
+}
+
+/*
+ * Assign a global register to a value.
+ */
+static void
+set_global_register(jit_gencode_t gen, jit_value_t value, int reg)
+{
+	value->has_global_register = 1;
+	value->in_global_register = 1;
+	value->global_reg = (short)reg;
+	jit_reg_set_used(gen->touched, reg);
+	jit_reg_set_used(gen->permanent, reg);
+}
+
+/*
+ * Allocate global registers to the most used values in the function.
+ * Every value gets its register for the whole function.  This is used
+ * when the control flow graph is not available.
+ */
+static void
+alloc_global_by_usage(jit_gencode_t gen, jit_function_t func)
+{
 	jit_value_t candidates[JIT_NUM_GLOBAL_REGS];
 	int num_candidates = 0;
 	int index, reg, posn, num;
 	jit_pool_block_t block;
 	jit_value_t value, temp;
 
-	/* If the function has a "try" block, then don't do global allocation
-	   as the "longjmp" for exception throws will wipe out global registers */
-	if(func->has_try)
-	{
-		return;
-	}
-
-	/* If the current function involves a tail call, then we don't do
-	   global register allocation and we also prevent the code generator
-	   from using any of the callee-saved registers.  This simplifies
-	   tail calls, which don't have to worry about restoring such registers */
-	if(func->builder->has_tail_call)
-	{
-		for(reg = 0; reg < JIT_NUM_REGS; ++reg)
-		{
-			if((jit_reg_flags(reg) & (JIT_REG_FIXED|JIT_REG_CALL_USED)) == 0)
-			{
-				jit_reg_set_used(gen->permanent, reg);
-			}
-		}
-		return;
-	}
-
-	/* Scan all values within the function, looking for the most used.
-	   We will replace this with a better allocation strategy later */
+	/* Scan all values within the function, looking for the most used */
 	block = func->builder->value_pool.blocks;
 	num = (int)(func->builder->value_pool.elems_per_block);
 	while(block != 0)
@@ -2731,8 +2773,7 @@ void _jit_regs_alloc_global(jit_gencode_t gen, jit_function_t func)
 		for(posn = 0; posn < num; ++posn)
 		{
 			value = (jit_value_t)(block->data + posn * sizeof(struct _jit_value));
-			if(value->global_candidate && value->usage_count >= JIT_MIN_USED &&
-			   !(value->is_addressable) && !(value->is_volatile))
+			if(is_global_candidate(value))
 			{
 				/* Insert this candidate into the list, ordered on count */
 				index = 0;
@@ -2767,14 +2808,216 @@ void _jit_regs_alloc_global(jit_gencode_t gen, jit_function_t func)
 		{
 			--reg;
 		}
-		candidates[index]->has_global_register = 1;
-		candidates[index]->in_global_register = 1;
-		candidates[index]->global_reg = (short)reg;
-		jit_reg_set_used(gen->touched, reg);
-		jit_reg_set_used(gen->permanent, reg);
+		set_global_register(gen, candidates[index], reg);
 		--reg;
 	}
+}
+
+/*
+ * Order value entries on the start of their live ranges.
+ */
+static int
+compare_live_ranges(const void *e1, const void *e2)
+{
+	_jit_value_entry_t entry1 = *((_jit_value_entry_t *)e1);
+	_jit_value_entry_t entry2 = *((_jit_value_entry_t *)e2);
+
+	if(entry1->start != entry2->start)
+	{
+		return (entry1->start < entry2->start) ? -1 : 1;
+	}
+	return (entry1->value->index < entry2->value->index) ? -1 : 1;
+}
+
+/*
+ * Allocate global registers with a linear scan over the live ranges
+ * of the candidate values.  Values whose live ranges do not overlap may
+ * share a register.  When more values are live at once than there are
+ * global registers then the least used ones are left in the frame.
+ *
+ * The live ranges are single intervals in the linear block order that
+ * cover every instruction where the value is used or defined and every
+ * block boundary across which the value is live.  A value keeps its
+ * register for the whole of its live range, the local allocator does
+ * not know how to move a value between a global register and its frame
+ * slot in the middle of the function.
+ *
+ * Returns zero if the data flow information cannot be computed.
+ */
+static int
+alloc_global_linear_scan(jit_gencode_t gen, jit_function_t func)
+{
+	_jit_cfg_t cfg;
+	_jit_value_entry_t *candidates;
+	int *assigned;
+	int active[JIT_NUM_GLOBAL_REGS];
+	int free_regs[JIT_NUM_GLOBAL_REGS];
+	int num_candidates, num_active, num_free;
+	int index, posn, reg, victim;
+	jit_value_t value;
+	jit_block_t block;
 
+	/* Live ranges are not known for the blocks that may be entered
+	   through a label address */
+	for(block = func->builder->entry_block; block; block = block->next)
+	{
+		if(block->address_of)
+		{
+			return 0;
+		}
+	}
+
+	cfg = _jit_cfg_build(func);
+	if(!cfg)
+	{
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	if(!_jit_cfg_compute_liveness(cfg))
+	{
+		_jit_cfg_free(cfg);
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	_jit_cfg_compute_live_ranges(cfg);
+
+	/* Collect the candidates and sort them on the live range start */
+	candidates = jit_malloc((cfg->num_values + 1)
+				* (sizeof(_jit_value_entry_t) + sizeof(int)));
+	if(!candidates)
+	{
+		_jit_cfg_free(cfg);
+		jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+	}
+	assigned = (int *)(candidates + cfg->num_values + 1);
+	num_candidates = 0;
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		if(is_global_candidate(cfg->values[index].value))
+		{
+			assigned[num_candidates] = -1;
+			candidates[num_candidates++] = &cfg->values[index];
+		}
+	}
+	qsort(candidates, num_candidates, sizeof(_jit_value_entry_t), compare_live_ranges);
+
+	/* Build the pool of free registers.  Registers are handed out from
+	   the top-most one in the allocation order, the same order as used
+	   by the simple allocator */
+	num_free = 0;
+	for(reg = 0; reg < JIT_NUM_REGS && num_free < JIT_NUM_GLOBAL_REGS; ++reg)
+	{
+		if((jit_reg_flags(reg) & JIT_REG_GLOBAL) != 0)
+		{
+			free_regs[num_free++] = reg;
+		}
+	}
+
+	num_active = 0;
+	for(index = 0; index < num_candidates; index++)
+	{
+		/* Expire the values whose live ranges ended before this one */
+		posn = 0;
+		while(posn < num_active)
+		{
+			if(candidates[active[posn]]->end < candidates[index]->start)
+			{
+				free_regs[num_free++] = assigned[active[posn]];
+				active[posn] = active[--num_active];
+			}
+			else
+			{
+				++posn;
+			}
+		}
+
+		if(num_free > 0)
+		{
+			assigned[index] = free_regs[--num_free];
+			active[num_active++] = index;
+			continue;
+		}
+
+		/* Take the register from the least used active value if
+		   this one is used more.  The evicted value stays in the
+		   frame for its whole live range */
+		value = candidates[index]->value;
+		victim = -1;
+		for(posn = 0; posn < num_active; posn++)
+		{
+			if(candidates[active[posn]]->value->usage_count < value->usage_count
+			   && (victim < 0
+			       || candidates[active[posn]]->value->usage_count
+			          < candidates[active[victim]]->value->usage_count))
+			{
+				victim = posn;
+			}
+		}
+		if(victim >= 0)
+		{
+			assigned[index] = assigned[active[victim]];
+			assigned[active[victim]] = -1;
+			active[victim] = index;
+		}
+	}
+
+	for(index = 0; index < num_candidates; index++)
+	{
+		if(assigned[index] >= 0)
+		{
+			set_global_register(gen, candidates[index]->value, assigned[index]);
+		}
+	}
+
+	jit_free(candidates);
+	_jit_cfg_free(cfg);
+	return 1;
+}
+
+#endif
+
+/*@
+ * @deftypefun void _jit_regs_alloc_global (jit_gencode_t gen, jit_function_t func)
+ * Perform global register allocation on the values in @code{func}.
+ * This is called during function compilation just after variable
+ * liveness has been computed.
+ *
+ * If the function's control flow graph has been built by the optimizer
+ * then the registers are allocated with a linear scan over the live
+ * ranges of the values.  Otherwise the most used values are given
+ * a register each for the whole function.
+ * @end deftypefun
+@*/
+void _jit_regs_alloc_global(jit_gencode_t gen, jit_function_t func)
+{
+#if JIT_NUM_GLOBAL_REGS != 0
+	int reg;
+
+	/* If the function has a "try" block, then don't do global allocation
+	   as the "longjmp" for exception throws will wipe out global registers */
+	if(func->has_try)
+	{
+		return;
+	}
+
+	/* If the current function involves a tail call, then we don't do
+	   global register allocation and we also prevent the code generator
+	   from using any of the callee-saved registers.  This simplifies
+	   tail calls, which don't have to worry about restoring such registers */
+	if(func->builder->has_tail_call)
+	{
+		for(reg = 0; reg < JIT_NUM_REGS; ++reg)
+		{
+			if((jit_reg_flags(reg) & (JIT_REG_FIXED|JIT_REG_CALL_USED)) == 0)
+			{
+				jit_reg_set_used(gen->permanent, reg);
+			}
+		}
+		return;
+	}
+
+	if(!func->is_optimized || !alloc_global_linear_scan(gen, func))
+	{
+		alloc_global_by_usage(gen, func);
+	}
 #endif
 }
 
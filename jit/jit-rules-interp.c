@@ -163,6 +163,13 @@ This value indicates the alignment required for the start of a function.
 e.g. define this to 32 if functions should be aligned on a 32-byte
 boundary.
 
+@item JIT_CODE_ALIGNMENT
+If defined, this indicates the preferred alignment of the function
+entry point, the loop headers and the branch targets that are not
+reached by falling through from the previous block.  The padding
+is executed in some cases, so it must be made of no-op instructions.
+It may be overridden with the @code{JIT_OPTION_CODE_ALIGNMENT} option.
+
 @item JIT_ALIGN_OVERRIDES
 Define this to 1 if the platform allows reads and writes on
 any byte boundary.  Define to 0 if only properly-aligned
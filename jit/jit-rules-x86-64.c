@@ -813,15 +813,16 @@ x86_64_nfloat_to_int(unsigned char *inst, int dreg, int scratch_reg, int size)
 }
 
 /*
- * Call a function
+ * Call a function.  The offset is relative to the address the code
+ * runs from.
  */
 static unsigned char *
-x86_64_call_code(unsigned char *inst, jit_nint func)
+x86_64_call_code(jit_gencode_t gen, unsigned char *inst, jit_nint func)
 {
 	jit_nint offset;
 
 	x86_64_mov_reg_imm_size(inst, X86_64_RAX, 8, 4);
-	offset = func - ((jit_nint)inst + 5);
+	offset = func - ((jit_nint)inst + gen->exec_offset + 5);
 	if(offset >= jit_min_int && offset <= jit_max_int)
 	{
 		/* We can use the immediate call */
@@ -840,11 +841,11 @@ x86_64_call_code(unsigned char *inst, jit_nint func)
  * Jump to a function
  */
 static unsigned char *
-x86_64_jump_to_code(unsigned char *inst, jit_nint func)
+x86_64_jump_to_code(jit_gencode_t gen, unsigned char *inst, jit_nint func)
 {
 	jit_nint offset;
 
-	offset = func - ((jit_nint)inst + 5);
+	offset = func - ((jit_nint)inst + gen->exec_offset + 5);
 	if(offset >= jit_min_int && offset <= jit_max_int)
 	{
 		/* We can use the immediate call */
@@ -863,7 +864,7 @@ x86_64_jump_to_code(unsigned char *inst, jit_nint func)
  * Throw a builtin exception.
  */
 static unsigned char *
-throw_builtin(unsigned char *inst, jit_function_t func, int type)
+throw_builtin(jit_gencode_t gen, unsigned char *inst, jit_function_t func, int type)
 {
 	/* We need to update "catch_pc" if we have a "try" block */
 	if(func->builder->setjmp_value != 0)
@@ -880,7 +881,7 @@ throw_builtin(unsigned char *inst, jit_function_t func, int type)
 	x86_64_mov_reg_imm_size(inst, X86_64_RDI, type, 4);
 
 	/* Call the "jit_exception_builtin" function, which will never return */
-	return x86_64_call_code(inst, (jit_nint)jit_exception_builtin);
+	return x86_64_call_code(gen, inst, (jit_nint)jit_exception_builtin);
 }
 
 /*
@@ -1157,6 +1158,24 @@ _jit_gen_free_reg(jit_gencode_t gen, int reg,
 	}
 }
 
+/*
+ * Compare a register with an immediate value.  A comparison with zero
+ * is done with TEST, which is shorter and sets the flags the same way.
+ */
+static unsigned char *
+compare_reg_imm(unsigned char *inst, int reg, jit_nint imm, int size)
+{
+	if(imm == 0)
+	{
+		x86_64_test_reg_reg_size(inst, reg, reg, size);
+	}
+	else
+	{
+		x86_64_cmp_reg_imm_size(inst, reg, imm, size);
+	}
+	return inst;
+}
+
 /*
  * Set a register value based on a condition code.
  */
@@ -2393,6 +2412,7 @@ _jit_gen_prolog(jit_gencode_t gen, jit_function_t func, void *buf)
 	unsigned char prolog[JIT_PROLOG_SIZE];
 	unsigned char *inst = prolog;
 	int reg;
+	int pad;
 	int frame_size = 0;
 	int regs_to_save = 0;
 
@@ -2475,10 +2495,20 @@ _jit_gen_prolog(jit_gencode_t gen, jit_function_t func, void *buf)
 	}
 #endif /* JIT_USE_PARAM_AREA */
 
-	/* Copy the prolog into place and return the adjusted entry position */
+	/* Align the entry point by moving the prolog back and filling the
+	   gap up to the function body with NOP's */
 	reg = (int)(inst - prolog);
-	jit_memcpy(((unsigned char *)buf) + JIT_PROLOG_SIZE - reg, prolog, reg);
-	return (void *)(((unsigned char *)buf) + JIT_PROLOG_SIZE - reg);
+	inst = ((unsigned char *)buf) + JIT_PROLOG_SIZE - reg;
+	pad = (int)(((jit_nuint)inst) & (jit_nuint)(gen->code_alignment - 1));
+	if(pad > 0 && inst - pad >= (unsigned char *)buf)
+	{
+		_jit_pad_buffer(inst + reg - pad, pad);
+		inst -= pad;
+	}
+
+	/* Copy the prolog into place and return the adjusted entry position */
+	jit_memcpy(inst, prolog, reg);
+	return (void *)inst;
 }
 
 void
@@ -2745,10 +2775,48 @@ memory_copy(jit_gencode_t gen, unsigned char *inst,
 	{
 		x86_64_add_reg_imm_size(inst, X86_64_RDI, doffset, 8);
 	}
-	inst = x86_64_call_code(inst, (jit_nint)jit_memcpy);
+	inst = x86_64_call_code(gen, inst, (jit_nint)jit_memcpy);
 	return inst;
 }
 
+/*
+ * Remove the forward branch that was just output if it jumps to the
+ * block that starts right after it.  The branch must be the last
+ * code of the previous block, not of an empty block in between, as
+ * the address of that block would then point past the branch.
+ */
+static void
+remove_branch_to_next(jit_gencode_t gen, jit_block_t block)
+{
+	unsigned char *fixup;
+	jit_int offset;
+
+	fixup = (unsigned char *)(block->fixup_list);
+	if(!fixup || fixup + 4 != gen->ptr
+	   || !block->prev || block->prev->address == (void *)(gen->ptr))
+	{
+		return;
+	}
+
+	/* Only jmp and jcc with a 32-bit displacement are removed */
+	if(fixup[-1] == 0xE9)
+	{
+		gen->ptr = fixup - 1;
+	}
+	else if(fixup[-2] == 0x0F && (fixup[-1] & 0xF0) == 0x80)
+	{
+		gen->ptr = fixup - 2;
+	}
+	else
+	{
+		return;
+	}
+
+	/* Take the branch off the block's fixup list */
+	offset = *((jit_int *)fixup);
+	block->fixup_list = (void *)_JIT_CALC_NEXT_FIXUP(fixup, offset);
+}
+
 void
 _jit_gen_start_block(jit_gencode_t gen, jit_block_t block)
 {
@@ -2757,6 +2825,9 @@ _jit_gen_start_block(jit_gencode_t gen, jit_block_t block)
 	void **absolute_fixup;
 	void **absolute_next;
 
+	/* Fall through to the block instead of branching to it */
+	remove_branch_to_next(gen, block);
+
 	/* Set the address of this block */
 	block->address = (void *)(gen->ptr);
 
@@ -2785,7 +2856,7 @@ _jit_gen_start_block(jit_gencode_t gen, jit_block_t block)
 	while(absolute_fixup != 0)
 	{
 		absolute_next = (void **)(absolute_fixup[0]);
-		absolute_fixup[0] = (void *)((jit_nint)(block->address));
+		absolute_fixup[0] = (void *)((jit_nint)(block->address) + gen->exec_offset);
 		absolute_fixup = absolute_next;
 	}
 	block->fixup_absolute_list = 0;
@@ -2821,6 +2892,79 @@ _jit_gen_is_global_candidate(jit_type_t type)
 	return 0;
 }
 
+/*
+ * Check if the value is held in a floating point register.
+ */
+static int
+is_float_value(jit_value_t value)
+{
+	switch(jit_type_normalize(value->type)->kind)
+	{
+	case JIT_TYPE_FLOAT32:
+	case JIT_TYPE_FLOAT64:
+	case JIT_TYPE_NFLOAT:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Get the number of cycles before the result of the instruction may be
+ * used.  These are the typical latencies of the recent Intel and AMD
+ * cores, with the loads hitting the first level cache.  The divisions
+ * vary the most between the cores and with the operand values.
+ */
+int
+_jit_gen_insn_latency(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_IMUL:
+	case JIT_OP_LMUL:
+		return 3;
+
+	case JIT_OP_IDIV:
+	case JIT_OP_IDIV_UN:
+	case JIT_OP_IREM:
+	case JIT_OP_IREM_UN:
+		return 26;
+
+	case JIT_OP_LDIV:
+	case JIT_OP_LDIV_UN:
+	case JIT_OP_LREM:
+	case JIT_OP_LREM_UN:
+		return 40;
+
+	case JIT_OP_FDIV:
+		return 11;
+
+	case JIT_OP_DDIV:
+	case JIT_OP_NFDIV:
+		return 14;
+
+	case JIT_OP_FSQRT:
+	case JIT_OP_DSQRT:
+	case JIT_OP_NFSQRT:
+		return 18;
+	}
+
+	if((insn->opcode >= JIT_OP_LOAD_RELATIVE_SBYTE
+	    && insn->opcode <= JIT_OP_LOAD_RELATIVE_NFLOAT)
+	   || (insn->opcode >= JIT_OP_LOAD_ELEMENT_SBYTE
+	       && insn->opcode <= JIT_OP_LOAD_ELEMENT_NFLOAT))
+	{
+		return 5;
+	}
+
+	/* The floating point additions, multiplications and conversions */
+	if(!is_float_value(insn->dest)
+	   && !(insn->value1 && is_float_value(insn->value1)))
+	{
+		return 1;
+	}
+	return 4;
+}
+
 /*
  * Do the stuff usually handled in jit-rules.c for native implementations
  * here too because the common implementation is not enough for x86_64.
@@ -102,6 +102,20 @@ extern	"C" {
  */
 #define	JIT_FUNCTION_ALIGNMENT		32
 
+/*
+ * Preferred alignment for the function entry point and the start of
+ * the loops and other branch targets, so that the instruction fetch
+ * does not straddle a boundary when jumping there.
+ */
+#define	JIT_CODE_ALIGNMENT		16
+
+/*
+ * The number of values that the instruction scheduler may compute
+ * ahead of their uses.  This leaves room in the registers that the
+ * local allocator hands out for the operands of the instructions.
+ */
+#define	JIT_SCHEDULE_PRESSURE		6
+
 /*
  * Define this to 1 if the platform allows reads and writes on
  * any byte boundary.  Define to 0 if only properly-aligned
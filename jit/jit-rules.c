@@ -751,13 +751,17 @@ void *
 _jit_gen_alloc(jit_gencode_t gen, unsigned long size)
 {
 	void *ptr;
+
+	/* The code is generated without holding the memory context lock */
+	_jit_memory_lock(gen->context);
 	_jit_memory_set_break(gen->context, gen->ptr);
 	ptr = _jit_memory_alloc_data(gen->context, size, JIT_BEST_ALIGNMENT);
+	gen->mem_limit = _jit_memory_get_limit(gen->context);
+	_jit_memory_unlock(gen->context);
 	if(!ptr)
 	{
 		jit_exception_builtin(JIT_RESULT_MEMORY_FULL);
 	}
-	gen->mem_limit = _jit_memory_get_limit(gen->context);
 	return ptr;
 }
 
@@ -164,6 +164,7 @@ struct jit_gencode
 	unsigned char		*mem_limit;	/* Available space limit */
 	unsigned char		*code_start;	/* Real code start */
 	unsigned char		*code_end;	/* Real code end */
+	jit_nint		exec_offset;	/* Offset of the code as it runs */
 	jit_regused_t		permanent;	/* Permanently allocated global regs */
 	jit_regused_t		touched;	/* All registers that were touched */
 	jit_regused_t		inhibit;	/* Temporarily inhibited registers */
@@ -177,6 +178,7 @@ struct jit_gencode
 #endif
 	void			*epilog_fixup;	/* Fixup list for function epilogs */
 	int			stack_changed;	/* Stack top changed since entry */
+	int			code_alignment;	/* Alignment of the branch targets */
 	jit_varint_encoder_t	offset_encoder;	/* Bytecode offset encoder */
 };
 
@@ -239,6 +241,9 @@ void _jit_gen_insn(jit_gencode_t gen, jit_function_t func,
 void _jit_gen_start_block(jit_gencode_t gen, jit_block_t block);
 void _jit_gen_end_block(jit_gencode_t gen, jit_block_t block);
 int _jit_gen_is_global_candidate(jit_type_t type);
+#ifdef JIT_SCHEDULE_PRESSURE
+int _jit_gen_insn_latency(jit_insn_t insn);
+#endif
 
 #if defined(JIT_NATIVE_INT32) && !defined(JIT_BACKEND_INTERP)
 int _jit_reg_get_pair(jit_type_t type, int reg);
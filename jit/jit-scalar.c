@@ -0,0 +1,730 @@
+/*
+ * jit-scalar.c - Scalar replacement of the local variables in memory.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+
+/*
+ * A local variable whose address is taken lives in the stack frame,
+ * and so do the fields of a local structure that are reached through
+ * its address.  If the address does not escape, that is all the
+ * pointers derived from it are only used to load and store at constant
+ * offsets, then each of the distinct fields that are accessed is made
+ * a separate local value that may live in a register.  The loads and
+ * stores become copies of the field values, and the instructions that
+ * computed the pointers are removed.
+ *
+ * The fields must not overlap unless they are accessed at the same
+ * offset with the same size and kind.  The byte and short fields are
+ * kept in int values and are truncated when they are loaded.
+ */
+
+/*
+ * The maximum number of fields of a variable that are replaced.
+ */
+#define MAX_FIELDS	8
+
+/*
+ * The kinds of the fields.
+ */
+#define FIELD_BYTE	0
+#define FIELD_SHORT	1
+#define FIELD_INT	2
+#define FIELD_LONG	3
+#define FIELD_FLOAT32	4
+#define FIELD_FLOAT64	5
+#define FIELD_NFLOAT	6
+
+/*
+ * A field of a variable that is accessed through a pointer.
+ */
+typedef struct
+{
+	jit_nint		offset;
+	int			kind;
+	jit_value_t		value;
+
+} _jit_field_t;
+
+/*
+ * A variable whose address is taken or a pointer into one.  The base
+ * is the index of the entry of the variable, and the offset is where
+ * the pointer points to within it.  The fields and the valid flag are
+ * only set for the variables.
+ */
+typedef struct
+{
+	jit_value_t		value;
+	int			base;
+	jit_nint		offset;
+	int			num_defs;
+	int			valid;
+	int			num_fields;
+	_jit_field_t		fields[MAX_FIELDS];
+
+} _jit_scalar_t;
+
+/*
+ * The variables and the pointers of a function, with a hash table
+ * that maps the values to their entries.
+ */
+typedef struct
+{
+	jit_function_t		func;
+	_jit_scalar_t		*entries;
+	int			num_entries;
+	int			max_entries;
+	int			*table;
+	unsigned int		size;
+
+} _jit_scalar_state_t;
+
+static unsigned int
+hash_value(_jit_scalar_state_t *state, jit_value_t value)
+{
+	return (unsigned int) (((jit_nuint) value) >> 4) & (state->size - 1);
+}
+
+/*
+ * Find the entry of a value.  Returns NULL if there is none.
+ */
+static _jit_scalar_t *
+find_entry(_jit_scalar_state_t *state, jit_value_t value)
+{
+	unsigned int index;
+	int entry;
+
+	if(!value || !state->size)
+	{
+		return 0;
+	}
+	index = hash_value(state, value);
+	while((entry = state->table[index]) >= 0)
+	{
+		if(state->entries[entry].value == value)
+		{
+			return &state->entries[entry];
+		}
+		index = (index + 1) & (state->size - 1);
+	}
+	return 0;
+}
+
+/*
+ * Add an entry for a value.  If the base is negative the value is a
+ * variable, otherwise it is a pointer into the variable of that entry.
+ */
+static void
+add_entry(_jit_scalar_state_t *state, jit_value_t value,
+	  int base, jit_nint offset)
+{
+	_jit_scalar_t *entry;
+	unsigned int index;
+	int *table;
+	unsigned int size;
+
+	/* Keep the hash table at most half full */
+	if((unsigned int) (state->num_entries + 1) * 2 > state->size)
+	{
+		size = state->size ? state->size * 2 : 64;
+		table = jit_malloc(size * sizeof(int));
+		if(!table)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+		jit_memset(table, -1, size * sizeof(int));
+		jit_free(state->table);
+		state->table = table;
+		state->size = size;
+		for(index = 0; index < (unsigned int) state->num_entries; index++)
+		{
+			table = &state->table[hash_value(state, state->entries[index].value)];
+			while(*table >= 0)
+			{
+				table = &state->table[(table - state->table + 1) & (size - 1)];
+			}
+			*table = (int) index;
+		}
+	}
+	if(state->num_entries == state->max_entries)
+	{
+		state->max_entries = state->max_entries ? state->max_entries * 2 : 16;
+		entry = jit_realloc(state->entries,
+				    state->max_entries * sizeof(_jit_scalar_t));
+		if(!entry)
+		{
+			jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+		}
+		state->entries = entry;
+	}
+
+	entry = &state->entries[state->num_entries];
+	jit_memzero(entry, sizeof(_jit_scalar_t));
+	entry->value = value;
+	entry->base = base < 0 ? state->num_entries : base;
+	entry->offset = offset;
+	entry->valid = 1;
+
+	index = hash_value(state, value);
+	while(state->table[index] >= 0)
+	{
+		index = (index + 1) & (state->size - 1);
+	}
+	state->table[index] = state->num_entries++;
+}
+
+/*
+ * Get the variable that the entry belongs to.
+ */
+static _jit_scalar_t *
+get_base(_jit_scalar_state_t *state, _jit_scalar_t *entry)
+{
+	return &state->entries[entry->base];
+}
+
+/*
+ * Check if a variable may be split into fields.
+ */
+static int
+is_candidate(jit_value_t value)
+{
+	return (value->is_local || value->is_temporary) && !value->is_parameter
+		&& !value->is_volatile && !value->is_constant;
+}
+
+/*
+ * Check if a value may hold a pointer into a variable.
+ */
+static int
+is_pointer(jit_value_t value)
+{
+	return !value->is_addressable && !value->is_volatile
+		&& !value->is_parameter && !value->is_constant;
+}
+
+/*
+ * Get the kind of the field that an instruction loads or stores.
+ * Returns -1 if the instruction does not access a field.
+ */
+static int
+get_field_kind(int opcode)
+{
+	switch(opcode)
+	{
+	case JIT_OP_LOAD_RELATIVE_SBYTE:
+	case JIT_OP_LOAD_RELATIVE_UBYTE:
+	case JIT_OP_STORE_RELATIVE_BYTE:
+		return FIELD_BYTE;
+	case JIT_OP_LOAD_RELATIVE_SHORT:
+	case JIT_OP_LOAD_RELATIVE_USHORT:
+	case JIT_OP_STORE_RELATIVE_SHORT:
+		return FIELD_SHORT;
+	case JIT_OP_LOAD_RELATIVE_INT:
+	case JIT_OP_STORE_RELATIVE_INT:
+		return FIELD_INT;
+	case JIT_OP_LOAD_RELATIVE_LONG:
+	case JIT_OP_STORE_RELATIVE_LONG:
+		return FIELD_LONG;
+	case JIT_OP_LOAD_RELATIVE_FLOAT32:
+	case JIT_OP_STORE_RELATIVE_FLOAT32:
+		return FIELD_FLOAT32;
+	case JIT_OP_LOAD_RELATIVE_FLOAT64:
+	case JIT_OP_STORE_RELATIVE_FLOAT64:
+		return FIELD_FLOAT64;
+	case JIT_OP_LOAD_RELATIVE_NFLOAT:
+	case JIT_OP_STORE_RELATIVE_NFLOAT:
+		return FIELD_NFLOAT;
+	}
+	return -1;
+}
+
+static jit_nint
+get_field_size(int kind)
+{
+	switch(kind)
+	{
+	case FIELD_BYTE:	return 1;
+	case FIELD_SHORT:	return 2;
+	case FIELD_INT:		return 4;
+	case FIELD_FLOAT32:	return 4;
+	case FIELD_NFLOAT:	return sizeof(jit_nfloat);
+	}
+	return 8;
+}
+
+static jit_type_t
+get_field_type(int kind)
+{
+	switch(kind)
+	{
+	case FIELD_LONG:	return jit_type_long;
+	case FIELD_FLOAT32:	return jit_type_float32;
+	case FIELD_FLOAT64:	return jit_type_float64;
+	case FIELD_NFLOAT:	return jit_type_nfloat;
+	}
+	return jit_type_int;
+}
+
+/*
+ * Get the instruction that copies a value to or from a field.
+ */
+static int
+get_copy_opcode(int opcode, int kind)
+{
+	switch(opcode)
+	{
+	case JIT_OP_LOAD_RELATIVE_SBYTE:	return JIT_OP_TRUNC_SBYTE;
+	case JIT_OP_LOAD_RELATIVE_UBYTE:	return JIT_OP_TRUNC_UBYTE;
+	case JIT_OP_LOAD_RELATIVE_SHORT:	return JIT_OP_TRUNC_SHORT;
+	case JIT_OP_LOAD_RELATIVE_USHORT:	return JIT_OP_TRUNC_USHORT;
+	}
+	switch(kind)
+	{
+	case FIELD_LONG:	return JIT_OP_COPY_LONG;
+	case FIELD_FLOAT32:	return JIT_OP_COPY_FLOAT32;
+	case FIELD_FLOAT64:	return JIT_OP_COPY_FLOAT64;
+	case FIELD_NFLOAT:	return JIT_OP_COPY_NFLOAT;
+	}
+	return JIT_OP_COPY_INT;
+}
+
+/*
+ * Record an access to a field of a variable.  The variable is left
+ * in memory if the access overlaps another one or is out of bounds.
+ */
+static void
+add_field(_jit_scalar_t *base, jit_nint offset, int kind)
+{
+	jit_nint size;
+	int index;
+
+	size = get_field_size(kind);
+	if(offset < 0 || offset + size > (jit_nint) jit_type_get_size(base->value->type))
+	{
+		base->valid = 0;
+		return;
+	}
+	for(index = 0; index < base->num_fields; index++)
+	{
+		if(base->fields[index].offset == offset
+		   && base->fields[index].kind == kind)
+		{
+			return;
+		}
+		if(offset < base->fields[index].offset
+		   + get_field_size(base->fields[index].kind)
+		   && base->fields[index].offset < offset + size)
+		{
+			base->valid = 0;
+			return;
+		}
+	}
+	if(base->num_fields == MAX_FIELDS)
+	{
+		base->valid = 0;
+		return;
+	}
+	base->fields[base->num_fields].offset = offset;
+	base->fields[base->num_fields].kind = kind;
+	++(base->num_fields);
+}
+
+/*
+ * Get the value that holds a field of a variable.
+ */
+static jit_value_t
+get_field(_jit_scalar_t *base, jit_nint offset, int kind)
+{
+	int index;
+
+	for(index = 0; index < base->num_fields; index++)
+	{
+		if(base->fields[index].offset == offset
+		   && base->fields[index].kind == kind)
+		{
+			return base->fields[index].value;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Leave the variable that a value belongs to in memory.
+ */
+static void
+escape(_jit_scalar_state_t *state, jit_value_t value)
+{
+	_jit_scalar_t *entry;
+
+	entry = find_entry(state, value);
+	if(entry)
+	{
+		get_base(state, entry)->valid = 0;
+	}
+}
+
+/*
+ * Find the variables whose address is taken and the pointers that are
+ * derived from the address.  Returns zero if there are none.
+ */
+static int
+find_pointers(_jit_scalar_state_t *state)
+{
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	_jit_scalar_t *entry;
+	int changed;
+
+	block = 0;
+	while((block = jit_block_next(state->func, block)) != 0)
+	{
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(insn->opcode != JIT_OP_ADDRESS_OF
+			   || !is_candidate(insn->value1)
+			   || !is_pointer(insn->dest))
+			{
+				continue;
+			}
+			if(!find_entry(state, insn->value1))
+			{
+				add_entry(state, insn->value1, -1, 0);
+			}
+			if(!find_entry(state, insn->dest))
+			{
+				entry = find_entry(state, insn->value1);
+				add_entry(state, insn->dest, entry - state->entries, 0);
+			}
+		}
+	}
+	if(state->num_entries == 0)
+	{
+		return 0;
+	}
+
+	/* Follow the constant adjustments of the pointers */
+	do
+	{
+		changed = 0;
+		block = 0;
+		while((block = jit_block_next(state->func, block)) != 0)
+		{
+			jit_insn_iter_init(&iter, block);
+			while((insn = jit_insn_iter_next(&iter)) != 0)
+			{
+				if(insn->opcode != JIT_OP_ADD_RELATIVE
+				   || !insn->value2->is_constant
+				   || !is_pointer(insn->dest)
+				   || find_entry(state, insn->dest))
+				{
+					continue;
+				}
+				entry = find_entry(state, insn->value1);
+				if(entry && entry->base != entry - state->entries)
+				{
+					add_entry(state, insn->dest, entry->base,
+						  entry->offset
+						  + jit_value_get_nint_constant(insn->value2));
+					changed = 1;
+				}
+			}
+		}
+	}
+	while(changed);
+
+	return 1;
+}
+
+/*
+ * Check that the pointers are only used to access the fields of their
+ * variables, and that the variables are not used in any other way.
+ */
+static void
+check_uses(_jit_scalar_state_t *state)
+{
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	_jit_scalar_t *entry;
+	_jit_scalar_t *pointer;
+	int kind;
+
+	block = 0;
+	while((block = jit_block_next(state->func, block)) != 0)
+	{
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(insn->opcode == JIT_OP_NOP)
+			{
+				continue;
+			}
+
+			/* The definitions of the pointers */
+			pointer = 0;
+			if((insn->flags & (JIT_INSN_DEST_OTHER_FLAGS | JIT_INSN_DEST_IS_VALUE)) == 0)
+			{
+				pointer = find_entry(state, insn->dest);
+			}
+			if(pointer && pointer->base != pointer - state->entries)
+			{
+				++(pointer->num_defs);
+				entry = find_entry(state, insn->value1);
+				if(pointer->num_defs > 1 || !entry
+				   || entry->base != pointer->base
+				   || (insn->opcode == JIT_OP_ADDRESS_OF
+				       ? entry->base != entry - state->entries
+				       : (insn->opcode != JIT_OP_ADD_RELATIVE
+					  || entry->base == entry - state->entries)))
+				{
+					get_base(state, pointer)->valid = 0;
+					escape(state, insn->value1);
+				}
+				continue;
+			}
+
+			/* The loads and stores at constant offsets */
+			kind = get_field_kind(insn->opcode);
+			if(kind >= 0 && insn->value2->is_constant)
+			{
+				if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+				{
+					pointer = find_entry(state, insn->dest);
+					escape(state, insn->value1);
+				}
+				else
+				{
+					pointer = find_entry(state, insn->value1);
+					escape(state, insn->dest);
+				}
+				if(pointer && pointer->base != pointer - state->entries)
+				{
+					add_field(get_base(state, pointer),
+						  pointer->offset
+						  + jit_value_get_nint_constant(insn->value2),
+						  kind);
+				}
+				else
+				{
+					escape(state, insn->dest);
+					escape(state, insn->value1);
+				}
+				continue;
+			}
+
+			/* The pointers into a variable are never null */
+			if(insn->opcode == JIT_OP_CHECK_NULL)
+			{
+				pointer = find_entry(state, insn->value1);
+				if(pointer && pointer->base != pointer - state->entries)
+				{
+					continue;
+				}
+			}
+
+			/* Any other use lets the address escape */
+			if((insn->flags & JIT_INSN_DEST_OTHER_FLAGS) == 0)
+			{
+				escape(state, insn->dest);
+			}
+			if((insn->flags & JIT_INSN_VALUE1_OTHER_FLAGS) == 0)
+			{
+				escape(state, insn->value1);
+			}
+			if((insn->flags & JIT_INSN_VALUE2_OTHER_FLAGS) == 0)
+			{
+				escape(state, insn->value2);
+			}
+		}
+	}
+}
+
+/*
+ * Create the values for the fields of the variables that are split.
+ * Returns zero if there are none.
+ */
+static int
+create_fields(_jit_scalar_state_t *state)
+{
+	_jit_scalar_t *entry;
+	int index, field;
+	int count;
+
+	count = 0;
+	for(index = 0; index < state->num_entries; index++)
+	{
+		entry = &state->entries[index];
+		if(entry->base != index || !entry->valid)
+		{
+			continue;
+		}
+		for(field = 0; field < entry->num_fields; field++)
+		{
+			entry->fields[field].value = _jit_value_create_local
+				(state->func, get_field_type(entry->fields[field].kind));
+			if(!entry->fields[field].value)
+			{
+				jit_exception_builtin(JIT_RESULT_OUT_OF_MEMORY);
+			}
+		}
+		++count;
+	}
+	return count;
+}
+
+/*
+ * Turn an instruction into a no-op.
+ */
+static void
+remove_insn(jit_insn_t insn)
+{
+	insn->opcode = (short) JIT_OP_NOP;
+	insn->flags = 0;
+	insn->dest = 0;
+	insn->value1 = 0;
+	insn->value2 = 0;
+}
+
+/*
+ * Replace the accesses to the fields of the split variables with
+ * copies of the field values.
+ */
+static void
+replace_fields(_jit_scalar_state_t *state)
+{
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	_jit_scalar_t *pointer;
+	_jit_scalar_t *base;
+	jit_value_t field;
+	jit_nint offset;
+	int kind;
+
+	block = 0;
+	while((block = jit_block_next(state->func, block)) != 0)
+	{
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			switch(insn->opcode)
+			{
+			case JIT_OP_ADDRESS_OF:
+			case JIT_OP_ADD_RELATIVE:
+				pointer = find_entry(state, insn->dest);
+				if(pointer && get_base(state, pointer)->valid)
+				{
+					remove_insn(insn);
+				}
+				continue;
+
+			case JIT_OP_CHECK_NULL:
+				pointer = find_entry(state, insn->value1);
+				if(pointer && get_base(state, pointer)->valid)
+				{
+					remove_insn(insn);
+				}
+				continue;
+			}
+
+			kind = get_field_kind(insn->opcode);
+			if(kind < 0)
+			{
+				continue;
+			}
+			if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+			{
+				pointer = find_entry(state, insn->dest);
+			}
+			else
+			{
+				pointer = find_entry(state, insn->value1);
+			}
+			if(!pointer || !get_base(state, pointer)->valid)
+			{
+				continue;
+			}
+			base = get_base(state, pointer);
+			offset = pointer->offset + jit_value_get_nint_constant(insn->value2);
+			field = get_field(base, offset, kind);
+
+			if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+			{
+				/* The store becomes a copy to the field */
+				insn->opcode = (short) get_copy_opcode(insn->opcode, kind);
+				insn->dest = field;
+			}
+			else
+			{
+				/* The load becomes a copy from the field */
+				insn->opcode = (short) get_copy_opcode(insn->opcode, kind);
+				insn->value1 = field;
+			}
+			insn->flags = 0;
+			insn->value2 = 0;
+			++(field->usage_count);
+		}
+	}
+}
+
+void
+_jit_block_replace_scalars(jit_function_t func)
+{
+	_jit_scalar_state_t state;
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+
+	/* The exception handlers and the nested functions expect the
+	   variables to be in the frame */
+	if(func->has_try)
+	{
+		return;
+	}
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(insn->opcode == JIT_OP_SETUP_FOR_NESTED
+			   || insn->opcode == JIT_OP_SETUP_FOR_SIBLING)
+			{
+				return;
+			}
+		}
+	}
+
+	jit_memzero(&state, sizeof(state));
+	state.func = func;
+	if(find_pointers(&state))
+	{
+		check_uses(&state);
+		if(create_fields(&state))
+		{
+			replace_fields(&state);
+		}
+	}
+	jit_free(state.entries);
+	jit_free(state.table);
+}
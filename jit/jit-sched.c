@@ -0,0 +1,587 @@
+/*
+ * jit-sched.c - List scheduling of the instructions within blocks.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#include "jit-rules.h"
+#include "jit-cfg.h"
+
+/*
+ * The instructions of a block are scheduled in regions, the runs of
+ * computations and loads between the instructions that have other side
+ * effects.  Those stay where they are and nothing moves across them.
+ * Within a region the instructions form a dependency graph on the
+ * values they read and write, and the loads and divisions that may
+ * throw exceptions keep their order.  The list scheduler issues one
+ * instruction per cycle, picking the ready instruction with the longest
+ * latency path to the end of the region, so that the long loads and
+ * divisions start early and their users come as late as possible.
+ *
+ * The scheduler counts the values defined in the region that are still
+ * waiting for their users.  Once the count reaches the limit it prefers
+ * the instructions that do not make it grow, so that the reordering
+ * does not cause more spills in the register allocator.
+ */
+
+#ifdef JIT_SCHEDULE_PRESSURE
+
+/*
+ * The maximum number of instructions in a region.  A longer run is
+ * split into several regions.
+ */
+#define MAX_REGION	64
+
+/*
+ * The classes of registers whose pressure is counted.
+ */
+#define CLASS_NONE	-1
+#define CLASS_WORD	0
+#define CLASS_FLOAT	1
+
+/*
+ * An instruction in the dependency graph.
+ */
+typedef struct
+{
+	jit_insn_t		insn;
+	jit_ulong		succs;
+	jit_ulong		data_succs;
+	int			num_preds;
+	int			latency;
+	int			priority;
+	int			earliest;
+	int			cycle;
+	int			uses;
+	int			reg_class;
+	int			scheduled;
+
+} _jit_sched_node_t;
+
+/*
+ * Check if the instruction is a load from memory.
+ */
+static int
+is_load(jit_insn_t insn)
+{
+	return ((insn->opcode >= JIT_OP_LOAD_RELATIVE_SBYTE
+		 && insn->opcode <= JIT_OP_LOAD_RELATIVE_NFLOAT)
+		|| (insn->opcode >= JIT_OP_LOAD_ELEMENT_SBYTE
+		    && insn->opcode <= JIT_OP_LOAD_ELEMENT_NFLOAT));
+}
+
+/*
+ * Check if the instruction is an integer division, which throws on
+ * a zero divisor.
+ */
+static int
+is_division(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_IDIV:
+	case JIT_OP_IDIV_UN:
+	case JIT_OP_IREM:
+	case JIT_OP_IREM_UN:
+	case JIT_OP_LDIV:
+	case JIT_OP_LDIV_UN:
+	case JIT_OP_LREM:
+	case JIT_OP_LREM_UN:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Check if the value may be kept in a register and so may be freely
+ * reordered with the memory accesses.
+ */
+static int
+is_register_value(jit_value_t value)
+{
+	return (!value || value->is_constant
+		|| !(value->is_addressable || value->is_volatile));
+}
+
+/*
+ * Check if the instruction may be moved within its region.
+ */
+static int
+is_schedulable(jit_insn_t insn)
+{
+	if(insn->opcode == JIT_OP_NOP)
+	{
+		return 1;
+	}
+	if((insn->flags & (JIT_INSN_DEST_OTHER_FLAGS | JIT_INSN_DEST_IS_VALUE
+			   | JIT_INSN_VALUE1_OTHER_FLAGS
+			   | JIT_INSN_VALUE2_OTHER_FLAGS)) != 0)
+	{
+		return 0;
+	}
+	if(!insn->dest || insn->dest->is_constant
+	   || !is_register_value(insn->dest)
+	   || !is_register_value(insn->value1)
+	   || !is_register_value(insn->value2))
+	{
+		return 0;
+	}
+	return (_jit_insn_is_pure(insn) || is_load(insn) || is_division(insn));
+}
+
+/*
+ * Get the class of the register that holds the value.
+ */
+static int
+get_reg_class(jit_value_t value)
+{
+	switch(jit_type_normalize(value->type)->kind)
+	{
+	case JIT_TYPE_FLOAT32:
+	case JIT_TYPE_FLOAT64:
+	case JIT_TYPE_NFLOAT:
+		return CLASS_FLOAT;
+	}
+	return CLASS_WORD;
+}
+
+/*
+ * Get the operand values that the instruction reads.
+ */
+static int
+get_inputs(jit_insn_t insn, jit_value_t *inputs)
+{
+	int count = 0;
+
+	if(insn->opcode == JIT_OP_NOP)
+	{
+		return 0;
+	}
+	if(insn->value1 && !insn->value1->is_constant)
+	{
+		inputs[count++] = insn->value1;
+	}
+	if(insn->value2 && !insn->value2->is_constant
+	   && insn->value2 != insn->value1)
+	{
+		inputs[count++] = insn->value2;
+	}
+	return count;
+}
+
+/*
+ * Add a dependency between two instructions of the region.
+ */
+static void
+add_dependency(_jit_sched_node_t *nodes, int from, int to, int data)
+{
+	jit_ulong bit = ((jit_ulong) 1) << to;
+
+	if(from == to)
+	{
+		return;
+	}
+	if((nodes[from].succs & bit) == 0)
+	{
+		nodes[from].succs |= bit;
+		++(nodes[to].num_preds);
+	}
+	if(data)
+	{
+		nodes[from].data_succs |= bit;
+	}
+}
+
+/*
+ * Build the dependency graph of the region.
+ */
+static void
+build_graph(_jit_sched_node_t *nodes, int num_nodes)
+{
+	jit_value_t inputs[2];
+	jit_value_t dest;
+	int index, other, num_inputs, input, last_throw;
+	int found[2];
+
+	last_throw = -1;
+	for(index = 0; index < num_nodes; index++)
+	{
+		num_inputs = get_inputs(nodes[index].insn, inputs);
+		found[0] = 0;
+		found[1] = 0;
+		dest = 0;
+		if(nodes[index].insn->opcode != JIT_OP_NOP)
+		{
+			dest = nodes[index].insn->dest;
+		}
+
+		for(other = index - 1; other >= 0; other--)
+		{
+			if(nodes[other].insn->opcode == JIT_OP_NOP)
+			{
+				continue;
+			}
+
+			/* The value is read after it is last written */
+			for(input = 0; input < num_inputs; input++)
+			{
+				if(!found[input] && nodes[other].insn->dest == inputs[input])
+				{
+					add_dependency(nodes, other, index, 1);
+					found[input] = 1;
+				}
+			}
+
+			/* The value is written after it is read or written */
+			if(dest && (nodes[other].insn->dest == dest
+				    || nodes[other].insn->value1 == dest
+				    || nodes[other].insn->value2 == dest))
+			{
+				add_dependency(nodes, other, index, 0);
+			}
+		}
+
+		/* The instructions that may throw keep their order */
+		if(nodes[index].insn->opcode != JIT_OP_NOP
+		   && !_jit_insn_is_pure(nodes[index].insn))
+		{
+			if(last_throw >= 0)
+			{
+				add_dependency(nodes, last_throw, index, 0);
+			}
+			last_throw = index;
+		}
+	}
+}
+
+/*
+ * Compute the length of the longest latency path from each instruction
+ * to the end of the region, and the number of users of its result.
+ */
+static void
+compute_priorities(_jit_sched_node_t *nodes, int num_nodes)
+{
+	jit_value_t inputs[2];
+	int index, other, num_inputs, input, path;
+
+	for(index = num_nodes - 1; index >= 0; index--)
+	{
+		nodes[index].priority = nodes[index].latency;
+		for(other = index + 1; other < num_nodes; other++)
+		{
+			if((nodes[index].succs & (((jit_ulong) 1) << other)) == 0)
+			{
+				continue;
+			}
+			path = nodes[other].priority;
+			if((nodes[index].data_succs & (((jit_ulong) 1) << other)) != 0)
+			{
+				path += nodes[index].latency;
+			}
+			if(path > nodes[index].priority)
+			{
+				nodes[index].priority = path;
+			}
+
+			/* Count the users that read this very definition */
+			num_inputs = get_inputs(nodes[other].insn, inputs);
+			for(input = 0; input < num_inputs; input++)
+			{
+				if(inputs[input] == nodes[index].insn->dest
+				   && (nodes[index].data_succs
+				       & (((jit_ulong) 1) << other)) != 0)
+				{
+					++(nodes[index].uses);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Find the instruction of the region that defines the value read by
+ * the given one.
+ */
+static int
+find_definition(_jit_sched_node_t *nodes, int index, jit_value_t value)
+{
+	int other;
+
+	for(other = index - 1; other >= 0; other--)
+	{
+		if(nodes[other].insn->opcode != JIT_OP_NOP
+		   && nodes[other].insn->dest == value)
+		{
+			return other;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Compute how much the instruction changes the register pressure of
+ * the given class if it is scheduled now.
+ */
+static int
+get_pressure_change(_jit_sched_node_t *nodes, int index, int reg_class)
+{
+	jit_value_t inputs[2];
+	int num_inputs, input, def, change;
+
+	change = 0;
+	if(nodes[index].reg_class == reg_class)
+	{
+		++change;
+	}
+	num_inputs = get_inputs(nodes[index].insn, inputs);
+	for(input = 0; input < num_inputs; input++)
+	{
+		def = find_definition(nodes, index, inputs[input]);
+		if(def >= 0 && nodes[def].reg_class == reg_class
+		   && nodes[def].uses == 1)
+		{
+			--change;
+		}
+	}
+	return change;
+}
+
+/*
+ * Check if the instruction makes the register pressure exceed the limit.
+ */
+static int
+is_too_costly(_jit_sched_node_t *nodes, int index, int *pressure, int limit)
+{
+	int reg_class = nodes[index].reg_class;
+
+	return (reg_class != CLASS_NONE && pressure[reg_class] >= limit
+		&& get_pressure_change(nodes, index, reg_class) > 0);
+}
+
+/*
+ * Check if the ready instruction should be issued before the other.
+ * When the registers run short the instructions that do not make it
+ * worse go first, then the ones whose operands are ready, then the ones
+ * on the longest path, then the ones that came first.
+ */
+static int
+is_better(_jit_sched_node_t *nodes, int index, int other,
+	  int *pressure, int limit, int cycle)
+{
+	int costly, other_costly;
+	int earliest, other_earliest;
+
+	costly = is_too_costly(nodes, index, pressure, limit);
+	other_costly = is_too_costly(nodes, other, pressure, limit);
+	if(costly != other_costly)
+	{
+		return other_costly;
+	}
+
+	earliest = (nodes[index].earliest > cycle) ? nodes[index].earliest : cycle;
+	other_earliest = (nodes[other].earliest > cycle) ? nodes[other].earliest : cycle;
+	if(earliest != other_earliest)
+	{
+		return (earliest < other_earliest);
+	}
+	if(nodes[index].priority != nodes[other].priority)
+	{
+		return (nodes[index].priority > nodes[other].priority);
+	}
+	return (index < other);
+}
+
+/*
+ * Schedule the instructions of the region and return the new order.
+ */
+static void
+schedule_region(_jit_sched_node_t *nodes, int num_nodes, int *order, int limit)
+{
+	jit_value_t inputs[2];
+	int pressure[2];
+	int num_order, cycle, index, best, other;
+	int num_inputs, input, def, earliest;
+
+	pressure[CLASS_WORD] = 0;
+	pressure[CLASS_FLOAT] = 0;
+	cycle = 0;
+	for(num_order = 0; num_order < num_nodes; num_order++)
+	{
+		best = -1;
+		for(index = 0; index < num_nodes; index++)
+		{
+			if(!nodes[index].scheduled && nodes[index].num_preds == 0
+			   && (best < 0 || is_better(nodes, index, best, pressure, limit, cycle)))
+			{
+				best = index;
+			}
+		}
+
+		/* Issue the instruction */
+		order[num_order] = best;
+		nodes[best].scheduled = 1;
+		if(nodes[best].earliest > cycle)
+		{
+			cycle = nodes[best].earliest;
+		}
+		nodes[best].cycle = cycle;
+		++cycle;
+
+		/* Track the values that are waiting for their users */
+		num_inputs = get_inputs(nodes[best].insn, inputs);
+		for(input = 0; input < num_inputs; input++)
+		{
+			def = find_definition(nodes, best, inputs[input]);
+			if(def >= 0 && --(nodes[def].uses) == 0
+			   && nodes[def].reg_class != CLASS_NONE)
+			{
+				--(pressure[nodes[def].reg_class]);
+			}
+		}
+		if(nodes[best].reg_class != CLASS_NONE)
+		{
+			++(pressure[nodes[best].reg_class]);
+		}
+
+		/* Release the successors */
+		for(other = 0; other < num_nodes; other++)
+		{
+			if((nodes[best].succs & (((jit_ulong) 1) << other)) == 0)
+			{
+				continue;
+			}
+			--(nodes[other].num_preds);
+			earliest = nodes[best].cycle;
+			if((nodes[best].data_succs & (((jit_ulong) 1) << other)) != 0)
+			{
+				earliest += nodes[best].latency;
+			}
+			if(earliest > nodes[other].earliest)
+			{
+				nodes[other].earliest = earliest;
+			}
+		}
+	}
+}
+
+/*
+ * Schedule a region of the block's instructions.
+ */
+static void
+schedule_insns(jit_block_t block, int start, int end, int limit)
+{
+	_jit_sched_node_t nodes[MAX_REGION];
+	struct _jit_insn insns[MAX_REGION];
+	int order[MAX_REGION];
+	int num_nodes, index;
+	jit_insn_t insn;
+
+	num_nodes = end - start;
+	for(index = 0; index < num_nodes; index++)
+	{
+		insn = &block->insns[start + index];
+		jit_memzero(&nodes[index], sizeof(_jit_sched_node_t));
+		nodes[index].insn = insn;
+		nodes[index].reg_class = CLASS_NONE;
+		if(insn->opcode != JIT_OP_NOP)
+		{
+			nodes[index].latency = _jit_gen_insn_latency(insn);
+			nodes[index].reg_class = get_reg_class(insn->dest);
+		}
+	}
+
+	build_graph(nodes, num_nodes);
+	compute_priorities(nodes, num_nodes);
+
+	/* The values that are not read in the region are not counted */
+	for(index = 0; index < num_nodes; index++)
+	{
+		if(nodes[index].uses == 0)
+		{
+			nodes[index].reg_class = CLASS_NONE;
+		}
+	}
+
+	schedule_region(nodes, num_nodes, order, limit);
+
+	for(index = 0; index < num_nodes; index++)
+	{
+		insns[index] = block->insns[start + order[index]];
+	}
+	for(index = 0; index < num_nodes; index++)
+	{
+		block->insns[start + index] = insns[index];
+	}
+}
+
+#endif /* JIT_SCHEDULE_PRESSURE */
+
+void
+_jit_block_schedule_insns(jit_function_t func)
+{
+#ifdef JIT_SCHEDULE_PRESSURE
+	jit_block_t block;
+	jit_nint limit;
+	int start, end;
+
+	/* The exception handlers expect the values to be updated in
+	   the original order */
+	if(func->has_try)
+	{
+		return;
+	}
+
+	limit = jit_context_get_meta_numeric(func->context,
+					     JIT_OPTION_SCHEDULE_PRESSURE);
+	if(limit < 0)
+	{
+		return;
+	}
+	if(limit == 0)
+	{
+		limit = JIT_SCHEDULE_PRESSURE;
+	}
+
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		start = 0;
+		while(start < block->num_insns)
+		{
+			if(!is_schedulable(&block->insns[start]))
+			{
+				++start;
+				continue;
+			}
+			end = start + 1;
+			while(end < block->num_insns && end - start < MAX_REGION
+			      && is_schedulable(&block->insns[end]))
+			{
+				++end;
+			}
+			if(end - start > 2)
+			{
+				schedule_insns(block, start, end, (int) limit);
+			}
+			start = end;
+		}
+	}
+#endif
+}
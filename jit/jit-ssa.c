@@ -0,0 +1,959 @@
+/*
+ * jit-ssa.c - Static single assignment form for the JIT.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit-internal.h"
+#include "jit-cfg.h"
+
+/*
+ * The maximum number of bits in the interference matrices that are
+ * used to coalesce the versions of the variables.  The versions of
+ * larger functions are left as separate local variables.
+ */
+#define	JIT_SSA_MAX_INTERFERENCE	(1 << 24)
+
+/*
+ * Entry of the log of the variable versions that are replaced while
+ * walking down the dominator tree.
+ */
+struct undo_entry
+{
+	int			var;
+	jit_value_t		value;
+};
+
+struct rename_state
+{
+	jit_value_t		*current;
+	struct undo_entry	*undo;
+	int			num_undo;
+	int			max_undo;
+};
+
+/*
+ * Check if a value can be renamed.  The value must be a local variable
+ * that lives in a register or in its own stack slot and that can be
+ * copied with a plain copy instruction.
+ */
+static int
+is_ssa_candidate(jit_value_t value)
+{
+	if(!value->is_local || value->is_temporary || value->is_parameter
+	   || value->is_addressable || value->is_volatile)
+	{
+		return 0;
+	}
+	switch(jit_type_normalize(value->type)->kind)
+	{
+	case JIT_TYPE_INT:
+	case JIT_TYPE_UINT:
+	case JIT_TYPE_LONG:
+	case JIT_TYPE_ULONG:
+	case JIT_TYPE_FLOAT32:
+	case JIT_TYPE_FLOAT64:
+	case JIT_TYPE_NFLOAT:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Check if the instruction ties its first operand to a specific
+ * register or stack location.
+ */
+static int
+is_pinning_insn(jit_insn_t insn)
+{
+	switch(insn->opcode)
+	{
+	case JIT_OP_INCOMING_REG:
+	case JIT_OP_INCOMING_FRAME_POSN:
+	case JIT_OP_RETURN_REG:
+	case JIT_OP_OUTGOING_FRAME_POSN:
+		return 1;
+	}
+	return 0;
+}
+
+static int
+is_copy_insn(jit_insn_t insn)
+{
+	return insn->opcode >= JIT_OP_COPY_INT && insn->opcode <= JIT_OP_COPY_NFLOAT;
+}
+
+/*
+ * Check if the value is one of the variables that are being renamed.
+ */
+static int
+is_variable(_jit_cfg_t cfg, jit_value_t value)
+{
+	return value && value->index >= 0 && cfg->values[value->index].var == value;
+}
+
+/*
+ * Check if the function's control flow is simple enough for the
+ * conversion.  Exception handlers and computed jumps add edges that
+ * are not represented in the graph.  The function entry is not a
+ * real edge so the entry block must not be a branch target.
+ */
+static int
+can_build_ssa(_jit_cfg_t cfg)
+{
+	jit_block_t block;
+
+	if(cfg->func->has_try || cfg->num_post_order == 0)
+	{
+		return 0;
+	}
+	if(cfg->nodes[0].block->num_preds > 0)
+	{
+		return 0;
+	}
+	for(block = cfg->func->builder->entry_block; block; block = block->next)
+	{
+		if(block->address_of)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Mark the variables that are renamed.  Returns the number of them.
+ */
+static int
+find_variables(_jit_cfg_t cfg)
+{
+	int index;
+	int count;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		value = cfg->values[index].value;
+		if(is_ssa_candidate(value))
+		{
+			cfg->values[index].var = value;
+		}
+	}
+
+	/* Exclude the variables whose location is fixed */
+	count = 0;
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		jit_insn_iter_init(&iter, cfg->nodes[index].block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(is_pinning_insn(insn) && (value = _jit_cfg_get_value1(insn)) != 0)
+			{
+				cfg->values[value->index].var = 0;
+			}
+		}
+	}
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		if(cfg->values[index].var)
+		{
+			++count;
+		}
+	}
+
+	return count;
+}
+
+static int
+create_phi(_jit_node_t node, jit_value_t var)
+{
+	_jit_phi_t phi;
+	int index;
+
+	phi = jit_new(struct _jit_phi);
+	if(!phi)
+	{
+		return 0;
+	}
+	phi->args = jit_malloc(node->block->num_preds * sizeof(jit_value_t));
+	if(!phi->args)
+	{
+		jit_free(phi);
+		return 0;
+	}
+
+	/* The arguments for the edges from the unreachable nodes are never
+	   renamed so they refer to the original variable */
+	for(index = 0; index < node->block->num_preds; index++)
+	{
+		phi->args[index] = var;
+	}
+	phi->dest = var;
+	phi->var = var;
+	phi->next = node->phis;
+	node->phis = phi;
+
+	return 1;
+}
+
+/*
+ * Place the phi functions at the iterated dominance frontiers of the
+ * variable definitions.  Only the variables that are live at the
+ * frontier need a phi function there.
+ */
+static int
+insert_phis(_jit_cfg_t cfg)
+{
+	_jit_node_t *work;
+	int *has_phi;
+	int *in_work;
+	int num_work;
+	int var, index;
+	_jit_node_t node;
+	_jit_node_t frontier;
+
+	work = jit_malloc(cfg->num_nodes * sizeof(_jit_node_t));
+	has_phi = jit_calloc(cfg->num_nodes, sizeof(int));
+	in_work = jit_calloc(cfg->num_nodes, sizeof(int));
+	if(!work || !has_phi || !in_work)
+	{
+		goto fail;
+	}
+
+	for(var = 0; var < cfg->num_values; var++)
+	{
+		if(!is_variable(cfg, cfg->values[var].value))
+		{
+			continue;
+		}
+
+		/* The marks hold the number of the variable plus one so that
+		   the arrays need not be cleared for each variable */
+		num_work = 0;
+		for(index = 0; index < cfg->num_post_order; index++)
+		{
+			node = cfg->post_order[index];
+			if(_jit_bitset_test_bit(&node->live_def, var))
+			{
+				in_work[node->block->index] = var + 1;
+				work[num_work++] = node;
+			}
+		}
+
+		while(num_work > 0)
+		{
+			node = work[--num_work];
+			for(index = 0; index < node->num_frontier; index++)
+			{
+				frontier = node->frontier[index];
+				if(has_phi[frontier->block->index] == var + 1
+				   || !_jit_bitset_test_bit(&frontier->live_in, var))
+				{
+					continue;
+				}
+				if(!create_phi(frontier, cfg->values[var].value))
+				{
+					goto fail;
+				}
+				has_phi[frontier->block->index] = var + 1;
+				if(in_work[frontier->block->index] != var + 1)
+				{
+					in_work[frontier->block->index] = var + 1;
+					work[num_work++] = frontier;
+				}
+			}
+		}
+	}
+
+	jit_free(work);
+	jit_free(has_phi);
+	jit_free(in_work);
+	return 1;
+
+fail:
+	jit_free(work);
+	jit_free(has_phi);
+	jit_free(in_work);
+	return 0;
+}
+
+/*
+ * Create a new version of a variable.
+ */
+static jit_value_t
+new_version(_jit_cfg_t cfg, jit_value_t var)
+{
+	jit_value_t value;
+
+	value = _jit_value_create_local(cfg->func, var->type);
+	if(!value || !_jit_cfg_add_value(cfg, value))
+	{
+		return 0;
+	}
+	cfg->values[value->index].var = var;
+	return value;
+}
+
+static int
+define_version(_jit_cfg_t cfg, struct rename_state *state, jit_value_t var,
+	       jit_value_t *version)
+{
+	struct undo_entry *undo;
+	int max_undo;
+
+	*version = new_version(cfg, var);
+	if(!*version)
+	{
+		return 0;
+	}
+
+	if(state->num_undo == state->max_undo)
+	{
+		max_undo = state->max_undo ? state->max_undo * 2 : 64;
+		undo = jit_realloc(state->undo, max_undo * sizeof(struct undo_entry));
+		if(!undo)
+		{
+			return 0;
+		}
+		state->undo = undo;
+		state->max_undo = max_undo;
+	}
+	state->undo[state->num_undo].var = var->index;
+	state->undo[state->num_undo].value = state->current[var->index];
+	++(state->num_undo);
+
+	state->current[var->index] = *version;
+	return 1;
+}
+
+static jit_value_t
+use_version(_jit_cfg_t cfg, struct rename_state *state, jit_value_t value)
+{
+	if(is_variable(cfg, value) && state->current[value->index] != value)
+	{
+		value = state->current[value->index];
+		++(value->usage_count);
+	}
+	return value;
+}
+
+/*
+ * Rename the variables in a node and fill the arguments of the phi
+ * functions in the node's successors.
+ */
+static int
+rename_node(_jit_cfg_t cfg, struct rename_state *state, _jit_node_t node)
+{
+	_jit_phi_t phi;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+	_jit_edge_t edge;
+	_jit_node_t succ;
+	int index, pred_index;
+
+	for(phi = node->phis; phi; phi = phi->next)
+	{
+		if(!define_version(cfg, state, phi->var, &phi->dest))
+		{
+			return 0;
+		}
+	}
+
+	jit_insn_iter_init(&iter, node->block);
+	while((insn = jit_insn_iter_next(&iter)) != 0)
+	{
+		if((value = _jit_cfg_get_value1(insn)) != 0)
+		{
+			insn->value1 = use_version(cfg, state, value);
+		}
+		if((value = _jit_cfg_get_value2(insn)) != 0)
+		{
+			insn->value2 = use_version(cfg, state, value);
+		}
+		if((value = _jit_cfg_get_dest(insn)) != 0)
+		{
+			if((insn->flags & JIT_INSN_DEST_IS_VALUE) != 0)
+			{
+				insn->dest = use_version(cfg, state, value);
+			}
+			else if(is_variable(cfg, value))
+			{
+				if(!define_version(cfg, state, value, &insn->dest))
+				{
+					return 0;
+				}
+				++(insn->dest->usage_count);
+			}
+		}
+	}
+
+	for(index = 0; index < node->block->num_succs; index++)
+	{
+		edge = node->block->succs[index];
+		succ = _jit_cfg_get_node(cfg, edge->dst);
+		for(pred_index = 0; pred_index < succ->block->num_preds; pred_index++)
+		{
+			if(succ->block->preds[pred_index] != edge)
+			{
+				continue;
+			}
+			for(phi = succ->phis; phi; phi = phi->next)
+			{
+				phi->args[pred_index] = use_version(cfg, state, phi->var);
+			}
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Rename the variables walking the dominator tree in depth first order.
+ * The current versions at the end of a node are those of its closest
+ * dominator that defines them.
+ */
+static int
+rename_variables(_jit_cfg_t cfg)
+{
+	struct stack_entry
+	{
+		_jit_node_t node;
+		int undo;
+	} *stack;
+	struct rename_state state;
+	int *first_child;
+	int *next_sibling;
+	int sp, index, child;
+	_jit_node_t node;
+	int result;
+
+	state.current = jit_malloc(cfg->num_values * sizeof(jit_value_t));
+	state.undo = 0;
+	state.num_undo = 0;
+	state.max_undo = 0;
+	stack = jit_malloc(cfg->num_nodes * sizeof(struct stack_entry));
+	first_child = jit_malloc(cfg->num_nodes * sizeof(int));
+	next_sibling = jit_malloc(cfg->num_nodes * sizeof(int));
+	result = 0;
+	if(!state.current || !stack || !first_child || !next_sibling)
+	{
+		goto done;
+	}
+
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		state.current[index] = cfg->values[index].value;
+	}
+
+	/* Build the dominator tree */
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		first_child[index] = -1;
+	}
+	for(index = 0; index < cfg->num_post_order; index++)
+	{
+		node = cfg->post_order[index];
+		if(node->idom)
+		{
+			next_sibling[node->block->index] = first_child[node->idom->block->index];
+			first_child[node->idom->block->index] = node->block->index;
+		}
+	}
+
+	/* A node is on the stack with a negative undo mark until it is
+	   renamed.  Then it stays there until all its children are done */
+	stack[0].node = &cfg->nodes[0];
+	stack[0].undo = -1;
+	sp = 1;
+	while(sp > 0)
+	{
+		node = stack[sp - 1].node;
+		if(stack[sp - 1].undo >= 0)
+		{
+			while(state.num_undo > stack[sp - 1].undo)
+			{
+				--(state.num_undo);
+				state.current[state.undo[state.num_undo].var]
+					= state.undo[state.num_undo].value;
+			}
+			--sp;
+			continue;
+		}
+
+		stack[sp - 1].undo = state.num_undo;
+		if(!rename_node(cfg, &state, node))
+		{
+			goto done;
+		}
+		for(child = first_child[node->block->index]; child >= 0; child = next_sibling[child])
+		{
+			stack[sp].node = &cfg->nodes[child];
+			stack[sp].undo = -1;
+			++sp;
+		}
+	}
+	result = 1;
+
+done:
+	jit_free(state.current);
+	jit_free(state.undo);
+	jit_free(stack);
+	jit_free(first_child);
+	jit_free(next_sibling);
+	return result;
+}
+
+int
+_jit_ssa_construct(_jit_cfg_t cfg)
+{
+	if(!can_build_ssa(cfg))
+	{
+		return 1;
+	}
+
+	if(!_jit_cfg_compute_liveness(cfg) || !_jit_cfg_compute_dominators(cfg))
+	{
+		return 0;
+	}
+	/* Without variables the function is in SSA form already */
+	if(find_variables(cfg) != 0
+	   && (!insert_phis(cfg) || !rename_variables(cfg)))
+	{
+		return 0;
+	}
+
+	cfg->in_ssa = 1;
+	return 1;
+}
+
+static int
+insert_copy(jit_block_t block, int index, jit_value_t dest, jit_value_t value)
+{
+	jit_insn_t insn;
+
+	insn = _jit_block_insert_insn(block, index);
+	if(!insn)
+	{
+		return 0;
+	}
+	insn->opcode = (short)_jit_store_opcode(JIT_OP_COPY_INT, JIT_OP_COPY_STORE_BYTE,
+						dest->type);
+	insn->dest = dest;
+	insn->value1 = value;
+	++(dest->usage_count);
+	++(value->usage_count);
+	return 1;
+}
+
+/*
+ * Insert a copy at the end of a block.  If the block ends with a branch
+ * then the copy goes before it.
+ */
+static int
+append_copy(jit_block_t block, jit_value_t dest, jit_value_t value)
+{
+	jit_insn_t last;
+	int index;
+
+	index = block->num_insns;
+	last = _jit_block_get_last(block);
+	if(last && ((last->opcode >= JIT_OP_BR && last->opcode <= JIT_OP_BR_NFGE_INV)
+		    || last->opcode == JIT_OP_JUMP_TABLE))
+	{
+		--index;
+	}
+	return insert_copy(block, index, dest, value);
+}
+
+/*
+ * Replace each phi function with copies to a new version of its variable
+ * at the end of the predecessors and a copy from it at the start of the
+ * node.  As the new version is only live across the edges the copies
+ * behave as a parallel assignment even on critical edges.
+ */
+static int
+replace_phis(_jit_cfg_t cfg)
+{
+	int index, pred_index;
+	_jit_node_t node;
+	_jit_phi_t phi;
+	jit_value_t temp;
+
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		node = &cfg->nodes[index];
+		while((phi = node->phis) != 0)
+		{
+			temp = new_version(cfg, phi->var);
+			if(!temp)
+			{
+				return 0;
+			}
+			for(pred_index = 0; pred_index < node->block->num_preds; pred_index++)
+			{
+				if(!append_copy(node->block->preds[pred_index]->src,
+						temp, phi->args[pred_index]))
+				{
+					return 0;
+				}
+			}
+			if(!insert_copy(node->block, 0, phi->dest, temp))
+			{
+				return 0;
+			}
+
+			node->phis = phi->next;
+			jit_free(phi->args);
+			jit_free(phi);
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Coalescing state.  The versions of each variable form a class and
+ * the interference of the class members is kept in a bit matrix.
+ */
+struct coalesce_state
+{
+	int			*member_class;
+	int			*member_pos;
+	int			*class_base;
+	int			*class_size;
+	int			*class_matrix;
+	int			*members;
+	int			num_classes;
+	_jit_bitset_t		matrix;
+};
+
+static void
+add_interference(_jit_cfg_t cfg, struct coalesce_state *state,
+		 jit_value_t dest, jit_value_t source, _jit_bitset_t *live)
+{
+	int class, size, pos, index;
+	int member;
+
+	class = state->member_class[dest->index];
+	size = state->class_size[class];
+	pos = state->member_pos[dest->index];
+	for(index = 0; index < size; index++)
+	{
+		member = state->members[state->class_base[class] + index];
+		if(member == dest->index || (source && member == source->index)
+		   || !_jit_bitset_test_bit(live, member))
+		{
+			continue;
+		}
+		_jit_bitset_set_bit(&state->matrix,
+				    state->class_matrix[class] + pos * size + index);
+		_jit_bitset_set_bit(&state->matrix,
+				    state->class_matrix[class] + index * size + pos);
+	}
+}
+
+/*
+ * Find the interference of the versions walking each node backwards
+ * from its live out set.  A definition interferes with the versions that
+ * are live after it except for the source of a copy.
+ */
+static void
+compute_interference(_jit_cfg_t cfg, struct coalesce_state *state, _jit_bitset_t *live)
+{
+	int index, insn_index;
+	_jit_node_t node;
+	jit_insn_t insn;
+	jit_value_t dest;
+	jit_value_t value;
+
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		node = &cfg->nodes[index];
+		_jit_bitset_copy(live, &node->live_out);
+		for(insn_index = node->block->num_insns - 1; insn_index >= 0; insn_index--)
+		{
+			insn = &node->block->insns[insn_index];
+			dest = _jit_cfg_get_dest(insn);
+			if(dest && (insn->flags & JIT_INSN_DEST_IS_VALUE) == 0)
+			{
+				if(state->member_class[dest->index] >= 0)
+				{
+					add_interference(cfg, state, dest,
+							 is_copy_insn(insn) ? _jit_cfg_get_value1(insn) : 0,
+							 live);
+				}
+				_jit_bitset_clear_bit(live, dest->index);
+			}
+			else if(dest)
+			{
+				_jit_bitset_set_bit(live, dest->index);
+			}
+			if((value = _jit_cfg_get_value1(insn)) != 0)
+			{
+				_jit_bitset_set_bit(live, value->index);
+			}
+			if((value = _jit_cfg_get_value2(insn)) != 0)
+			{
+				_jit_bitset_set_bit(live, value->index);
+			}
+		}
+	}
+}
+
+/*
+ * Color the versions of each variable so that the versions that do not
+ * interfere share a variable.  The first color is the original variable.
+ */
+static int
+assign_variables(_jit_cfg_t cfg, struct coalesce_state *state, jit_value_t *replace)
+{
+	int class, pos, other, color, size, base;
+	int *colors;
+	char *used;
+	jit_value_t *vars;
+	jit_value_t var;
+	int result;
+
+	colors = jit_malloc(cfg->num_values * sizeof(int));
+	used = jit_malloc(cfg->num_values);
+	vars = jit_malloc(cfg->num_values * sizeof(jit_value_t));
+	result = 0;
+	if(!colors || !used || !vars)
+	{
+		goto done;
+	}
+
+	for(class = 0; class < state->num_classes; class++)
+	{
+		size = state->class_size[class];
+		base = state->class_base[class];
+		var = cfg->values[state->members[base]].value;
+		vars[0] = var;
+		for(color = 1; color < size; color++)
+		{
+			vars[color] = 0;
+		}
+
+		for(pos = 0; pos < size; pos++)
+		{
+			jit_memzero(used, size);
+			for(other = 0; other < pos; other++)
+			{
+				if(_jit_bitset_test_bit(&state->matrix,
+							state->class_matrix[class] + pos * size + other))
+				{
+					used[colors[other]] = 1;
+				}
+			}
+			for(color = 0; used[color]; color++)
+			{
+			}
+			colors[pos] = color;
+
+			if(!vars[color])
+			{
+				vars[color] = _jit_value_create_local(cfg->func, var->type);
+				if(!vars[color])
+				{
+					goto done;
+				}
+			}
+			replace[state->members[base + pos]] = vars[color];
+		}
+	}
+	result = 1;
+
+done:
+	jit_free(colors);
+	jit_free(used);
+	jit_free(vars);
+	return result;
+}
+
+static jit_value_t
+replace_value(jit_value_t *replace, jit_value_t value)
+{
+	if(replace[value->index] && replace[value->index] != value)
+	{
+		value = replace[value->index];
+		++(value->usage_count);
+	}
+	return value;
+}
+
+static void
+rewrite_insns(_jit_cfg_t cfg, jit_value_t *replace)
+{
+	int index;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	jit_value_t value;
+
+	for(index = 0; index < cfg->num_nodes; index++)
+	{
+		jit_insn_iter_init(&iter, cfg->nodes[index].block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if((value = _jit_cfg_get_dest(insn)) != 0)
+			{
+				insn->dest = replace_value(replace, value);
+			}
+			if((value = _jit_cfg_get_value1(insn)) != 0)
+			{
+				insn->value1 = replace_value(replace, value);
+			}
+			if((value = _jit_cfg_get_value2(insn)) != 0)
+			{
+				insn->value2 = replace_value(replace, value);
+			}
+			if(is_copy_insn(insn) && insn->dest == insn->value1)
+			{
+				insn->opcode = (short)JIT_OP_NOP;
+			}
+		}
+	}
+}
+
+static int
+coalesce_versions(_jit_cfg_t cfg)
+{
+	struct coalesce_state state;
+	_jit_bitset_t live;
+	jit_value_t *replace;
+	jit_value_t var;
+	int index, class, offset;
+	double bits;
+	int result;
+
+	if(!_jit_cfg_compute_liveness(cfg))
+	{
+		return 0;
+	}
+
+	jit_memzero(&state, sizeof(state));
+	_jit_bitset_init(&state.matrix);
+	_jit_bitset_init(&live);
+	replace = 0;
+	result = 0;
+
+	state.member_class = jit_malloc(cfg->num_values * sizeof(int));
+	state.member_pos = jit_malloc(cfg->num_values * sizeof(int));
+	state.class_base = jit_malloc(cfg->num_values * sizeof(int));
+	state.class_size = jit_calloc(cfg->num_values, sizeof(int));
+	state.class_matrix = jit_malloc(cfg->num_values * sizeof(int));
+	state.members = jit_malloc(cfg->num_values * sizeof(int));
+	replace = jit_calloc(cfg->num_values, sizeof(jit_value_t));
+	if(!state.member_class || !state.member_pos || !state.class_base
+	   || !state.class_size || !state.class_matrix || !state.members || !replace)
+	{
+		goto done;
+	}
+
+	/* The original variables are numbered before their versions so
+	   they come first in their classes */
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		var = cfg->values[index].var;
+		if(!var)
+		{
+			state.member_class[index] = -1;
+			continue;
+		}
+		if(var->index == index)
+		{
+			state.member_class[index] = state.num_classes++;
+		}
+		else
+		{
+			state.member_class[index] = state.member_class[var->index];
+		}
+		class = state.member_class[index];
+		state.member_pos[index] = state.class_size[class]++;
+	}
+
+	offset = 0;
+	bits = 0;
+	for(class = 0; class < state.num_classes; class++)
+	{
+		state.class_base[class] = offset;
+		state.class_matrix[class] = (int)bits;
+		offset += state.class_size[class];
+		bits += (double)state.class_size[class] * state.class_size[class];
+	}
+	if(bits > JIT_SSA_MAX_INTERFERENCE)
+	{
+		/* Keep the versions as separate variables */
+		result = 1;
+		goto done;
+	}
+	for(index = 0; index < cfg->num_values; index++)
+	{
+		class = state.member_class[index];
+		if(class >= 0)
+		{
+			state.members[state.class_base[class] + state.member_pos[index]] = index;
+		}
+	}
+
+	if(!_jit_bitset_allocate(&state.matrix, (int)bits)
+	   || !_jit_bitset_allocate(&live, cfg->num_values))
+	{
+		goto done;
+	}
+
+	compute_interference(cfg, &state, &live);
+	if(!assign_variables(cfg, &state, replace))
+	{
+		goto done;
+	}
+	rewrite_insns(cfg, replace);
+	result = 1;
+
+done:
+	jit_free(state.member_class);
+	jit_free(state.member_pos);
+	jit_free(state.class_base);
+	jit_free(state.class_size);
+	jit_free(state.class_matrix);
+	jit_free(state.members);
+	jit_free(replace);
+	_jit_bitset_free(&state.matrix);
+	_jit_bitset_free(&live);
+	return result;
+}
+
+int
+_jit_ssa_destruct(_jit_cfg_t cfg)
+{
+	if(!cfg->in_ssa)
+	{
+		return 1;
+	}
+
+	if(!replace_phis(cfg) || !coalesce_versions(cfg))
+	{
+		return 0;
+	}
+
+	cfg->in_ssa = 0;
+	return 1;
+}
@@ -170,6 +170,76 @@ jit_thread_id_t _jit_thread_current_id(void)
 #endif
 }
 
+#if defined(JIT_THREADS_PTHREAD) || defined(JIT_THREADS_WIN32)
+
+/*
+ * Start-up information that is passed to a new thread.
+ */
+typedef struct
+{
+	jit_thread_func_t	func;
+	void			*arg;
+
+} jit_thread_start_t;
+
+#if defined(JIT_THREADS_PTHREAD)
+static void *thread_start(void *data)
+#else
+static DWORD WINAPI thread_start(LPVOID data)
+#endif
+{
+	jit_thread_func_t func = ((jit_thread_start_t *)data)->func;
+	void *arg = ((jit_thread_start_t *)data)->arg;
+	jit_free(data);
+	(*func)(arg);
+	return 0;
+}
+
+#endif
+
+int _jit_thread_create(jit_thread_id_t *thread, jit_thread_func_t func, void *arg)
+{
+#if defined(JIT_THREADS_PTHREAD) || defined(JIT_THREADS_WIN32)
+	jit_thread_start_t *start;
+
+	_jit_thread_init();
+	start = jit_new(jit_thread_start_t);
+	if(!start)
+	{
+		return 0;
+	}
+	start->func = func;
+	start->arg = arg;
+#if defined(JIT_THREADS_PTHREAD)
+	if(pthread_create(thread, 0, thread_start, start) != 0)
+	{
+		jit_free(start);
+		return 0;
+	}
+#else
+	*thread = CreateThread(NULL, 0, thread_start, start, 0, NULL);
+	if(*thread == NULL)
+	{
+		jit_free(start);
+		return 0;
+	}
+#endif
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void _jit_thread_join(jit_thread_id_t thread)
+{
+#if defined(JIT_THREADS_PTHREAD)
+	pthread_join(thread, 0);
+#elif defined(JIT_THREADS_WIN32)
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#endif
+}
+
 int _jit_monitor_wait(jit_monitor_t *mon, jit_int timeout)
 {
 #if defined(JIT_THREADS_PTHREAD)
@@ -77,6 +77,18 @@ jit_thread_control_t _jit_thread_get_control(void);
  */
 jit_thread_id_t _jit_thread_current_id(void);
 
+/*
+ * Start a new thread that runs "func(arg)".  Returns zero if the
+ * thread could not be started or there is no thread package.
+ */
+typedef void (*jit_thread_func_t)(void *arg);
+int _jit_thread_create(jit_thread_id_t *thread, jit_thread_func_t func, void *arg);
+
+/*
+ * Wait for a thread started with "_jit_thread_create" to exit.
+ */
+void _jit_thread_join(jit_thread_id_t thread);
+
 /*
  * Define the primitive mutex operations.
  */
@@ -106,6 +118,66 @@ typedef int jit_mutex_t;
 
 #endif
 
+/*
+ * Define the memory barriers for data that is read without a lock.
+ * "jit_barrier_load" keeps the loads on either side of it in order,
+ * and "jit_barrier_store" does the same for the stores.
+ * "jit_barrier_full" also keeps the stores before it ahead of the
+ * loads after it.
+ */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+
+#define	jit_barrier_load()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define	jit_barrier_store()		__atomic_thread_fence(__ATOMIC_RELEASE)
+#define	jit_barrier_full()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#elif defined(__GNUC__)
+
+#define	jit_barrier_load()		__sync_synchronize()
+#define	jit_barrier_store()		__sync_synchronize()
+#define	jit_barrier_full()		__sync_synchronize()
+
+#elif defined(JIT_THREADS_WIN32)
+
+#define	jit_barrier_load()		MemoryBarrier()
+#define	jit_barrier_store()		MemoryBarrier()
+#define	jit_barrier_full()		MemoryBarrier()
+
+#else
+
+#define	jit_barrier_load()		do { ; } while (0)
+#define	jit_barrier_store()		do { ; } while (0)
+#define	jit_barrier_full()		do { ; } while (0)
+
+#endif
+
+/*
+ * Increment and decrement a counter that is shared between threads
+ * which do not hold a common lock.  "jit_atomic_dec" returns the new
+ * value of the counter.
+ */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+
+#define	jit_atomic_inc(p)		((void) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED))
+#define	jit_atomic_dec(p)		(__atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL))
+
+#elif defined(__GNUC__)
+
+#define	jit_atomic_inc(p)		((void) __sync_add_and_fetch((p), 1))
+#define	jit_atomic_dec(p)		(__sync_sub_and_fetch((p), 1))
+
+#elif defined(JIT_THREADS_WIN32)
+
+#define	jit_atomic_inc(p)		((void) InterlockedIncrement((LONG volatile *) (p)))
+#define	jit_atomic_dec(p)		((unsigned int) InterlockedDecrement((LONG volatile *) (p)))
+
+#else
+
+#define	jit_atomic_inc(p)		((void) ++*(p))
+#define	jit_atomic_dec(p)		(--*(p))
+
+#endif
+
 /*
  * Mutex that synchronizes global data initialization.
  */
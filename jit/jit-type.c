@@ -433,7 +433,7 @@ jit_type_t jit_type_copy(jit_type_t type)
 	{
 		return type;
 	}
-	++(type->ref_count);
+	jit_atomic_inc(&(type->ref_count));
 	return type;
 }
 
@@ -451,7 +451,7 @@ void jit_type_free(jit_type_t type)
 	{
 		return;
 	}
-	if(--(type->ref_count) != 0)
+	if(jit_atomic_dec(&(type->ref_count)) != 0)
 	{
 		return;
 	}
@@ -683,6 +683,33 @@ void _jit_value_ref_params(jit_function_t func)
 	jit_value_ref(func, func->builder->parent_frame);
 }
 
+jit_value_t _jit_value_create_local(jit_function_t func, jit_type_t type)
+{
+	jit_value_t value = alloc_value(func, type);
+	if(!value)
+	{
+		return 0;
+	}
+	value->block = func->builder->entry_block;
+	value->is_local = 1;
+	if(_jit_gen_is_global_candidate(type))
+	{
+		value->global_candidate = 1;
+	}
+	return value;
+}
+
+void _jit_value_make_local(jit_function_t func, jit_value_t value)
+{
+	value->is_temporary = 0;
+	value->is_local = 1;
+	value->block = func->builder->entry_block;
+	if(_jit_gen_is_global_candidate(value->type))
+	{
+		value->global_candidate = 1;
+	}
+}
+
 /*@
  * @deftypefun void jit_value_set_volatile (jit_value_t @var{value})
  * Set a flag on a value to indicate that it is volatile.  The contents
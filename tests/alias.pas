@@ -0,0 +1,154 @@
+(*
+ * alias.pas - Test the elimination of redundant loads.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program alias;
+
+{$optimize 2}
+
+type
+	Pair = record
+		x, y: Integer;
+		b: Byte;
+	end;
+	PPair = ^Pair;
+
+
+var
+	failed: Boolean;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ A store to another field leaves the first load valid }
+function other_field(p: PPair): Integer;
+var
+	a, c: Integer;
+begin
+	a := p^.x;
+	p^.y := a + 5;
+	c := p^.x;
+	other_field := a * 100 + c + p^.y;
+end;
+
+{ Two pointers to the same record }
+function same_record(p, q: PPair): Integer;
+var
+	a, c: Integer;
+begin
+	p^.x := 1;
+	a := p^.x;
+	q^.x := 2;
+	c := p^.x;
+	same_record := a * 10 + c;
+end;
+
+{ A byte field reads back what was stored }
+function byte_field(p: PPair; v: Integer): Integer;
+var
+	t: Byte;
+begin
+	t := v;
+	p^.b := t;
+	p^.y := v;
+	byte_field := p^.b + p^.y;
+end;
+
+procedure change(q: PPair);
+begin
+	q^.x := q^.x + 7;
+end;
+
+{ A call may change anything }
+function after_call(p, q: PPair): Integer;
+var
+	a, c: Integer;
+begin
+	a := p^.x;
+	change(q);
+	c := p^.x;
+	after_call := c - a;
+end;
+
+{ A store on one path only }
+function one_path(p: PPair; flag: Boolean): Integer;
+var
+	a: Integer;
+begin
+	a := p^.x;
+	if flag then begin
+		p^.x := a + 1;
+	end;
+	one_path := p^.x - a;
+end;
+
+{ A store in a loop }
+function in_loop(p: PPair; n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	p^.x := 0;
+	for i := 1 to n do begin
+		sum := sum + p^.x;
+		p^.x := p^.x + i;
+	end;
+	in_loop := sum;
+end;
+
+procedure run_tests;
+var
+	p, q: PPair;
+begin
+	New(p);
+	New(q);
+	p^.x := 3;
+	p^.y := 0;
+	run("alias_other_field", other_field(p) = 311);
+	run("alias_same_record_1", same_record(p, p) = 12);
+	run("alias_same_record_2", same_record(p, q) = 11);
+	run("alias_byte_field_1", byte_field(p, 300) = 344);
+	run("alias_byte_field_2", byte_field(p, 255) = 510);
+	run("alias_after_call_1", after_call(p, p) = 7);
+	run("alias_after_call_2", after_call(p, q) = 0);
+	run("alias_one_path_1", one_path(p, True) = 1);
+	run("alias_one_path_2", one_path(p, False) = 0);
+	run("alias_in_loop", in_loop(p, 5) = 20);
+	Dispose(p);
+	Dispose(q);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
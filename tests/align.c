@@ -0,0 +1,151 @@
+/*
+
+Test the alignment of the generated code with JIT_OPTION_CODE_ALIGNMENT.
+The function has a loop and a branch target that is only reached by a
+branch:
+
+int sum_or_negate(int n)
+{
+    int sum = 0, i = 0;
+    if(n < 0)
+        goto negative;
+    while(i < n)
+    {
+        sum = sum + i;
+        i = i + 1;
+    }
+    return sum;
+negative:
+    return -n;
+}
+
+On the back ends that pad the code, the entry point and the loop header
+must start on the boundary.  This looks at the blocks of the function
+after it is compiled, so it needs the internal headers.
+
+*/
+
+#include <stdio.h>
+#include "jit-internal.h"
+#include "jit-rules.h"
+
+typedef int (*sum_t)(int);
+
+static int
+expected_sum(int n)
+{
+	int sum = 0, i = 0;
+	if(n < 0)
+	{
+		return -n;
+	}
+	while(i < n)
+	{
+		sum = sum + i;
+		i = i + 1;
+	}
+	return sum;
+}
+
+static int
+test_alignment(int align)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t func;
+	jit_label_t loop = jit_label_undefined;
+	jit_label_t done = jit_label_undefined;
+	jit_label_t negative = jit_label_undefined;
+	jit_value_t n, sum, i, temp;
+	void *entry;
+	sum_t sum_func;
+	int failed = 0;
+	int count;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_CODE_ALIGNMENT, align);
+	jit_context_build_start(context);
+
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+	func = jit_function_create(context, signature);
+	jit_type_free(signature);
+
+	n = jit_value_get_param(func, 0);
+	sum = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, sum, jit_value_create_nint_constant(func, jit_type_int, 0));
+	jit_insn_store(func, i, jit_value_create_nint_constant(func, jit_type_int, 0));
+	temp = jit_insn_lt(func, n, jit_value_create_nint_constant(func, jit_type_int, 0));
+	jit_insn_branch_if(func, temp, &negative);
+	jit_insn_label(func, &loop);
+	temp = jit_insn_lt(func, i, n);
+	jit_insn_branch_if_not(func, temp, &done);
+	jit_insn_store(func, sum, jit_insn_add(func, sum, i));
+	jit_insn_store(func, i, jit_insn_add(func, i,
+		jit_value_create_nint_constant(func, jit_type_int, 1)));
+	jit_insn_branch(func, &loop);
+	jit_insn_label(func, &done);
+	jit_insn_return(func, sum);
+	jit_insn_label(func, &negative);
+	jit_insn_return(func, jit_insn_neg(func, n));
+
+	/* Compile without freeing the builder, to look at the blocks */
+	if(!jit_function_compile_entry(func, &entry))
+	{
+		printf("compilation failed with alignment %d\n", align);
+		jit_context_destroy(context);
+		return 1;
+	}
+
+#if defined(JIT_CODE_ALIGNMENT) && defined(jit_should_pad)
+	if(align > 1)
+	{
+		jit_block_t block = jit_block_from_label(func, loop);
+		if(!block || ((jit_nuint) block->address % align) != 0)
+		{
+			printf("loop header not aligned on %d\n", align);
+			failed = 1;
+		}
+# if defined(JIT_BACKEND_X86_64)
+		if(((jit_nuint) entry % align) != 0)
+		{
+			printf("entry point not aligned on %d\n", align);
+			failed = 1;
+		}
+# endif
+	}
+#endif
+
+	jit_function_setup_entry(func, entry);
+	jit_context_build_end(context);
+
+	/* The padding must not change the results */
+	sum_func = (sum_t) jit_function_to_closure(func);
+	for(count = -3; count < 20; ++count)
+	{
+		if(sum_func(count) != expected_sum(count))
+		{
+			printf("sum_or_negate(%d) returned %d with alignment %d\n",
+			       count, sum_func(count), align);
+			failed = 1;
+		}
+	}
+
+	jit_context_destroy(context);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	int failed = 0;
+
+	/* The back end default, none, and boundaries above the default */
+	failed |= test_alignment(0);
+	failed |= test_alignment(1);
+	failed |= test_alignment(32);
+	failed |= test_alignment(64);
+	return failed;
+}
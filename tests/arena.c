@@ -0,0 +1,262 @@
+/*
+
+Test the code regions that the default memory manager gives to each
+compiling thread.  A thread starts a function, and while it is being
+written another thread starts one as well.  The second thread must be
+given a region of its own, instead of being turned away.  Then several
+threads call functions that are compiled on demand at once, and every
+function must be compiled once and return x * k + k for its own k.  This starts threads with the internal thread routines, so it
+needs the internal headers.
+
+*/
+
+#include <stdio.h>
+#include "jit-internal.h"
+
+#define	NUM_FUNCS	64
+#define	NUM_THREADS	4
+#define	META_FACTOR	10000
+
+typedef int (*func_t)(int);
+
+static jit_monitor_t monitor;
+static int step;
+
+static jit_memory_manager_t manager;
+static jit_memory_context_t memctx;
+static jit_function_t thread_func;
+static unsigned char *thread_break;
+static unsigned char *thread_limit;
+static int thread_result;
+
+static func_t closures[NUM_FUNCS];
+static int built[NUM_FUNCS];
+static int failed;
+
+/*
+ * Start a function, and finish it only after the main thread has
+ * written a function of its own.
+ */
+static void
+write_func(void *arg)
+{
+	jit_monitor_lock(&monitor);
+	thread_result = manager->start_function(memctx, thread_func);
+	thread_break = manager->get_break(memctx);
+	thread_limit = manager->get_limit(memctx);
+	step = 1;
+	jit_monitor_signal_all(&monitor);
+	while(step != 2)
+	{
+		jit_monitor_wait(&monitor, -1);
+	}
+	if(thread_result == JIT_MEMORY_OK)
+	{
+		manager->set_break(memctx, thread_break + 16);
+		thread_result = manager->end_function(memctx, JIT_MEMORY_OK);
+	}
+	step = 3;
+	jit_monitor_signal_all(&monitor);
+	jit_monitor_unlock(&monitor);
+}
+
+static int
+test_regions(void)
+{
+	jit_context_t context;
+	jit_type_t signature;
+	jit_function_t func;
+	jit_thread_id_t thread;
+	jit_function_info_t info;
+	unsigned char *brk, *limit;
+	int result;
+	int failed = 0;
+
+	context = jit_context_create();
+	signature = jit_type_create_signature(jit_abi_cdecl, jit_type_void, 0, 0, 1);
+	jit_context_build_start(context);
+	thread_func = jit_function_create(context, signature);
+	func = jit_function_create(context, signature);
+	jit_context_build_end(context);
+
+	manager = jit_default_memory_manager();
+	memctx = manager->create(context);
+	jit_monitor_create(&monitor);
+	step = 0;
+
+	if(!_jit_thread_create(&thread, write_func, 0))
+	{
+		/* There is no thread package, so nothing can be compiled at once */
+		jit_monitor_destroy(&monitor);
+		manager->destroy(memctx);
+		jit_type_free(signature);
+		jit_context_destroy(context);
+		return 0;
+	}
+
+	/* Start a function while the other thread is writing one */
+	jit_monitor_lock(&monitor);
+	while(step != 1)
+	{
+		jit_monitor_wait(&monitor, -1);
+	}
+	result = manager->start_function(memctx, func);
+	brk = manager->get_break(memctx);
+	limit = manager->get_limit(memctx);
+	if(thread_result != JIT_MEMORY_OK || result != JIT_MEMORY_OK)
+	{
+		printf("a function could not be started while another was written\n");
+		failed = 1;
+	}
+	else if(brk < thread_limit && thread_break < limit)
+	{
+		printf("the two functions are written to the same region\n");
+		failed = 1;
+	}
+	if(result == JIT_MEMORY_OK)
+	{
+		manager->set_break(memctx, brk + 16);
+		if(manager->end_function(memctx, JIT_MEMORY_OK) != JIT_MEMORY_OK)
+		{
+			printf("the function could not be finished\n");
+			failed = 1;
+		}
+	}
+	step = 2;
+	jit_monitor_signal_all(&monitor);
+	while(step != 3)
+	{
+		jit_monitor_wait(&monitor, -1);
+	}
+	jit_monitor_unlock(&monitor);
+	_jit_thread_join(thread);
+
+	/* Both functions can be found by their code */
+	if(thread_result != JIT_MEMORY_OK)
+	{
+		printf("the function of the other thread could not be finished\n");
+		failed = 1;
+	}
+	else
+	{
+		info = manager->find_function_info(memctx, thread_break + 8);
+		if(!info || manager->get_function(memctx, info) != thread_func)
+		{
+			printf("the function of the other thread was not found\n");
+			failed = 1;
+		}
+		info = manager->find_function_info(memctx, brk + 8);
+		if(!info || manager->get_function(memctx, info) != func)
+		{
+			printf("the function of the main thread was not found\n");
+			failed = 1;
+		}
+	}
+
+	jit_monitor_destroy(&monitor);
+	manager->destroy(memctx);
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
+
+static int
+build_func(jit_function_t func)
+{
+	jit_nint k = (jit_nint) jit_function_get_meta(func, META_FACTOR);
+	jit_value_t x, factor, temp;
+
+	x = jit_value_get_param(func, 0);
+	factor = jit_value_create_nint_constant(func, jit_type_int, k);
+	temp = jit_insn_mul(func, x, factor);
+	temp = jit_insn_add(func, temp, factor);
+	jit_insn_return(func, temp);
+
+	/* The on-demand compilers run with the builder lock held */
+	++(built[k]);
+	return JIT_RESULT_OK;
+}
+
+/*
+ * Call all of the functions, each thread starting at another one.
+ */
+static void
+call_funcs(void *arg)
+{
+	int first = (int) (jit_nint) arg;
+	int index, k;
+
+	for(index = 0; index < NUM_FUNCS; ++index)
+	{
+		k = (first + index) % NUM_FUNCS;
+		if(closures[k](3) != 3 * k + k)
+		{
+			printf("function %d returned %d\n", k, closures[k](3));
+			failed = 1;
+		}
+	}
+}
+
+static int
+test_compile(void)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t func;
+	jit_thread_id_t threads[NUM_THREADS];
+	int started[NUM_THREADS];
+	int k;
+
+	context = jit_context_create();
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		func = jit_function_create(context, signature);
+		jit_function_set_meta(func, META_FACTOR, (void *) (jit_nint) k, 0, 0);
+		jit_function_set_on_demand_compiler(func, build_func);
+		closures[k] = (func_t) jit_function_to_closure(func);
+	}
+	jit_context_build_end(context);
+
+	for(k = 0; k < NUM_THREADS; ++k)
+	{
+		started[k] = _jit_thread_create(&threads[k], call_funcs,
+						(void *) (jit_nint) (k * NUM_FUNCS / NUM_THREADS));
+	}
+	for(k = 0; k < NUM_THREADS; ++k)
+	{
+		if(started[k])
+		{
+			_jit_thread_join(threads[k]);
+		}
+	}
+
+	/* Every function is compiled once */
+	call_funcs(0);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		if(built[k] != 1)
+		{
+			printf("function %d was built %d times\n", k, built[k]);
+			failed = 1;
+		}
+	}
+
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	int result = 0;
+
+	result |= test_regions();
+	result |= test_compile();
+	return result;
+}
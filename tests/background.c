@@ -0,0 +1,204 @@
+/*
+
+Test the background compilation of functions queued with
+jit_function_queue_compile.  Each function returns x * k + k for its
+own k, and is built by an on-demand compiler.  The functions are called
+through their redirectors while the background threads compile them,
+and some functions are abandoned or left in the queue when the context
+is destroyed.  A function with a loop is compiled in the background at
+the highest optimization level, where the passes create values in it.
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+#define	NUM_FUNCS	64
+#define	NUM_THREADS	4
+#define	META_FACTOR	10000
+
+typedef int (*func_t)(int);
+
+static int built[NUM_FUNCS];
+
+static int
+build_func(jit_function_t func)
+{
+	jit_nint k = (jit_nint) jit_function_get_meta(func, META_FACTOR);
+	jit_value_t x, factor, temp;
+
+	x = jit_value_get_param(func, 0);
+	factor = jit_value_create_nint_constant(func, jit_type_int, k);
+	temp = jit_insn_mul(func, x, factor);
+	temp = jit_insn_add(func, temp, factor);
+	jit_insn_return(func, temp);
+
+	/* The on-demand compilers run with the builder lock held */
+	++(built[k]);
+	return JIT_RESULT_OK;
+}
+
+/*
+int loop(int n)
+{
+    int sum = 0, i = 0;
+    while(i < n)
+    {
+        sum = sum + i * 8;
+        i = i + 1;
+    }
+    return sum;
+}
+*/
+static int
+build_loop(jit_function_t func)
+{
+	jit_label_t loop = jit_label_undefined;
+	jit_label_t done = jit_label_undefined;
+	jit_value_t n, sum, i, temp;
+
+	jit_function_set_optimization_level
+		(func, jit_function_get_max_optimization_level());
+	n = jit_value_get_param(func, 0);
+	sum = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, sum, jit_value_create_nint_constant(func, jit_type_int, 0));
+	jit_insn_store(func, i, jit_value_create_nint_constant(func, jit_type_int, 0));
+	jit_insn_label(func, &loop);
+	temp = jit_insn_lt(func, i, n);
+	jit_insn_branch_if_not(func, temp, &done);
+	temp = jit_insn_mul(func, i, jit_value_create_nint_constant(func, jit_type_int, 8));
+	jit_insn_store(func, sum, jit_insn_add(func, sum, temp));
+	jit_insn_store(func, i, jit_insn_add(func, i,
+		jit_value_create_nint_constant(func, jit_type_int, 1)));
+	jit_insn_branch(func, &loop);
+	jit_insn_label(func, &done);
+	jit_insn_return(func, sum);
+	return JIT_RESULT_OK;
+}
+
+static jit_function_t
+create_func(jit_context_t context, jit_type_t signature, jit_nint k)
+{
+	jit_function_t func;
+
+	func = jit_function_create(context, signature);
+	jit_function_set_meta(func, META_FACTOR, (void *) k, 0, 0);
+	jit_function_set_on_demand_compiler(func, build_func);
+	return func;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t funcs[NUM_FUNCS];
+	func_t closures[NUM_FUNCS];
+	jit_function_t abandoned;
+	int failed = 0;
+	int round;
+	int k;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_COMPILE_THREADS, NUM_THREADS);
+
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	/* Queue the functions, keeping their redirectors to call them */
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		funcs[k] = create_func(context, signature, k);
+		closures[k] = (func_t) jit_function_to_closure(funcs[k]);
+	}
+	jit_context_build_end(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		if(!jit_function_queue_compile(funcs[k]))
+		{
+			printf("function %d could not be queued\n", k);
+			failed = 1;
+		}
+	}
+
+	/* Call the functions while they are being compiled, from the last
+	   one queued, and again once they are all compiled */
+	for(round = 0; round < 2; ++round)
+	{
+		for(k = NUM_FUNCS - 1; k >= 0; --k)
+		{
+			if(closures[k](3) != 3 * k + k)
+			{
+				printf("function %d returned %d\n", k, closures[k](3));
+				failed = 1;
+			}
+		}
+	}
+
+	/* Every function must have been built exactly once */
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		if(built[k] != 1)
+		{
+			printf("function %d built %d times\n", k, built[k]);
+			failed = 1;
+		}
+		if(!jit_function_is_compiled(funcs[k]))
+		{
+			printf("function %d not compiled\n", k);
+			failed = 1;
+		}
+	}
+	jit_context_build_end(context);
+
+	/* The loop of this one is reduced by the compiling thread */
+	jit_context_build_start(context);
+	funcs[0] = jit_function_create(context, signature);
+	jit_function_set_on_demand_compiler(funcs[0], build_loop);
+	closures[0] = (func_t) jit_function_to_closure(funcs[0]);
+	jit_context_build_end(context);
+	jit_function_queue_compile(funcs[0]);
+	if(closures[0](10) != 360)
+	{
+		printf("loop function returned %d\n", closures[0](10));
+		failed = 1;
+	}
+
+	/* Abandon functions while they are queued.  The builder lock keeps
+	   the background threads from taking them off the queue, so they
+	   must be removed from it when they are destroyed */
+	for(round = 0; round < 16; ++round)
+	{
+		jit_context_build_start(context);
+		built[0] = 0;
+		abandoned = create_func(context, signature, 0);
+		jit_value_get_param(abandoned, 0);
+		jit_function_queue_compile(abandoned);
+		funcs[1] = create_func(context, signature, 1);
+		jit_function_queue_compile(funcs[1]);
+		jit_function_abandon(abandoned);
+		jit_context_build_end(context);
+	}
+
+	/* Destroy the context with functions still in the queue */
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		funcs[k] = create_func(context, signature, k);
+		jit_function_queue_compile(funcs[k]);
+	}
+	if(built[0] != 0)
+	{
+		printf("abandoned function was built\n");
+		failed = 1;
+	}
+	jit_context_build_end(context);
+	jit_context_destroy(context);
+	jit_type_free(signature);
+
+	return failed;
+}
@@ -0,0 +1,142 @@
+/*
+
+Test the eviction of the least recently used functions with
+JIT_OPTION_CODE_BUDGET.  Each function returns x * k + k for its own k,
+and is built by an on-demand compiler.  Together the functions take
+more code than the budget, so calling them all evicts the ones that
+were compiled first, and calling those again builds them again.  A
+function that is called through its closure in between the others
+counts as used, so it is kept even though it was compiled first.
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+#define	NUM_FUNCS	64
+#define	CODE_BUDGET	2048
+#define	META_FACTOR	10000
+
+typedef int (*func_t)(int);
+
+static int built[NUM_FUNCS];
+
+static int
+build_func(jit_function_t func)
+{
+	jit_nint k = (jit_nint) jit_function_get_meta(func, META_FACTOR);
+	jit_value_t x, factor, temp;
+
+	x = jit_value_get_param(func, 0);
+	factor = jit_value_create_nint_constant(func, jit_type_int, k);
+	temp = jit_insn_mul(func, x, factor);
+	temp = jit_insn_add(func, temp, factor);
+	jit_insn_return(func, temp);
+
+	++(built[k]);
+	return JIT_RESULT_OK;
+}
+
+static int
+call_all(jit_context_t context, func_t *closures)
+{
+	unsigned int epoch;
+	int failed = 0;
+	int k;
+
+	epoch = jit_context_enter_code(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		if(closures[k](3) != 3 * k + k)
+		{
+			printf("function %d returned %d\n", k, closures[k](3));
+			failed = 1;
+		}
+	}
+	jit_context_leave_code(context, epoch);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t funcs[NUM_FUNCS];
+	func_t closures[NUM_FUNCS];
+	jit_memory_stats_t stats;
+	unsigned int epoch;
+	int failed = 0;
+	int count;
+	int k;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_RECLAIM_CODE, 1);
+	jit_context_set_meta_numeric(context, JIT_OPTION_CODE_BUDGET, CODE_BUDGET);
+
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		funcs[k] = jit_function_create(context, signature);
+		jit_function_set_meta(funcs[k], META_FACTOR, (void *) (jit_nint) k, 0, 0);
+		jit_function_set_on_demand_compiler(funcs[k], build_func);
+		jit_function_set_recompilable(funcs[k]);
+		closures[k] = (func_t) jit_function_to_closure(funcs[k]);
+	}
+	jit_context_build_end(context);
+
+	/* The first functions are evicted to make room for the last ones */
+	failed |= call_all(context, closures);
+	jit_context_build_start(context);
+	if(jit_function_is_compiled(funcs[0]))
+	{
+		printf("the least recently used function was not evicted\n");
+		failed = 1;
+	}
+	if(!jit_function_is_compiled(funcs[NUM_FUNCS - 1]))
+	{
+		printf("the most recently used function was evicted\n");
+		failed = 1;
+	}
+	jit_context_build_end(context);
+
+	/* The evicted functions are built again when they are called */
+	failed |= call_all(context, closures);
+	if(built[0] != 2)
+	{
+		printf("the evicted function was built %d times\n", built[0]);
+		failed = 1;
+	}
+
+	/* The function called in between the others is never evicted */
+	epoch = jit_context_enter_code(context);
+	closures[0](3);
+	count = built[0];
+	for(k = 1; k < NUM_FUNCS; ++k)
+	{
+		closures[k](3);
+		closures[0](3);
+	}
+	jit_context_leave_code(context, epoch);
+	if(built[0] != count)
+	{
+		printf("the function in use was evicted\n");
+		failed = 1;
+	}
+
+	/* The code stays within the budget, give or take a function */
+	jit_context_get_memory_stats(context, &stats);
+	if(stats.code_bytes > 2 * CODE_BUDGET)
+	{
+		printf("the code takes %d bytes\n", (int) stats.code_bytes);
+		failed = 1;
+	}
+
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
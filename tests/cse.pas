@@ -0,0 +1,125 @@
+(*
+ * cse.pas - Test the local value numbering.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program cse;
+
+{$option value_numbering 1}
+
+var
+	failed: Boolean;
+	g: Integer;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+procedure change_global;
+begin
+	g := g + 10;
+end;
+
+{ The same expression twice }
+function repeated(a, b: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	x := a * b + 1;
+	y := a * b + 1;
+	repeated := x + y;
+end;
+
+{ An operand that changes between the two expressions }
+function operand_changed(a, b: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	x := a * b;
+	a := a + 1;
+	y := a * b;
+	operand_changed := x * 1000 + y;
+end;
+
+{ A load that repeats after a store to the same memory }
+function load_after_store(n: Integer): Integer;
+var
+	p: ^Integer;
+	x, y: Integer;
+begin
+	New(p);
+	p^ := n;
+	x := p^ + 1;
+	p^ := n * 2;
+	y := p^ + 1;
+	Dispose(p);
+	load_after_store := x * 1000 + y;
+end;
+
+{ A global that is changed by a call between the two loads }
+function load_after_call(n: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	g := n;
+	x := g * 2;
+	change_global;
+	y := g * 2;
+	load_after_call := x * 1000 + y;
+end;
+
+{ The same expression in two blocks is computed again }
+function across_blocks(a, b: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	x := a - b;
+	if a > 0 then begin
+		b := b + 1;
+	end;
+	y := a - b;
+	across_blocks := x * 1000 + y;
+end;
+
+procedure run_tests;
+begin
+	run("cse_repeated", repeated(3, 4) = 26);
+	run("cse_operand_changed", operand_changed(3, 4) = 12016);
+	run("cse_load_after_store", load_after_store(5) = 6011);
+	run("cse_load_after_call", load_after_call(5) = 10030);
+	run("cse_across_blocks_changed", across_blocks(9, 4) = 5004);
+	run("cse_across_blocks_same", across_blocks(-9, 4) = -13013);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
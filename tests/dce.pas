@@ -0,0 +1,130 @@
+(*
+ * dce.pas - Test the elimination of dead code and dead stores.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program dce;
+
+{$optimize 2}
+
+var
+	failed: Boolean;
+	counter: Integer;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ Values that are computed but never used }
+function unused_values(n: Integer): Integer;
+var
+	a, b, c: Integer;
+begin
+	a := n * 7;
+	b := a + 3;
+	c := n + 1;
+	unused_values := c;
+end;
+
+{ A store that is overwritten before it is read }
+function overwritten(n: Integer): Integer;
+var
+	x: Integer;
+begin
+	x := n * 2;
+	x := n + 5;
+	overwritten := x;
+end;
+
+{ A value that is only dead on one path }
+function dead_on_one_path(n: Integer): Integer;
+var
+	x: Integer;
+begin
+	x := n * 3;
+	if n > 10 then begin
+		x := 1;
+	end;
+	dead_on_one_path := x;
+end;
+
+{ Stores to global variables are not dead at the end of the function }
+procedure store_global(n: Integer);
+var
+	x: Integer;
+begin
+	x := n * 4;
+	counter := x;
+end;
+
+{ A value carried around the loop stays live }
+function loop_carried(n: Integer): Integer;
+var
+	i, sum, unused: Integer;
+begin
+	sum := 0;
+	unused := 0;
+	for i := 1 to n do begin
+		unused := unused + i * 2;
+		sum := sum + i;
+	end;
+	loop_carried := sum;
+end;
+
+{ Stores through a pointer are kept }
+function through_pointer(n: Integer): Integer;
+var
+	p: ^Integer;
+begin
+	New(p);
+	p^ := n;
+	p^ := p^ + 1;
+	through_pointer := p^;
+	Dispose(p);
+end;
+
+procedure run_tests;
+begin
+	run("dce_unused_values", unused_values(4) = 5);
+	run("dce_overwritten", overwritten(4) = 9);
+	run("dce_dead_on_one_path_taken", dead_on_one_path(11) = 1);
+	run("dce_dead_on_one_path_not_taken", dead_on_one_path(2) = 6);
+	counter := 0;
+	store_global(3);
+	run("dce_store_global", counter = 12);
+	run("dce_loop_carried", loop_carried(10) = 55);
+	run("dce_through_pointer", through_pointer(8) = 9);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
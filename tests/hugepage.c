@@ -0,0 +1,221 @@
+/*
+
+Test the code cache backed by huge pages with JIT_OPTION_CACHE_HUGE_PAGES.
+Many functions are compiled, so that they take several cache pages,
+and each function returns x * k + k for its own k.  If the system gave
+a region of huge pages, then all of the code must be in it, and the
+statistics must show the pages taken from it.  Otherwise the pages are
+allocated one by one, and the functions must work all the same.
+Without a cache limit, the region only reserves the address space, so
+it may be larger than 256 megabytes on 64-bit systems, and the part of
+it past the code cannot be accessed.
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+#define	NUM_FUNCS	2000
+#define	CACHE_LIMIT	(4 * 1024 * 1024)
+#define	HUGE_PAGE_SIZE	(2 * 1024 * 1024)
+
+typedef int (*func_t)(int);
+
+#if defined(__linux__)
+
+/*
+ * Get the permissions of the mapping that holds "ptr".
+ */
+static int
+get_perms(jit_nuint ptr, char *perms)
+{
+	FILE *file;
+	char line[256];
+	unsigned long start, end;
+	int found = 0;
+
+	file = fopen("/proc/self/maps", "r");
+	if(!file)
+	{
+		return 0;
+	}
+	while(!found && fgets(line, sizeof(line), file))
+	{
+		if(sscanf(line, "%lx-%lx %4s", &start, &end, perms) == 3
+		   && ptr >= start && ptr < end)
+		{
+			found = 1;
+		}
+	}
+	fclose(file);
+	return found;
+}
+
+#endif
+
+/*
+ * Compile a function without a cache limit, and check the region.
+ */
+static int
+check_unlimited(jit_type_t signature)
+{
+	jit_context_t context;
+	jit_function_t func;
+	jit_memory_stats_t stats;
+	jit_nuint base, region_end;
+	func_t closure;
+	int failed = 0;
+#if defined(__linux__)
+	char perms[8];
+#endif
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_CACHE_HUGE_PAGES, 1);
+
+	jit_context_build_start(context);
+	func = jit_function_create(context, signature);
+	jit_insn_return(func, jit_value_get_param(func, 0));
+	if(!jit_function_compile(func))
+	{
+		printf("the function could not be compiled without a limit\n");
+		jit_context_build_end(context);
+		jit_context_destroy(context);
+		return 1;
+	}
+	closure = (func_t) jit_function_to_closure(func);
+	jit_context_build_end(context);
+	if(closure(7) != 7)
+	{
+		printf("the function returned %d without a limit\n", closure(7));
+		failed = 1;
+	}
+
+	jit_context_get_memory_stats(context, &stats);
+	if(stats.huge_pages)
+	{
+		if(sizeof(void *) > 4
+		   && stats.region_pages * stats.page_size <= (jit_nuint) 256 << 20)
+		{
+			printf("the region has only %d pages without a limit\n",
+			       (int) stats.region_pages);
+			failed = 1;
+		}
+		base = ((jit_nuint) closure) & ~((jit_nuint) HUGE_PAGE_SIZE - 1);
+		region_end = base + stats.region_pages * stats.page_size;
+#if defined(__linux__)
+		if(get_perms(region_end - 1, perms) && perms[0] != '-')
+		{
+			printf("the end of the region is %s\n", perms);
+			failed = 1;
+		}
+#endif
+	}
+
+	jit_context_destroy(context);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t func;
+	jit_value_t x, factor, temp;
+	func_t closures[NUM_FUNCS];
+	jit_memory_stats_t stats;
+	jit_code_iter_t iter;
+	jit_nuint base, region_end;
+	int failed = 0;
+	int k;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_CACHE_HUGE_PAGES, 1);
+	jit_context_set_meta_numeric(context, JIT_OPTION_CACHE_LIMIT, CACHE_LIMIT);
+
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		func = jit_function_create(context, signature);
+		x = jit_value_get_param(func, 0);
+		factor = jit_value_create_nint_constant(func, jit_type_int, k);
+		temp = jit_insn_mul(func, x, factor);
+		temp = jit_insn_add(func, temp, factor);
+		jit_insn_return(func, temp);
+		if(!jit_function_compile(func))
+		{
+			printf("function %d could not be compiled\n", k);
+			return 1;
+		}
+		closures[k] = (func_t) jit_function_to_closure(func);
+	}
+	jit_context_build_end(context);
+
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		if(closures[k](3) != 3 * k + k)
+		{
+			printf("function %d returned %d\n", k, closures[k](3));
+			failed = 1;
+		}
+	}
+
+	jit_context_get_memory_stats(context, &stats);
+	if(stats.pages_used < 2)
+	{
+		printf("the functions take only %d pages\n", (int) stats.pages_used);
+		failed = 1;
+	}
+	if(!stats.huge_pages)
+	{
+		/* The system has no huge pages, so there is nothing more to see */
+		jit_type_free(signature);
+		jit_context_destroy(context);
+		return failed;
+	}
+	failed |= check_unlimited(signature);
+
+	/* The region covers the cache limit, and the pages come from it */
+	if(stats.region_pages * stats.page_size != CACHE_LIMIT)
+	{
+		printf("the region has %d pages of %d bytes\n",
+		       (int) stats.region_pages, (int) stats.page_size);
+		failed = 1;
+	}
+	if(stats.pages_used > stats.region_pages)
+	{
+		printf("%d pages are taken from a region of %d\n",
+		       (int) stats.pages_used, (int) stats.region_pages);
+		failed = 1;
+	}
+
+	/* The region is aligned on a huge page, and holds all of the code */
+	base = (jit_nuint) -1;
+	jit_code_iter_init(&iter, context);
+	while(jit_code_iter_next(&iter))
+	{
+		if((jit_nuint) iter.start < base)
+		{
+			base = (jit_nuint) iter.start;
+		}
+	}
+	base &= ~((jit_nuint) HUGE_PAGE_SIZE - 1);
+	region_end = base + stats.region_pages * stats.page_size;
+	jit_code_iter_init(&iter, context);
+	while(jit_code_iter_next(&iter))
+	{
+		if((jit_nuint) iter.end > region_end)
+		{
+			printf("the code at %p is outside of the region\n", iter.start);
+			failed = 1;
+		}
+	}
+
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
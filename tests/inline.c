@@ -0,0 +1,187 @@
+/*
+
+Test the inlining of small functions with JIT_OPTION_INLINE_LIMIT.
+Only the calls to functions that were compiled before the caller was
+built may be inlined:
+
+int add(int x, int y) { return x + y; }
+int twice_add(int x, int y) { return add(x, y) * 2; }
+
+A callee that is only declared, or whose build is not finished yet,
+must be called instead, even if it is small once it is done:
+
+int later(int x, int y);
+int call_later(int x, int y) { return later(x, y) + 1; }
+int later(int x, int y) { return x * y; }
+
+int is_odd(int n);
+int is_even(int n) { return n == 0 ? 1 : is_odd(n - 1); }
+int is_odd(int n) { return n == 0 ? 0 : is_even(n - 1); }
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+typedef int (*binary_t)(int, int);
+typedef int (*unary_t)(int);
+
+/*
+ * Count the calls to "callee" in the body of "func".
+ */
+static int
+count_calls(jit_function_t func, jit_function_t callee)
+{
+	jit_block_t block = 0;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int count = 0;
+
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(jit_insn_get_opcode(insn) == JIT_OP_CALL
+			   && jit_insn_get_function(insn) == callee)
+			{
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
+static jit_value_t
+call_binary(jit_function_t func, jit_function_t callee,
+	    jit_value_t x, jit_value_t y)
+{
+	jit_value_t args[2];
+
+	args[0] = x;
+	args[1] = y;
+	return jit_insn_call(func, 0, callee, 0, args, 2, 0);
+}
+
+/*
+ * Build a function that returns the opposite parity of "n" by calling
+ * "other" with n - 1, or "zero" if "n" is zero.
+ */
+static void
+build_parity(jit_function_t func, jit_function_t other, jit_nint zero)
+{
+	jit_label_t label = jit_label_undefined;
+	jit_value_t n, temp;
+
+	n = jit_value_get_param(func, 0);
+	jit_insn_branch_if(func, n, &label);
+	jit_insn_return(func, jit_value_create_nint_constant(func, jit_type_int, zero));
+	jit_insn_label(func, &label);
+	temp = jit_insn_sub(func, n, jit_value_create_nint_constant(func, jit_type_int, 1));
+	temp = jit_insn_call(func, 0, other, 0, &temp, 1, 0);
+	jit_insn_return(func, temp);
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[2];
+	jit_type_t binary, unary;
+	jit_function_t add, twice_add, later, call_later, is_even, is_odd;
+	jit_value_t x, y, temp;
+	binary_t twice_add_func, call_later_func;
+	unary_t is_even_func;
+	int failed = 0;
+	int n;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_INLINE_LIMIT, 20);
+	jit_context_build_start(context);
+
+	params[0] = jit_type_int;
+	params[1] = jit_type_int;
+	binary = jit_type_create_signature(jit_abi_cdecl, jit_type_int, params, 2, 1);
+	unary = jit_type_create_signature(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	/* A compiled callee is copied into the caller */
+	add = jit_function_create(context, binary);
+	x = jit_value_get_param(add, 0);
+	y = jit_value_get_param(add, 1);
+	jit_insn_return(add, jit_insn_add(add, x, y));
+	jit_function_compile(add);
+
+	twice_add = jit_function_create(context, binary);
+	x = jit_value_get_param(twice_add, 0);
+	y = jit_value_get_param(twice_add, 1);
+	temp = call_binary(twice_add, add, x, y);
+	jit_insn_return(twice_add, jit_insn_add(twice_add, temp, temp));
+	if(count_calls(twice_add, add) != 0)
+	{
+		printf("compiled callee was not inlined\n");
+		failed = 1;
+	}
+	jit_function_compile(twice_add);
+
+	/* A callee that is only declared is called, and built later */
+	later = jit_function_create(context, binary);
+	call_later = jit_function_create(context, binary);
+	x = jit_value_get_param(call_later, 0);
+	y = jit_value_get_param(call_later, 1);
+	temp = call_binary(call_later, later, x, y);
+	jit_insn_return(call_later, jit_insn_add(call_later, temp,
+		jit_value_create_nint_constant(call_later, jit_type_int, 1)));
+	if(count_calls(call_later, later) != 1)
+	{
+		printf("declared callee was inlined\n");
+		failed = 1;
+	}
+	jit_function_compile(call_later);
+	x = jit_value_get_param(later, 0);
+	y = jit_value_get_param(later, 1);
+	jit_insn_return(later, jit_insn_mul(later, x, y));
+	jit_function_compile(later);
+
+	/* Mutually recursive callees, "is_odd" is half built when it is
+	   called and "is_even" is compiled by the time it is called */
+	is_even = jit_function_create(context, unary);
+	is_odd = jit_function_create(context, unary);
+	jit_value_get_param(is_odd, 0);
+	build_parity(is_even, is_odd, 1);
+	if(count_calls(is_even, is_odd) != 1)
+	{
+		printf("half built callee was inlined\n");
+		failed = 1;
+	}
+	jit_function_compile(is_even);
+	build_parity(is_odd, is_even, 0);
+	jit_function_compile(is_odd);
+
+	jit_context_build_end(context);
+
+	twice_add_func = (binary_t) jit_function_to_closure(twice_add);
+	call_later_func = (binary_t) jit_function_to_closure(call_later);
+	is_even_func = (unary_t) jit_function_to_closure(is_even);
+	for(n = -3; n < 10; ++n)
+	{
+		if(twice_add_func(n, 5) != (n + 5) * 2)
+		{
+			printf("twice_add(%d, 5) returned %d\n", n, twice_add_func(n, 5));
+			failed = 1;
+		}
+		if(call_later_func(n, 7) != n * 7 + 1)
+		{
+			printf("call_later(%d, 7) returned %d\n", n, call_later_func(n, 7));
+			failed = 1;
+		}
+		if(n >= 0 && is_even_func(n) != (n % 2 == 0))
+		{
+			printf("is_even(%d) returned %d\n", n, is_even_func(n));
+			failed = 1;
+		}
+	}
+
+	jit_type_free(binary);
+	jit_type_free(unary);
+	jit_context_destroy(context);
+	return failed;
+}
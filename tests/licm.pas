@@ -0,0 +1,148 @@
+(*
+ * licm.pas - Test the loop-invariant code motion.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program licm;
+
+{$optimize 2}
+
+var
+	failed: Boolean;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ An invariant product computed in every iteration }
+function invariant_product(a, b, n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	for i := 1 to n do begin
+		sum := sum + a * b + i;
+	end;
+	invariant_product := sum;
+end;
+
+{ A division that must not happen when the loop is not entered }
+function zero_trip_division(a, d, n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	i := 0;
+	while i < n do begin
+		sum := sum + a div d;
+		i := i + 1;
+	end;
+	zero_trip_division := sum;
+end;
+
+{ An invariant that is only computed on one path in the loop }
+function conditional_invariant(a, n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	for i := 1 to n do begin
+		if (i mod 3) = 0 then begin
+			sum := sum + a * 5;
+		end else begin
+			sum := sum + 1;
+		end;
+	end;
+	conditional_invariant := sum;
+end;
+
+{ An operand that is changed in the loop }
+function variant_operand(a, n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	for i := 1 to n do begin
+		sum := sum + a * 2;
+		if i = 2 then begin
+			a := a + 10;
+		end;
+	end;
+	variant_operand := sum;
+end;
+
+{ A load from memory that is stored to in the loop }
+function changing_memory(n: Integer): Integer;
+var
+	p: ^Integer;
+	i, sum: Integer;
+begin
+	New(p);
+	p^ := 1;
+	sum := 0;
+	for i := 1 to n do begin
+		sum := sum + p^ * 2;
+		p^ := p^ + 1;
+	end;
+	Dispose(p);
+	changing_memory := sum;
+end;
+
+{ An inner loop invariant that depends on the outer loop }
+function nested_invariant(n: Integer): Integer;
+var
+	i, j, sum: Integer;
+begin
+	sum := 0;
+	for i := 1 to n do begin
+		for j := 1 to n do begin
+			sum := sum + i * 100 + j;
+		end;
+	end;
+	nested_invariant := sum;
+end;
+
+procedure run_tests;
+begin
+	run("licm_invariant_product", invariant_product(3, 4, 5) = 75);
+	run("licm_invariant_product_none", invariant_product(3, 4, 0) = 0);
+	run("licm_zero_trip_division", zero_trip_division(7, 0, 0) = 0);
+	run("licm_division", zero_trip_division(7, 2, 4) = 12);
+	run("licm_conditional_invariant", conditional_invariant(2, 7) = 25);
+	run("licm_variant_operand", variant_operand(1, 4) = 48);
+	run("licm_changing_memory", changing_memory(4) = 20);
+	run("licm_nested_invariant", nested_invariant(3) = 1818);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
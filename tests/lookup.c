@@ -0,0 +1,198 @@
+/*
+
+Test the lookup of the functions by the address of their code.  Many
+small functions and a big one that spans several granules of the
+lookup map are compiled, and every address of their code must lead
+back to the function.  The functions are walked in the order of their
+addresses.  Then a thread looks the functions up over and over, without
+a lock, while other functions are recompiled and their old code is
+removed from the map.  This starts a thread with the internal thread
+routines, so it needs the internal headers.
+
+*/
+
+#include <stdio.h>
+#include "jit-internal.h"
+
+#define	NUM_FUNCS	500
+#define	NUM_ADDS	8000
+#define	NUM_RECOMPILED	16
+#define	NUM_LOOKUPS	1000
+#define	GRANULE_SIZE	4096
+
+typedef int (*func_t)(int);
+
+static jit_context_t context;
+static jit_function_t funcs[NUM_FUNCS];
+static void *entries[NUM_FUNCS];
+static volatile int done;
+static int lookup_failed;
+
+/*
+ * Build a function that returns x * (num_adds + 1) + k.
+ */
+static void
+build_func(jit_function_t func, int k, int num_adds)
+{
+	jit_value_t x, temp;
+	int count;
+
+	x = jit_value_get_param(func, 0);
+	temp = x;
+	for(count = 0; count < num_adds; ++count)
+	{
+		temp = jit_insn_add(func, temp, x);
+	}
+	temp = jit_insn_add(func, temp, jit_value_create_nint_constant(func, jit_type_int, k));
+	jit_insn_return(func, temp);
+}
+
+/*
+ * Look up the functions that are not recompiled by their entry points.
+ */
+static void
+look_up(void *arg)
+{
+	int round, k;
+
+	for(round = 0; round < NUM_LOOKUPS; ++round)
+	{
+		for(k = NUM_RECOMPILED; k < NUM_FUNCS; ++k)
+		{
+			if(jit_function_from_pc(context, entries[k], 0) != funcs[k])
+			{
+				lookup_failed = 1;
+			}
+		}
+	}
+	done = 1;
+}
+
+int main(int argc, char **argv)
+{
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t big, func;
+	jit_code_iter_t iter;
+	jit_memory_stats_t stats;
+	jit_thread_id_t thread;
+	unsigned char *pc, *prev_start;
+	int started;
+	int failed = 0;
+	int count, k, round;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_RECLAIM_CODE, 1);
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	/* The first functions are recompiled later */
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		funcs[k] = jit_function_create(context, signature);
+		build_func(funcs[k], k, k % 8);
+		if(k < NUM_RECOMPILED)
+		{
+			jit_function_set_recompilable(funcs[k]);
+		}
+		jit_function_compile(funcs[k]);
+		entries[k] = jit_function_to_closure(funcs[k]);
+	}
+	big = jit_function_create(context, signature);
+	build_func(big, NUM_FUNCS, NUM_ADDS);
+	jit_function_compile(big);
+	jit_context_build_end(context);
+
+	if(((func_t) jit_function_to_closure(big))(1) != 1 + NUM_ADDS + NUM_FUNCS)
+	{
+		printf("the big function returned %d\n",
+		       ((func_t) jit_function_to_closure(big))(1));
+		failed = 1;
+	}
+
+	/* Every address of the code leads to its function, and the
+	   functions come in the order of their addresses */
+	count = 0;
+	prev_start = 0;
+	jit_code_iter_init(&iter, context);
+	while((func = jit_code_iter_next(&iter)) != 0)
+	{
+		if((unsigned char *) iter.start <= prev_start)
+		{
+			printf("the functions are not in the order of their addresses\n");
+			failed = 1;
+		}
+		prev_start = (unsigned char *) iter.start;
+		for(pc = iter.start; pc < (unsigned char *) iter.end; pc += 64)
+		{
+			if(jit_function_from_pc(context, pc, 0) != func)
+			{
+				printf("the code at %p was not found\n", pc);
+				failed = 1;
+			}
+		}
+		if(jit_function_from_pc(context, (unsigned char *) iter.end - 1, 0) != func)
+		{
+			printf("the end of the code at %p was not found\n", iter.start);
+			failed = 1;
+		}
+		++count;
+	}
+	jit_context_get_memory_stats(context, &stats);
+	if(count != NUM_FUNCS + 1 || stats.num_functions != NUM_FUNCS + 1)
+	{
+		printf("%d functions were walked, %d are in the cache\n",
+		       count, (int) stats.num_functions);
+		failed = 1;
+	}
+	if(jit_function_get_code_size(big) < 4 * GRANULE_SIZE)
+	{
+		printf("the big function takes only %d bytes\n",
+		       (int) jit_function_get_code_size(big));
+		failed = 1;
+	}
+
+	/* Search the map without a lock while it is changed */
+	started = _jit_thread_create(&thread, look_up, 0);
+	if(!started)
+	{
+		look_up(0);
+	}
+	round = 0;
+	do
+	{
+		jit_context_build_start(context);
+		for(k = 0; k < NUM_RECOMPILED; ++k)
+		{
+			build_func(funcs[k], k, round % 8);
+			jit_function_compile(funcs[k]);
+		}
+		jit_context_build_end(context);
+		++round;
+	}
+	while(!done);
+	if(started)
+	{
+		_jit_thread_join(thread);
+	}
+	for(k = 0; k < NUM_RECOMPILED; ++k)
+	{
+		if(((func_t) entries[k])(1) != (round - 1) % 8 + 1 + k)
+		{
+			printf("the recompiled function %d returned %d\n",
+			       k, ((func_t) entries[k])(1));
+			failed = 1;
+		}
+	}
+	if(lookup_failed)
+	{
+		printf("a function was not found while the map was changed\n");
+		failed = 1;
+	}
+
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
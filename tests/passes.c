@@ -0,0 +1,823 @@
+/*
+
+Test the effect of the optimization passes on the intermediate
+representation.  Each check builds a small function at the highest
+optimization level, runs jit_optimize on it, and then looks at the
+instructions that are left:
+
+propagate: the constant stored to a local is folded through a multiply
+           and a compare, so neither of them is left.
+
+dce:       the multiply whose result is stored over before it is read
+           is removed.
+
+licm:      the multiply of the two parameters in the loop is moved
+           ahead of the loop header.
+
+strength:  the multiply of the induction variable by a constant is
+           replaced by an addition.
+
+unroll:    the body of a loop unrolled by four is found four times.
+
+cse:       with JIT_OPTION_VALUE_NUMBERING, the same multiply and the
+           same load are only built once.  This is done by the builder,
+           so it is checked before jit_optimize.
+
+range:     the checks of the loop counter against the bounds that the
+           loop condition already implies are removed, so the only
+           branch left in the loop body is the loop test.
+
+sched:     the load that does not depend on the arithmetic before it
+           is moved ahead of it, to hide its latency.
+
+peephole:  on x86-64, the branch to the block that follows is not
+           emitted, so the code is the same as without the branch.
+           This is done by the code generator, so it is checked on
+           the compiled code of a function that is not optimized.
+
+scalar:    the fields of a local structure whose address is only used
+           for loads and stores are replaced by locals, so neither the
+           address nor the memory accesses are left.
+
+tailcall:  the recursive call in tail position becomes a branch back
+           to the start of the function, when it is built.
+
+alias:     the loads from the two fields that were just stored through
+           the same pointer are replaced by the stored values.
+
+Each function is also compiled and run, to check that the passes keep
+its result.  This looks at the blocks of the function after it is
+optimized and at the end of its code, so it needs the internal
+headers.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "jit-internal.h"
+
+typedef int (*func1_t)(int);
+typedef int (*func2_t)(int, int);
+typedef int (*funcp_t)(int *, int);
+
+static jit_type_t signature1;
+static jit_type_t signature2;
+static jit_type_t signaturep;
+
+static jit_value_t
+int_constant(jit_function_t func, jit_nint value)
+{
+	return jit_value_create_nint_constant(func, jit_type_int, value);
+}
+
+static jit_function_t
+create_func(jit_context_t context, jit_type_t signature)
+{
+	jit_function_t func;
+
+	func = jit_function_create(context, signature);
+	jit_function_set_optimization_level
+		(func, jit_function_get_max_optimization_level());
+	return func;
+}
+
+static int
+count_opcode(jit_function_t func, int opcode)
+{
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int count = 0;
+
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(jit_insn_get_opcode(insn) == opcode)
+			{
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
+/*
+int propagate(int x)
+{
+    int c = 6;
+    if(x)
+        ;
+    if(c * 7 == 42)
+        return x;
+    return x + 1;
+}
+*/
+static int
+check_propagate(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t x, c, temp;
+	jit_label_t next = jit_label_undefined;
+	jit_label_t taken = jit_label_undefined;
+	func1_t closure;
+
+	func = create_func(context, signature1);
+	x = jit_value_get_param(func, 0);
+	c = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, c, int_constant(func, 6));
+	jit_insn_branch_if(func, x, &next);
+	jit_insn_label(func, &next);
+	temp = jit_insn_mul(func, c, int_constant(func, 7));
+	temp = jit_insn_eq(func, temp, int_constant(func, 42));
+	jit_insn_branch_if(func, temp, &taken);
+	jit_insn_return(func, jit_insn_add(func, x, int_constant(func, 1)));
+	jit_insn_label(func, &taken);
+	jit_insn_return(func, x);
+
+	jit_optimize(func);
+	if(count_opcode(func, JIT_OP_IMUL) != 0
+	   || count_opcode(func, JIT_OP_BR_IEQ) != 0
+	   || count_opcode(func, JIT_OP_BR_ITRUE) != 0)
+	{
+		printf("propagate: the constant was not folded\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func1_t) jit_function_to_closure(func);
+	if(closure(5) != 5)
+	{
+		printf("propagate(5) returned %d, expected 5\n", closure(5));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int dce(int x)
+{
+    int c = x * 3;
+    if(x)
+        ;
+    c = x + 1;
+    return c;
+}
+*/
+static int
+check_dce(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t x, c;
+	jit_label_t next = jit_label_undefined;
+	func1_t closure;
+
+	func = create_func(context, signature1);
+	x = jit_value_get_param(func, 0);
+	c = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, c, jit_insn_mul(func, x, int_constant(func, 3)));
+	jit_insn_branch_if(func, x, &next);
+	jit_insn_label(func, &next);
+	jit_insn_store(func, c, jit_insn_add(func, x, int_constant(func, 1)));
+	jit_insn_return(func, c);
+
+	jit_optimize(func);
+	if(count_opcode(func, JIT_OP_IMUL) != 0)
+	{
+		printf("dce: the dead multiply was not removed\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func1_t) jit_function_to_closure(func);
+	if(closure(5) != 6)
+	{
+		printf("dce(5) returned %d, expected 6\n", closure(5));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int licm(int x, int y)
+{
+    int sum = 0, i = 0;
+    while(i < x)
+    {
+        sum = sum + x * y;
+        i = i + 1;
+    }
+    return sum;
+}
+*/
+static int
+check_licm(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t x, y, sum, i, temp;
+	jit_label_t loop = jit_label_undefined;
+	jit_label_t done = jit_label_undefined;
+	jit_block_t block, header;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int in_loop, num_before, num_inside;
+	func2_t closure;
+
+	func = create_func(context, signature2);
+	x = jit_value_get_param(func, 0);
+	y = jit_value_get_param(func, 1);
+	sum = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, sum, int_constant(func, 0));
+	jit_insn_store(func, i, int_constant(func, 0));
+	jit_insn_label(func, &loop);
+	temp = jit_insn_lt(func, i, x);
+	jit_insn_branch_if_not(func, temp, &done);
+	jit_insn_store(func, sum, jit_insn_add(func, sum, jit_insn_mul(func, x, y)));
+	jit_insn_store(func, i, jit_insn_add(func, i, int_constant(func, 1)));
+	jit_insn_branch(func, &loop);
+	jit_insn_label(func, &done);
+	jit_insn_return(func, sum);
+
+	/* The multiply must only be found ahead of the loop header */
+	jit_optimize(func);
+	header = jit_block_from_label(func, loop);
+	in_loop = 0;
+	num_before = 0;
+	num_inside = 0;
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		if(block == header)
+		{
+			in_loop = 1;
+		}
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(jit_insn_get_opcode(insn) != JIT_OP_IMUL)
+			{
+				continue;
+			}
+			if(in_loop)
+			{
+				++num_inside;
+			}
+			else
+			{
+				++num_before;
+			}
+		}
+	}
+	if(!in_loop || num_before != 1 || num_inside != 0)
+	{
+		printf("licm: the invariant multiply was not hoisted\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func2_t) jit_function_to_closure(func);
+	if(closure(4, 3) != 48)
+	{
+		printf("licm(4, 3) returned %d, expected 48\n", closure(4, 3));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int strength(int n)
+{
+    int sum = 0, i = 0;
+    while(i < n)
+    {
+        sum = sum + i * 8;
+        i = i + 1;
+    }
+    return sum;
+}
+*/
+static int
+check_strength(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t n, sum, i, temp;
+	jit_label_t loop = jit_label_undefined;
+	jit_label_t done = jit_label_undefined;
+	func1_t closure;
+
+	func = create_func(context, signature1);
+	n = jit_value_get_param(func, 0);
+	sum = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, sum, int_constant(func, 0));
+	jit_insn_store(func, i, int_constant(func, 0));
+	jit_insn_label(func, &loop);
+	temp = jit_insn_lt(func, i, n);
+	jit_insn_branch_if_not(func, temp, &done);
+	temp = jit_insn_mul(func, i, int_constant(func, 8));
+	jit_insn_store(func, sum, jit_insn_add(func, sum, temp));
+	jit_insn_store(func, i, jit_insn_add(func, i, int_constant(func, 1)));
+	jit_insn_branch(func, &loop);
+	jit_insn_label(func, &done);
+	jit_insn_return(func, sum);
+
+	jit_optimize(func);
+	if(count_opcode(func, JIT_OP_IMUL) != 0)
+	{
+		printf("strength: the multiply was not reduced\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func1_t) jit_function_to_closure(func);
+	if(closure(10) != 360)
+	{
+		printf("strength(10) returned %d, expected 360\n", closure(10));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int unroll(int n)
+{
+    int sum = 0, i = 0;
+    if(i < n)
+    {
+        do
+        {
+            sum = sum + (i ^ 5);
+            i = i + 1;
+        }
+        while(i < n);
+    }
+    return sum;
+}
+*/
+static int
+check_unroll(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t n, sum, i, temp;
+	jit_label_t loop = jit_label_undefined;
+	jit_label_t done = jit_label_undefined;
+	func1_t closure;
+
+	func = create_func(context, signature1);
+	jit_function_set_unroll_factor(func, 4);
+	n = jit_value_get_param(func, 0);
+	sum = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, sum, int_constant(func, 0));
+	jit_insn_store(func, i, int_constant(func, 0));
+	temp = jit_insn_lt(func, i, n);
+	jit_insn_branch_if_not(func, temp, &done);
+	jit_insn_label(func, &loop);
+	temp = jit_insn_xor(func, i, int_constant(func, 5));
+	jit_insn_store(func, sum, jit_insn_add(func, sum, temp));
+	jit_insn_store(func, i, jit_insn_add(func, i, int_constant(func, 1)));
+	temp = jit_insn_lt(func, i, n);
+	jit_insn_branch_if(func, temp, &loop);
+	jit_insn_label(func, &done);
+	jit_insn_return(func, sum);
+
+	jit_optimize(func);
+	if(count_opcode(func, JIT_OP_IXOR) < 4)
+	{
+		printf("unroll: the loop was not unrolled\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func1_t) jit_function_to_closure(func);
+	if(closure(10) != 53)
+	{
+		printf("unroll(10) returned %d, expected 53\n", closure(10));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int cse(int *p, int x)
+{
+    return x * p[1] + p[1] * x;
+}
+*/
+static int
+check_cse(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t p, x, a, b;
+	funcp_t closure;
+	int array[2] = {3, 4};
+
+	jit_context_set_meta_numeric(context, JIT_OPTION_VALUE_NUMBERING, 1);
+	func = create_func(context, signaturep);
+	p = jit_value_get_param(func, 0);
+	x = jit_value_get_param(func, 1);
+	a = jit_insn_mul(func, x, jit_insn_load_relative
+		(func, p, sizeof(int), jit_type_int));
+	b = jit_insn_mul(func, jit_insn_load_relative
+		(func, p, sizeof(int), jit_type_int), x);
+	jit_insn_return(func, jit_insn_add(func, a, b));
+	jit_context_set_meta_numeric(context, JIT_OPTION_VALUE_NUMBERING, 0);
+
+	if(a != b
+	   || count_opcode(func, JIT_OP_IMUL) != 1
+	   || count_opcode(func, JIT_OP_LOAD_RELATIVE_INT) != 1)
+	{
+		printf("cse: the common subexpression was built twice\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (funcp_t) jit_function_to_closure(func);
+	if(closure(array, 5) != 40)
+	{
+		printf("cse returned %d, expected 40\n", closure(array, 5));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int range(int n)
+{
+    int sum = 0, i = 0;
+    while(i < n)
+    {
+        if(i >= n)
+            return -1;
+        if(i < 0)
+            return -1;
+        sum = sum + i;
+        i = i + 1;
+    }
+    return sum;
+}
+*/
+static int
+check_range(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t n, sum, i, temp;
+	jit_label_t loop = jit_label_undefined;
+	jit_label_t done = jit_label_undefined;
+	jit_label_t bad = jit_label_undefined;
+	func1_t closure;
+
+	func = create_func(context, signature1);
+	n = jit_value_get_param(func, 0);
+	sum = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, sum, int_constant(func, 0));
+	jit_insn_store(func, i, int_constant(func, 0));
+	jit_insn_label(func, &loop);
+	temp = jit_insn_lt(func, i, n);
+	jit_insn_branch_if_not(func, temp, &done);
+	temp = jit_insn_ge(func, i, n);
+	jit_insn_branch_if(func, temp, &bad);
+	temp = jit_insn_lt(func, i, int_constant(func, 0));
+	jit_insn_branch_if(func, temp, &bad);
+	jit_insn_store(func, sum, jit_insn_add(func, sum, i));
+	jit_insn_store(func, i, jit_insn_add(func, i, int_constant(func, 1)));
+	jit_insn_branch(func, &loop);
+	jit_insn_label(func, &bad);
+	jit_insn_return(func, int_constant(func, -1));
+	jit_insn_label(func, &done);
+	jit_insn_return(func, sum);
+
+	jit_optimize(func);
+	if(count_opcode(func, JIT_OP_BR_IGE) != 1
+	   || count_opcode(func, JIT_OP_BR_ILT) != 0)
+	{
+		printf("range: the redundant bound checks were not removed\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func1_t) jit_function_to_closure(func);
+	if(closure(10) != 45)
+	{
+		printf("range(10) returned %d, expected 45\n", closure(10));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int sched(int *p, int x)
+{
+    int a = x + 1;
+    int b = a * 3;
+    int c = p[1];
+    return b + c;
+}
+*/
+static int
+check_sched(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t p, x, a, b, c;
+	jit_block_t block;
+	jit_insn_iter_t iter;
+	jit_insn_t insn;
+	int posn, load_posn, add_posn;
+	funcp_t closure;
+	int array[2] = {3, 4};
+
+	func = create_func(context, signaturep);
+	p = jit_value_get_param(func, 0);
+	x = jit_value_get_param(func, 1);
+	a = jit_insn_add(func, x, int_constant(func, 1));
+	b = jit_insn_mul(func, a, int_constant(func, 3));
+	c = jit_insn_load_relative(func, p, sizeof(int), jit_type_int);
+	jit_insn_return(func, jit_insn_add(func, b, c));
+
+	/* The load must come before the first addition */
+	jit_optimize(func);
+	posn = 0;
+	load_posn = -1;
+	add_posn = -1;
+	block = 0;
+	while((block = jit_block_next(func, block)) != 0)
+	{
+		jit_insn_iter_init(&iter, block);
+		while((insn = jit_insn_iter_next(&iter)) != 0)
+		{
+			if(jit_insn_get_opcode(insn) == JIT_OP_LOAD_RELATIVE_INT
+			   && load_posn < 0)
+			{
+				load_posn = posn;
+			}
+			else if(jit_insn_get_opcode(insn) == JIT_OP_IADD
+				&& add_posn < 0)
+			{
+				add_posn = posn;
+			}
+			++posn;
+		}
+	}
+	if(load_posn < 0 || add_posn < 0 || load_posn > add_posn)
+	{
+		printf("sched: the load was not moved ahead\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (funcp_t) jit_function_to_closure(func);
+	if(closure(array, 5) != 22)
+	{
+		printf("sched returned %d, expected 22\n", closure(array, 5));
+		return 1;
+	}
+	return 0;
+}
+
+#if defined(JIT_BACKEND_X86_64)
+
+static jit_nuint
+get_code_length(jit_function_t func)
+{
+	void *info;
+
+	info = _jit_memory_find_function_info(func->context, func->entry_point);
+	if(!info)
+	{
+		return 0;
+	}
+	return (unsigned char *) _jit_memory_get_function_end(func->context, info)
+		- (unsigned char *) func->entry_point;
+}
+
+/*
+int plain(int x)
+{
+    return x;
+}
+
+int peephole(int x)
+{
+    goto next;
+next:
+    return x;
+}
+*/
+static int
+check_peephole(jit_context_t context)
+{
+	jit_function_t plain, func;
+	jit_label_t next = jit_label_undefined;
+	jit_nuint length;
+
+	/* The branch is kept in the instructions without optimization */
+	plain = jit_function_create(context, signature1);
+	jit_function_set_optimization_level(plain, 0);
+	jit_insn_return(plain, jit_value_get_param(plain, 0));
+	func = jit_function_create(context, signature1);
+	jit_function_set_optimization_level(func, 0);
+	jit_insn_branch(func, &next);
+	jit_insn_label(func, &next);
+	jit_insn_return(func, jit_value_get_param(func, 0));
+
+	jit_function_compile(plain);
+	jit_function_compile(func);
+	length = get_code_length(plain);
+	if(length == 0 || get_code_length(func) != length
+	   || memcmp(plain->entry_point, func->entry_point, length) != 0)
+	{
+		printf("peephole: the branch to the next block was emitted\n");
+		return 1;
+	}
+	return 0;
+}
+
+#endif
+
+/*
+int scalar(int x, int y)
+{
+    struct { int a, b; } s;
+    s.a = x;
+    s.b = y;
+    return s.a - s.b;
+}
+*/
+static int
+check_scalar(jit_context_t context)
+{
+	jit_function_t func;
+	jit_type_t fields[2];
+	jit_type_t type;
+	jit_value_t x, y, s, addr, a, b;
+	func2_t closure;
+
+	fields[0] = jit_type_int;
+	fields[1] = jit_type_int;
+	type = jit_type_create_struct(fields, 2, 1);
+	func = create_func(context, signature2);
+	x = jit_value_get_param(func, 0);
+	y = jit_value_get_param(func, 1);
+	s = jit_value_create(func, type);
+	addr = jit_insn_address_of(func, s);
+	jit_insn_store_relative(func, addr, jit_type_get_offset(type, 0), x);
+	jit_insn_store_relative(func, addr, jit_type_get_offset(type, 1), y);
+	a = jit_insn_load_relative
+		(func, addr, jit_type_get_offset(type, 0), jit_type_int);
+	b = jit_insn_load_relative
+		(func, addr, jit_type_get_offset(type, 1), jit_type_int);
+	jit_insn_return(func, jit_insn_sub(func, a, b));
+	jit_type_free(type);
+
+	jit_optimize(func);
+	if(count_opcode(func, JIT_OP_ADDRESS_OF) != 0
+	   || count_opcode(func, JIT_OP_LOAD_RELATIVE_INT) != 0
+	   || count_opcode(func, JIT_OP_STORE_RELATIVE_INT) != 0)
+	{
+		printf("scalar: the structure was not replaced\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func2_t) jit_function_to_closure(func);
+	if(closure(7, 3) != 4)
+	{
+		printf("scalar(7, 3) returned %d, expected 4\n", closure(7, 3));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int tailcall(int n, int acc)
+{
+    if(n)
+        return tailcall(n - 1, acc + n);
+    return acc;
+}
+*/
+static int
+check_tailcall(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t n, acc, args[2];
+	jit_label_t recurse = jit_label_undefined;
+	func2_t closure;
+
+	func = create_func(context, signature2);
+	n = jit_value_get_param(func, 0);
+	acc = jit_value_get_param(func, 1);
+	jit_insn_branch_if(func, n, &recurse);
+	jit_insn_return(func, acc);
+	jit_insn_label(func, &recurse);
+	args[0] = jit_insn_sub(func, n, int_constant(func, 1));
+	args[1] = jit_insn_add(func, acc, n);
+	jit_insn_return(func, jit_insn_call
+		(func, "tailcall", func, 0, args, 2, JIT_CALL_TAIL));
+
+	if(count_opcode(func, JIT_OP_CALL) != 0
+	   || count_opcode(func, JIT_OP_CALL_TAIL) != 0)
+	{
+		printf("tailcall: the call was not turned into a branch\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (func2_t) jit_function_to_closure(func);
+	if(closure(100000, 0) != 705082704)
+	{
+		printf("tailcall(100000, 0) returned %d, expected 705082704\n",
+		       closure(100000, 0));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+int alias(int *p, int x)
+{
+    p[0] = x;
+    p[1] = x + 1;
+    return p[0] + p[1];
+}
+*/
+static int
+check_alias(jit_context_t context)
+{
+	jit_function_t func;
+	jit_value_t p, x, a, b;
+	funcp_t closure;
+	int array[2] = {0, 0};
+
+	func = create_func(context, signaturep);
+	p = jit_value_get_param(func, 0);
+	x = jit_value_get_param(func, 1);
+	jit_insn_store_relative(func, p, 0, x);
+	jit_insn_store_relative
+		(func, p, sizeof(int), jit_insn_add(func, x, int_constant(func, 1)));
+	a = jit_insn_load_relative(func, p, 0, jit_type_int);
+	b = jit_insn_load_relative(func, p, sizeof(int), jit_type_int);
+	jit_insn_return(func, jit_insn_add(func, a, b));
+
+	jit_optimize(func);
+	if(count_opcode(func, JIT_OP_LOAD_RELATIVE_INT) != 0
+	   || count_opcode(func, JIT_OP_STORE_RELATIVE_INT) != 2)
+	{
+		printf("alias: the loads were not replaced\n");
+		return 1;
+	}
+
+	jit_function_compile(func);
+	closure = (funcp_t) jit_function_to_closure(func);
+	if(closure(array, 5) != 11 || array[0] != 5 || array[1] != 6)
+	{
+		printf("alias returned %d, expected 11\n", closure(array, 5));
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[2];
+	int failed = 0;
+
+	context = jit_context_create();
+	params[0] = jit_type_int;
+	signature1 = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+	params[1] = jit_type_int;
+	signature2 = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 2, 1);
+	params[0] = jit_type_void_ptr;
+	signaturep = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 2, 1);
+
+	jit_context_build_start(context);
+	failed |= check_propagate(context);
+	failed |= check_dce(context);
+	failed |= check_licm(context);
+	failed |= check_strength(context);
+	failed |= check_unroll(context);
+	failed |= check_cse(context);
+	failed |= check_range(context);
+	failed |= check_sched(context);
+#if defined(JIT_BACKEND_X86_64)
+	failed |= check_peephole(context);
+#endif
+	failed |= check_scalar(context);
+	failed |= check_tailcall(context);
+	failed |= check_alias(context);
+	jit_context_build_end(context);
+
+	jit_type_free(signature1);
+	jit_type_free(signature2);
+	jit_type_free(signaturep);
+	jit_context_destroy(context);
+	return failed;
+}
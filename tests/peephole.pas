@@ -0,0 +1,152 @@
+(*
+ * peephole.pas - Test the peephole optimizations of the branches and compares.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program peephole;
+
+{$optimize 0}
+
+
+var
+	failed: Boolean;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ Compares with zero, one per kind of comparison }
+function sign_int(x: Integer): Integer;
+begin
+	if x < 0 then begin
+		sign_int := -1;
+	end else if x = 0 then begin
+		sign_int := 0;
+	end else begin
+		sign_int := 1;
+	end;
+end;
+
+function sign_long(x: LongInt): Integer;
+begin
+	if x > 0 then begin
+		sign_long := 1;
+	end else if x <> 0 then begin
+		sign_long := -1;
+	end else begin
+		sign_long := 0;
+	end;
+end;
+
+function zero_flags(x: Integer): Integer;
+var
+	flags: Integer;
+begin
+	flags := 0;
+	if x <= 0 then begin
+		flags := flags + 1;
+	end;
+	if x >= 0 then begin
+		flags := flags + 2;
+	end;
+	if x <> 0 then begin
+		flags := flags + 4;
+	end;
+	zero_flags := flags;
+end;
+
+function unsigned_zero(x: Cardinal): Integer;
+begin
+	if x > 0 then begin
+		unsigned_zero := 1;
+	end else begin
+		unsigned_zero := 0;
+	end;
+end;
+
+{ Branches that end up jumping to the next block }
+function empty_branches(x: Integer): Integer;
+var
+	y: Integer;
+begin
+	y := x;
+	if x = 1 then begin
+		y := y;
+	end else begin
+		y := y;
+	end;
+	if x > 2 then begin
+		if x > 3 then begin
+			y := y;
+		end;
+	end;
+	while y < 0 do begin
+		y := y + 1;
+	end;
+	empty_branches := y;
+end;
+
+function count_down(n: Integer): Integer;
+var
+	count: Integer;
+begin
+	count := 0;
+	while n <> 0 do begin
+		n := n - 1;
+		count := count + 1;
+	end;
+	count_down := count;
+end;
+
+procedure run_tests;
+begin
+	run("peephole_sign_int_1", sign_int(-5) = -1);
+	run("peephole_sign_int_2", sign_int(0) = 0);
+	run("peephole_sign_int_3", sign_int(7) = 1);
+	run("peephole_sign_int_4", sign_int(-2147483647 - 1) = -1);
+	run("peephole_sign_long_1", sign_long(-5) = -1);
+	run("peephole_sign_long_2", sign_long(0) = 0);
+	run("peephole_sign_long_3", sign_long(4294967296) = 1);
+	run("peephole_zero_flags_1", zero_flags(-3) = 5);
+	run("peephole_zero_flags_2", zero_flags(0) = 3);
+	run("peephole_zero_flags_3", zero_flags(3) = 6);
+	run("peephole_unsigned_zero_1", unsigned_zero(0) = 0);
+	run("peephole_unsigned_zero_2", unsigned_zero(2147483647) = 1);
+	run("peephole_empty_branches_1", empty_branches(1) = 1);
+	run("peephole_empty_branches_2", empty_branches(5) = 5);
+	run("peephole_count_down_1", count_down(0) = 0);
+	run("peephole_count_down_2", count_down(10) = 10);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
@@ -0,0 +1,172 @@
+/*
+
+Test the profile guided block layout with JIT_OPTION_BLOCK_PROFILE.
+The function is built with a block that never runs ahead of the loop:
+
+int sum_or_scale(int n)
+{
+    int sum = 0, i = 0;
+    if(n >= 0)
+        goto hot;
+    return n * 3;
+hot:
+    while(i < n)
+    {
+        sum = sum + i;
+        i = i + 1;
+    }
+    return sum;
+}
+
+The first compilation counts the blocks, and after the function has
+run with non-negative arguments it is built and compiled again.  The
+block that never ran must then be placed after the loop.  This looks
+at the blocks of the function after it is compiled, so it needs the
+internal headers.
+
+*/
+
+#include <stdio.h>
+#include "jit-internal.h"
+
+typedef int (*sum_t)(int);
+
+static jit_label_t cold_label;
+static jit_label_t done_label;
+
+static void
+build_func(jit_function_t func)
+{
+	jit_label_t hot = jit_label_undefined;
+	jit_label_t loop = jit_label_undefined;
+	jit_value_t n, sum, i, temp;
+
+	cold_label = jit_label_undefined;
+	done_label = jit_label_undefined;
+
+	n = jit_value_get_param(func, 0);
+	sum = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, sum, jit_value_create_nint_constant(func, jit_type_int, 0));
+	jit_insn_store(func, i, jit_value_create_nint_constant(func, jit_type_int, 0));
+	temp = jit_insn_ge(func, n, jit_value_create_nint_constant(func, jit_type_int, 0));
+	jit_insn_branch_if(func, temp, &hot);
+	jit_insn_label(func, &cold_label);
+	jit_insn_return(func, jit_insn_mul(func, n,
+		jit_value_create_nint_constant(func, jit_type_int, 3)));
+	jit_insn_label(func, &hot);
+	jit_insn_label(func, &loop);
+	temp = jit_insn_lt(func, i, n);
+	jit_insn_branch_if_not(func, temp, &done_label);
+	jit_insn_store(func, sum, jit_insn_add(func, sum, i));
+	jit_insn_store(func, i, jit_insn_add(func, i,
+		jit_value_create_nint_constant(func, jit_type_int, 1)));
+	jit_insn_branch(func, &loop);
+	jit_insn_label(func, &done_label);
+	jit_insn_return(func, sum);
+}
+
+static int
+expected_sum(int n)
+{
+	int sum = 0, i = 0;
+	if(n < 0)
+	{
+		return n * 3;
+	}
+	while(i < n)
+	{
+		sum = sum + i;
+		i = i + 1;
+	}
+	return sum;
+}
+
+static int
+check_results(sum_t sum_func, int from, int to)
+{
+	int failed = 0;
+	int count;
+
+	for(count = from; count < to; ++count)
+	{
+		if(sum_func(count) != expected_sum(count))
+		{
+			printf("sum_or_scale(%d) returned %d\n", count, sum_func(count));
+			failed = 1;
+		}
+	}
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t func;
+	jit_block_t block, cold, done;
+	void *entry;
+	sum_t sum_func;
+	int failed = 0;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_BLOCK_PROFILE, 1);
+	jit_context_build_start(context);
+
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+	func = jit_function_create(context, signature);
+	jit_type_free(signature);
+	jit_function_set_recompilable(func);
+	jit_function_set_optimization_level(func, JIT_OPTLEVEL_NORMAL);
+
+	/* The first compilation adds the counters */
+	build_func(func);
+	if(!jit_function_compile(func))
+	{
+		printf("compilation failed\n");
+		return 1;
+	}
+	jit_context_build_end(context);
+
+	sum_func = (sum_t) jit_function_to_closure(func);
+	failed |= check_results(sum_func, 0, 20);
+	if(!func->block_counts || func->block_counts[0] != 20)
+	{
+		printf("the entry block was not counted\n");
+		failed = 1;
+	}
+
+	/* The second compilation places the blocks by the counts, and keeps
+	   the builder to look at the order of the blocks */
+	jit_context_build_start(context);
+	build_func(func);
+	if(!jit_function_compile_entry(func, &entry))
+	{
+		printf("recompilation failed\n");
+		return 1;
+	}
+	cold = jit_block_from_label(func, cold_label);
+	done = jit_block_from_label(func, done_label);
+	block = done;
+	while(block && block != cold)
+	{
+		block = jit_block_next(func, block);
+	}
+	if(!cold || !done || !block)
+	{
+		printf("the block that never ran is not after the loop\n");
+		failed = 1;
+	}
+	jit_function_setup_entry(func, entry);
+	jit_context_build_end(context);
+
+	/* The new layout must not change the results, also on the path
+	   that was moved */
+	failed |= check_results(sum_func, -5, 20);
+
+	jit_context_destroy(context);
+	return failed;
+}
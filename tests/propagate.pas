@@ -0,0 +1,171 @@
+(*
+ * propagate.pas - Test the global constant and copy propagation.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program propagate;
+
+{$optimize 2}
+{$option dont_fold 0}
+
+var
+	failed: Boolean;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ A constant that reaches the uses through several blocks }
+function through_blocks(n: Integer): Integer;
+var
+	k, x: Integer;
+begin
+	k := 12;
+	x := 0;
+	if n > 0 then begin
+		x := k * 2;
+	end else begin
+		x := k - 2;
+	end;
+	through_blocks := x + k;
+end;
+
+{ The same constant on both paths }
+function same_on_both(n: Integer): Integer;
+var
+	k: Integer;
+begin
+	if n > 0 then begin
+		k := 5;
+	end else begin
+		k := 5;
+	end;
+	same_on_both := k * n;
+end;
+
+{ Different constants on the two paths }
+function differ_on_paths(n: Integer): Integer;
+var
+	k: Integer;
+begin
+	if n > 0 then begin
+		k := 5;
+	end else begin
+		k := 7;
+	end;
+	differ_on_paths := k;
+end;
+
+{ A value that starts out constant but changes in the loop }
+function changed_in_loop(n: Integer): Integer;
+var
+	k, i: Integer;
+begin
+	k := 1;
+	for i := 1 to n do begin
+		k := k * 3;
+	end;
+	changed_in_loop := k;
+end;
+
+{ A chain of copies }
+function copies(a: Integer): Integer;
+var
+	b, c, d: Integer;
+begin
+	b := a;
+	c := b;
+	if a > 100 then begin
+		d := c;
+	end else begin
+		d := b;
+	end;
+	copies := d + c;
+end;
+
+{ The division only happens on a path that is never taken }
+function guarded_division(n: Integer): Integer;
+var
+	k, x: Integer;
+begin
+	k := 0;
+	x := n;
+	if k <> 0 then begin
+		x := n div k;
+	end;
+	guarded_division := x;
+end;
+
+{ The folded sum must wrap around like the computed one }
+function wrap_around(n: Integer): Integer;
+var
+	a, b: Integer;
+begin
+	a := 2147483647;
+	b := a + n;
+	if n > 0 then begin
+		b := a + 1;
+	end;
+	wrap_around := b;
+end;
+
+{ A copy of a parameter that is changed later }
+function copy_then_change(a: Integer): Integer;
+var
+	b: Integer;
+begin
+	b := a;
+	a := a + 1;
+	copy_then_change := b * 10 + a;
+end;
+
+procedure run_tests;
+begin
+	run("propagate_through_blocks_then", through_blocks(1) = 36);
+	run("propagate_through_blocks_else", through_blocks(0) = 22);
+	run("propagate_same_on_both", same_on_both(3) = 15);
+	run("propagate_same_on_both_neg", same_on_both(-3) = -15);
+	run("propagate_differ_then", differ_on_paths(1) = 5);
+	run("propagate_differ_else", differ_on_paths(0) = 7);
+	run("propagate_changed_in_loop", changed_in_loop(4) = 81);
+	run("propagate_changed_in_loop_none", changed_in_loop(0) = 1);
+	run("propagate_copies", copies(7) = 14);
+	run("propagate_copies_large", copies(200) = 400);
+	run("propagate_guarded_division", guarded_division(9) = 9);
+	run("propagate_wrap_around", wrap_around(1) = -2147483648);
+	run("propagate_wrap_around_zero", wrap_around(0) = 2147483647);
+	run("propagate_copy_then_change", copy_then_change(4) = 45);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
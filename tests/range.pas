@@ -0,0 +1,167 @@
+(*
+ * range.pas - Test the elimination of redundant checks by range analysis.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program range;
+
+{$optimize 2}
+{$option dont_fold 0}
+
+
+var
+	failed: Boolean;
+	errors: Integer;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ Checks on a loop counter that always pass }
+function counted(n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	errors := 0;
+	sum := 0;
+	i := 0;
+	while i < n do begin
+		if i < 0 then begin
+			errors := errors + 1;
+		end;
+		if i >= n then begin
+			errors := errors + 1;
+		end;
+		sum := sum + i;
+		i := i + 1;
+	end;
+	counted := sum;
+end;
+
+{ A check that fails in the last iteration }
+function off_by_one(n: Integer): Integer;
+var
+	i: Integer;
+begin
+	errors := 0;
+	for i := 0 to n do begin
+		if i >= n then begin
+			errors := errors + 1;
+		end;
+	end;
+	off_by_one := errors;
+end;
+
+{ Checks on a loop that counts down }
+function counted_down(n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	errors := 0;
+	sum := 0;
+	i := n;
+	while i >= 1 do begin
+		if i < 1 then begin
+			errors := errors + 1;
+		end;
+		if i > n then begin
+			errors := errors + 1;
+		end;
+		sum := sum + i;
+		i := i - 1;
+	end;
+	counted_down := sum;
+end;
+
+{ A loop that steps by two }
+function stepped(n: Integer): Integer;
+var
+	i, count: Integer;
+begin
+	errors := 0;
+	count := 0;
+	i := 0;
+	while i < n do begin
+		if i > n - 1 then begin
+			errors := errors + 1;
+		end;
+		count := count + 1;
+		i := i + 2;
+	end;
+	stepped := count;
+end;
+
+{ A check decided by a dominating branch }
+function dominated(i, n: Integer): Integer;
+begin
+	errors := 0;
+	if i < n then begin
+		if i + 1 > n then begin
+			errors := errors + 1;
+		end;
+		dominated := 1;
+	end else begin
+		if i < n then begin
+			errors := errors + 1;
+		end;
+		dominated := 2;
+	end;
+end;
+
+{ An addition that may overflow proves nothing }
+function plus_one_greater(x: Integer): Boolean;
+var
+	y: Integer;
+begin
+	y := x + 1;
+	plus_one_greater := y > x;
+end;
+
+procedure run_tests;
+begin
+	run("range_counted_1", (counted(10) = 45) and (errors = 0));
+	run("range_counted_2", (counted(0) = 0) and (errors = 0));
+	run("range_off_by_one_1", off_by_one(10) = 1);
+	run("range_off_by_one_2", off_by_one(0) = 1);
+	run("range_counted_down_1", (counted_down(10) = 55) and (errors = 0));
+	run("range_counted_down_2", (counted_down(-1) = 0) and (errors = 0));
+	run("range_stepped_1", (stepped(9) = 5) and (errors = 0));
+	run("range_stepped_2", (stepped(10) = 5) and (errors = 0));
+	run("range_dominated_1", (dominated(3, 5) = 1) and (errors = 0));
+	run("range_dominated_2", (dominated(5, 5) = 2) and (errors = 0));
+	run("range_overflow_1", plus_one_greater(5));
+	run("range_overflow_2", not plus_one_greater(2147483647));
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
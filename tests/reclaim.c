@@ -0,0 +1,126 @@
+/*
+
+Test the reclaiming of the code replaced by recompiling a function,
+with JIT_OPTION_RECLAIM_CODE.  The function returns x + k, and is
+recompiled with a new k many times.  The old code must stay while a
+thread that entered before the recompilation runs, and must be reused
+once it has left, so the cache does not grow.
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+#define	NUM_RECOMPILES	1000
+
+typedef int (*add_t)(int);
+
+static void
+build_add(jit_function_t func, int k)
+{
+	jit_value_t x;
+
+	x = jit_value_get_param(func, 0);
+	jit_insn_return(func, jit_insn_add(func, x,
+		jit_value_create_nint_constant(func, jit_type_int, k)));
+	jit_function_compile(func);
+}
+
+/*
+ * Count the blocks of code of the function in the cache.
+ */
+static int
+count_code(jit_context_t context, jit_function_t func)
+{
+	jit_code_iter_t iter;
+	jit_function_t next;
+	int count = 0;
+
+	jit_code_iter_init(&iter, context);
+	while((next = jit_code_iter_next(&iter)) != 0)
+	{
+		if(next == func)
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t func;
+	jit_memory_stats_t stats;
+	jit_nuint pages_used;
+	add_t add;
+	unsigned int epoch;
+	int failed = 0;
+	int k;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_RECLAIM_CODE, 1);
+
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+	jit_context_build_start(context);
+	func = jit_function_create(context, signature);
+	jit_function_set_recompilable(func);
+	build_add(func, 0);
+	jit_context_build_end(context);
+	add = (add_t) jit_function_to_closure(func);
+
+	/* The old code is kept while this thread may still run it */
+	epoch = jit_context_enter_code(context);
+	if(add(1) != 1)
+	{
+		printf("add(1) returned %d\n", add(1));
+		failed = 1;
+	}
+	jit_context_build_start(context);
+	build_add(func, 1);
+	jit_context_build_end(context);
+	if(count_code(context, func) != 2)
+	{
+		printf("the old code was reclaimed while in use\n");
+		failed = 1;
+	}
+	jit_context_leave_code(context, epoch);
+	if(count_code(context, func) != 1)
+	{
+		printf("the old code was not reclaimed\n");
+		failed = 1;
+	}
+
+	/* Recompile many times, the cache must reuse the memory */
+	jit_context_get_memory_stats(context, &stats);
+	pages_used = stats.pages_used;
+	for(k = 2; k < NUM_RECOMPILES; ++k)
+	{
+		jit_context_build_start(context);
+		build_add(func, k);
+		jit_context_build_end(context);
+
+		epoch = jit_context_enter_code(context);
+		if(add(1) != 1 + k)
+		{
+			printf("add(1) returned %d after %d recompiles\n", add(1), k);
+			failed = 1;
+		}
+		jit_context_leave_code(context, epoch);
+	}
+	jit_context_get_memory_stats(context, &stats);
+	if(stats.pages_used > pages_used || stats.num_functions > 1)
+	{
+		printf("the cache grew to %d pages and %d functions\n",
+		       (int) stats.pages_used, (int) stats.num_functions);
+		failed = 1;
+	}
+
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
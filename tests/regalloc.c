@@ -0,0 +1,165 @@
+/*
+
+Test the global register allocation of an optimized function.  The
+function has two loops in a row, each with its own long-lived locals:
+
+int sums(int n, int *out)
+{
+    int a = 0, i = 0, b = 1, j = 0;
+    while(i < n)
+    {
+        a = a + i * 3;
+        i = i + 1;
+    }
+    *out = a;
+    while(j < n)
+    {
+        b = b + b + j;
+        j = j + 1;
+    }
+    return b;
+}
+
+The locals of the second loop are not live in the first loop, so they
+must reuse the global registers of the locals of the first loop.  This
+looks at the values of the function after it is compiled, so it needs
+the internal headers.
+
+*/
+
+#include <stdio.h>
+#include "jit-internal.h"
+#include "jit-rules.h"
+
+typedef int (*sums_t)(int, int *);
+
+static void
+build_loop(jit_function_t func, jit_value_t n, jit_value_t acc,
+	   jit_value_t counter, int double_acc)
+{
+	jit_label_t top = jit_label_undefined;
+	jit_label_t done = jit_label_undefined;
+	jit_value_t temp;
+
+	jit_insn_label(func, &top);
+	temp = jit_insn_lt(func, counter, n);
+	jit_insn_branch_if_not(func, temp, &done);
+	if(double_acc)
+	{
+		temp = jit_insn_add(func, acc, acc);
+		temp = jit_insn_add(func, temp, counter);
+	}
+	else
+	{
+		temp = jit_insn_mul(func, counter,
+			jit_value_create_nint_constant(func, jit_type_int, 3));
+		temp = jit_insn_add(func, acc, temp);
+	}
+	jit_insn_store(func, acc, temp);
+	temp = jit_insn_add(func, counter,
+		jit_value_create_nint_constant(func, jit_type_int, 1));
+	jit_insn_store(func, counter, temp);
+	jit_insn_branch(func, &top);
+	jit_insn_label(func, &done);
+}
+
+static int
+expected_sums(int n, int *out)
+{
+	int a = 0, i = 0, b = 1, j = 0;
+	while(i < n)
+	{
+		a = a + i * 3;
+		i = i + 1;
+	}
+	*out = a;
+	while(j < n)
+	{
+		b = b + b + j;
+		j = j + 1;
+	}
+	return b;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[2];
+	jit_type_t signature;
+	jit_function_t func;
+	jit_value_t n, out, a, i, b, j;
+	void *entry;
+	sums_t sums;
+	int failed = 0;
+	int value, expected, stored, expected_stored, count;
+
+	context = jit_context_create();
+	jit_context_build_start(context);
+
+	params[0] = jit_type_int;
+	params[1] = jit_type_void_ptr;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 2, 1);
+	func = jit_function_create(context, signature);
+	jit_type_free(signature);
+
+	n = jit_value_get_param(func, 0);
+	out = jit_value_get_param(func, 1);
+	a = jit_value_create(func, jit_type_int);
+	i = jit_value_create(func, jit_type_int);
+	b = jit_value_create(func, jit_type_int);
+	j = jit_value_create(func, jit_type_int);
+	jit_insn_store(func, a, jit_value_create_nint_constant(func, jit_type_int, 0));
+	jit_insn_store(func, i, jit_value_create_nint_constant(func, jit_type_int, 0));
+	build_loop(func, n, a, i, 0);
+	jit_insn_store_relative(func, out, 0, a);
+	jit_insn_store(func, b, jit_value_create_nint_constant(func, jit_type_int, 1));
+	jit_insn_store(func, j, jit_value_create_nint_constant(func, jit_type_int, 0));
+	build_loop(func, n, b, j, 1);
+	jit_insn_return(func, b);
+
+	/* Compile without freeing the builder, to look at the values */
+	if(!jit_function_compile_entry(func, &entry))
+	{
+		printf("compilation failed\n");
+		return 1;
+	}
+
+#if JIT_NUM_GLOBAL_REGS >= 3
+	/* The parameter and the two locals of the first loop fit into the
+	   global registers, and the second loop takes those of the first */
+	if(!a->has_global_register || !i->has_global_register
+	   || !b->has_global_register || !j->has_global_register)
+	{
+		printf("locals not in global registers\n");
+		failed = 1;
+	}
+	else if(!((a->global_reg == b->global_reg && i->global_reg == j->global_reg)
+		  || (a->global_reg == j->global_reg && i->global_reg == b->global_reg)))
+	{
+		printf("locals of the loops in registers %d, %d and %d, %d\n",
+		       a->global_reg, i->global_reg, b->global_reg, j->global_reg);
+		failed = 1;
+	}
+#endif
+
+	jit_function_setup_entry(func, entry);
+	jit_context_build_end(context);
+
+	/* The shared registers must not change the results */
+	sums = (sums_t) jit_function_to_closure(func);
+	for(count = 0; count < 20; ++count)
+	{
+		value = sums(count, &stored);
+		expected = expected_sums(count, &expected_stored);
+		if(value != expected || stored != expected_stored)
+		{
+			printf("sums(%d) returned %d, %d instead of %d, %d\n",
+			       count, value, stored, expected, expected_stored);
+			failed = 1;
+		}
+	}
+
+	jit_context_destroy(context);
+	return failed;
+}
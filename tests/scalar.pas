@@ -0,0 +1,129 @@
+(*
+ * scalar.pas - Test the scalar replacement of local records.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program scalar;
+
+{$optimize 2}
+
+type
+	Point = record
+		x, y: Integer;
+	end;
+	Mixed = record
+		b: Byte;
+		s: ShortInt;
+		i: Integer;
+	end;
+	Buffer = record
+		count: Integer;
+		items: array[0..3] of Integer;
+	end;
+
+
+var
+	failed: Boolean;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ A record whose fields can all live in registers }
+function sum_points(n: Integer): Integer;
+var
+	p: Point;
+	i: Integer;
+begin
+	p.x := 0;
+	p.y := 1;
+	for i := 1 to n do begin
+		p.x := p.x + i;
+		p.y := p.y * 2 mod 1000;
+	end;
+	sum_points := p.x * 1000 + p.y;
+end;
+
+{ Small fields must still wrap around like memory does }
+function mixed_fields(v: Integer): Integer;
+var
+	m: Mixed;
+begin
+	m.b := v;
+	m.s := v * 300;
+	m.i := v * 70000;
+	mixed_fields := m.b + m.s + m.i;
+end;
+
+{ A field indexed by a variable keeps the record in memory }
+function indexed_items(k: Integer): Integer;
+var
+	b: Buffer;
+	i: Integer;
+begin
+	b.count := 0;
+	for i := 0 to 3 do begin
+		b.items[i] := i * 10;
+	end;
+	b.items[k] := b.items[k] + 1;
+	for i := 0 to 3 do begin
+		b.count := b.count + b.items[i];
+	end;
+	indexed_items := b.count;
+end;
+
+{ A copy of the whole record keeps both in memory }
+function copied_record(a, b: Integer): Integer;
+var
+	p, q: Point;
+begin
+	p.x := a;
+	p.y := b;
+	q := p;
+	p.x := 0;
+	copied_record := q.x * 10 + q.y + p.x;
+end;
+
+procedure run_tests;
+begin
+	run("scalar_sum_points_1", sum_points(0) = 1);
+	run("scalar_sum_points_2", sum_points(10) = 55024);
+	run("scalar_mixed_fields_1", mixed_fields(1) = 70301);
+	run("scalar_mixed_fields_2", mixed_fields(300) = 21024508);
+	run("scalar_indexed_items_1", indexed_items(0) = 61);
+	run("scalar_indexed_items_2", indexed_items(3) = 61);
+	run("scalar_copied_record", copied_record(3, 4) = 34);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
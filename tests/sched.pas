@@ -0,0 +1,162 @@
+(*
+ * sched.pas - Test the instruction scheduling.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program sched;
+
+
+var
+	failed: Boolean;
+	a: array[0..7] of Integer;
+	g: Integer;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ The reference versions are not optimized }
+{$optimize 0}
+
+function ref_loads(i: Integer): Integer;
+begin
+	ref_loads := a[i] * 3 + a[i + 1] * 5 + a[i + 2] - a[i + 3] * 7;
+end;
+
+function ref_divisions(x, y, z: Integer): Integer;
+begin
+	ref_divisions := x div y + z div 3 - x mod 7 + (y + z) div 2;
+end;
+
+function ref_store_between(i: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	x := a[i] + g;
+	a[i] := x * 2;
+	g := a[i] + 1;
+	y := a[i] * 3 + g;
+	ref_store_between := x + y;
+end;
+
+{ The same functions again, reordered within their blocks }
+{$optimize 2}
+
+function loads(i: Integer): Integer;
+begin
+	loads := a[i] * 3 + a[i + 1] * 5 + a[i + 2] - a[i + 3] * 7;
+end;
+
+function divisions(x, y, z: Integer): Integer;
+begin
+	divisions := x div y + z div 3 - x mod 7 + (y + z) div 2;
+end;
+
+function store_between(i: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	x := a[i] + g;
+	a[i] := x * 2;
+	g := a[i] + 1;
+	y := a[i] * 3 + g;
+	store_between := x + y;
+end;
+
+procedure fill;
+var
+	i: Integer;
+begin
+	for i := 0 to 7 do begin
+		a[i] := i * i - 5;
+	end;
+	g := 4;
+end;
+
+procedure check_loads;
+var
+	i: Integer;
+	ok: Boolean;
+begin
+	fill;
+	ok := True;
+	for i := 0 to 4 do begin
+		if loads(i) <> ref_loads(i) then begin
+			ok := False;
+		end;
+	end;
+	run("sched_loads", ok);
+end;
+
+procedure check_divisions;
+var
+	x, y: Integer;
+	ok: Boolean;
+begin
+	ok := True;
+	for x := -20 to 20 do begin
+		for y := 1 to 9 do begin
+			if divisions(x, y, x * y) <> ref_divisions(x, y, x * y) then begin
+				ok := False;
+			end;
+		end;
+	end;
+	run("sched_divisions", ok);
+end;
+
+procedure check_store_between;
+var
+	i, expected: Integer;
+	ok: Boolean;
+begin
+	ok := True;
+	for i := 0 to 7 do begin
+		fill;
+		expected := ref_store_between(i);
+		fill;
+		if store_between(i) <> expected then begin
+			ok := False;
+		end;
+	end;
+	run("sched_store_between", ok);
+end;
+
+procedure run_tests;
+begin
+	check_loads;
+	check_divisions;
+	check_store_between;
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
@@ -0,0 +1,112 @@
+/*
+
+Test the size hint that the compiler passes to the memory manager
+before it starts a function.  Functions of growing size are compiled
+through a memory manager that wraps the default one and counts the
+calls.  The hint must cover the code of each function, so that no
+function is generated again on a bigger page, and each function must
+return x * (n + 1) + n for its own number of additions n.
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+#define	NUM_SIZES	5
+
+typedef int (*func_t)(int);
+
+static const int sizes[NUM_SIZES] = {10, 100, 1000, 5000, 20000};
+
+static struct jit_memory_manager manager;
+static jit_size_t size_hint;
+static int num_hints;
+static int num_extends;
+
+static void
+set_size_hint(jit_memory_context_t memctx, jit_size_t size)
+{
+	size_hint = size;
+	++num_hints;
+	jit_default_memory_manager()->set_size_hint(memctx, size);
+}
+
+static int
+extend_limit(jit_memory_context_t memctx, int count)
+{
+	++num_extends;
+	return jit_default_memory_manager()->extend_limit(memctx, count);
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t func;
+	jit_value_t x, temp;
+	func_t closure;
+	int failed = 0;
+	int k, count;
+
+	manager = *jit_default_memory_manager();
+	manager.set_size_hint = set_size_hint;
+	manager.extend_limit = extend_limit;
+
+	context = jit_context_create();
+	jit_context_set_memory_manager(context, &manager);
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	for(k = 0; k < NUM_SIZES; ++k)
+	{
+		jit_context_build_start(context);
+		func = jit_function_create(context, signature);
+		x = jit_value_get_param(func, 0);
+		temp = x;
+		for(count = 0; count < sizes[k]; ++count)
+		{
+			temp = jit_insn_add(func, temp, x);
+		}
+		temp = jit_insn_add(func, temp, jit_value_create_nint_constant
+					(func, jit_type_int, sizes[k]));
+		jit_insn_return(func, temp);
+
+		num_hints = 0;
+		num_extends = 0;
+		if(!jit_function_compile(func))
+		{
+			printf("the function of %d additions could not be compiled\n", sizes[k]);
+			failed = 1;
+			jit_context_build_end(context);
+			continue;
+		}
+		jit_context_build_end(context);
+
+		/* The hint covers the code, so the function is generated once */
+		if(num_hints != 1 || size_hint < jit_function_get_code_size(func))
+		{
+			printf("the function of %d bytes was given %d hints, the last of %d bytes\n",
+			       (int) jit_function_get_code_size(func), num_hints, (int) size_hint);
+			failed = 1;
+		}
+		if(num_extends != 0)
+		{
+			printf("the function of %d additions was generated %d more times\n",
+			       sizes[k], num_extends);
+			failed = 1;
+		}
+		closure = (func_t) jit_function_to_closure(func);
+		if(closure(2) != 2 * (sizes[k] + 1) + sizes[k])
+		{
+			printf("the function of %d additions returned %d\n",
+			       sizes[k], closure(2));
+			failed = 1;
+		}
+	}
+
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
@@ -0,0 +1,143 @@
+(*
+ * ssa.pas - Test the conversion of functions to SSA form and back.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program ssa;
+
+{$optimize 2}
+
+var
+	failed: Boolean;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ The phi nodes at the loop header swap the two values }
+function swap_loop(n: Integer): Integer;
+var
+	a, b, t, i: Integer;
+begin
+	a := 1;
+	b := 2;
+	for i := 1 to n do begin
+		t := a;
+		a := b;
+		b := t;
+	end;
+	swap_loop := a * 10 + b;
+end;
+
+{ The old value of x is still live when x is redefined }
+function lost_copy(n: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	x := 1;
+	repeat
+		y := x;
+		x := x + 1;
+	until x > n;
+	lost_copy := y;
+end;
+
+{ Values defined on some paths only }
+function merge(a, b: Integer): Integer;
+var
+	x, y: Integer;
+begin
+	x := 0;
+	y := a;
+	if a > b then begin
+		x := a - b;
+	end else if a < b then begin
+		x := b - a;
+		y := b;
+	end;
+	merge := x * 100 + y;
+end;
+
+{ Three values rotated in a loop }
+function fibonacci(n: Integer): Integer;
+var
+	a, b, c, i: Integer;
+begin
+	a := 0;
+	b := 1;
+	for i := 1 to n do begin
+		c := a + b;
+		a := b;
+		b := c;
+	end;
+	fibonacci := a;
+end;
+
+{ Nested loops that update the same value }
+function nested(n: Integer): Integer;
+var
+	i, j, sum: Integer;
+begin
+	sum := 0;
+	i := 0;
+	while i < n do begin
+		j := i;
+		while j < n do begin
+			sum := sum + j;
+			j := j + 1;
+		end;
+		if (sum mod 2) = 0 then begin
+			sum := sum + 1;
+		end;
+		i := i + 1;
+	end;
+	nested := sum;
+end;
+
+procedure run_tests;
+begin
+	run("ssa_swap_even", swap_loop(4) = 12);
+	run("ssa_swap_odd", swap_loop(5) = 21);
+	run("ssa_swap_none", swap_loop(0) = 12);
+	run("ssa_lost_copy", lost_copy(10) = 10);
+	run("ssa_lost_copy_once", lost_copy(0) = 1);
+	run("ssa_merge_gt", merge(7, 3) = 407);
+	run("ssa_merge_lt", merge(3, 7) = 407);
+	run("ssa_merge_eq", merge(5, 5) = 5);
+	run("ssa_fibonacci", fibonacci(20) = 6765);
+	run("ssa_fibonacci_none", fibonacci(0) = 0);
+	run("ssa_nested", nested(5) = 43);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
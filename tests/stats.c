@@ -0,0 +1,179 @@
+/*
+
+Test the statistics of the code memory of a context, and the iteration
+over its compiled code.  Each function returns x * k + k for its own k.
+The statistics must count every function, and add up to no more than
+the pages.  The iterator must visit every function once, in the order
+of their addresses, with the bounds of its code.
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+#define	NUM_FUNCS	100
+
+typedef int (*func_t)(int);
+
+static void
+call_closure(jit_type_t signature, void *result, void **args, void *user_data)
+{
+	*((jit_int *) result) = *((jit_int *) args[0]) + 1;
+}
+
+int main(int argc, char **argv)
+{
+	jit_context_t context;
+	jit_type_t params[1];
+	jit_type_t signature;
+	jit_function_t funcs[NUM_FUNCS];
+	jit_function_t func;
+	jit_value_t x, factor, temp;
+	jit_memory_stats_t stats;
+	jit_code_iter_t iter;
+	jit_nuint code_bytes, used_bytes, closure_bytes;
+	int visited[NUM_FUNCS];
+	void *prev_start;
+	func_t closure;
+	int failed = 0;
+	int k;
+
+	context = jit_context_create();
+	params[0] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 1, 1);
+
+	/* There are no statistics before the first function */
+	stats.num_functions = 1;
+	if(jit_context_get_memory_stats(context, &stats) || stats.num_functions != 0)
+	{
+		printf("there are statistics before the first function\n");
+		failed = 1;
+	}
+
+	jit_context_build_start(context);
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		funcs[k] = jit_function_create(context, signature);
+		x = jit_value_get_param(funcs[k], 0);
+		factor = jit_value_create_nint_constant(funcs[k], jit_type_int, k);
+		temp = jit_insn_mul(funcs[k], x, factor);
+		temp = jit_insn_add(funcs[k], temp, factor);
+		jit_insn_return(funcs[k], temp);
+		jit_function_compile(funcs[k]);
+		visited[k] = 0;
+	}
+	jit_context_build_end(context);
+
+	if(!jit_context_get_memory_stats(context, &stats))
+	{
+		printf("there are no statistics\n");
+		return 1;
+	}
+	if(stats.page_size == 0 || stats.num_pages == 0
+	   || stats.pages_used < stats.num_pages || stats.region_pages != 0)
+	{
+		printf("there are %d pages of %d bytes in a region of %d\n",
+		       (int) stats.num_pages, (int) stats.page_size,
+		       (int) stats.region_pages);
+		failed = 1;
+	}
+	if(stats.num_functions != NUM_FUNCS || stats.code_bytes == 0
+	   || stats.data_bytes == 0)
+	{
+		printf("%d functions have %d bytes of code and %d of data\n",
+		       (int) stats.num_functions, (int) stats.code_bytes,
+		       (int) stats.data_bytes);
+		failed = 1;
+	}
+	used_bytes = stats.code_bytes + stats.data_bytes + stats.trampoline_bytes
+		+ stats.closure_bytes + stats.free_bytes;
+	if(used_bytes > stats.pages_used * stats.page_size)
+	{
+		printf("%d bytes are counted in %d bytes of pages\n",
+		       (int) used_bytes, (int) (stats.pages_used * stats.page_size));
+		failed = 1;
+	}
+	if(stats.largest_free > stats.free_bytes
+	   || (stats.free_bytes != 0 && stats.num_free_blocks == 0))
+	{
+		printf("the largest of %d free blocks has %d of %d bytes\n",
+		       (int) stats.num_free_blocks, (int) stats.largest_free,
+		       (int) stats.free_bytes);
+		failed = 1;
+	}
+
+	/* Every function is visited once, in the order of the addresses */
+	code_bytes = 0;
+	prev_start = 0;
+	jit_code_iter_init(&iter, context);
+	while((func = jit_code_iter_next(&iter)) != 0)
+	{
+		for(k = 0; k < NUM_FUNCS; ++k)
+		{
+			if(funcs[k] == func)
+			{
+				break;
+			}
+		}
+		if(k == NUM_FUNCS || visited[k])
+		{
+			printf("the code at %p does not belong to a new function\n", iter.start);
+			failed = 1;
+			break;
+		}
+		visited[k] = 1;
+		if(iter.start <= prev_start || iter.end <= iter.start)
+		{
+			printf("the code of function %d is out of order\n", k);
+			failed = 1;
+		}
+		if((jit_nuint) ((char *) iter.end - (char *) iter.start)
+		   != jit_function_get_code_size(func))
+		{
+			printf("the code of function %d has %d bytes, not %d\n", k,
+			       (int) ((char *) iter.end - (char *) iter.start),
+			       (int) jit_function_get_code_size(func));
+			failed = 1;
+		}
+		if(jit_function_from_pc(context, iter.start, 0) != func)
+		{
+			printf("function %d was not found by its code\n", k);
+			failed = 1;
+		}
+		prev_start = iter.start;
+		code_bytes += (char *) iter.end - (char *) iter.start;
+	}
+	for(k = 0; k < NUM_FUNCS; ++k)
+	{
+		if(!visited[k])
+		{
+			printf("function %d was not visited\n", k);
+			failed = 1;
+		}
+	}
+	if(code_bytes != stats.code_bytes)
+	{
+		printf("the functions have %d bytes of code, the statistics %d\n",
+		       (int) code_bytes, (int) stats.code_bytes);
+		failed = 1;
+	}
+
+	/* A closure is counted as well */
+	if(jit_supports_closures())
+	{
+		closure_bytes = stats.closure_bytes;
+		closure = (func_t) jit_closure_create(context, signature, call_closure, 0);
+		jit_context_get_memory_stats(context, &stats);
+		if(!closure || closure(41) != 42 || stats.closure_bytes <= closure_bytes)
+		{
+			printf("the closure has %d bytes\n",
+			       (int) (stats.closure_bytes - closure_bytes));
+			failed = 1;
+		}
+	}
+
+	jit_type_free(signature);
+	jit_context_destroy(context);
+	return failed;
+}
@@ -0,0 +1,223 @@
+/*
+
+Test the tail calls of a function to itself, which become branches back
+to the start of the function.  The new arguments must all be computed
+from the old parameters before any of them is replaced:
+
+unsigned int gcd_sub(unsigned int x, unsigned int y)
+{
+    if(x == y)
+        return x;
+    else if(x < y)
+        return gcd_sub(x, y - x);
+    else
+        return gcd_sub(x - y, y);
+}
+
+unsigned int gcd_mod(unsigned int x, unsigned int y)
+{
+    if(y == 0)
+        return x;
+    return gcd_mod(y, x % y);
+}
+
+int swap(int a, int b, int n)
+{
+    if(n == 0)
+        return a * 100 + b;
+    return swap(b, a, n - 1);
+}
+
+The first one is the function of tutorial 5.
+
+*/
+
+#include <stdio.h>
+#include <jit/jit.h>
+
+typedef unsigned int (*gcd_t)(unsigned int, unsigned int);
+typedef int (*swap_t)(int, int, int);
+
+static unsigned int
+expected_gcd(unsigned int x, unsigned int y)
+{
+	unsigned int temp;
+	while(y != 0)
+	{
+		temp = x % y;
+		x = y;
+		y = temp;
+	}
+	return x;
+}
+
+static jit_function_t
+build_gcd_sub(jit_context_t context, jit_type_t signature)
+{
+	jit_function_t func;
+	jit_value_t x, y, args[2];
+	jit_label_t label1 = jit_label_undefined;
+	jit_label_t label2 = jit_label_undefined;
+
+	func = jit_function_create(context, signature);
+	x = jit_value_get_param(func, 0);
+	y = jit_value_get_param(func, 1);
+	jit_insn_branch_if_not(func, jit_insn_eq(func, x, y), &label1);
+	jit_insn_return(func, x);
+	jit_insn_label(func, &label1);
+	jit_insn_branch_if_not(func, jit_insn_lt(func, x, y), &label2);
+	args[0] = x;
+	args[1] = jit_insn_sub(func, y, x);
+	jit_insn_call(func, "gcd_sub", func, 0, args, 2, JIT_CALL_TAIL);
+	jit_insn_label(func, &label2);
+	args[0] = jit_insn_sub(func, x, y);
+	args[1] = y;
+	jit_insn_call(func, "gcd_sub", func, 0, args, 2, JIT_CALL_TAIL);
+	return func;
+}
+
+static jit_function_t
+build_gcd_mod(jit_context_t context, jit_type_t signature)
+{
+	jit_function_t func;
+	jit_value_t x, y, args[2];
+	jit_label_t label = jit_label_undefined;
+
+	func = jit_function_create(context, signature);
+	x = jit_value_get_param(func, 0);
+	y = jit_value_get_param(func, 1);
+	jit_insn_branch_if(func, y, &label);
+	jit_insn_return(func, x);
+	jit_insn_label(func, &label);
+	args[0] = y;
+	args[1] = jit_insn_rem(func, x, y);
+	jit_insn_call(func, "gcd_mod", func, 0, args, 2, JIT_CALL_TAIL);
+	return func;
+}
+
+static jit_function_t
+build_swap(jit_context_t context, jit_type_t signature)
+{
+	jit_function_t func;
+	jit_value_t a, b, n, args[3];
+	jit_label_t label = jit_label_undefined;
+
+	func = jit_function_create(context, signature);
+	a = jit_value_get_param(func, 0);
+	b = jit_value_get_param(func, 1);
+	n = jit_value_get_param(func, 2);
+	jit_insn_branch_if(func, n, &label);
+	jit_insn_return(func, jit_insn_add(func, b, jit_insn_mul(func, a,
+		jit_value_create_nint_constant(func, jit_type_int, 100))));
+	jit_insn_label(func, &label);
+	args[0] = b;
+	args[1] = a;
+	args[2] = jit_insn_sub(func, n, jit_value_create_nint_constant(func, jit_type_int, 1));
+	jit_insn_call(func, "swap", func, 0, args, 3, JIT_CALL_TAIL);
+	return func;
+}
+
+static int
+test_level(unsigned int level)
+{
+	jit_context_t context;
+	jit_type_t params[3];
+	jit_type_t gcd_signature, swap_signature;
+	jit_function_t gcd_sub, gcd_mod, swap;
+	gcd_t gcd_sub_func, gcd_mod_func;
+	swap_t swap_func;
+	unsigned int x, y;
+	int n, expected;
+	int failed = 0;
+
+	context = jit_context_create();
+	jit_context_build_start(context);
+
+	params[0] = jit_type_uint;
+	params[1] = jit_type_uint;
+	gcd_signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_uint, params, 2, 1);
+	params[0] = jit_type_int;
+	params[1] = jit_type_int;
+	params[2] = jit_type_int;
+	swap_signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 3, 1);
+
+	gcd_sub = build_gcd_sub(context, gcd_signature);
+	gcd_mod = build_gcd_mod(context, gcd_signature);
+	swap = build_swap(context, swap_signature);
+	jit_function_set_optimization_level(gcd_sub, level);
+	jit_function_set_optimization_level(gcd_mod, level);
+	jit_function_set_optimization_level(swap, level);
+	jit_function_compile(gcd_sub);
+	jit_function_compile(gcd_mod);
+	jit_function_compile(swap);
+	jit_context_build_end(context);
+
+	gcd_sub_func = (gcd_t) jit_function_to_closure(gcd_sub);
+	gcd_mod_func = (gcd_t) jit_function_to_closure(gcd_mod);
+	swap_func = (swap_t) jit_function_to_closure(swap);
+
+	/* The example of tutorial 5 */
+	if(gcd_sub_func(27, 14) != 1)
+	{
+		printf("gcd_sub(27, 14) returned %u at level %u\n",
+		       gcd_sub_func(27, 14), level);
+		failed = 1;
+	}
+
+	for(x = 1; x < 40; ++x)
+	{
+		for(y = 1; y < 40; ++y)
+		{
+			if(gcd_sub_func(x, y) != expected_gcd(x, y))
+			{
+				printf("gcd_sub(%u, %u) returned %u at level %u\n",
+				       x, y, gcd_sub_func(x, y), level);
+				failed = 1;
+			}
+			if(gcd_mod_func(x, y) != expected_gcd(x, y))
+			{
+				printf("gcd_mod(%u, %u) returned %u at level %u\n",
+				       x, y, gcd_mod_func(x, y), level);
+				failed = 1;
+			}
+		}
+	}
+
+	/* The arguments trade places on every call */
+	for(n = 0; n < 10; ++n)
+	{
+		expected = (n % 2) == 0 ? 3 * 100 + 4 : 4 * 100 + 3;
+		if(swap_func(3, 4, n) != expected)
+		{
+			printf("swap(3, 4, %d) returned %d at level %u\n",
+			       n, swap_func(3, 4, n), level);
+			failed = 1;
+		}
+	}
+
+	/* A deep recursion must not grow the stack */
+	if(swap_func(3, 4, 10000001) != 4 * 100 + 3)
+	{
+		printf("swap(3, 4, 10000001) failed at level %u\n", level);
+		failed = 1;
+	}
+
+	jit_type_free(gcd_signature);
+	jit_type_free(swap_signature);
+	jit_context_destroy(context);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int level;
+	int failed = 0;
+
+	for(level = 0; level <= jit_function_get_max_optimization_level(); ++level)
+	{
+		failed |= test_level(level);
+	}
+	return failed;
+}
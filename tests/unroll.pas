@@ -0,0 +1,154 @@
+(*
+ * unroll.pas - Test the strength reduction and unrolling of loops.
+ *
+ * Copyright (C) 2026  Southern Storm Software, Pty Ltd.
+ *
+ * This file is part of the libjit library.
+ *
+ * The libjit library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * The libjit library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libjit library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *)
+
+program unroll;
+
+var
+	failed: Boolean;
+
+procedure run(msg: String; value: Boolean);
+begin
+	Write(msg);
+	Write(" ... ");
+	if value then begin
+		WriteLn("ok");
+	end else begin
+		WriteLn("failed");
+		failed := True;
+	end;
+end;
+
+{ The reference versions of the loops are not optimized }
+{$optimize 0}
+
+function ref_sum_step(n, step: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	i := 0;
+	while i < n do begin
+		sum := sum + i * 7 + 1;
+		i := i + step;
+	end;
+	ref_sum_step := sum;
+end;
+
+function ref_sum_down(n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	for i := n downto 1 do begin
+		sum := sum * 3 + i;
+	end;
+	ref_sum_down := sum;
+end;
+
+{ The same loops with strength reduction and unrolling }
+{$optimize 2}
+{$unroll 4}
+
+function sum_step(n, step: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	i := 0;
+	repeat
+		sum := sum + i * 7 + 1;
+		i := i + step;
+	until i >= n;
+	sum_step := sum;
+end;
+
+function sum_step3(n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	i := 0;
+	repeat
+		sum := sum + i * 7 + 1;
+		i := i + 3;
+	until i >= n;
+	sum_step3 := sum;
+end;
+
+function sum_down(n: Integer): Integer;
+var
+	i, sum: Integer;
+begin
+	sum := 0;
+	for i := n downto 1 do begin
+		sum := sum * 3 + i;
+	end;
+	sum_down := sum;
+end;
+
+procedure run_tests;
+var
+	n: Integer;
+	ok: Boolean;
+begin
+	{ The trip counts that are not a multiple of the factor are
+	  finished by the original loop }
+	ok := True;
+	for n := 1 to 21 do begin
+		if sum_step(n, 1) <> ref_sum_step(n, 1) then begin
+			ok := False;
+		end;
+	end;
+	run("unroll_step_1", ok);
+
+	ok := True;
+	for n := 1 to 21 do begin
+		if sum_step(n, 2) <> ref_sum_step(n, 2) then begin
+			ok := False;
+		end;
+	end;
+	run("unroll_step_2", ok);
+
+	ok := True;
+	for n := 1 to 21 do begin
+		if sum_step3(n) <> ref_sum_step(n, 3) then begin
+			ok := False;
+		end;
+	end;
+	run("unroll_constant_step", ok);
+
+	ok := True;
+	for n := 0 to 12 do begin
+		if sum_down(n) <> ref_sum_down(n) then begin
+			ok := False;
+		end;
+	end;
+	run("unroll_down", ok);
+end;
+
+begin
+	failed := False;
+	run_tests;
+	if failed then begin
+		Terminate(1);
+	end;
+end.
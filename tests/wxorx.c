@@ -0,0 +1,284 @@
+/*
+
+Test the code cache with JIT_OPTION_WRITE_XOR_EXECUTE, where the code
+is written through one mapping and runs from another one.  The calls
+between the functions, to native functions, through the closures and
+the redirectors of the functions compiled on demand, and the lookup of
+the functions by their code must all work from the executable mapping:
+
+int add(int x, int y)
+{
+    return x + y;
+}
+
+int add3(int x, int y, int z)
+{
+    return add(add(x, y), z);
+}
+
+int scale(int x, int y)
+{
+    return native_mul(x, y);
+}
+
+where native_mul is a native function.  On the back ends that support it,
+the executable mapping must not be writable, and the writable one not
+executable.  This looks at the offset between the two mappings, so it
+needs the internal headers.  A function too large for the memory that
+backs the mappings at first makes them grow, and without a cache limit
+the mappings may grow past 256 megabytes on 64-bit systems.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "jit-internal.h"
+
+typedef int (*add_t)(int, int);
+typedef int (*add3_t)(int, int, int);
+
+static jit_context_t context;
+
+static int
+native_mul(int x, int y)
+{
+	return x * y;
+}
+
+static int
+build_add(jit_function_t func)
+{
+	jit_insn_return(func, jit_insn_add(func, jit_value_get_param(func, 0),
+					   jit_value_get_param(func, 1)));
+	return JIT_RESULT_OK;
+}
+
+#if JIT_EXEC_VIEW_SUPPORTED
+
+#if defined(__linux__)
+
+/*
+ * Get the permissions of the mapping that holds "ptr".
+ */
+static int
+get_perms(void *ptr, char *perms)
+{
+	FILE *file;
+	char line[256];
+	unsigned long start, end;
+	int found = 0;
+
+	file = fopen("/proc/self/maps", "r");
+	if(!file)
+	{
+		return 0;
+	}
+	while(!found && fgets(line, sizeof(line), file))
+	{
+		if(sscanf(line, "%lx-%lx %4s", &start, &end, perms) == 3
+		   && (unsigned long) ptr >= start && (unsigned long) ptr < end)
+		{
+			found = 1;
+		}
+	}
+	fclose(file);
+	return found;
+}
+
+#endif
+
+/*
+ * Check that the code runs from a mapping that cannot be written, and
+ * that its bytes are the ones written through the other mapping.
+ */
+static int
+check_mapping(void *entry)
+{
+	unsigned char *code = (unsigned char *) entry - context->exec_offset;
+	int failed = 0;
+#if defined(__linux__)
+	char perms[8];
+#endif
+
+	if(context->exec_offset == 0)
+	{
+		printf("the code is not mapped twice\n");
+		return 1;
+	}
+	if(memcmp(code, entry, 16) != 0)
+	{
+		printf("the two mappings have different code\n");
+		failed = 1;
+	}
+#if defined(__linux__)
+	if(get_perms(entry, perms) && (perms[1] == 'w' || perms[2] != 'x'))
+	{
+		printf("the executable mapping is %s\n", perms);
+		failed = 1;
+	}
+	if(get_perms(code, perms) && (perms[1] != 'w' || perms[2] == 'x'))
+	{
+		printf("the writable mapping is %s\n", perms);
+		failed = 1;
+	}
+#endif
+	return failed;
+}
+
+#endif
+
+/*
+ * Build a function that adds its first parameter to the second one
+ * "count" times.
+ */
+static jit_function_t
+create_long(jit_type_t signature, int count)
+{
+	jit_function_t func;
+	jit_value_t x, y;
+
+	func = jit_function_create(context, signature);
+	x = jit_value_get_param(func, 0);
+	y = jit_value_get_param(func, 1);
+	while(count-- > 0)
+	{
+		y = jit_insn_add(func, x, y);
+	}
+	jit_insn_return(func, y);
+	jit_function_compile(func);
+	return func;
+}
+
+int main(int argc, char **argv)
+{
+	jit_type_t params[3];
+	jit_type_t signature, signature3;
+	jit_function_t add, add3, scale, lazy, big;
+	jit_memory_stats_t stats;
+	jit_value_t args[2], temp;
+	add_t add_func, scale_func, lazy_func, big_func;
+	add3_t add3_func;
+	void *apply_args[2];
+	jit_int arg1, arg2, result;
+	int failed = 0;
+
+	context = jit_context_create();
+	jit_context_set_meta_numeric(context, JIT_OPTION_WRITE_XOR_EXECUTE, 1);
+	jit_context_build_start(context);
+
+	params[0] = jit_type_int;
+	params[1] = jit_type_int;
+	params[2] = jit_type_int;
+	signature = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 2, 1);
+	signature3 = jit_type_create_signature
+		(jit_abi_cdecl, jit_type_int, params, 3, 1);
+
+	/* A function called by another one */
+	add = jit_function_create(context, signature);
+	build_add(add);
+	jit_function_compile(add);
+
+	add3 = jit_function_create(context, signature3);
+	args[0] = jit_value_get_param(add3, 0);
+	args[1] = jit_value_get_param(add3, 1);
+	temp = jit_insn_call(add3, "add", add, 0, args, 2, 0);
+	args[0] = temp;
+	args[1] = jit_value_get_param(add3, 2);
+	temp = jit_insn_call(add3, "add", add, 0, args, 2, 0);
+	jit_insn_return(add3, temp);
+	jit_function_compile(add3);
+
+	/* A function that calls a native function */
+	scale = jit_function_create(context, signature);
+	args[0] = jit_value_get_param(scale, 0);
+	args[1] = jit_value_get_param(scale, 1);
+	temp = jit_insn_call_native(scale, "native_mul", (void *) native_mul,
+				    signature, args, 2, 0);
+	jit_insn_return(scale, temp);
+	jit_function_compile(scale);
+
+	/* A function compiled on demand through its redirector */
+	lazy = jit_function_create(context, signature);
+	jit_function_set_on_demand_compiler(lazy, build_add);
+
+	/* A function that takes more than one cache page */
+	big = create_long(signature, 20000);
+
+	jit_context_build_end(context);
+
+	add_func = (add_t) jit_function_to_closure(add);
+	add3_func = (add3_t) jit_function_to_closure(add3);
+	scale_func = (add_t) jit_function_to_closure(scale);
+	lazy_func = (add_t) jit_function_to_closure(lazy);
+	big_func = (add_t) jit_function_to_closure(big);
+
+	if(add_func(2, 3) != 5)
+	{
+		printf("add(2, 3) returned %d\n", add_func(2, 3));
+		failed = 1;
+	}
+	if(add3_func(2, 3, 4) != 9)
+	{
+		printf("add3(2, 3, 4) returned %d\n", add3_func(2, 3, 4));
+		failed = 1;
+	}
+	if(scale_func(6, 7) != 42)
+	{
+		printf("scale(6, 7) returned %d\n", scale_func(6, 7));
+		failed = 1;
+	}
+	if(lazy_func(7, 8) != 15)
+	{
+		printf("lazy(7, 8) returned %d\n", lazy_func(7, 8));
+		failed = 1;
+	}
+	if(!big_func || big_func(2, 1) != 40001)
+	{
+		printf("the large function failed\n");
+		failed = 1;
+	}
+
+	/* The functions can be applied, and found by their code */
+	arg1 = 20;
+	arg2 = 22;
+	apply_args[0] = &arg1;
+	apply_args[1] = &arg2;
+	result = 0;
+	if(!jit_function_apply(add, apply_args, &result) || result != 42)
+	{
+		printf("applying add returned %d\n", (int) result);
+		failed = 1;
+	}
+	if(jit_function_from_closure(context, (void *) add3_func) != add3)
+	{
+		printf("add3 was not found by its closure\n");
+		failed = 1;
+	}
+	if(jit_function_from_pc(context, (unsigned char *) scale_func + 1, 0) != scale)
+	{
+		printf("scale was not found by its code\n");
+		failed = 1;
+	}
+
+#if JIT_EXEC_VIEW_SUPPORTED
+	failed |= check_mapping(add3->entry_point);
+	failed |= check_mapping((void *) add3_func);
+	failed |= check_mapping(lazy->entry_point);
+	failed |= check_mapping(big->entry_point);
+
+	/* Only the address space of the region is reserved up front */
+	jit_context_get_memory_stats(context, &stats);
+	if(sizeof(void *) > 4
+	   && stats.region_pages * stats.page_size <= (jit_nuint) 256 << 20)
+	{
+		printf("the region has only %d pages\n", (int) stats.region_pages);
+		failed = 1;
+	}
+#endif
+
+	jit_type_free(signature);
+	jit_type_free(signature3);
+	jit_context_destroy(context);
+	return failed;
+}